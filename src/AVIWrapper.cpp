@@ -25,6 +25,7 @@
  */
 
 #include "AVIWrapper.h"
+#include "VideoPipeline.h"
 #include <SDL_mixer.h>
 #include <audiodecoder.h>
 #include <avm_cpuinfo.h>
@@ -38,7 +39,8 @@
 
 AVIWrapper::AVIWrapper()
 {
-    screen_overlay = NULL;
+    renderer = NULL;
+    texture  = NULL;
     i_avi    = NULL;
     v_stream = NULL;
     a_stream = NULL;
@@ -57,13 +59,13 @@ AVIWrapper::~AVIWrapper()
 
     if (i_avi) delete i_avi;
 
-    if (screen_overlay) SDL_FreeYUVOverlay(screen_overlay);
+    if (texture) SDL_DestroyTexture(texture);
 
     if (remaining_buffer) delete[] remaining_buffer;
 }
 
 
-int AVIWrapper::init(char* filename, bool debug_flag)
+int AVIWrapper::init(const char* filename, bool debug_flag)
 {
     this->debug_flag = debug_flag;
     if (!debug_flag) avm::out.resetDebugLevels(-1);
@@ -88,11 +90,9 @@ int AVIWrapper::init(char* filename, bool debug_flag)
 }
 
 
-int AVIWrapper::initAV(SDL_Surface* surface, bool audio_open_flag)
+int AVIWrapper::initAV(SDL_Renderer* renderer, bool audio_open_flag)
 {
-    screen_rect.x = screen_rect.y = 0;
-    screen_rect.w = surface->w;
-    screen_rect.h = surface->h;
+    this->renderer = renderer;
 
     v_stream->StartStreaming();
     if (v_stream->GetVideoDecoder() == NULL) {
@@ -104,16 +104,19 @@ int AVIWrapper::initAV(SDL_Surface* surface, bool audio_open_flag)
     IVideoDecoder::CAPS cap = v_stream->GetVideoDecoder()->GetCapabilities();
     if (debug_flag) printf("cap %x\n", cap);
 
+    Uint32 format = SDL_PIXELFORMAT_YV12;
     if (cap & IVideoDecoder::CAP_YV12) {
         v_stream->GetVideoDecoder()->SetDestFmt(0, fccYV12);
-        screen_overlay = SDL_CreateYUVOverlay(width, height, SDL_YV12_OVERLAY, surface);
     }
     else if (cap & IVideoDecoder::CAP_YUY2) {
         v_stream->GetVideoDecoder()->SetDestFmt(0, fccYUY2);
-        screen_overlay = SDL_CreateYUVOverlay(width, height, SDL_YUY2_OVERLAY, surface);
+        format = SDL_PIXELFORMAT_YUY2;
     }
-    else {
-        screen_overlay = SDL_CreateYUVOverlay(width, height, SDL_YV12_OVERLAY, surface);
+    texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING,
+                                width, height);
+    if (texture == NULL) {
+        fprintf(stderr, "can't create video texture: %s\n", SDL_GetError());
+        return -1;
     }
 
     if (!audio_open_flag) return 0;
@@ -175,13 +178,13 @@ void AVIWrapper::audioCallback(void* userdata, Uint8* stream, int len)
 
     while (len > 0 && !a_stream->Eof()) {
         a_stream->ReadFrames(remaining_buffer, len, len, samples, ocnt);
-        if (ocnt <= len) {
+        if (ocnt <= (uint_t) len) {
             memcpy(stream + count, remaining_buffer, ocnt);
             len -= ocnt;
         }
         else {
             memcpy(stream + count, remaining_buffer, len);
-            if (ocnt - len < DEFAULT_AUDIOBUF * 4 - len) {
+            if (ocnt - len < (uint_t) (DEFAULT_AUDIOBUF * 4 - len)) {
                 memmove(remaining_buffer, remaining_buffer + len, ocnt - len);
                 remaining_count = ocnt - len;
             }
@@ -199,10 +202,7 @@ void AVIWrapper::audioCallback(void* userdata, Uint8* stream, int len)
 
 double AVIWrapper::getAudioTime()
 {
-    if (time_start == 0) {
-        frame_start = (v_stream) ? v_stream->GetTime() : 0.;
-        time_start  = longcount();
-    }
+    if (time_start == 0) time_start = longcount();
 
     if (a_stream)
         return a_stream->GetTime();
@@ -211,110 +211,47 @@ double AVIWrapper::getAudioTime()
 }
 
 
-static int playVideo(void* userdata)
-{
-    AVIWrapper &avi = *(AVIWrapper*) userdata;
-    return avi.playVideo(userdata);
-}
-
-
-#define NUM_CACHES 3
-int AVIWrapper::playVideo(void* userdata)
-{
-    int i;
-
-    struct {
-        bool valid;
-        CImage* image;
-        double time;
-    }   cache[NUM_CACHES];
-    for (i = 0; i < NUM_CACHES; i++) {
-        cache[i].valid = false;
-    }
-
-    int remaining_cache = NUM_CACHES;
-
-    while (status == AVI_PLAYING && !v_stream->Eof()) {
-        CImage* image = v_stream->GetFrame(true);
-        if (image == NULL) break;
-
-        double current_time = v_stream->GetTime();
-        double minimum_time = current_time;
-
-        // look for the nearest in the cache
-        int nearest_cache = -1;
-        for (i = 0; i < NUM_CACHES; i++) {
-            if (cache[i].valid) {
-                if (nearest_cache == -1
-                    || nearest_cache >= 0
-                    && cache[i].time < cache[nearest_cache].time) {
-                    nearest_cache = i;
-                    if (minimum_time > cache[nearest_cache].time)
-                        minimum_time = cache[nearest_cache].time;
-                }
-            }
-        }
-
-        double async = getAudioTime() - minimum_time;
-        //printf("audio %f (%f - %f) minimum %d %f cur %f\n", async, getAudioTime(), minimum_time, nearest_cache, minimum_time, current_time );
-        if (async < -0.01) {
-            if (remaining_cache == 0) {
-                //printf("sync0 %f %f %f %f\n", async, (a_stream)?a_stream->GetTime():0.0, v_stream->GetTime(), minimum_time );
-                SDL_Delay((int) (-async * 1000));
-            }
-        }
-
-        if (async < -0.01 && remaining_cache > 0
-            || nearest_cache >= 0) {
-            // add cache
-            for (i = 0; i < NUM_CACHES; i++) {
-                if (cache[i].valid == false) {
-                    cache[i].valid = true;
-                    cache[i].image = new CImage(image);
-                    cache[i].time  = current_time;
-                    remaining_cache--;
-                    break;
-                }
-            }
+// Feeds the pipeline from the avifile stream.  The stream reuses its
+// image, so each frame is copied.
+class AviFrameSource : public VideoFrameSource {
+public:
+    AviFrameSource(IAviReadStream* stream) : stream(stream) {}
 
-            if (async < -0.01) {
-                image->Release();
-                continue;
-            }
-        }
+    void* decodeFrame(double& time)
+    {
+        if (stream->Eof()) return NULL;
 
-        if (nearest_cache >= 0 && minimum_time == cache[nearest_cache].time) {
-            //printf("draw cache %d %f\n", nearest_cache, cache[nearest_cache].time );
-            //if ( async <= 0.033 ) // drop frame if necessary
-            drawFrame(cache[nearest_cache].image);
-            cache[nearest_cache].image->Release();
-            cache[nearest_cache].valid = false;
-            remaining_cache++;
-        }
-        else {
-            //printf("draw real %f\n", current_time );
-            //if ( async <= 0.033 ) // drop frame if necessary
-            drawFrame(image);
-        }
+        CImage* image = stream->GetFrame(true);
+        if (image == NULL) return NULL;
 
+        CImage* copy = new CImage(image);
         image->Release();
+        time = stream->GetTime();
+        return copy;
     }
-    status = AVI_STOP;
 
-    for (i = 0; i < NUM_CACHES; i++)
-        if (cache[i].valid) cache[i].image->Release();
+    void releaseFrame(void* frame) { ((CImage*) frame)->Release(); }
 
-    return 0;
-}
+private:
+    IAviReadStream* stream;
+};
 
 
+// Frames are decoded ahead on the pipeline's thread and shown from
+// this one, which also owns the renderer and the event queue; showing
+// a frame never waits for the decoder unless it has fallen behind.
 int AVIWrapper::play(bool click_flag)
 {
     int ret = 0;
     time_start = 0;
+    // Read now: once playing, only the decode thread touches v_stream.
+    frame_start = (v_stream) ? v_stream->GetTime() : 0.;
     status = AVI_PLAYING;
+
+    AviFrameSource source(v_stream);
+    VideoPipeline pipeline(&source);
     if (v_stream)
-        thread_id = SDL_CreateThread(::playVideo, this);
+        pipeline.start();
 
     if (a_stream)
         Mix_HookMusic(::audioCallback, this);
@@ -334,11 +271,6 @@ int AVIWrapper::play(bool click_flag)
                     || ((SDL_KeyboardEvent*) &event)->keysym.sym == SDLK_SPACE
                     || ((SDL_KeyboardEvent*) &event)->keysym.sym == SDLK_ESCAPE)
                     done_flag = true;
-
-                if (s == SDLK_f) {
-                    if (fullscreen_mode) menu_windowCommand("menu_window");
-                    else menu_fullCommand("menu_full");
-                }
                 break;
             case SDL_QUIT:
                 ret = 1;
@@ -368,25 +300,47 @@ int AVIWrapper::play(bool click_flag)
                 break;
             }
         }
-        SDL_Delay(10);
-    }
 
+        if (!v_stream) {
+            SDL_Delay(10);
+            continue;
+        }
+
+        double wait;
+        void* frame = pipeline.frameAt(getAudioTime(), wait);
+        if (frame) {
+            drawFrame((CImage*) frame);
+            pipeline.release(frame);
+        }
+        else if (pipeline.finished())
+            break;
+        else
+            // Sleep until the next frame is due, but keep noticing
+            // input and the end of the audio.
+            SDL_Delay(wait > 0.01 ? 10 : wait > 0.001 ? (int) (wait * 1000) : 1);
+    }
     status = AVI_STOP;
-    if (v_stream)
-        SDL_WaitThread(thread_id, NULL);
+
+    pipeline.stop();
+    if (debug_flag)
+        fprintf(stderr, "dropped %lu late frames\n", pipeline.droppedFrames());
 
     if (a_stream)
         Mix_HookMusic(NULL, NULL);
 
-
+    // Hand back a redraw that arrived while playing.
     if(interrupted_redraw) {
-        queueRedraw();
+        SDL_Event event;
+        event.type = INTERNAL_REDRAW_EVENT;
+        SDL_PushEvent(&event);
     }
 
     return ret;
 }
 
 
+// Copies a decoded frame into the texture, whose rows may be padded,
+// and shows it over the whole window.
 int AVIWrapper::drawFrame(CImage* image)
 {
     if (image == NULL) return -1;
@@ -395,32 +349,42 @@ int AVIWrapper::drawFrame(CImage* image)
     uint32_t comp = image->GetFmt()->biCompression;
 
     unsigned char* buf = image->Data();
-    SDL_LockYUVOverlay(screen_overlay);
-    Uint8* dst_y = screen_overlay->pixels[0];
-    Uint8* dst_u = screen_overlay->pixels[1];
-    Uint8* dst_v = screen_overlay->pixels[2];
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0) return -1;
+    Uint8* dst_y = (Uint8*) pixels;
+    Uint8* dst_v = dst_y + pitch * height;
+    Uint8* dst_u = dst_v + pitch / 2 * (height / 2);
 
     if (comp == 0) { // BGR
         image->ToYUV();
-        for (i = 0; i < width * height; i++)
-            *dst_y++ = buf[i* 3];
+        for (i = 0; i < height; i++)
+            for (j = 0; j < width; j++)
+                dst_y[i * pitch + j] = buf[(i * width + j) * 3];
 
         for (i = 0; i < height / 2; i++) {
             for (j = 0; j < width / 2; j++) {
-                *dst_v++ = buf[(i * width * 2 + j * 2) * 3 + 1];
-                *dst_u++ = buf[(i * width * 2 + j * 2) * 3 + 2];
+                dst_v[i * (pitch / 2) + j] = buf[(i * width * 2 + j * 2) * 3 + 1];
+                dst_u[i * (pitch / 2) + j] = buf[(i * width * 2 + j * 2) * 3 + 2];
             }
         }
     }
     else if (comp == IMG_FMT_YUY2) {
-        memcpy(dst_y, buf, width * height * 2);
+        for (i = 0; i < height; i++)
+            memcpy(dst_y + i * pitch, buf + i * width * 2, width * 2);
     }
     else if (comp == IMG_FMT_YV12) {
-        memcpy(dst_y, buf, width * height + width * height / 2);
+        for (i = 0; i < height; i++)
+            memcpy(dst_y + i * pitch, buf + i * width, width);
+        buf += width * height;
+        for (i = 0; i < height; i++)  // V then U, each half size
+            memcpy(dst_v + i * (pitch / 2), buf + i * (width / 2), width / 2);
     }
 
-    SDL_UnlockYUVOverlay(screen_overlay);
-    SDL_DisplayYUVOverlay(screen_overlay, &screen_rect);
+    SDL_UnlockTexture(texture);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
 
     return 0;
 }
@@ -28,7 +28,6 @@
 #define __AVI_WRAPPER_H__
 
 #include <SDL.h>
-#include <SDL_thread.h>
 #include <avifile.h>
 #include <avm_fourcc.h>
 #include <utils.h>
@@ -40,12 +39,11 @@ public:
     AVIWrapper();
     ~AVIWrapper();
 
-    int init(char* filename, bool debug_flag);
-    int initAV(SDL_Surface* surface, bool audio_open_flag);
+    int init(const char* filename, bool debug_flag);
+    int initAV(SDL_Renderer* renderer, bool audio_open_flag);
     int play(bool click_flag);
 
     void audioCallback(void* userdata, Uint8* stream, int len);
-    int playVideo(void* userdata);
 
     unsigned int getWidth() { return width; };
     unsigned int getHeight() { return height; };
@@ -54,8 +52,8 @@ private:
     double getAudioTime();
     int drawFrame(CImage* image);
 
-    SDL_Overlay* screen_overlay;
-    SDL_Rect screen_rect;
+    SDL_Renderer* renderer;
+    SDL_Texture* texture;  // YV12 or YUY2, as the decoder gives
     unsigned int width;
     unsigned int height;
 
@@ -67,7 +65,6 @@ private:
 
     bool debug_flag;
     int  status;
-    SDL_Thread* thread_id;
     int64_t time_start;
     double  frame_start;
 };
@@ -29,6 +29,7 @@
 
 #include "AnimationInfo.h"
 #include "BaseReader.h"
+#include "MemStats.h"
 
 #include "graphics_common.h"
 
@@ -49,12 +50,22 @@
 //Mion: for special graphics routine handling
 static unsigned int cpufuncs;
 
+Uint32 blend_recip[256];
+static struct BlendRecipInit {
+    BlendRecipInit() {
+        for (int a = 1; a < 256; ++a)
+            blend_recip[a] = ((1 << 24) + a - 1) / a;
+    }
+} blend_recip_init;
+
 
 AnimationInfo::AnimationInfo()
 {
     is_copy = false;
 
     image_surface = NULL;
+    image_evicted = false;
+    image_changed = false;
 #ifdef BPP16
     alpha_buf     = NULL;
 #endif
@@ -180,12 +191,22 @@ void AnimationInfo::reset()
 
 void AnimationInfo::deleteImage()
 {
-    if (!is_copy && image_surface) SDL_FreeSurface(image_surface);
-    image_surface = NULL;
 #ifdef BPP16
-    if (!is_copy && alpha_buf) delete[] alpha_buf;
+    if (!is_copy && alpha_buf) {
+        MemStats::remove(MemStats::SPRITES,
+                         image_surface->w * image_surface->h);
+        delete[] alpha_buf;
+    }
     alpha_buf = NULL;
 #endif
+    if (!is_copy && image_surface) {
+        MemStats::remove(MemStats::SPRITES,
+                         MemStats::surfaceBytes(image_surface));
+        SDL_FreeSurface(image_surface);
+    }
+    image_surface = NULL;
+    image_evicted = false;
+    image_changed = false;
 }
 
 
@@ -638,16 +659,41 @@ void AnimationInfo::blendOnSurface2(SDL_Surface* dst_surface, int dst_x,
 // used to draw characters on text_surface
 // Alpha = 1 - (1-Da)(1-Sa)
 // Color = (DaSaSc + Da(1-Sa)Dc + Sa(1-Da)Sc)/A
-void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
-                               SDL_Color &color, SDL_Rect *clip,
-                               bool rotate_flag )
+void AnimationInfo::blendText(const Glyph& glyph, int dst_x, int dst_y,
+                              SDL_Color &color, SDL_Rect *clip,
+                              bool rotate_flag)
+{
+    if (image_surface == NULL || glyph.pixels == NULL) return;
+
+    SDL_LockSurface(image_surface);
+    blendGlyph(glyph, dst_x, dst_y, color, clip, rotate_flag);
+    SDL_UnlockSurface(image_surface);
+}
+
+
+void AnimationInfo::blendGlyphs(const std::vector<GlyphBlend>& glyphs,
+                                SDL_Rect *clip)
 {
-    if (image_surface == NULL || surface == NULL) return;
+    if (image_surface == NULL || glyphs.empty()) return;
 
-    SDL_Rect dst_rect = { dst_x, dst_y, surface->w, surface->h };
+    SDL_LockSurface(image_surface);
+    for (size_t i = 0; i < glyphs.size(); ++i) {
+        const GlyphBlend& b = glyphs[i];
+        if (b.glyph.pixels)
+            blendGlyph(b.glyph, b.x, b.y, b.color, clip, false);
+    }
+    SDL_UnlockSurface(image_surface);
+}
+
+
+void AnimationInfo::blendGlyph(const Glyph& glyph, int dst_x, int dst_y,
+                               const SDL_Color &color, SDL_Rect *clip,
+                               bool rotate_flag)
+{
+    SDL_Rect dst_rect = { dst_x, dst_y, glyph.w, glyph.h };
     if (rotate_flag){
-        dst_rect.w = surface->h;
-        dst_rect.h = surface->w;
+        dst_rect.w = glyph.h;
+        dst_rect.h = glyph.w;
     }
     SDL_Rect src_rect = { 0, 0, 0, 0 };
     SDL_Rect clipped_rect;
@@ -671,9 +717,6 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
 
     /* ---------------------------------------- */
 
-    SDL_LockSurface(surface);
-    SDL_LockSurface(image_surface);
-
 #ifdef BPP16
     int total_width = image_surface->pitch / 2;
     Uint32 src_color = ((color.r >> RLOSS) << RSHIFT) |
@@ -695,28 +738,36 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
                             dst_rect.x;
 #endif
     if (!rotate_flag){
-        unsigned char *src_buffer = (unsigned char*)surface->pixels +
-                                    surface->pitch*src_rect.y + src_rect.x;
+        const Uint8 *src_buffer = glyph.pixels +
+                                  glyph.pitch*src_rect.y + src_rect.x;
+#ifdef BPP16
         for (int i=dst_rect.h; i>0; i--){
             for (int j=dst_rect.w; j>0; j--, dst_buffer++, src_buffer++){
                 BLEND_PIXEL8_ALPHA();
             }
             dst_buffer += total_width - dst_rect.w;
-#ifdef BPP16
             alphap += image_surface->w - dst_rect.w;
-#endif
-            src_buffer += surface->pitch - dst_rect.w;
+            src_buffer += glyph.pitch - dst_rect.w;
+        }
+#else
+        Uint32 src_color = src_color1 | src_color2;
+        for (int i=dst_rect.h; i>0; i--){
+            imageFilterBlendText(dst_buffer, src_buffer, src_color,
+                                 dst_rect.w);
+            dst_buffer += total_width;
+            src_buffer += glyph.pitch;
         }
+#endif
     }
     else{
         for (int i=0; i<dst_rect.h; i++){
-            unsigned char *src_buffer = (unsigned char*)surface->pixels +
-                                        surface->pitch * (surface->h -
-                                                          src_rect.x - 1) +
-                                        src_rect.y + i;
+            const Uint8 *src_buffer = glyph.pixels +
+                                      glyph.pitch * (glyph.h -
+                                                     src_rect.x - 1) +
+                                      src_rect.y + i;
             for (int j=dst_rect.w; j>0; j--, dst_buffer++){
                 BLEND_PIXEL8_ALPHA();
-                src_buffer -= surface->pitch;
+                src_buffer -= glyph.pitch;
             }
             dst_buffer += total_width - dst_rect.w;
 #ifdef BPP16
@@ -724,9 +775,6 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
 #endif
         }
     }
-
-    SDL_UnlockSurface(image_surface);
-    SDL_UnlockSurface(surface);
 }
 
 
@@ -792,9 +840,12 @@ void AnimationInfo::allocImage(int w, int h)
         deleteImage();
 
         image_surface = allocSurface(w, h);
+        MemStats::add(MemStats::SPRITES, MemStats::surfaceBytes(image_surface));
 #ifdef BPP16
-        if (image_surface)
-        alpha_buf = new unsigned char[w * h];
+        if (image_surface) {
+            alpha_buf = new unsigned char[w * h];
+            MemStats::add(MemStats::SPRITES, w * h);
+        }
 #endif
     }
 
@@ -1041,6 +1092,8 @@ void AnimationInfo::setupImage( SDL_Surface *surface, SDL_Surface *surface_m,
                                     fmt->BitsPerPixel, fmt->Rmask,
                                     fmt->Gmask, fmt->Bmask, fmt->Amask);
 #else
+        // src_s is the old image_surface, freed below.
+        MemStats::remove(MemStats::SPRITES, MemStats::surfaceBytes(src_s));
         image_surface = NULL;
         allocImage(w, h);
         tmp = image_surface;
@@ -1199,6 +1252,118 @@ void AnimationInfo::imageFilterBlend(Uint32 *dst_buffer, Uint32 *src_buffer,
 }
 
 
+void AnimationInfo::imageFilterNega(Uint32 *buffer, Uint32 mask, int length)
+{
+#if defined(USE_X86_GFX)
+
+#ifndef MACOSX
+    if (cpufuncs & CPUF_X86_SSE2) {
+#endif // !MACOSX
+
+        imageFilterNega_SSE2(buffer, mask, length);
+
+#ifndef MACOSX
+    } else {
+        int n = length + 1;
+        BASIC_NEGA();
+    }
+#endif // !MACOSX
+
+#else // no special gfx handling
+    int n = length + 1;
+    BASIC_NEGA();
+#endif
+}
+
+
+
+// Blocks are sampled at their bottom-left pixel and grow upwards.
+// Fill the bottom row of each band of blocks, then copy it up.
+void AnimationInfo::imageFilterMosaic(ONSBuf *dst_buffer,
+                                      const ONSBuf *src_buffer, int width,
+                                      int height, int pitch, int block)
+{
+    for (int i = height - 1; i >= 0; i -= block) {
+        ONSBuf* dst_row = dst_buffer + i * pitch;
+
+        for (int j = 0; j < width; j += block) {
+            ONSBuf p = src_buffer[i * pitch + j];
+
+            int width2 = block;
+            if (j + block > width) width2 = width - j;
+
+            for (int jj = 0; jj < width2; jj++)
+                dst_row[j + jj] = p;
+        }
+
+        int height2 = block;
+        if (i + 1 - block < 0) height2 = i + 1;
+
+        for (int ii = 1; ii < height2; ii++)
+            memcpy(dst_row - ii * pitch, dst_row, width * sizeof(ONSBuf));
+    }
+}
+
+
+#ifndef BPP16
+void AnimationInfo::imageFilterMonochrome(Uint32 *buffer, const rgb_t& color,
+                                          int length)
+{
+#if defined(USE_X86_GFX)
+
+#ifndef MACOSX
+    if (cpufuncs & CPUF_X86_SSE2) {
+#endif // !MACOSX
+
+        imageFilterMonochrome_SSE2(buffer, color.r, color.g, color.b, length);
+
+#ifndef MACOSX
+    } else {
+        int monocro_r = color.r, monocro_g = color.g, monocro_b = color.b;
+        int n = length + 1;
+        BASIC_MONOCRO();
+    }
+#endif // !MACOSX
+
+#else // no special gfx handling
+    int monocro_r = color.r, monocro_g = color.g, monocro_b = color.b;
+    int n = length + 1;
+    BASIC_MONOCRO();
+#endif
+}
+#endif
+
+
+#ifndef BPP16
+// One row of a glyph's coverage blended onto the image in the given
+// colour; see BLEND_PIXEL8_ALPHA.
+void AnimationInfo::imageFilterBlendText(Uint32 *dst_buffer,
+                                         const Uint8 *src_buffer,
+                                         Uint32 color, int length)
+{
+#if defined(USE_X86_GFX)
+
+#ifndef MACOSX
+    if (cpufuncs & CPUF_X86_SSE2) {
+#endif // !MACOSX
+
+        imageFilterBlendText_SSE2(dst_buffer, src_buffer, color, length);
+        return;
+
+#ifndef MACOSX
+    }
+#endif // !MACOSX
+
+#endif
+    Uint32 src_color1 = color & RBMASK;
+    Uint32 src_color2 = color & GMASK;
+    for (int n = length; n > 0; n--, dst_buffer++, src_buffer++){
+        BLEND_PIXEL8_ALPHA();
+    }
+}
+#endif
+
+
 #include "resize_image.h"
 
 static unsigned char *resize_buffer = NULL;
@@ -35,6 +35,8 @@
 #include <string.h>
 #include "defs.h"
 #include "BaseReader.h"
+#include "font.h"
+#include <vector>
 
 #define USE_2X_MODE
 
@@ -114,6 +116,12 @@ public:
     int  trans;
     pstring image_name;
     SDL_Surface*   image_surface;
+    // image_surface was dropped to keep under the memory budget and
+    // must be loaded again from image_name before it is drawn.
+    bool image_evicted;
+    // image_surface has been drawn on since it was loaded, so it
+    // can't be dropped and loaded again.
+    bool image_changed;
 #ifdef BPP16
     unsigned char* alpha_buf;
 #endif
@@ -195,8 +203,21 @@ public:
                         SDL_Rect &clip, int alpha = 256);
     void blendOnSurface2(SDL_Surface* dst_surface, int dst_x, int dst_y,
                          SDL_Rect& clip, int alpha = 256);
-    void blendText(SDL_Surface* surface, int dst_x, int dst_y,
+    void blendText(const Glyph& glyph, int dst_x, int dst_y,
                    SDL_Color &color, SDL_Rect* clip, bool rotate_flag=false);
+
+    // A page of text is drawn as one batch of glyphs, blended under a
+    // single lock of the image.
+    struct GlyphBlend {
+        Glyph glyph;
+        int x, y;
+        SDL_Color color;
+    };
+    void blendGlyphs(const std::vector<GlyphBlend>& glyphs, SDL_Rect* clip);
+private:
+    void blendGlyph(const Glyph& glyph, int dst_x, int dst_y,
+                    const SDL_Color &color, SDL_Rect* clip, bool rotate_flag);
+public:
     void calcAffineMatrix();
     
     static SDL_Surface* allocSurface(int w, int h);
@@ -217,6 +238,17 @@ public:
                                    int length);
     static void imageFilterBlend(Uint32 *dst_buffer, Uint32 *src_buffer,
                                  Uint8 *alphap, int alpha, int length);
+    static void imageFilterNega(Uint32 *buffer, Uint32 mask, int length);
+    static void imageFilterMosaic(ONSBuf *dst_buffer,
+                                  const ONSBuf *src_buffer, int width,
+                                  int height, int pitch, int block);
+#ifndef BPP16
+    static void imageFilterMonochrome(Uint32 *buffer, const rgb_t& color,
+                                      int length);
+    static void imageFilterBlendText(Uint32 *dst_buffer,
+                                     const Uint8 *src_buffer, Uint32 color,
+                                     int length);
+#endif
 
     //Mion: for resizing (moved from ONScripterLabel)
     static void resetResizeBuffer();
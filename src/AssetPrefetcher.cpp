@@ -0,0 +1,246 @@
+/* -*- C++ -*-
+ *
+ *  AssetPrefetcher.cpp - Background loading of images and sounds that
+ *  the script is about to use
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "AssetPrefetcher.h"
+#include "ScriptHandler.h"
+#include <SDL_image.h>
+
+AssetPrefetcher::AssetPrefetcher()
+    : thread(NULL), quit(false), next_serial(0),
+      requested(0), hits(0), misses(0), wasted(0), wasted_bytes(0)
+{
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+}
+
+
+AssetPrefetcher::~AssetPrefetcher()
+{
+    if (thread) {
+        SDL_LockMutex(mutex);
+        quit = true;
+        SDL_CondSignal(cond);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+    }
+    clear();
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+
+pstring AssetPrefetcher::key(const pstring& filename)
+{
+    pstring k = filename;
+    k.tolower();
+    k.findreplace("\\", "/");
+    return k;
+}
+
+
+void AssetPrefetcher::request(const pstring& filename, Kind kind,
+                              const pstring& alt_dir)
+{
+    pstring k = key(filename);
+    SDL_LockMutex(mutex);
+    if (entries.find(k) == entries.end()) {
+        if (entries.size() >= MAX_ENTRIES) evict();
+        Entry& e = entries[k];
+        e.name = filename;
+        if (alt_dir) {
+            e.alt_name = alt_dir + filename;
+            e.alt_name.findreplace("\\", DELIMITER);
+        }
+        e.kind = kind;
+        e.serial = next_serial++;
+        queue.push_back(k);
+        ++requested;
+        if (!thread)
+            thread = SDL_CreateThread(threadFunc, "prefetch", this);
+        SDL_CondSignal(cond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+SDL_Surface* AssetPrefetcher::takeSurface(const pstring& filename,
+                                          pstring& dat, int* location)
+{
+    SDL_Surface* surface = NULL;
+    SDL_LockMutex(mutex);
+    entries_t::iterator it = entries.find(key(filename));
+    if (it == entries.end()) {
+        // Never requested, or already taken or evicted: not ours to
+        // count.
+    }
+    else if (it->second.ready && it->second.kind == IMAGE &&
+             (it->second.surface || it->second.data)) {
+        Entry& e = it->second;
+        surface = e.surface;
+        if (!surface) dat = pstring((const char*) e.data, e.length);
+        if (location) *location = e.location;
+        e.surface = NULL;
+        delete[] e.data;
+        entries.erase(it);
+        ++hits;
+    }
+    else {
+        // Whatever the worker produces for this name now arrives too
+        // late to be of use.
+        if (!it->second.ready) ++misses;
+        discard(it);
+    }
+    SDL_UnlockMutex(mutex);
+    return surface;
+}
+
+
+unsigned char* AssetPrefetcher::takeData(const pstring& filename,
+                                         size_t* length)
+{
+    unsigned char* data = NULL;
+    SDL_LockMutex(mutex);
+    entries_t::iterator it = entries.find(key(filename));
+    if (it == entries.end()) {
+        // Not requested: see takeSurface().
+    }
+    else if (it->second.ready && it->second.kind == SOUND &&
+             it->second.data) {
+        data = it->second.data;
+        *length = it->second.length;
+        it->second.data = NULL;
+        entries.erase(it);
+        ++hits;
+    }
+    else {
+        if (!it->second.ready) ++misses;
+        discard(it);
+    }
+    SDL_UnlockMutex(mutex);
+    return data;
+}
+
+
+void AssetPrefetcher::clear()
+{
+    SDL_LockMutex(mutex);
+    queue.clear();
+    while (!entries.empty()) discard(entries.begin());
+    SDL_UnlockMutex(mutex);
+}
+
+
+void AssetPrefetcher::printStats()
+{
+    SDL_LockMutex(mutex);
+    unsigned long lookups = hits + misses;
+    printf("Prefetch: %lu requested, %lu hits, %lu misses (%lu%% hit rate), "
+           "%lu wasted (%lu bytes)\n", requested, hits, misses,
+           lookups ? hits * 100 / lookups : 0, wasted,
+           (unsigned long) wasted_bytes);
+    SDL_UnlockMutex(mutex);
+}
+
+
+// Called with the mutex held.
+void AssetPrefetcher::discard(entries_t::iterator it)
+{
+    Entry& e = it->second;
+    if (e.ready && (e.surface || e.data)) {
+        ++wasted;
+        wasted_bytes += e.length;
+    }
+    if (e.surface) SDL_FreeSurface(e.surface);
+    delete[] e.data;
+    entries.erase(it);
+}
+
+
+// Called with the mutex held: make room by dropping the oldest entry.
+void AssetPrefetcher::evict()
+{
+    entries_t::iterator oldest = entries.begin();
+    for (entries_t::iterator it = entries.begin(); it != entries.end(); ++it)
+        if (it->second.serial < oldest->second.serial) oldest = it;
+    if (oldest != entries.end()) discard(oldest);
+}
+
+
+int AssetPrefetcher::threadFunc(void* data)
+{
+    ((AssetPrefetcher*) data)->run();
+    return 0;
+}
+
+
+void AssetPrefetcher::run()
+{
+    SDL_LockMutex(mutex);
+    while (true) {
+        while (!quit && queue.empty()) SDL_CondWait(cond, mutex);
+        if (quit) break;
+
+        pstring k = queue.front();
+        queue.pop_front();
+        entries_t::iterator it = entries.find(k);
+        if (it == entries.end() || it->second.ready) continue;
+        pstring name = it->second.name;
+        pstring alt_name = it->second.alt_name;
+        Kind kind = it->second.kind;
+        SDL_UnlockMutex(mutex);
+
+        // The entry may be taken or discarded while we work, so only
+        // touch it again once we hold the lock.
+        int location = 0;
+        pstring dat = ScriptHandler::cBR->getFile(name, &location);
+        if (!dat && alt_name)
+            dat = ScriptHandler::cBR->getFile(alt_name, &location);
+        size_t length = dat.length();
+        SDL_Surface* surface = NULL;
+        unsigned char* buffer = NULL;
+        if (length && kind == IMAGE)
+            surface = IMG_Load_RW(rwops(dat), 1);
+        // Keep the bytes of an image we couldn't decode: the loader
+        // has fallbacks (such as forcing JPEG) we don't duplicate.
+        if (length && !surface) {
+            buffer = new unsigned char[length];
+            memcpy(buffer, (const char*) dat, length);
+        }
+
+        SDL_LockMutex(mutex);
+        it = entries.find(k);
+        if (it != entries.end() && !it->second.ready) {
+            Entry& e = it->second;
+            e.ready = true;
+            e.surface = surface;
+            e.data = buffer;
+            e.length = length;
+            e.location = location;
+        }
+        else if (surface || buffer) {
+            ++wasted;
+            wasted_bytes += length;
+            if (surface) SDL_FreeSurface(surface);
+            delete[] buffer;
+        }
+    }
+    SDL_UnlockMutex(mutex);
+}
@@ -0,0 +1,102 @@
+/* -*- C++ -*-
+ *
+ *  AssetPrefetcher.h - Background loading of images and sounds that
+ *  the script is about to use
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __ASSET_PREFETCHER_H__
+#define __ASSET_PREFETCHER_H__
+
+#include "defs.h"
+#include <deque>
+
+// The main thread queues file names found a few lines ahead of the
+// current script position; a worker thread reads them through
+// ScriptHandler::cBR and, for images, decodes them.  When the script
+// gets there, the loader takes the result if it is ready and
+// otherwise loads synchronously as before.
+//
+// Hits and misses only count lookups of names that were requested:
+// a miss is one that was still queued or loading.
+class AssetPrefetcher {
+public:
+    enum Kind { IMAGE, SOUND };
+
+    AssetPrefetcher();
+    ~AssetPrefetcher();
+
+    // An image not in the archives is looked for in alt_dir, as
+    // createSurfaceFromFile() does.
+    void request(const pstring& filename, Kind kind,
+                 const pstring& alt_dir = "");
+
+    // Return the decoded image and forget it, or NULL if the worker
+    // hasn't finished it.  If the worker read the file but couldn't
+    // decode it, return NULL with the file contents in dat, so the
+    // caller can try its own fallbacks.
+    SDL_Surface* takeSurface(const pstring& filename, pstring& dat,
+                             int* location);
+
+    // Return the file contents (allocated with new[]) and forget
+    // them, or NULL if they aren't ready.
+    unsigned char* takeData(const pstring& filename, size_t* length);
+
+    // Drop everything that is queued or loaded.
+    void clear();
+
+    void printStats();
+
+private:
+    enum { MAX_ENTRIES = 32 };
+
+    struct Entry {
+        pstring name;
+        pstring alt_name; // IMAGE: where else to look
+        Kind kind;
+        bool ready;
+        SDL_Surface* surface;
+        unsigned char* data;
+        size_t length;
+        int location;
+        unsigned int serial;
+        Entry() : kind(IMAGE), ready(false), surface(NULL), data(NULL),
+                  length(0), location(0), serial(0) {}
+    };
+    typedef dictionary<pstring, Entry>::t entries_t;
+
+    static pstring key(const pstring& filename);
+    static int threadFunc(void* data);
+    void run();
+    void discard(entries_t::iterator it);
+    void evict();
+
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+    bool quit;
+
+    entries_t entries;
+    std::deque<pstring> queue;
+    unsigned int next_serial;
+
+    // Statistics
+    unsigned long requested, hits, misses, wasted;
+    size_t wasted_bytes;
+};
+
+#endif // __ASSET_PREFETCHER_H__
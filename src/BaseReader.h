@@ -38,6 +38,13 @@
 #define DELIMITER "/"
 #endif
 
+// Concurrency: once open() has returned, getFileLength(), getFile()
+// and getFileByIndex() may be called from several threads at once;
+// readers keep no per-call state in the object and read archives with
+// positioned reads.  (The one thing they do write, a decoded length
+// worked out on first use, is set under a lock.)  open(), close() and
+// registerCompressionType() must not run concurrently with anything
+// else.
 struct BaseReader {
     enum {
         NO_COMPRESSION   = 0,
@@ -51,7 +58,8 @@ struct BaseReader {
         ARCHIVE_TYPE_SAR  = 1,
         ARCHIVE_TYPE_NSA  = 2,
         ARCHIVE_TYPE_NS2  = 3,
-        ARCHIVE_TYPE_NS3  = 4
+        ARCHIVE_TYPE_NS3  = 4,
+        ARCHIVE_TYPE_PSA  = 5
     };
 
     struct FileInfo {
@@ -104,6 +112,16 @@ struct BaseReader {
 			   int* location = NULL) = 0;
 
     pstring getFile(const pstring& file_name, int* location = NULL);
+
+    // Returns a read-only stream over the file's contents, or NULL if
+    // it isn't found.  Stored entries are read from disk as the stream
+    // is consumed, and NBZ and LZSS entries are decoded as they are
+    // read, a buffer at a time; seeking back restarts the decoder.  SPB
+    // images and PSA entries are decoded into memory first.  The stream
+    // holds its own file handle, so it stays usable after the reader is
+    // closed or replaced.  Close it with SDL_RWclose().
+    virtual SDL_RWops* openFile(const pstring& file_name,
+                                int* location = NULL) = 0;
 };
 
 
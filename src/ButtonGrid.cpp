@@ -0,0 +1,50 @@
+/* -*- C++ -*-
+ *
+ *  ButtonGrid.cpp - Buttons indexed by screen area for hit-testing
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ButtonGrid.h"
+#include <algorithm>
+
+ButtonGrid::ButtonGrid()
+    : count(size_t(-1)), cols(0), rows(0)
+{
+}
+
+
+void ButtonGrid::reset(int w, int h)
+{
+    cols = (w + CELL_SIZE - 1) / CELL_SIZE;
+    rows = (h + CELL_SIZE - 1) / CELL_SIZE;
+    cells.assign(cols * rows, std::vector<int>());
+    count = 0;
+}
+
+
+void ButtonGrid::add(int no, const SDL_Rect& r)
+{
+    ++count;
+    if (r.w <= 0 || r.h <= 0) return;
+    int x1 = std::max(r.x / CELL_SIZE, 0);
+    int y1 = std::max(r.y / CELL_SIZE, 0);
+    int x2 = std::min((r.x + r.w - 1) / CELL_SIZE, cols - 1);
+    int y2 = std::min((r.y + r.h - 1) / CELL_SIZE, rows - 1);
+    for (int cy = y1; cy <= y2; ++cy)
+        for (int cx = x1; cx <= x2; ++cx)
+            cells[cy * cols + cx].push_back(no);
+}
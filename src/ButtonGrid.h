@@ -0,0 +1,55 @@
+/* -*- C++ -*-
+ *
+ *  ButtonGrid.h - Buttons indexed by screen area for hit-testing
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __BUTTON_GRID__
+#define __BUTTON_GRID__
+
+#include <SDL.h>
+#include <vector>
+
+// Button numbers by screen area, so mouse motion needn't test every
+// button.  Each cell of the grid lists the buttons whose rects touch it,
+// in the order they were added, which is the order they are checked.
+struct ButtonGrid {
+    static const int CELL_SIZE = 32;
+
+    ButtonGrid();
+
+    // Empties the grid and sizes it to cover a w x h screen.
+    void reset(int w, int h);
+
+    void add(int no, const SDL_Rect& rect);
+
+    // The buttons that may be under (x, y), or NULL if it is off the
+    // grid.
+    const std::vector<int>* cell(int x, int y) const {
+        if (x < 0 || y < 0 || x >= cols * CELL_SIZE ||
+            y >= rows * CELL_SIZE) return NULL;
+        return &cells[y / CELL_SIZE * cols + x / CELL_SIZE];
+    }
+
+    size_t count; // buttons added since reset(); size_t(-1) if stale
+
+private:
+    int cols, rows;
+    std::vector<std::vector<int> > cells;
+};
+
+#endif // __BUTTON_GRID__
@@ -28,11 +28,18 @@
 #include <bzlib.h>
 #if !defined (WIN32) && !defined (PSP) && !defined (__OS2__)
 #include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#define HAVE_PREAD
+#define CASELESS_LOOKUP
 #endif
 
 #ifdef WIN32
 //Mion: support for non-ASCII (SJIS) filenames
 #include <wchar.h>
+#include <io.h>
 #endif
 
 #if defined(MACOSX) || defined(LINUX) || defined(UTF8_FILESYSTEM)
@@ -54,6 +61,111 @@
 #define N (1 << EI)  /* buffer size */
 #define F ((1 << EJ) + P)  /* lookahead buffer size */
 
+// Reads MSB-first bit fields, refilling a 64-bit buffer eight bytes
+// at a time.  get() returns EOF once the span is exhausted.
+struct DirectReader::BitReader {
+    const unsigned char* p;
+    const unsigned char* end;
+    Uint64 bits;   // unread bits, left-aligned
+    int avail;
+
+    BitReader(const unsigned char* buf, size_t len)
+        : p(buf), end(buf + len), bits(0), avail(0) {}
+
+    inline void refill() {
+        if (end - p >= 8) {
+            // Bits below the ones we count as available are the
+            // following input bits, so ORing them in again is harmless.
+            Uint64 w;
+            memcpy(&w, p, 8);
+            bits |= SDL_SwapBE64(w) >> avail;
+            p += (63 - avail) >> 3;
+            avail |= 56;
+        }
+        else {
+            while (avail <= 56 && p < end) {
+                bits |= (Uint64) *p++ << (56 - avail);
+                avail += 8;
+            }
+        }
+    }
+
+    inline int get(int n) {
+        if (avail < n) {
+            refill();
+            if (avail < n) return EOF;
+        }
+        int x = (int) (bits >> (64 - n));
+        bits <<= n;
+        avail -= n;
+        return x;
+    }
+};
+
+#ifndef HAVE_PREAD
+static SDL_mutex* read_lock = NULL;
+#endif
+
+#ifdef CASELESS_LOOKUP
+// Upper-cased listings of the directories fileopen has had to search,
+// keyed by path.  A listing is reread only when the directory's mtime
+// changes, so repeated lookups (and misses) cost a stat, not a scan.
+// mtime only has a resolution of a second, so a listing read in the
+// same second as the directory last changed may miss a later change in
+// that second: until a scan comes after the mtime, misses rescan.
+struct DirListing {
+    time_t mtime, scanned;
+    dictionary<pstring, pstring>::t names; // folded name -> actual name
+};
+typedef dictionary<pstring, DirListing>::t dir_cache_t;
+static dir_cache_t dir_cache;
+static SDL_mutex* dir_cache_lock = NULL;
+
+static void scanDir(const pstring& dir, time_t mtime, DirListing& l)
+{
+    l.mtime = mtime;
+    l.scanned = time(NULL);
+    l.names.clear();
+    DIR* dp = opendir(dir);
+    if (!dp) return;
+    dirent* entry;
+    while ((entry = readdir(dp))) {
+        pstring item = entry->d_name;
+        pstring key = item;
+        key.toupper();
+        // first match wins, as with a plain scan
+        l.names.insert(std::make_pair(key, item));
+    }
+    closedir(dp);
+}
+
+// Find the entry of dir whose name matches name regardless of case.
+static bool findCaseless(const pstring& dir, const pstring& name,
+                         pstring& actual)
+{
+    struct stat st;
+    if (stat(dir, &st) != 0) return false;
+
+    pstring key = name;
+    key.toupper();
+    SDL_mutexP(dir_cache_lock);
+    dir_cache_t::iterator d = dir_cache.find(dir);
+    bool fresh = d == dir_cache.end() || d->second.mtime != st.st_mtime;
+    DirListing& l = fresh ? dir_cache[dir] : d->second;
+    if (fresh) scanDir(dir, st.st_mtime, l);
+
+    dictionary<pstring, pstring>::t::const_iterator e = l.names.find(key);
+    if (e == l.names.end() && !fresh && l.scanned <= l.mtime) {
+        scanDir(dir, st.st_mtime, l);
+        e = l.names.find(key);
+    }
+    bool found = e != l.names.end();
+    if (found) actual = e->second;
+    SDL_mutexV(dir_cache_lock);
+    return found;
+}
+#endif
+
 DirectReader::DirectReader(DirPaths *path, const unsigned char* key_table)
 {
     if ( path != NULL )
@@ -71,9 +183,12 @@ DirectReader::DirectReader(DirPaths *path, const unsigned char* key_table)
         for (i = 0; i < 256; i++) this->key_table[i] = (unsigned char) i;
     }
 
-    read_buf = new unsigned char[READ_LENGTH];
-    decomp_buffer = new unsigned char[N * 2];
-    decomp_buffer_len = N * 2;
+#ifndef HAVE_PREAD
+    if (!read_lock) read_lock = SDL_CreateMutex();
+#endif
+#ifdef CASELESS_LOOKUP
+    if (!dir_cache_lock) dir_cache_lock = SDL_CreateMutex();
+#endif
 
     last_registered_compression_type = &root_registered_compression_type;
     registerCompressionType("SPB", SPB_COMPRESSION);
@@ -84,9 +199,6 @@ DirectReader::DirectReader(DirPaths *path, const unsigned char* key_table)
 
 DirectReader::~DirectReader()
 {
-    delete[] read_buf;
-    delete[] decomp_buffer;
-
     last_registered_compression_type = root_registered_compression_type.next;
     while (last_registered_compression_type) {
         RegisteredCompressionType* cur = last_registered_compression_type;
@@ -173,7 +285,7 @@ FILE* DirectReader::fileopen(pstring path, const char* mode)
         }
 #endif
 
-#if !defined (WIN32) && !defined (PSP) && !defined (__OS2__)
+#ifdef CASELESS_LOOKUP
         // For systems that are case-sensitive, split the path into
         // directories and check each for correct case, correcting
         // the case in memory as appropriate, until we either
@@ -187,23 +299,11 @@ FILE* DirectReader::fileopen(pstring path, const char* mode)
         // Correct the case of each.
         bool found = false;
         for (CBStringList::iterator it = parts.begin(); it != parts.end(); ++it) {
-            found = false;
-            DIR* dp = opendir(full_path);
-            if (!dp) {
-                fp = NULL;
-                break;
-            }
-            dirent* entry;
-            while ((entry = readdir(dp))) {
-                pstring item = entry->d_name;
-                if (it->caselessEqual(item)) {
-                    found = true;
-                    full_path += DELIMITER;
-                    full_path += item;
-                    break;
-                }
-            }
-            closedir(dp);
+            pstring item;
+            found = findCaseless(full_path, *it, item);
+            if (!found) continue;
+            full_path += DELIMITER;
+            full_path += item;
         }
         if (!found) continue;
         fp = fopen(full_path, mode);
@@ -248,6 +348,31 @@ unsigned long DirectReader::readLong(FILE* fp)
 }
 
 
+// Read len bytes from offset without using (or moving) the stream
+// position, so that several threads can share one archive handle.
+size_t DirectReader::readAt(FILE* fp, size_t offset, void* buf, size_t len)
+{
+#ifdef HAVE_PREAD
+    int fd = fileno(fp);
+    size_t total = 0;
+    while (total < len) {
+        ssize_t c = pread(fd, (char*) buf + total, len - total,
+                          offset + total);
+        if (c < 0 && errno == EINTR) continue;
+        if (c <= 0) break;
+        total += c;
+    }
+    return total;
+#else
+    SDL_LockMutex(read_lock);
+    fseek(fp, offset, SEEK_SET);
+    size_t total = fread(buf, 1, len, fp);
+    SDL_UnlockMutex(read_lock);
+    return total;
+#endif
+}
+
+
 int DirectReader::open(const pstring& name, int archive_type)
 {
     return 0;
@@ -338,19 +463,24 @@ size_t DirectReader::getFile(const pstring& file_name, unsigned char* buffer,
     FILE*  fp = getFileHandle(file_name, compression_type, &len);
 
     if (fp) {
-        if (compression_type & NBZ_COMPRESSION)
-	    return decodeNBZ(fp, 0, buffer);
-        else if (compression_type & SPB_COMPRESSION)
-	    return decodeSPB(fp, 0, buffer);
-
-        total = len;
-        while (len > 0) {
-            if (len > READ_LENGTH) c = READ_LENGTH;
-            else c = len;
-
-            len -= c;
-            fread(buffer, 1, c, fp);
-            buffer += c;
+        if (compression_type & NBZ_COMPRESSION) {
+            fseek(fp, 0, SEEK_END);
+            total = decodeNBZ(fp, 0, ftell(fp), buffer);
+        }
+        else if (compression_type & SPB_COMPRESSION) {
+            fseek(fp, 0, SEEK_END);
+            total = decodeSPB(fp, 0, ftell(fp), buffer);
+        }
+        else {
+            total = len;
+            while (len > 0) {
+                if (len > READ_LENGTH) c = READ_LENGTH;
+                else c = len;
+
+                len -= c;
+                fread(buffer, 1, c, fp);
+                buffer += c;
+            }
         }
         fclose(fp);
         if (location) *location = ARCHIVE_TYPE_NONE;
@@ -360,6 +490,34 @@ size_t DirectReader::getFile(const pstring& file_name, unsigned char* buffer,
 }
 
 
+SDL_RWops* DirectReader::openFile(const pstring& file_name, int* location)
+{
+    int compression_type;
+    size_t len;
+    FILE* fp = getFileHandle(file_name, compression_type, &len);
+    if (!fp) return NULL;
+
+    SDL_RWops* src;
+    if (compression_type & NBZ_COMPRESSION) {
+        fseek(fp, 0, SEEK_END);
+        src = openCompressedEntry(fp, 0, ftell(fp), NBZ_COMPRESSION, len);
+        fclose(fp);
+    }
+    else if (compression_type & SPB_COMPRESSION) {
+        fclose(fp);
+        unsigned char* buf = new unsigned char[len];
+        memset(buf, 0, len); // SPB leaves row padding unwritten
+        src = openBuffer(buf, getFile(file_name, buf));
+    }
+    else {
+        src = openEntry(fp, 0, len, false);
+        fclose(fp);
+    }
+    if (src && location) *location = ARCHIVE_TYPE_NONE;
+    return src;
+}
+
+
 pstring DirectReader::convertFromSJISToUTF8(const pstring& src)
 {
     pstring dst = "";
@@ -391,80 +549,77 @@ pstring DirectReader::convertFromSJISToUTF8(const pstring& src)
 }
 
 
-size_t DirectReader::decodeNBZ(FILE* fp, size_t offset, unsigned char* buf)
+// Read a whole compressed entry into memory, undoing the key table.
+// length becomes the number of bytes actually read.
+unsigned char* DirectReader::readSpan(FILE* fp, size_t offset, size_t& length)
 {
+    unsigned char* span = new unsigned char[length];
+    length = readAt(fp, offset, span, length);
     if (key_table_flag)
-        fprintf(stderr, "may not decode NBZ with key_table enabled.\n");
-
-    unsigned int original_length, count;
-    BZFILE* bfp;
-    void*   unused;
-    int err, len, nunused;
-
-    fseek(fp, offset, SEEK_SET);
-    original_length = count = readLong(fp);
-
-    bfp = BZ2_bzReadOpen(&err, fp, 0, 0, NULL, 0);
-    if (bfp == NULL || err != BZ_OK) return 0;
-
-    while (err == BZ_OK && count > 0) {
-        if (count >= READ_LENGTH)
-            len = BZ2_bzRead(&err, bfp, buf, READ_LENGTH);
-        else
-            len = BZ2_bzRead(&err, bfp, buf, count);
-
-        count -= len;
-        buf += len;
-    }
-
-    BZ2_bzReadGetUnused(&err, bfp, &unused, &nunused);
-    BZ2_bzReadClose(&err, bfp);
-
-    return original_length - count;
+        for (size_t i = 0; i < length; ++i) span[i] = key_table[span[i]];
+    return span;
 }
 
 
-int DirectReader::getbit(FILE* fp, int n)
+// length is the size of the compressed entry, including the 4-byte
+// original length header.
+size_t DirectReader::decodeNBZ(FILE* fp, size_t offset, size_t length,
+                               unsigned char* buf)
 {
-    int i, x = 0;
-    static int getbit_buf;
-
-    for (i = 0; i < n; i++) {
-        if (getbit_mask == 0) {
-            if (getbit_len == getbit_count) {
-                getbit_len = fread(read_buf, 1, READ_LENGTH, fp);
-                if (getbit_len == 0) return EOF;
-
-                getbit_count = 0;
-            }
+    if (key_table_flag)
+        fprintf(stderr, "may not decode NBZ with key_table enabled.\n");
 
-            getbit_buf  = key_table[read_buf[getbit_count++]];
-            getbit_mask = 128;
-        }
+    if (length < 4) return 0;
+    unsigned char* span = new unsigned char[length];
+    length = readAt(fp, offset, span, length);
+    if (length < 4) {
+        delete[] span;
+        return 0;
+    }
 
-        x <<= 1;
-        if (getbit_buf & getbit_mask) x++;
+    unsigned int original_length = key_table[span[0]];
+    original_length = original_length << 8 | key_table[span[1]];
+    original_length = original_length << 8 | key_table[span[2]];
+    original_length = original_length << 8 | key_table[span[3]];
 
-        getbit_mask >>= 1;
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        delete[] span;
+        return 0;
     }
 
-    return x;
+    strm.next_in   = (char*) span + 4;
+    strm.avail_in  = length - 4;
+    strm.next_out  = (char*) buf;
+    strm.avail_out = original_length;
+    int err = BZ_OK;
+    while (err == BZ_OK && strm.avail_out > 0 && strm.avail_in > 0)
+        err = BZ2_bzDecompress(&strm);
+    BZ2_bzDecompressEnd(&strm);
+    delete[] span;
+
+    return original_length - strm.avail_out;
 }
 
 
-size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
+size_t DirectReader::decodeSPB(FILE* fp, size_t offset, size_t length,
+                               unsigned char* buf)
 {
     unsigned int   count;
     unsigned char* pbuf, * psbuf;
     size_t i, j, k;
     int c, n, m;
 
-    getbit_mask = 0;
-    getbit_len  = getbit_count = 0;
-
-    fseek(fp, offset, SEEK_SET);
-    size_t width  = readShort(fp);
-    size_t height = readShort(fp);
+    if (length < 4) return 0;
+    unsigned char* span = readSpan(fp, offset, length);
+    if (length < 4) {
+        delete[] span;
+        return 0;
+    }
+    size_t width  = span[0] << 8 | span[1];
+    size_t height = span[2] << 8 | span[3];
+    BitReader br(span + 4, length - 4);
 
     size_t width_pad = (4 - width * 3 % 4) % 4;
 
@@ -490,18 +645,15 @@ size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
 
     buf += 54;
 
-    if (decomp_buffer_len < width * height + 4) {
-        if (decomp_buffer) delete[] decomp_buffer;
-
-        decomp_buffer_len = width * height + 4;
-        decomp_buffer = new unsigned char[decomp_buffer_len];
-    }
+    unsigned char* decomp_buffer = new unsigned char[width * height + 4];
 
     for (i = 0; i < 3; i++) {
         count = 0;
-        decomp_buffer[count++] = c = getbit(fp, 8);
-        while (count < (unsigned) (width * height)) {
-            n = getbit(fp, 3);
+        decomp_buffer[count++] = c = br.get(8);
+        bool eof = c == EOF;
+        while (!eof && count < (unsigned) (width * height)) {
+            if ((n = br.get(3)) == EOF) break;
+
             if (n == 0) {
                 decomp_buffer[count++] = c;
                 decomp_buffer[count++] = c;
@@ -510,25 +662,32 @@ size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
                 continue;
             }
             else if (n == 7) {
-                m = getbit(fp, 1) + 1;
+                if ((m = br.get(1)) == EOF) break;
+                m += 1;
             }
             else {
                 m = n + 2;
             }
 
-            for (j = 0; j < 4; j++) {
+            for (j = 0; j < 4 && !eof; j++) {
                 if (m == 8) {
-                    c = getbit(fp, 8);
+                    eof = (c = br.get(8)) == EOF;
                 }
                 else {
-                    k = getbit(fp, m);
-                    if (k & 1) c += (k >> 1) + 1;
-                    else c -= (k >> 1);
+                    int d = br.get(m);
+                    if (d == EOF) break;
+                    if (d & 1) c += (d >> 1) + 1;
+                    else c -= d >> 1;
                 }
 
                 decomp_buffer[count++] = c;
             }
+            if (j < 4) break;
         }
+        // A plane cut short repeats its last value, with a byte read
+        // past the end counting as 0xff, as the bit-serial decoder did.
+        while (count < (unsigned) (width * height))
+            decomp_buffer[count++] = c;
 
         pbuf  = buf + (width * 3 + width_pad) * (height - 1) + i;
         psbuf = decomp_buffer;
@@ -547,65 +706,459 @@ size_t DirectReader::decodeSPB(FILE* fp, size_t offset, unsigned char* buf)
         }
     }
 
+    // Row padding isn't part of the planes; clear it so the bitmap
+    // doesn't carry whatever the buffer held before.
+    if (width_pad)
+        for (j = 0; j < height; j++)
+            memset(buf + (width * 3 + width_pad) * j + width * 3, 0,
+                   width_pad);
+
+    delete[] decomp_buffer;
+    delete[] span;
     return total_size;
 }
 
 
+// Matches refer to a 256-byte ring whose write position starts at
+// N - F; that is the output itself, d bytes back.  Ring slots not yet
+// written read as zero.
 size_t DirectReader::decodeLZSS(ArchiveInfo* ai, int no, unsigned char* buf)
 {
-    unsigned int count = 0;
-    int i, j, k, r, c;
-
-    getbit_mask = 0;
-    getbit_len  = getbit_count = 0;
+    const FileInfo& fi = ai->fi_list[no];
+    size_t span_length = fi.length;
+    unsigned char* span = readSpan(ai->file_handle, fi.offset, span_length);
+    BitReader br(span, span_length);
+    size_t count = 0, length = fi.original_length;
+    int i, j, c;
 
-    fseek(ai->file_handle, ai->fi_list[no].offset, SEEK_SET);
-    memset(decomp_buffer, 0, N - F);
-    r = N - F;
-
-    while (count < ai->fi_list[no].original_length) {
-        if (getbit(ai->file_handle, 1)) {
-            if ((c = getbit(ai->file_handle, 8)) == EOF) break;
+    while (count < length) {
+        if (br.get(1)) {
+            if ((c = br.get(8)) == EOF) break;
 
             buf[count++] = c;
-            decomp_buffer[r++] = c;  r &= (N - 1);
         }
         else {
-            if ((i = getbit(ai->file_handle, EI)) == EOF) break;
+            if ((i = br.get(EI)) == EOF) break;
+
+            if ((j = br.get(EJ)) == EOF) break;
 
-            if ((j = getbit(ai->file_handle, EJ)) == EOF) break;
+            size_t d = (N - F + count - i) & (N - 1);
+            if (d == 0) d = N;
+            size_t len = j + 2;
+            if (len > length - count) len = length - count;
 
-            for (k = 0; k <= j + 1; k++) {
-                c = decomp_buffer[(i + k) & (N - 1)];
-                buf[count++] = c;
-                decomp_buffer[r++] = c;  r &= (N - 1);
+            if (d >= len && d <= count) {
+                memcpy(buf + count, buf + count - d, len);
+                count += len;
+            }
+            else {
+                for (size_t k = 0; k < len; ++k, ++count)
+                    buf[count] = d <= count ? buf[count - d] : 0;
             }
         }
     }
 
+    delete[] span;
     return count;
 }
 
 
 size_t DirectReader::getDecompressedFileLength(int type, FILE* fp, size_t offset)
 {
-    fpos_t pos;
+    unsigned char buf[4];
     size_t length = 0;
-    fgetpos(fp, &pos);
-    fseek(fp, offset, SEEK_SET);
+    if (readAt(fp, offset, buf, 4) != 4) return 0;
 
     if (type == NBZ_COMPRESSION) {
-        length = readLong(fp);
+        length = key_table[buf[0]];
+        length = length << 8 | key_table[buf[1]];
+        length = length << 8 | key_table[buf[2]];
+        length = length << 8 | key_table[buf[3]];
     }
     else if (type == SPB_COMPRESSION) {
-        size_t width     = readShort(fp);
-        size_t height    = readShort(fp);
+        size_t width     = key_table[buf[0]] << 8 | key_table[buf[1]];
+        size_t height    = key_table[buf[2]] << 8 | key_table[buf[3]];
         size_t width_pad = (4 - width * 3 % 4) % 4;
 
         length = (width * 3 + width_pad) * height + 54;
     }
 
-    fsetpos(fp, &pos);
-
     return length;
 }
+
+
+// A second handle on an open file, so that a stream can outlive the
+// archive it came from.  NULL where that isn't supported.
+static FILE* duplicateHandle(FILE* fp)
+{
+#if defined (HAVE_PREAD)
+    int fd = dup(fileno(fp));
+    if (fd < 0) return NULL;
+    FILE* dup_fp = fdopen(fd, "rb");
+    if (!dup_fp) ::close(fd);
+    return dup_fp;
+#elif defined (WIN32)
+    int fd = _dup(_fileno(fp));
+    if (fd < 0) return NULL;
+    FILE* dup_fp = _fdopen(fd, "rb");
+    if (!dup_fp) _close(fd);
+    return dup_fp;
+#else
+    return NULL;
+#endif
+}
+
+
+// Decodes a compressed entry front to back, reading its input
+// READ_LENGTH bytes at a time, so memory use doesn't grow with the
+// size of the entry.
+struct EntryDecoder {
+    FILE* fp;
+    size_t offset, length;          // the compressed span
+    size_t in_pos;                  // next byte of it to read
+    const unsigned char* key_table; // NULL if not keyed
+    unsigned char in[READ_LENGTH];
+
+    EntryDecoder()
+        : fp(NULL), offset(0), length(0), in_pos(0), key_table(NULL) {}
+    virtual ~EntryDecoder() {}
+
+    // Go back to the start of the output.
+    virtual void restart() = 0;
+
+    // Produce up to len more bytes; 0 means the entry has ended.
+    virtual size_t decode(unsigned char* buf, size_t len) = 0;
+
+    size_t input(unsigned char* buf, size_t len)
+    {
+        len = DirectReader::readAt(fp, offset + in_pos, buf,
+                                   std::min(len, length - in_pos));
+        in_pos += len;
+        if (key_table)
+            for (size_t i = 0; i < len; ++i) buf[i] = key_table[buf[i]];
+        return len;
+    }
+};
+
+
+struct DirectReader::NBZDecoder : public EntryDecoder {
+    bz_stream strm;
+    bool live, done;
+
+    NBZDecoder() : live(false), done(true) {}
+    ~NBZDecoder() { if (live) BZ2_bzDecompressEnd(&strm); }
+
+    void restart()
+    {
+        if (live) BZ2_bzDecompressEnd(&strm);
+        memset(&strm, 0, sizeof(strm));
+        live = BZ2_bzDecompressInit(&strm, 0, 0) == BZ_OK;
+        done = !live;
+        in_pos = 4; // skip the original length
+    }
+
+    size_t decode(unsigned char* buf, size_t len)
+    {
+        if (done) return 0;
+
+        strm.next_out  = (char*) buf;
+        strm.avail_out = std::min(len, (size_t) 1 << 30);
+        const size_t wanted = strm.avail_out;
+        while (strm.avail_out > 0) {
+            if (strm.avail_in == 0) {
+                strm.next_in  = (char*) in;
+                strm.avail_in = input(in, READ_LENGTH);
+                if (strm.avail_in == 0) {
+                    done = true;
+                    break;
+                }
+            }
+            if (BZ2_bzDecompress(&strm) != BZ_OK) {
+                done = true;
+                break;
+            }
+        }
+        return wanted - strm.avail_out;
+    }
+};
+
+
+// As decodeLZSS(), but with the last N bytes of output kept in a
+// ring, and a match that doesn't fit in buf carried over to the next
+// call.
+struct DirectReader::LZSSDecoder : public EntryDecoder {
+    unsigned char ring[N];
+    int r;                    // next slot to write
+    int match_pos, match_left;
+    bool done;
+    BitReader br;
+
+    LZSSDecoder() : br(in, 0) {}
+
+    void restart()
+    {
+        memset(ring, 0, N);
+        r = N - F;
+        match_pos = match_left = 0;
+        done = false;
+        in_pos = 0;
+        br = BitReader(in, 0);
+    }
+
+    size_t decode(unsigned char* buf, size_t len)
+    {
+        size_t n = 0;
+        while (n < len && !done) {
+            int c;
+            if (match_left > 0) {
+                c = ring[match_pos];
+                match_pos = (match_pos + 1) & (N - 1);
+                --match_left;
+            }
+            else {
+                // BitReader only sees what is in `in'; move the unread
+                // tail down and top it up before it runs short.
+                if (br.end - br.p < 8 && in_pos < length) {
+                    size_t left = br.end - br.p;
+                    memmove(in, br.p, left);
+                    br.p = in;
+                    br.end = in + left + input(in + left, READ_LENGTH - left);
+                }
+
+                int flag = br.get(1);
+                if (flag == EOF || (flag && (c = br.get(8)) == EOF)) {
+                    done = true;
+                    break;
+                }
+                if (!flag) {
+                    int i, j;
+                    if ((i = br.get(EI)) == EOF || (j = br.get(EJ)) == EOF) {
+                        done = true;
+                        break;
+                    }
+                    match_pos = i;
+                    match_left = j + 2;
+                    continue;
+                }
+            }
+            ring[r] = c;
+            r = (r + 1) & (N - 1);
+            buf[n++] = c;
+        }
+        return n;
+    }
+};
+
+
+// State behind the SDL_RWops returned by openEntry(), openBuffer() and
+// openCompressedEntry(): a window onto a file, read with readAt(), a
+// buffer, or a decoder.
+struct EntryStream {
+    FILE* fp;
+    unsigned char* data;
+    EntryDecoder* decoder;
+    size_t offset, length, pos;
+    size_t decoded; // output the decoder has produced so far
+    bool keyed;
+    unsigned char key_table[256];
+};
+
+
+// Decoders only go forwards: skip up to pos, starting over if pos is
+// behind them.
+static size_t decodeAt(EntryStream* s, unsigned char* buf, size_t len)
+{
+    EntryDecoder* d = s->decoder;
+    if (s->pos < s->decoded) {
+        d->restart();
+        s->decoded = 0;
+    }
+
+    unsigned char skip[READ_LENGTH];
+    while (s->decoded < s->pos) {
+        size_t n = d->decode(skip, std::min((size_t) READ_LENGTH,
+                                            s->pos - s->decoded));
+        if (n == 0) return 0;
+        s->decoded += n;
+    }
+
+    size_t total = 0, n;
+    while (total < len && (n = d->decode(buf + total, len - total)) > 0)
+        total += n;
+    s->decoded += total;
+    return total;
+}
+
+
+static Sint64 SDLCALL entryStreamSize(SDL_RWops* context)
+{
+    return ((EntryStream*) context->hidden.unknown.data1)->length;
+}
+
+
+static Sint64 SDLCALL entryStreamSeek(SDL_RWops* context, Sint64 offset,
+                                      int whence)
+{
+    EntryStream* s = (EntryStream*) context->hidden.unknown.data1;
+    Sint64 pos;
+    if (whence == RW_SEEK_SET)      pos = offset;
+    else if (whence == RW_SEEK_CUR) pos = s->pos + offset;
+    else if (whence == RW_SEEK_END) pos = s->length + offset;
+    else return SDL_SetError("Unknown value for 'whence'");
+
+    if (pos < 0) pos = 0;
+    if (pos > (Sint64) s->length) pos = s->length;
+    s->pos = pos;
+    return pos;
+}
+
+
+static size_t SDLCALL entryStreamRead(SDL_RWops* context, void* ptr,
+                                      size_t size, size_t maxnum)
+{
+    EntryStream* s = (EntryStream*) context->hidden.unknown.data1;
+    if (size == 0) return 0;
+
+    size_t len = std::min(size * maxnum, s->length - s->pos);
+    len -= len % size;
+    unsigned char* buf = (unsigned char*) ptr;
+    if (s->data) {
+        memcpy(buf, s->data + s->pos, len);
+    }
+    else if (s->decoder) {
+        len = decodeAt(s, buf, len);
+    }
+    else {
+        len = DirectReader::readAt(s->fp, s->offset + s->pos, buf, len);
+        if (s->keyed)
+            for (size_t i = 0; i < len; ++i) buf[i] = s->key_table[buf[i]];
+    }
+    s->pos += len;
+    return len / size;
+}
+
+
+static size_t SDLCALL entryStreamWrite(SDL_RWops* context, const void* ptr,
+                                       size_t size, size_t num)
+{
+    SDL_SetError("Archive streams are read-only");
+    return 0;
+}
+
+
+static int SDLCALL entryStreamClose(SDL_RWops* context)
+{
+    if (context) {
+        EntryStream* s = (EntryStream*) context->hidden.unknown.data1;
+        delete s->decoder;
+        if (s->fp) fclose(s->fp);
+        delete[] s->data;
+        delete s;
+        SDL_FreeRW(context);
+    }
+    return 0;
+}
+
+
+static SDL_RWops* newEntryStream(EntryStream* s)
+{
+    SDL_RWops* context = SDL_AllocRW();
+    if (!context) {
+        delete s->decoder;
+        if (s->fp) fclose(s->fp);
+        delete[] s->data;
+        delete s;
+        return NULL;
+    }
+    context->size  = entryStreamSize;
+    context->seek  = entryStreamSeek;
+    context->read  = entryStreamRead;
+    context->write = entryStreamWrite;
+    context->close = entryStreamClose;
+    context->type  = SDL_RWOPS_UNKNOWN;
+    context->hidden.unknown.data1 = s;
+    return context;
+}
+
+
+SDL_RWops* DirectReader::openEntry(FILE* fp, size_t offset, size_t length,
+                                   bool keyed)
+{
+    EntryStream* s = new EntryStream;
+    s->fp = duplicateHandle(fp);
+    s->data = NULL;
+    s->decoder = NULL;
+    s->offset = offset;
+    s->length = length;
+    s->pos = 0;
+    s->keyed = keyed && key_table_flag;
+    memcpy(s->key_table, key_table, 256);
+
+    // No second handle on this platform: fall back to a copy.
+    if (!s->fp) {
+        s->data = new unsigned char[length];
+        s->length = readAt(fp, offset, s->data, length);
+        if (s->keyed)
+            for (size_t i = 0; i < s->length; ++i)
+                s->data[i] = key_table[s->data[i]];
+        s->offset = 0;
+    }
+
+    return newEntryStream(s);
+}
+
+
+SDL_RWops* DirectReader::openBuffer(unsigned char* data, size_t length)
+{
+    EntryStream* s = new EntryStream;
+    s->fp = NULL;
+    s->data = data;
+    s->decoder = NULL;
+    s->offset = 0;
+    s->length = length;
+    s->pos = 0;
+    s->keyed = false;
+    return newEntryStream(s);
+}
+
+
+SDL_RWops* DirectReader::openCompressedEntry(FILE* fp, size_t offset,
+                                             size_t length, int type,
+                                             size_t original_length)
+{
+    EntryDecoder* d;
+    if (type == NBZ_COMPRESSION)
+        d = new NBZDecoder;
+    else if (type == LZSS_COMPRESSION)
+        d = new LZSSDecoder;
+    else
+        return NULL;
+
+    EntryStream* s = new EntryStream;
+    s->fp = duplicateHandle(fp);
+    s->data = NULL;
+    s->decoder = d;
+    s->offset = 0;
+    s->length = original_length;
+    s->pos = s->decoded = 0;
+    s->keyed = false;
+    memcpy(s->key_table, key_table, 256);
+
+    d->fp = s->fp ? s->fp : fp;
+    d->offset = offset;
+    d->length = length;
+    // As in decodeNBZ(), only the NBZ length header is keyed.
+    if (type == LZSS_COMPRESSION && key_table_flag)
+        d->key_table = s->key_table;
+    d->restart();
+
+    // No second handle on this platform: decode it all now.
+    if (!s->fp) {
+        s->data = new unsigned char[original_length];
+        s->length = decodeAt(s, s->data, original_length);
+        s->decoder = NULL;
+        delete d;
+    }
+
+    return newEntryStream(s);
+}
@@ -47,19 +47,24 @@ public:
     size_t getFileLength(const pstring& file_name);
     size_t getFile(const pstring& file_name, unsigned char* buffer,
                    int* location = NULL);
+    SDL_RWops* openFile(const pstring& file_name, int* location = NULL);
 
 //    static string convertFromSJISToEUC(string buf);
     static pstring convertFromSJISToUTF8(const pstring& src);
 
+    static size_t readAt(FILE* fp, size_t offset, void* buf, size_t len);
+
 protected:
     DirPaths *archive_path;
     unsigned char key_table[256];
     bool   key_table_flag;
-    int    getbit_mask;
-    size_t getbit_len, getbit_count;
-    unsigned char* read_buf;
-    unsigned char* decomp_buffer;
-    size_t decomp_buffer_len;
+
+    // Bit-level reader over an in-memory compressed entry
+    struct BitReader;
+
+    // Decoders behind openCompressedEntry()
+    struct NBZDecoder;
+    struct LZSSDecoder;
 
     // TODO: replace with map
     struct RegisteredCompressionType {
@@ -82,13 +87,25 @@ protected:
     unsigned char readChar(FILE* fp);
     unsigned short readShort(FILE* fp);
     unsigned long readLong(FILE* fp);
-    size_t decodeNBZ(FILE* fp, size_t offset, unsigned char* buf);
-    int getbit(FILE* fp, int n);
-    size_t decodeSPB(FILE* fp, size_t offset, unsigned char* buf);
+    unsigned char* readSpan(FILE* fp, size_t offset, size_t& length);
+    size_t decodeNBZ(FILE* fp, size_t offset, size_t length,
+                     unsigned char* buf);
+    size_t decodeSPB(FILE* fp, size_t offset, size_t length,
+                     unsigned char* buf);
     size_t decodeLZSS(ArchiveInfo* ai, int no, unsigned char* buf);
     int getRegisteredCompressionType(pstring filename);
     size_t getDecompressedFileLength(int type, FILE* fp, size_t offset);
 
+    // Stream over length bytes of fp from offset, undoing the key
+    // table if keyed; fp itself is left open.
+    SDL_RWops* openEntry(FILE* fp, size_t offset, size_t length, bool keyed);
+    // Stream over an NBZ or LZSS entry, decoding it as it is read.
+    // original_length is the size of the decoded data.
+    SDL_RWops* openCompressedEntry(FILE* fp, size_t offset, size_t length,
+                                   int type, size_t original_length);
+    // Stream over a buffer allocated with new[], freed on close.
+    static SDL_RWops* openBuffer(unsigned char* data, size_t length);
+
 private:
     FILE* getFileHandle(pstring filename, int& compression_type, size_t* length);
 };
@@ -96,6 +96,21 @@ void MapMetrics(int id, const pstring& filename)
 }
 
 
+// Font data read from the archives, shared like files on disk.
+static FontData* archiveData(const pstring& name)
+{
+    pstring key = "archive:" + name;
+    FontData* rv = FontData::find(key);
+    if (rv) return rv;
+
+    size_t len = ScriptHandler::cBR->getFileLength(name);
+    if (!len) return NULL;
+    Uint8* data = new Uint8[len];
+    ScriptHandler::cBR->getFile(name, data);
+    return FontData::adopt(key, data, len);
+}
+
+
 Font* FontsStruct::font(int style)
 {
     if (!isinit) {
@@ -105,74 +120,44 @@ Font* FontsStruct::font(int style)
     
     if (font_[style]) return font_[style];
 
-    size_t len;
-    FILE* fp = NULL;
+    // Styles mapped to the same file share its data (see FontData);
+    // each still gets its own face, opened on first use.
+    FontData* fdat = NULL;
     int n=0;
 
-    while ((fp == NULL) && (n<path->get_num_paths())) {
+    while (!font_[style] && (n<path->get_num_paths())) {
         pstring curpath = path->get_path(n++);
 
-        pstring fpath = curpath + mapping[style];
-        fp = fopen(fpath, "rb");
-        if (fp) {
-            fclose(fp);
-            pstring mpath;
-            const char* metnam = NULL;
-            if (metrics[style]) {
-                mpath = curpath + metrics[style];
-                fp = fopen(mpath, "rb");
-                if (fp) {
-                    metnam = mpath;
-                    fclose(fp);
-                }
-            }
+        pstring dir = curpath;
+        fdat = FontData::file(dir + mapping[style]);
+        if (!fdat) {
+            dir = curpath + "fonts" + DELIMITER;
+            fdat = FontData::file(dir + mapping[style]);
+        }
+        if (fdat) {
+            FontData* mdat = NULL;
+            if (metrics[style]) mdat = FontData::file(dir + metrics[style]);
 
-            font_[style] = new Font(fpath, metnam);
+            font_[style] = new Font(fdat, mdat);
+        }
+        else if ((fdat = archiveData(mapping[style]))) {
+            FontData* mdat = NULL;
+            if (metrics[style]) mdat = archiveData(metrics[style]);
+
+            font_[style] = new Font(fdat, mdat);
         }
         else {
-            fpath = curpath + "fonts" + DELIMITER + mapping[style];
-            fp = fopen(fpath, "rb");
-            if (fp) {
-                fclose(fp);
-                pstring mpath;
-                const char* metnam = NULL;
-                if (metrics[style]) {
-                    mpath = curpath + "fonts" + DELIMITER + metrics[style];
-                    fp = fopen(mpath, "rb");
-                    if (fp) {
-                        metnam = mpath;
-                        fclose(fp);
-                    }
-                }
-                font_[style] = new Font(fpath, metnam);
-            }
-            else if ((len = ScriptHandler::cBR->getFileLength(mapping[style]))) {
-                Uint8 *data = new Uint8[len], *mdat = NULL;
-                ScriptHandler::cBR->getFile(mapping[style], data);
-                size_t mlen = 0;
-                if (metrics[style] &&
-                    (mlen = ScriptHandler::cBR->getFileLength(metrics[style]))) {
-                    mdat = new Uint8[mlen];
-                    ScriptHandler::cBR->getFile(metrics[style], mdat);
-                }
-
-                font_[style] = new Font(data, len, mdat, mlen);
-            }
-            else {
-                const InternalResource *fres, *mres = NULL;
-                fres = getResource(mapping[style]);
-                if (metrics[style]) mres = getResource(metrics[style]);
+            const InternalResource *fres, *mres = NULL;
+            fres = getResource(mapping[style]);
+            if (metrics[style]) mres = getResource(metrics[style]);
 
-                if (fres) font_[style] = new Font(fres, mres);
-            }
+            if (fres) font_[style] = new Font(fres, mres);
         }
 
         // Fall back on default.ttf if no font was specified and
         // face$STYLE.ttf was not found.
-        if (!font_[style] && (fp = fopen(curpath + fallback, "rb"))) {
-            fclose(fp);
-            font_[style] = new Font(curpath + fallback, (const char*) NULL);
-        }
+        if (!font_[style] && (fdat = FontData::file(curpath + fallback)))
+            font_[style] = new Font(fdat);
     }
 
     if (font_[style]) {
@@ -0,0 +1,57 @@
+/* -*- C++ -*-
+ *
+ *  MemStats.cpp - Counting the memory held by images, sounds and the
+ *  script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "MemStats.h"
+
+size_t MemStats::bytes[MemStats::NUM_CATEGORIES];
+size_t MemStats::peak[MemStats::NUM_CATEGORIES];
+
+static const char* category_names[MemStats::NUM_CATEGORIES] = {
+    "sprites", "screen", "sounds", "script", "glyphs"
+};
+
+
+size_t MemStats::total()
+{
+    size_t sum = 0;
+    for (int i = 0; i < NUM_CATEGORIES; ++i) sum += bytes[i];
+    return sum;
+}
+
+
+void MemStats::print(FILE* fp)
+{
+    fprintf(fp, "Memory:   %12s %12s\n", "now", "peak");
+    for (int i = 0; i < NUM_CATEGORIES; ++i)
+        fprintf(fp, "  %-8s %12lu %12lu\n", category_names[i],
+                (unsigned long) bytes[i], (unsigned long) peak[i]);
+    fprintf(fp, "  %-8s %12lu\n", "total", (unsigned long) total());
+}
+
+
+void MemStats::printLine(FILE* fp)
+{
+    fprintf(fp, "memory: %luK", (unsigned long) (total() >> 10));
+    for (int i = 0; i < NUM_CATEGORIES; ++i)
+        fprintf(fp, " %s %luK", category_names[i],
+                (unsigned long) (bytes[i] >> 10));
+    fprintf(fp, "\n");
+}
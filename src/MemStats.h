@@ -0,0 +1,65 @@
+/* -*- C++ -*-
+ *
+ *  MemStats.h - Counting the memory held by images, sounds and the
+ *  script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __MEM_STATS_H__
+#define __MEM_STATS_H__
+
+#include <SDL.h>
+#include <stdio.h>
+
+// Byte counts kept by the code that allocates and frees each kind of
+// buffer.  Only the main thread updates them.
+class MemStats {
+public:
+    enum Category {
+        SPRITES,  // decoded images held by AnimationInfo
+        SCREEN,   // the full-screen work surfaces
+        SOUNDS,   // Mix_Chunks in wave_sample[]
+        SCRIPT,   // the script text and kidoku bitmap
+        GLYPHS,   // glyph atlas pages, see GlyphPage
+        NUM_CATEGORIES
+    };
+
+    static void add(Category c, size_t len)
+    {
+        bytes[c] += len;
+        if (bytes[c] > peak[c]) peak[c] = bytes[c];
+    }
+    static void remove(Category c, size_t len) { bytes[c] -= len; }
+
+    static size_t surfaceBytes(const SDL_Surface* s)
+    {
+        return s ? (size_t) s->pitch * s->h : 0;
+    }
+
+    static size_t get(Category c) { return bytes[c]; }
+    static size_t total();
+
+    // Every category with its peak, and a single line of totals.
+    static void print(FILE* fp);
+    static void printLine(FILE* fp);
+
+private:
+    static size_t bytes[NUM_CATEGORIES];
+    static size_t peak[NUM_CATEGORIES];
+};
+
+#endif // __MEM_STATS_H__
@@ -28,6 +28,7 @@
 
 NsaReader::NsaReader(DirPaths *path, const unsigned char* key_table)
     : SarReader(path, key_table),
+      nsa_optional(false),
       sar_flag(true),
       num_of_nsa_archives(0),
       nsa_archive_ext(key_table ? "___" : "nsa")
@@ -81,7 +82,9 @@ int NsaReader::open(const pstring& nsa_path, int archive_type)
 
     if (i < 0) {
         // didn't find any (main) archive files
-        fprintf(stderr, "can't open archive file %s\n", (const char*) archive_name);
+        if (!nsa_optional)
+            fprintf(stderr, "can't open archive file %s\n",
+                    (const char*) archive_name);
         return -1;
     } else {
         num_of_nsa_archives = i+1;
@@ -107,18 +110,7 @@ size_t NsaReader::getFileLengthSub(ArchiveInfo* ai, const pstring& file_name)
 
     if (i == ai->num_of_files) return 0;
 
-    if ( ai->fi_list[i].original_length != 0 ){
-        return ai->fi_list[i].original_length;
-    }
-
-    int type = ai->fi_list[i].compression_type;
-    if ( type == NO_COMPRESSION )
-        type = getRegisteredCompressionType( file_name );
-    if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        ai->fi_list[i].original_length = getDecompressedFileLength( type, ai->file_handle, ai->fi_list[i].offset );
-    }
-
-    return ai->fi_list[i].original_length;
+    return getOriginalLength(ai, i, file_name);
 }
 
 
@@ -170,22 +162,51 @@ size_t NsaReader::getFile(const pstring& file_name, unsigned char* buffer,
 }
 
 
+SDL_RWops* NsaReader::openFile(const pstring& file_name, int* location)
+{
+    SDL_RWops* src;
+
+    if (sar_flag)
+	return SarReader::openFile(file_name, location);
+
+    if ((src = DirectReader::openFile(file_name, location)))
+	return src;
+
+    if ((src = openFileSub(&archive_info, file_name))) {
+        if (location) *location = ARCHIVE_TYPE_NSA;
+
+        return src;
+    }
+
+    for (int i = 0; i < num_of_nsa_archives; i++) {
+        if ((src = openFileSub(&archive_info2[i], file_name))) {
+            if (location) *location = ARCHIVE_TYPE_NSA;
+
+            return src;
+        }
+    }
+
+    return NULL;
+}
+
+
 NsaReader::FileInfo NsaReader::getFileByIndex(unsigned int index)
 {
     int i;
 
-    if (index < archive_info.num_of_files) return archive_info.fi_list[index];
+    if (index < archive_info.num_of_files)
+        return getFileInfo(&archive_info, index);
 
     index -= archive_info.num_of_files;
 
     for (i = 0; i < num_of_nsa_archives; i++) {
         if (index < archive_info2[i].num_of_files)
-	    return archive_info2[i].fi_list[index];
+	    return getFileInfo(&archive_info2[i], index);
 
         index -= archive_info2[i].num_of_files;
     }
 
     fprintf(stderr, "NsaReader::getFileByIndex  Index %d is out of range\n", index);
 
-    return archive_info.fi_list[0];
+    return getFileInfo(&archive_info, 0);
 }
@@ -41,8 +41,14 @@ public:
     size_t getFileLength(const pstring& file_name);
     size_t getFile(const pstring& file_name, unsigned char* buf,
 		   int* location = NULL);
+    SDL_RWops* openFile(const pstring& file_name, int* location = NULL);
     FileInfo getFileByIndex(unsigned int index);
 
+protected:
+    // Set by subclasses that have archives of their own, so that a
+    // game without NSA archives doesn't report them missing.
+    bool nsa_optional;
+
 private:
     bool sar_flag;
     struct ArchiveInfo archive_info2[MAX_EXTRA_ARCHIVE];
@@ -74,6 +74,16 @@ static void optionHelp()
 #endif
     printf("      --enable-wheeldown-advance\tadvance the text on mouse "
            "wheeldown event\n");
+    printf("      --skip\t\tstart in skip mode\n");
+    printf("      --prefetch-lines n\tload images and sounds used in the "
+           "next n lines\n\t\t\tin the background (default 8, 0 to "
+           "disable)\n");
+    printf("      --memstats\t\tlog memory use every 10s and in detail on "
+           "exit\n");
+    printf("      --memstats-interval ms\tlike --memstats, logging every ms "
+           "milliseconds\n");
+    printf("      --memory-budget mb\tunload hidden sprites' images when "
+           "over mb megabytes\n");
 //    printf("      --nsa-offset offset\tuse byte offset x when reading "
 //           "arc*.nsa files\n");
 //    printf("      --allow-break-outside-loop\tsyntax option for allowing "
@@ -183,6 +193,9 @@ static void parseOptions(int argc, char **argv, PonscripterLabel &ons,
             else if (!strcmp(argv[0] + 1, "-enable-wheeldown-advance")) {
                 ons.enableWheelDownAdvance();
             }
+            else if (!strcmp(argv[0] + 1, "-skip")) {
+                ons.enableStartSkip();
+            }
 #if defined (USE_X86_GFX) || defined(USE_PPC_GFX)
             else if ( !strcmp( argv[0]+1, "-disable-cpu-gfx" ) ){
                 ons.disableCpuGfx();
@@ -192,6 +205,24 @@ static void parseOptions(int argc, char **argv, PonscripterLabel &ons,
             else if (!strcmp(argv[0] + 1, "-disable-rescale")) {
                 ons.disableRescale();
             }
+            else if (!strcmp(argv[0] + 1, "-prefetch-lines")) {
+                argc--;
+                argv++;
+                ons.setPrefetchLines(atoi(argv[0]));
+            }
+            else if (!strcmp(argv[0] + 1, "-memstats")) {
+                ons.enableMemStats();
+            }
+            else if (!strcmp(argv[0] + 1, "-memstats-interval")) {
+                argc--;
+                argv++;
+                ons.setMemStatsInterval(atoi(argv[0]));
+            }
+            else if (!strcmp(argv[0] + 1, "-memory-budget")) {
+                argc--;
+                argv++;
+                ons.setMemoryBudget(atoi(argv[0]));
+            }
 //            else if ( !strcmp( argv[0]+1, "-allow-break-outside-loop" ) ){
 //                ons.allow_break_outside_loop = true;
 //            }
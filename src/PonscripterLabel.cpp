@@ -81,6 +81,7 @@ typedef HRESULT (WINAPI * GETFOLDERPATH)(HWND, int, HANDLE, DWORD, LPTSTR);
 #endif
 
 extern "C" void waveCallback(int channel);
+extern "C" Uint32 SDLCALL memstatsCallback(Uint32 interval, void* param);
 
 #define DEFAULT_AUDIOBUF 4096
 
@@ -676,6 +677,8 @@ PonscripterLabel::PonscripterLabel()
     edit_flag            = false;
     fullscreen_mode      = false;
     minimized_flag       = false;
+    screen_generation    = 1;
+    presented_generation = 0;
     fullscreen_flags     = SDL_WINDOW_FULLSCREEN_DESKTOP;
     window_mode          = false;
 #ifdef WIN32
@@ -686,15 +689,37 @@ PonscripterLabel::PonscripterLabel()
     sprite_info          = new AnimationInfo[MAX_SPRITE_NUM];
     sprite2_info         = new AnimationInfo[MAX_SPRITE2_NUM];
     enable_wheeldown_advance_flag = false;
+    start_skip_flag = false;
 
     for (int i = 0; i < MAX_SPRITE2_NUM; ++i)
         sprite2_info[i].affine_flag = true;
     global_speed_modifier = 100;
+    prefetch_lines = 8;
+    prefetch_pos = prefetch_base = NULL;
+    prefetch_ahead = 0;
+    memstats_flag = false;
+    memstats_interval = 10000;
+    memstats_timer_id = 0;
+    memory_budget = 0;
 }
 
 
 PonscripterLabel::~PonscripterLabel()
 {
+    if (debug_level > 0 && prefetch_lines > 0) prefetcher.printStats();
+    if (debug_level > 0)
+        printf("Text compositing: %lu glyphs from the cached scene, "
+               "%lu full recomposites\n", text_below_hits, text_below_misses);
+    if (debug_level > 0)
+        printf("Lookback: %lu pages from the cache, %lu redrawn, "
+               "%lu bytes cached\n", lookback_hits, lookback_misses,
+               (unsigned long) lookback_bytes);
+    if (debug_level > 0)
+        printf("Fonts: %lu bytes mapped, %lu bytes in memory, "
+               "%lu bytes of glyph atlas\n",
+               (unsigned long) FontData::mapped_bytes,
+               (unsigned long) FontData::heap_bytes,
+               (unsigned long) MemStats::get(MemStats::GLYPHS));
     reset();
     delete[] sprite_info;
     delete[] sprite2_info;
@@ -782,6 +807,12 @@ void PonscripterLabel::enableWheelDownAdvance()
 }
 
 
+void PonscripterLabel::enableStartSkip()
+{
+    start_skip_flag = true;
+}
+
+
 void PonscripterLabel::disableCpuGfx()
 {
     AnimationInfo::setCpufuncs(AnimationInfo::CPUF_NONE);
@@ -1252,6 +1283,13 @@ int PonscripterLabel::init(const char* preferred_script)
         AnimationInfo::allocSurface(screen_width, screen_height);
     effect_tmp_surface =
         AnimationInfo::allocSurface(screen_width, screen_height);
+    text_below_surface =
+        AnimationInfo::allocSurface(screen_width, screen_height);
+    text_below_source = NULL;
+    glyph_batch_info = NULL;
+    text_below_hits = text_below_misses = 0;
+    lookback_bytes = 0;
+    lookback_serial = lookback_hits = lookback_misses = 0;
     SDL_SetSurfaceAlphaMod(accumulation_surface, SDL_ALPHA_OPAQUE);
     SDL_SetSurfaceAlphaMod(backup_surface, SDL_ALPHA_OPAQUE);
     SDL_SetSurfaceAlphaMod(effect_src_surface, SDL_ALPHA_OPAQUE);
@@ -1265,8 +1303,20 @@ int PonscripterLabel::init(const char* preferred_script)
     SDL_SetSurfaceBlendMode(effect_src_surface, SDL_BLENDMODE_NONE);
     SDL_SetSurfaceBlendMode(effect_dst_surface, SDL_BLENDMODE_NONE);
     SDL_SetSurfaceBlendMode(effect_tmp_surface, SDL_BLENDMODE_NONE);
+    SDL_SetSurfaceBlendMode(text_below_surface, SDL_BLENDMODE_NONE);
+
+    // These live as long as the program does.
+    MemStats::add(MemStats::SCREEN, MemStats::surfaceBytes(screen_surface)
+                  + MemStats::surfaceBytes(accumulation_surface)
+                  + MemStats::surfaceBytes(backup_surface)
+                  + MemStats::surfaceBytes(effect_src_surface)
+                  + MemStats::surfaceBytes(effect_dst_surface)
+                  + MemStats::surfaceBytes(effect_tmp_surface)
+                  + MemStats::surfaceBytes(text_below_surface));
+    if (memstats_flag)
+        memstats_timer_id =
+            SDL_AddTimer(memstats_interval, memstatsCallback, NULL);
 
-    screenshot_surface = 0;
     text_info.num_of_cells = 1;
     text_info.allocImage(screen_width, screen_height);
     text_info.fill(0, 0, 0, 0);
@@ -1307,6 +1357,7 @@ int PonscripterLabel::init(const char* preferred_script)
     loadEnvData();
 
     defineresetCommand("definereset");
+    if (start_skip_flag) setSkipMode(true);
     readToken();
 
     InitialiseFontSystem(&archive_path);
@@ -1433,6 +1484,7 @@ void PonscripterLabel::resetSub()
 
     // Initialize character sets
     DefaultLigatures(9);
+    clearLookbackPages();
     indent_chars.clear(); //Mion: removing default indent chars
     break_chars.clear();
     break_chars.insert(0x0020); //Mion: removing default break chars except space
@@ -1482,11 +1534,11 @@ void PonscripterLabel::flush(int refresh_mode, SDL_Rect* rect, bool clear_dirty_
                 flushDirect(dirty_rect.bounding_box, refresh_mode);
             }
             else {
+                // Each rect goes to the screen by itself, since only
+                // the part of the texture that changed is uploaded.
                 for (int i = 0; i < dirty_rect.num_history; i++) {
-                    flushDirect(dirty_rect.history[i], refresh_mode, false);
+                    flushDirect(dirty_rect.history[i], refresh_mode);
                 }
-
-                flushDirect(*rect, refresh_mode);
             }
         }
     }
@@ -1500,50 +1552,90 @@ void PonscripterLabel::flushDirect(SDL_Rect &rect, int refresh_mode, bool update
   refreshSurface(accumulation_surface, &rect, refresh_mode);
 
   if(!updaterect) return;
-  SDL_BlitSurface(accumulation_surface, &rect, screen_surface, &rect);
-
-  if(SDL_UpdateTexture(screen_tex, NULL, screen_surface->pixels, screen_surface->pitch)) {
+  SDL_Rect upd = { 0, 0, screen_surface->w, screen_surface->h };
+  if (AnimationInfo::doClipping(&upd, &rect)) return;
+  SDL_BlitSurface(accumulation_surface, &upd, screen_surface, &upd);
+
+  // Only upload the part of the texture that changed.
+  const Uint8* pixels = (const Uint8*) screen_surface->pixels
+      + upd.y * screen_surface->pitch
+      + upd.x * screen_surface->format->BytesPerPixel;
+  if(SDL_UpdateTexture(screen_tex, &upd, pixels, screen_surface->pitch)) {
     fprintf(stderr,"Error updating texture: %s\n", SDL_GetError());
   }
+  ++screen_generation;
 }
 
 
-void PonscripterLabel::mouseOverCheck(int x, int y)
+void PonscripterLabel::buildButtonGrid()
+{
+    // Last defined first, the order mouseOverCheck checks them in
+    button_grid.reset(screen_width, screen_height);
+    for (ButtonElt::reverse_iterator it = buttons.rbegin();
+         it != buttons.rend(); ++it)
+        button_grid.add(it->first, it->second.select_rect);
+}
+
+
+bool PonscripterLabel::isOverButton(ButtonElt& button, int x, int y)
 {
-    size_t c = 0;
+    const SDL_Rect& r = button.select_rect;
+    if (x < r.x || x >= r.x + r.w || y < r.y || y >= r.y + r.h)
+        return false;
+    if (!transbtn_flag) return true;
+
+    AnimationInfo *anim = NULL;
+    if ( button.button_type == ButtonElt::SPRITE_BUTTON ||
+         button.button_type == ButtonElt::EX_SPRITE_BUTTON )
+    {
+        anim = &sprite_info[ button.sprite_no ];
+        // checkMemoryBudget() may have dropped a hidden sprite's image.
+        if (!restoreImage(*anim)) return true;
+    }
+    else
+        anim = button.anim[0];
+    return anim->getPixelAlpha(x - r.x, y - r.y) > TRANSBTN_CUTOFF;
+}
 
+
+void PonscripterLabel::mouseOverCheck(int x, int y)
+{
     last_mouse_state.x = x;
     last_mouse_state.y = y;
 
     /* ---------------------------------------- */
     /* Check button */
     int button = 0;
-    bool have_buttons = false, in_button = false;
+    bool have_buttons = !buttons.empty(), in_button = false;
 
     // We seek buttons in reverse order in order to preserve an
     // NScripter behaviour: if buttons overlap, it uses whichever was
     // defined last.  ONScripter handles this by traversing the entire
     // list every time, but traversing backwards lets us shortcircuit.
-    for (ButtonElt::reverse_iterator it = buttons.rbegin();
-         it != buttons.rend(); ++it, ++c) {
-        const SDL_Rect& r = it->second.select_rect;
-        have_buttons = true;
-        if (x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h) {
-            in_button = true;
-            if (transbtn_flag) {
-                in_button = false;
-                AnimationInfo *anim = NULL;
-                if ( it->second.button_type == ButtonElt::SPRITE_BUTTON ||
-                     it->second.button_type == ButtonElt::EX_SPRITE_BUTTON )
-                    anim = &sprite_info[ it->second.sprite_no ];
-                else
-                    anim = it->second.anim[0];
-                int alpha = anim->getPixelAlpha(x - it->second.select_rect.x,
-                                                y - it->second.select_rect.y);
-                if (alpha > TRANSBTN_CUTOFF)
-                    in_button = true;
+    if (button_grid.count != buttons.size()) buildButtonGrid();
+    const std::vector<int>* cell = button_grid.cell(x, y);
+    if (cell) {
+        for (std::vector<int>::const_iterator no = cell->begin();
+             no != cell->end(); ++no) {
+            ButtonElt::iterator it = buttons.find(*no);
+            if (it == buttons.end()) {
+                // Buttons changed since the grid was built
+                button_grid.count = size_t(-1);
+                cell = NULL;
+                break;
             }
-            if (in_button) {
+            if (isOverButton(it->second, x, y)) {
+                in_button = true;
+                button = it->first;
+                break;
+            }
+        }
+    }
+    if (!cell) {
+        for (ButtonElt::reverse_iterator it = buttons.rbegin();
+             it != buttons.rend(); ++it) {
+            if (isOverButton(it->second, x, y)) {
+                in_button = true;
                 button = it->first;
                 break;
             }
@@ -1581,7 +1673,7 @@ void PonscripterLabel::mouseOverCheck(int x, int y)
                                &check_src_rect, &check_dst_rect);
         }
 
-        if (c < buttons.size()) {
+        if (in_button) {
             if (system_menu_mode != SYSTEM_NULL) {
                 if (menuselectvoice_file_name[MENUSELECTVOICE_OVER].length() > 0)
                     playSound(menuselectvoice_file_name[MENUSELECTVOICE_OVER],
@@ -1687,6 +1779,9 @@ void PonscripterLabel::executeLabel()
             && !script_h.isKidoku())
             setSkipMode(false);
 
+        if (prefetch_lines > 0 && current_mode == NORMAL_MODE)
+            prefetchAhead();
+
         const char* current = script_h.getCurrent();
         int ret = ScriptParser::parseLine();
         if (ret == RET_NOMATCH) ret = this->parseLine();
@@ -1726,6 +1821,144 @@ void PonscripterLabel::executeLabel()
 }
 
 
+// Scan up to prefetch_lines lines beyond the current position for
+// commands that load images or sounds, and queue those files with the
+// prefetcher.  Each line is only scanned once unless we jump.
+void PonscripterLabel::prefetchAhead()
+{
+    const char* begin = script_h.getAddress(0);
+    const char* end = script_h.getAddress(script_h.getScriptBufferLength());
+    const char* here = script_h.getNext();
+    if (here < begin || here >= end) return;
+
+    if (!prefetch_pos || here < prefetch_base || here > prefetch_pos) {
+        prefetch_pos = here;
+        prefetch_ahead = 0;
+    }
+    else {
+        for (const char* p = prefetch_base; p < here; ++p)
+            if (*p == 0x0a) --prefetch_ahead;
+    }
+    prefetch_base = here;
+
+    while (prefetch_ahead < prefetch_lines && prefetch_pos < end) {
+        prefetch_pos = prefetchLine(prefetch_pos, end);
+        ++prefetch_ahead;
+    }
+}
+
+
+// Returns the start of the following line.
+const char* PonscripterLabel::prefetchLine(const char* p, const char* end)
+{
+    static const struct {
+        const char* name;
+        int arg;
+        AssetPrefetcher::Kind kind;
+    } commands[] = {
+        { "bg",        0, AssetPrefetcher::IMAGE },
+        { "ld",        1, AssetPrefetcher::IMAGE },
+        { "lsp",       1, AssetPrefetcher::IMAGE },
+        { "lsph",      1, AssetPrefetcher::IMAGE },
+        { "lsp2",      1, AssetPrefetcher::IMAGE },
+        { "lsph2",     1, AssetPrefetcher::IMAGE },
+        // bgm and mp3 aren't listed: music streams from the archive.
+        { "wave",      0, AssetPrefetcher::SOUND },
+        { "waveloop",  0, AssetPrefetcher::SOUND },
+        { "dwave",     1, AssetPrefetcher::SOUND },
+        { "dwaveloop", 1, AssetPrefetcher::SOUND },
+        { NULL, 0, AssetPrefetcher::IMAGE }
+    };
+
+    while (p < end && *p != 0x0a) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ':')) ++p;
+
+        // Anything not starting with a command name (text, labels,
+        // comments) ends the scan of this line.
+        const char* cmd = p;
+        while (p < end && (isalnum((unsigned char) *p) || *p == '_')) ++p;
+        if (p == cmd) break;
+        pstring name(cmd, p - cmd);
+        name.tolower();
+
+        int i = 0;
+        while (commands[i].name && name != commands[i].name) ++i;
+        if (commands[i].name) {
+            for (int arg = 0; p < end; ++arg) {
+                while (p < end && (*p == ' ' || *p == '\t')) ++p;
+                const char* start = p;
+                bool literal = p < end && *p == '"';
+                if (literal) {
+                    ++start;
+                    ++p;
+                    while (p < end && *p != '"' && *p != 0x0a) ++p;
+                }
+                else {
+                    while (p < end && !strchr(",:; \t\n", *p)) ++p;
+                }
+                if (arg == commands[i].arg) {
+                    prefetchFile(pstring(start, p - start), literal,
+                                 commands[i].kind);
+                    break;
+                }
+                if (literal && p < end && *p == '"') ++p;
+                while (p < end && (*p == ' ' || *p == '\t')) ++p;
+                if (p >= end || *p != ',') break;
+                ++p;
+            }
+        }
+
+        // Skip to the next statement.
+        bool quoted = false;
+        while (p < end && *p != 0x0a && (quoted || (*p != ':' && *p != ';'))) {
+            if (*p == '"') quoted = !quoted;
+            ++p;
+        }
+        if (p < end && *p == ';') break;
+    }
+
+    while (p < end && *p != 0x0a) ++p;
+    return p < end ? p + 1 : end;
+}
+
+
+void PonscripterLabel::prefetchFile(const pstring& arg, bool literal,
+                                    AssetPrefetcher::Kind kind)
+{
+    pstring str = arg;
+    if (!literal) {
+        // A bareword is only a file name if it is a string alias.
+        pstring alias = arg;
+        alias.tolower();
+        if (!script_h.findStrAlias(alias, str)) return;
+    }
+    if (!str || str[0] == '#') return;
+
+    if (kind == AssetPrefetcher::SOUND) {
+        // Sound effects aren't played while skipping.
+        if (!skip_flag && !ctrl_pressed_status)
+            prefetcher.request(str, kind);
+        return;
+    }
+
+    // Pick the file (and mask) names out of a tagged image string
+    // without touching the parser state, as parseTaggedString would.
+    if (str[0] == ':') {
+        const char* buf = str;
+        while (*++buf == ' ') ;
+        if (*buf == 'b') ++buf;
+        if (*buf == 's' || *buf == 'S') return;
+        const char* semi = strchr(buf, ';');
+        if (!semi) return;
+        if (*buf == 'm' && semi > buf + 1)
+            prefetcher.request(pstring(buf + 1, semi - buf - 1), kind,
+                               script_h.save_path);
+        str = pstring(semi + 1);
+    }
+    if (str) prefetcher.request(str, kind, script_h.save_path);
+}
+
+
 bool PonscripterLabel::check_orphan_control()
 {
     // Check whether the current break point follows a logical break
@@ -1744,62 +1977,11 @@ bool PonscripterLabel::check_orphan_control()
         || p == '!' || p == 0xff01 || p == '?' || p == 0xff1f;
 }
 
-int PonscripterLabel::parseLine()
+// Decodes the character at string_buffer_offset and, if it is a break
+// character, starts a new line when the word that follows would not
+// fit.  Returns the size of the character in bytes.
+int PonscripterLabel::checkLineBreak()
 {
-    int ret = 0;
-    pstring cmd = script_h.getStrBuf();
-    bool is_orig_cmd = false;
-    if (cmd[0] == '_') {
-        cmd.remove(0, 1);
-        is_orig_cmd = true;
-    }
-
-    if (!script_h.isText()) {
-
-        if (cmd[0] == 0x0a)
-            return RET_CONTINUE;
-        else if (cmd[0] == 'v' && cmd[1] >= '0' && cmd[1] <= '9')
-            return vCommand(cmd);
-        else if (cmd[0] == 'd' && cmd[1] == 'v' && cmd[2] >= '0' &&
-                 cmd[2] <= '9')
-            return dvCommand(cmd);
-
-        PonscrFun f = func_lut.get(cmd);
-        if (f) {
-            if (is_orig_cmd && (debug_level > 0)) {
-                printf("** executing builtin command '%s' **\n",
-                       (const char*) cmd);
-                fflush(stdout);
-            }
-            return (this->*f)(cmd);
-        }
-
-        errorAndCont("unknown command [" + cmd + "]");
-
-        script_h.skipToken();
-
-        return RET_CONTINUE;
-    }
-
-    /* Text */
-    if (current_mode == DEFINE_MODE)
-        errorAndExit("text cannot be displayed in define section.");
-
-//--------INDENT ROUTINE--------------------------------------------------------
-    if (sentence_font.GetXOffset() == 0 && sentence_font.GetYOffset() == 0) {
-        const wchar first_ch = file_encoding->DecodeWithLigatures
-            (script_h.getStrBuf(string_buffer_offset), sentence_font);
-        if (is_indent_char(first_ch))
-            sentence_font.SetIndent(first_ch);
-        else
-            sentence_font.ClearIndent();
-    }
-//--------END INDENT ROUTINE----------------------------------------------------
-
-    ret = textCommand();
-
-//--------LINE BREAKING ROUTINE-------------------------------------------------
-
     int lf, j;
     Fontinfo f = sentence_font;
     const wchar first_ch =
@@ -1889,6 +2071,66 @@ int PonscripterLabel::parseLine()
             f.newLine();
         }
     }
+
+    return lf;
+}
+
+int PonscripterLabel::parseLine()
+{
+    int ret = 0;
+    pstring cmd = script_h.getStrBuf();
+    bool is_orig_cmd = false;
+    if (cmd[0] == '_') {
+        cmd.remove(0, 1);
+        is_orig_cmd = true;
+    }
+
+    if (!script_h.isText()) {
+
+        if (cmd[0] == 0x0a)
+            return RET_CONTINUE;
+        else if (cmd[0] == 'v' && cmd[1] >= '0' && cmd[1] <= '9')
+            return vCommand(cmd);
+        else if (cmd[0] == 'd' && cmd[1] == 'v' && cmd[2] >= '0' &&
+                 cmd[2] <= '9')
+            return dvCommand(cmd);
+
+        PonscrFun f = func_lut.get(cmd);
+        if (f) {
+            if (is_orig_cmd && (debug_level > 0)) {
+                printf("** executing builtin command '%s' **\n",
+                       (const char*) cmd);
+                fflush(stdout);
+            }
+            return (this->*f)(cmd);
+        }
+
+        errorAndCont("unknown command [" + cmd + "]");
+
+        script_h.skipToken();
+
+        return RET_CONTINUE;
+    }
+
+    /* Text */
+    if (current_mode == DEFINE_MODE)
+        errorAndExit("text cannot be displayed in define section.");
+
+//--------INDENT ROUTINE--------------------------------------------------------
+    if (sentence_font.GetXOffset() == 0 && sentence_font.GetYOffset() == 0) {
+        const wchar first_ch = file_encoding->DecodeWithLigatures
+            (script_h.getStrBuf(string_buffer_offset), sentence_font);
+        if (is_indent_char(first_ch))
+            sentence_font.SetIndent(first_ch);
+        else
+            sentence_font.ClearIndent();
+    }
+//--------END INDENT ROUTINE----------------------------------------------------
+
+    ret = textCommand();
+
+//--------LINE BREAKING ROUTINE-------------------------------------------------
+    int j, lf = checkLineBreak();
 //-----END LINE BREAKING ROUTINE------------------------------------------------
 
     if (script_h.readStrBuf(string_buffer_offset) == 0x0a) {
@@ -1929,6 +2171,7 @@ int PonscripterLabel::parseLine()
 void PonscripterLabel::refreshMouseOverButton()
 {
     current_over_button = 0;
+    buildButtonGrid();
     mouseOverCheck(current_button_state.x, current_button_state.y);
 }
 
@@ -2277,6 +2520,8 @@ int PonscripterLabel::refreshMode()
 
 void PonscripterLabel::quit()
 {
+    // exit() won't run our destructor, so finish writing screenshots.
+    screenshot.flush();
     saveAll();
 
     if (midi_info) {
@@ -2290,6 +2535,9 @@ void PonscripterLabel::quit()
 #ifdef STEAM
     SteamAPI_Shutdown();
 #endif
+
+    if (memstats_timer_id) SDL_RemoveTimer(memstats_timer_id);
+    if (memstats_flag) MemStats::print(stdout);
 }
 
 
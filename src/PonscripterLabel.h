@@ -29,6 +29,10 @@
 #include "DirPaths.h"
 #include "ScriptParser.h"
 #include "DirtyRect.h"
+#include "ButtonGrid.h"
+#include "AssetPrefetcher.h"
+#include "ScreenshotWriter.h"
+#include "MemStats.h"
 #include <SDL.h>
 #include <SDL_image.h>
 #include <SDL_mixer.h>
@@ -117,12 +121,17 @@ public:
     void setPreferredWidth(const char *widthstr);
     void enableButtonShortCut();
     void enableWheelDownAdvance();
+    void enableStartSkip();
     void disableCpuGfx();
     void disableRescale();
     void enableEdit();
     void setKeyEXE(const char* path);
     void setGameIdentifier(const char *gameid);
     void setMaskType(int mask_type) { png_mask_type = mask_type; }
+    void setPrefetchLines(int lines) { prefetch_lines = lines; }
+    void enableMemStats() { memstats_flag = true; }
+    void setMemStatsInterval(int ms) { memstats_flag = true; memstats_interval = ms > 0 ? ms : 1; }
+    void setMemoryBudget(int megabytes) { memory_budget = (size_t) megabytes << 20; }
 
     pstring getSavePath(pstring gameid);
 
@@ -408,6 +417,7 @@ private:
     pstring getret_str;
     int    getret_int;
     bool   enable_wheeldown_advance_flag;
+    bool   start_skip_flag;
     bool   disable_rescale_flag;
     bool   edit_flag;
     pstring key_exe_file;
@@ -423,6 +433,9 @@ private:
 
     Uint32 timer_event_time;
     bool timer_event_flag;
+    // Bumped whenever screen_tex changes; the redraw loop only
+    // presents when it differs from the last generation presented.
+    Uint32 screen_generation, presented_generation;
 
     bool saveon_flag;
     bool internal_saveon_flag; // to saveoff at the head of text
@@ -481,6 +494,15 @@ private:
     SDL_Surface* accumulation_surface;
     // Final image w/o (shadow + text_surface) used in leaveTextDisplayMode():
     SDL_Surface* backup_surface;
+    // Everything beneath the shadow and text, as saved by the last
+    // refreshSurface() of each area; lets drawGlyph recomposite just
+    // the glyph's rect.  text_below_source is the surface the copy
+    // matches: accumulation_surface when it can be used,
+    // effect_dst_surface while an effect is taking the screen there,
+    // or NULL.
+    SDL_Surface* text_below_surface;
+    SDL_Surface* text_below_source;
+    unsigned long text_below_hits, text_below_misses;
     // Text + Select_image + Tachi image + background:
 public:
     SDL_Surface* screen_surface;
@@ -491,7 +513,7 @@ private:
     SDL_Surface* effect_dst_surface; // Intermediate source buffer for effect
     SDL_Surface* effect_src_surface; // Intermediate dest buffer for effect
     SDL_Surface *effect_tmp_surface; // Intermediate buffer for effect
-    SDL_Surface* screenshot_surface; // Screenshot
+    ScreenshotWriter screenshot; // Screenshot, scaled and saved off-thread
     SDL_Surface* image_surface; // Reference for loadImage()
 
     /* ---------------------------------------- */
@@ -548,6 +570,14 @@ private:
     ButtonElt::collection buttons, shelter_buttons;
     ButtonElt exbtn_d_button;
 
+    // Rebuilt by refreshMouseOverButton, which runs whenever buttons
+    // are set up, and by mouseOverCheck after invalidateButtonGrid,
+    // which anything that adds, replaces or removes a button must call.
+    ButtonGrid button_grid;
+    void buildButtonGrid();
+    bool isOverButton(ButtonElt& button, int x, int y);
+    void invalidateButtonGrid() { button_grid.count = size_t(-1); }
+
     void buttonsRemoveSprite(int no) {
         ButtonElt::iterator it = buttons.begin();
         while (it != buttons.end())
@@ -557,6 +587,7 @@ private:
             }
             else
                 ++it;
+        invalidateButtonGrid();
     }
 
     void deleteButtons() {
@@ -564,6 +595,7 @@ private:
              ++it)
             it->second.destroy();
         buttons.clear();
+        invalidateButtonGrid();
         exbtn_d_button.exbtn_ctl.trunc(0);
     }
 
@@ -662,6 +694,13 @@ private:
     int  global_speed_modifier;
     Glyph current_glyph;
 
+    // While a whole page or string sprite is drawn off-screen, glyphs
+    // bound for glyph_batch_info are queued up here and blended in one
+    // go by flushGlyphBatch().
+    AnimationInfo* glyph_batch_info;
+    std::vector<AnimationInfo::GlyphBlend> glyph_batch;
+    void flushGlyphBatch();
+
     int  refreshMode();
     void DoSetwindow(WindowDef& def);
     void setwindowCore();
@@ -687,6 +726,26 @@ private:
 				   surface, rect, cache_info); }*/
 
     void restoreTextBuffer();
+
+    // Rendered lookback pages, so that paging through the history is
+    // a copy rather than a full redraw.  Each page keeps the text it
+    // was drawn from and the font it was drawn with, and is only
+    // reused while both still match.
+    struct LookbackPage {
+        pstring contents;
+        Fontinfo font;
+        SDL_Surface* surface;
+        SDL_Rect rect;
+        unsigned long serial;
+    };
+    typedef std::map<TextBuffer*, LookbackPage> lookback_pages_t;
+    enum { LOOKBACK_CACHE_BYTES = 16 * 1024 * 1024 };
+    lookback_pages_t lookback_pages;
+    size_t lookback_bytes;
+    unsigned long lookback_serial, lookback_hits, lookback_misses;
+    bool restoreLookbackPage(TextBuffer* buf, const Fontinfo& f);
+    void storeLookbackPage(TextBuffer* buf, const Fontinfo& f);
+    void clearLookbackPages();
     int  enterTextDisplayMode(bool text_flag = true);
     int  leaveTextDisplayMode(bool force_leave_flag = false);
     void doClickEnd();
@@ -694,6 +753,7 @@ private:
     int  clickNewPage(bool display_char);
     int  textCommand();
     int  processText();
+    int  checkLineBreak();
 
     std::set<wchar> indent_chars;
     std::set<wchar> break_chars;
@@ -819,6 +879,8 @@ private:
 
     int playWave(Mix_Chunk* chunk, int format, bool loop_flag, int channel);
     int playMP3();
+    int playStream(const pstring& filename, int format);
+    void streamOGG(OVInfo* ovi, int channels, int rate);
     int playOGG(int format, unsigned char* buffer, long length, bool loop_flag,
                 int channel);
     int playExternalMusic(bool loop_flag);
@@ -837,11 +899,11 @@ private:
            WAVE_PLAY_LOADED = 2 };
     void stopBGM(bool continue_flag);
     void stopAllDWAVE();
+    void setWaveSample(int channel, Mix_Chunk* chunk);
     void playClickVoice();
     void setupWaveHeader(unsigned char* buffer, int channels, int rate,
                          int bits, unsigned long data_length);
-    OVInfo* openOggVorbis(unsigned char* buf, long len, int &channels,
-                          int &rate);
+    OVInfo* openOggVorbis(SDL_RWops* src, int &channels, int &rate);
     int  closeOggVorbis(OVInfo* ovi);
 
     /* ---------------------------------------- */
@@ -862,10 +924,40 @@ private:
     void executeLabel();
     int parseLine();
 
+    /* ---------------------------------------- */
+    /* Prefetching of upcoming images and sounds */
+    AssetPrefetcher prefetcher;
+    int prefetch_lines;
+    int prefetch_ahead;          // lines scanned beyond prefetch_base
+    const char* prefetch_base;   // script position at the last scan
+    const char* prefetch_pos;    // start of the next line to scan
+
+    void prefetchAhead();
+    const char* prefetchLine(const char* p, const char* end);
+    void prefetchFile(const pstring& arg, bool literal,
+                      AssetPrefetcher::Kind kind);
+
+    /* ---------------------------------------- */
+    /* Memory accounting (see MemStats.h) */
+    bool memstats_flag;
+    Uint32 memstats_interval;  // ms between memstats lines
+    SDL_TimerID memstats_timer_id;  // posts ONS_MEMSTATS_EVENT
+    size_t memory_budget;  // 0 for no limit
+
+    void checkMemoryBudget(AnimationInfo* keep);
+    bool restoreImage(AnimationInfo& anim);
+
     void mouseOverCheck(int x, int y);
 
     /* ---------------------------------------- */
     /* Animation */
+    // The tachi and sprite slots parseTaggedString has made
+    // animatable, so that animation ticks needn't sweep every slot.
+    // Entries are dropped lazily once they stop being animatable.
+    typedef std::vector<AnimationInfo*> animations_t;
+    animations_t animations;
+    void registerAnimation(AnimationInfo* anim);
+
     int  proceedAnimation();
     int  estimateNextDuration(AnimationInfo* anim, SDL_Rect &rect, int minimum);
     void resetRemainingTime(int t);
@@ -899,12 +991,16 @@ private:
                         SDL_Surface *src1=NULL, SDL_Surface *src2=NULL,
                         SDL_Surface *dst=NULL);
     void alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
-                        SDL_Surface *txt_surface, SDL_Color &color,
+                        const Glyph &glyph, SDL_Color &color,
                         SDL_Rect *clip, bool rotate_flag);
     void makeNegaSurface(SDL_Surface* surface, SDL_Rect &clip);
     void makeMonochromeSurface(SDL_Surface* surface, SDL_Rect &clip);
     void refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
              int refresh_mode = REFRESH_NORMAL_MODE);
+    void saveTextBelow(SDL_Surface* surface, SDL_Rect &clip);
+    void textBelowChanged(SDL_Surface* surface);
+    bool isTextOverlaid(SDL_Rect &rect, int refresh_mode);
+    void refreshTextRect(SDL_Rect &rect);
     void createBackground();
 
     /* ---------------------------------------- */
@@ -25,34 +25,34 @@
 
 #include "PonscripterLabel.h"
 
-int PonscripterLabel::proceedAnimation()
+void PonscripterLabel::registerAnimation(AnimationInfo* anim)
 {
-    int i, minimum_duration = -1;
-    AnimationInfo* anim;
-
-    for (i = 0; i < 3; i++) {
-        anim = &tachi_info[i];
-        if (anim->showing() && anim->is_animatable) {
-            minimum_duration = estimateNextDuration(anim, anim->pos,
-                                                    minimum_duration);
-        }
+    if ((anim >= tachi_info && anim < tachi_info + 3) ||
+        (anim >= sprite_info && anim < sprite_info + MAX_SPRITE_NUM) ||
+        (anim >= sprite2_info && anim < sprite2_info + MAX_SPRITE2_NUM)) {
+        if (std::find(animations.begin(), animations.end(), anim) ==
+            animations.end())
+            animations.push_back(anim);
     }
+}
 
-    for (i = MAX_SPRITE_NUM - 1; i >= 0; i--) {
-        anim = &sprite_info[i];
-        if (anim->showing() && anim->is_animatable) {
-            minimum_duration = estimateNextDuration(anim, anim->pos,
-                                                    minimum_duration);
-        }
-    }
 
-    for (i = MAX_SPRITE2_NUM - 1; i >= 0; i--) {
-        anim = &sprite2_info[i];
-        if (anim->showing() && anim->is_animatable) {
+int PonscripterLabel::proceedAnimation()
+{
+    int minimum_duration = -1;
+    AnimationInfo* anim;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < animations.size(); ++i) {
+        anim = animations[i];
+        if (!anim->is_animatable) continue;
+        animations[kept++] = anim;
+        if (anim->showing()) {
             minimum_duration = estimateNextDuration(anim, anim->pos,
                                                     minimum_duration);
         }
     }
+    animations.resize(kept);
     
     if (!textgosub_label
         && (clickstr_state == CLICK_WAIT
@@ -102,25 +102,11 @@ int PonscripterLabel::estimateNextDuration(AnimationInfo* anim, SDL_Rect &rect,
 
 void PonscripterLabel::resetRemainingTime(int t)
 {
-    int i;
     AnimationInfo* anim;
 
-    for (i = 0; i < 3; i++) {
-        anim = &tachi_info[i];
-        if (anim->showing() && anim->is_animatable) {
-            anim->remaining_time -= t;
-        }
-    }
-
-    for (i = MAX_SPRITE_NUM - 1; i >= 0; i--) {
-        anim = &sprite_info[i];
-        if (anim->showing() && anim->is_animatable) {
-            anim->remaining_time -= t;
-        }
-    }
-
-    for (i = MAX_SPRITE2_NUM - 1; i >= 0; i--) {
-        anim = &sprite2_info[i];
+    for (animations_t::iterator it = animations.begin();
+         it != animations.end(); ++it) {
+        anim = *it;
         if (anim->showing() && anim->is_animatable) {
             anim->remaining_time -= t;
         }
@@ -245,6 +231,7 @@ void PonscripterLabel::setupAnimationInfo(AnimationInfo* anim, Fontinfo* info)
         anim->fill(0, 0, 0, 0);
 
         f_info.top_x = f_info.top_y = 0;
+        glyph_batch_info = anim;
         for (int i = 0; i < anim->num_of_cells; i++) {
             f_info.clear();
             f_info.style = Default;
@@ -252,6 +239,7 @@ void PonscripterLabel::setupAnimationInfo(AnimationInfo* anim, Fontinfo* info)
                        NULL, NULL, anim, anim->skip_whitespace);
             f_info.top_x += anim->pos.w * screen_ratio2 / screen_ratio1;
         }
+        flushGlyphBatch();
     }
     else {
         bool has_alpha;
@@ -265,6 +253,8 @@ void PonscripterLabel::setupAnimationInfo(AnimationInfo* anim, Fontinfo* info)
         if (surface)   SDL_FreeSurface(surface);
         if (surface_m) SDL_FreeSurface(surface_m);
     }
+
+    checkMemoryBudget(anim);
 }
 
 
@@ -406,7 +396,10 @@ void PonscripterLabel::parseTaggedString(AnimationInfo* anim, bool is_mask)
         }
 
         anim->loop_mode = *buffer++ - '0'; // 3...no animation
-        if (anim->loop_mode != 3) anim->is_animatable = true;
+        if (anim->loop_mode != 3) {
+            anim->is_animatable = true;
+            registerAnimation(anim);
+        }
 
         while (buffer[0] != ';' && buffer[0] != '\0') buffer++;
     }
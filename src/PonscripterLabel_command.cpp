@@ -85,8 +85,7 @@ int PonscripterLabel::wavestopCommand(const pstring& cmd)
 {
     if (wave_sample[MIX_WAVE_CHANNEL]) {
         Mix_Pause(MIX_WAVE_CHANNEL);
-        Mix_FreeChunk(wave_sample[MIX_WAVE_CHANNEL]);
-        wave_sample[MIX_WAVE_CHANNEL] = NULL;
+        setWaveSample(MIX_WAVE_CHANNEL, NULL);
     }
 
     wave_file_name = "";
@@ -437,7 +436,12 @@ int PonscripterLabel::sp_rgb_gradationCommand(const pstring& cmd)
 
     AnimationInfo* si;
     if (no == -1) si = &sentence_font_info;
-    else si = &sprite_info[no];
+    else {
+        si = &sprite_info[no];
+        // Reloading would lose the gradation, so keep it loaded.
+        restoreImage(*si);
+        si->image_changed = true;
+    }
 
     SDL_Surface* surface = si->image_surface;
     if (surface == NULL) return RET_CONTINUE;
@@ -601,7 +605,7 @@ int PonscripterLabel::spbtnCommand(const pstring& cmd)
 	button.button_type = ButtonElt::SPRITE_BUTTON;
 	button.sprite_no = sprite_no;
 
-	if (sprite_info[sprite_no].image_surface
+	if (restoreImage(sprite_info[sprite_no])
 	    || sprite_info[sprite_no].trans_mode ==
                   AnimationInfo::TRANS_STRING)
 	{
@@ -612,6 +616,7 @@ int PonscripterLabel::spbtnCommand(const pstring& cmd)
 
 	buttons[no] = button;
     }
+    invalidateButtonGrid();
     
     return RET_CONTINUE;
 }
@@ -1016,6 +1021,7 @@ int PonscripterLabel::selectCommand(const pstring& cmd)
 							     &sentence_font);
 		++counter;
 	    }
+	    invalidateButtonGrid();
         }
 
         if (select_mode == SELECT_CSEL_MODE) {
@@ -1076,12 +1082,7 @@ int PonscripterLabel::savescreenshotCommand(const pstring& cmd)
 #endif
                  );
         }
-        if (screenshot_surface == NULL) {
-            printf("savescreenshot: no screenshot buffer, creating a blank 1x1 surface.\n");
-            screenshot_surface = SDL_CreateRGBSurface(0, 1, 1, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
-        }
-
-        SDL_SaveBMP(screenshot_surface, filename);
+        screenshot.save(filename);
     }
     else
         printf("%s: %s files are not supported.\n",
@@ -1214,6 +1215,7 @@ int PonscripterLabel::quakeCommand(const pstring& cmd)
     if (ctrl_pressed_status || skip_to_wait) {
         dirty_rect.fill(screen_width, screen_height);
         SDL_BlitSurface(accumulation_surface, NULL, effect_dst_surface, NULL);
+        textBelowChanged(effect_dst_surface);
         event_mode = IDLE_EVENT_MODE;
         return RET_CONTINUE;
     }
@@ -1228,6 +1230,12 @@ int PonscripterLabel::quakeCommand(const pstring& cmd)
     else {
         dirty_rect.fill(screen_width, screen_height);
         SDL_BlitSurface(accumulation_surface, NULL, effect_dst_surface, NULL);
+        // A quake ends where it began, so what was saved beneath the
+        // text still applies afterwards.
+        if (text_below_source == accumulation_surface)
+            text_below_source = effect_dst_surface;
+        else
+            textBelowChanged(effect_dst_surface);
 
         return setEffect(tmp_effect, false, true);
     }
@@ -1365,6 +1373,7 @@ int PonscripterLabel::ofscopyCommand(const pstring& cmd)
 {
   fprintf(stderr, "Non-upgraded command, help\n");
     SDL_BlitSurface(screen_surface, NULL, accumulation_surface, NULL);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -1785,14 +1794,12 @@ int PonscripterLabel::loopbgmstopCommand(const pstring& cmd)
 {
     if (wave_sample[MIX_LOOPBGM_CHANNEL0]) {
         Mix_Pause(MIX_LOOPBGM_CHANNEL0);
-        Mix_FreeChunk(wave_sample[MIX_LOOPBGM_CHANNEL0]);
-        wave_sample[MIX_LOOPBGM_CHANNEL0] = NULL;
+        setWaveSample(MIX_LOOPBGM_CHANNEL0, NULL);
     }
 
     if (wave_sample[MIX_LOOPBGM_CHANNEL1]) {
         Mix_Pause(MIX_LOOPBGM_CHANNEL1);
-        Mix_FreeChunk(wave_sample[MIX_LOOPBGM_CHANNEL1]);
-        wave_sample[MIX_LOOPBGM_CHANNEL1] = NULL;
+        setWaveSample(MIX_LOOPBGM_CHANNEL1, NULL);
     }
 
     loop_bgm_name[0] = "";
@@ -2280,22 +2287,7 @@ int PonscripterLabel::getscreenshotCommand(const pstring& cmd)
     int h = script_h.readIntValue();
     if (w == 0) w = 1;
     if (h == 0) h = 1;
-    if (screenshot_surface &&
-	(screenshot_surface->w != w || screenshot_surface->h != h))
-    {
-        SDL_FreeSurface(screenshot_surface);
-        screenshot_surface = NULL;
-    }
-
-    if (screenshot_surface == NULL)
-        screenshot_surface =
-	    SDL_CreateRGBSurface(0, w, h, 32, 0, 0, 0, 0);
-
-    SDL_Surface* surface =
-	SDL_ConvertSurface(screen_surface,image_surface->format, SDL_SWSURFACE);
-
-    AnimationInfo::resizeSurface(surface, screenshot_surface);
-    SDL_FreeSurface(surface);
+    screenshot.capture(screen_surface, image_surface->format->format, w, h);
 
     return RET_CONTINUE;
 }
@@ -2534,7 +2526,9 @@ int PonscripterLabel::gameCommand(const pstring& cmd)
 int PonscripterLabel::fileexistCommand(const pstring& cmd)
 {
     Expression e = script_h.readIntExpr();
-    e.mutate(ScriptHandler::cBR->getFileLength(script_h.readStrValue()) > 0);
+    pstring filename = script_h.readStrValue();
+    screenshot.waitFor(filename);
+    e.mutate(ScriptHandler::cBR->getFileLength(filename) > 0);
     return RET_CONTINUE;
 }
 
@@ -2605,6 +2599,7 @@ int PonscripterLabel::exbtnCommand(const pstring& cmd)
             return RET_CONTINUE;
         }
 	button = &buttons[no];
+        invalidateButtonGrid();
     }
 
     button->button_type = ButtonElt::EX_SPRITE_BUTTON;
@@ -2612,7 +2607,7 @@ int PonscripterLabel::exbtnCommand(const pstring& cmd)
     button->exbtn_ctl = script_h.readStrValue();
 
     if (sprite_no >= 0
-        && (sprite_info[sprite_no].image_surface ||
+        && (restoreImage(sprite_info[sprite_no]) ||
             sprite_info[sprite_no].trans_mode == AnimationInfo::TRANS_STRING)) {
         button->image_rect = button->select_rect = sprite_info[sprite_no].pos;
         sprite_info[sprite_no].visible(true);
@@ -2645,8 +2640,7 @@ int PonscripterLabel::dwavestopCommand(const pstring& cmd)
     else if (ch >= ONS_MIX_CHANNELS) ch = ONS_MIX_CHANNELS - 1;
     if (wave_sample[ch]) {
         Mix_Pause(ch);
-        Mix_FreeChunk(wave_sample[ch]);
-        wave_sample[ch] = NULL;
+        setWaveSample(ch, NULL);
     }
     return RET_CONTINUE;
 }
@@ -2701,6 +2695,7 @@ int PonscripterLabel::drawtextCommand(const pstring& cmd)
 {
     SDL_Rect clip = { 0, 0, accumulation_surface->w, accumulation_surface->h };
     text_info.blendOnSurface(accumulation_surface, 0, 0, clip);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -2721,6 +2716,7 @@ int PonscripterLabel::drawsp3Command(const pstring& cmd)
     int y         = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
 
     AnimationInfo &si = sprite_info[sprite_no];
+    restoreImage(si);
     int old_cell_no = si.current_cell;
     si.setCell(cell_no);
 
@@ -2743,6 +2739,7 @@ int PonscripterLabel::drawsp3Command(const pstring& cmd)
     SDL_Rect clip = { 0, 0, screen_surface->w, screen_surface->h };
     si.blendOnSurface2(accumulation_surface, x, y, clip, alpha);
     si.setCell(old_cell_no);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -2760,6 +2757,7 @@ int PonscripterLabel::drawsp2Command(const pstring& cmd)
     #endif
 
     AnimationInfo &si = sprite_info[sprite_no];
+    restoreImage(si);
     si.pos.x   = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
     si.pos.y   = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
     si.scale_x = script_h.readIntValue();
@@ -2773,6 +2771,7 @@ int PonscripterLabel::drawsp2Command(const pstring& cmd)
     SDL_Rect clip = { 0, 0, screen_surface->w, screen_surface->h };
     si.blendOnSurface2(accumulation_surface, si.pos.x, si.pos.y, clip, alpha);
     si.setCell(old_cell_no);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -2793,11 +2792,13 @@ int PonscripterLabel::drawspCommand(const pstring& cmd)
     int y         = script_h.readIntValue() * screen_ratio1 * res_multiplier / screen_ratio2;
 
     AnimationInfo &si = sprite_info[sprite_no];
+    restoreImage(si);
     int old_cell_no = si.current_cell;
     si.setCell(cell_no);
     SDL_Rect clip = { 0, 0, accumulation_surface->w, accumulation_surface->h };
     si.blendOnSurface(accumulation_surface, x, y, clip, alpha);
     si.setCell(old_cell_no);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -2810,6 +2811,7 @@ int PonscripterLabel::drawfillCommand(const pstring& cmd)
     int b = script_h.readIntValue();
     SDL_FillRect(accumulation_surface, NULL,
 		 SDL_MapRGBA(accumulation_surface->format, r, g, b, 0xff));
+    textBelowChanged(accumulation_surface);
     return RET_CONTINUE;
 }
 
@@ -2818,6 +2820,7 @@ int PonscripterLabel::drawclearCommand(const pstring& cmd)
 {
     SDL_FillRect(accumulation_surface, NULL,
 		 SDL_MapRGBA(accumulation_surface->format, 0, 0, 0, 0xff));
+    textBelowChanged(accumulation_surface);
     return RET_CONTINUE;
 }
 
@@ -2827,6 +2830,7 @@ int PonscripterLabel::drawbgCommand(const pstring& cmd)
     SDL_Rect clip = { 0, 0, accumulation_surface->w, accumulation_surface->h };
     bg_info.blendOnSurface(accumulation_surface, bg_info.pos.x, bg_info.pos.y,
 			   clip);
+    textBelowChanged(accumulation_surface);
     return RET_CONTINUE;
 }
 
@@ -2842,6 +2846,7 @@ int PonscripterLabel::drawbg2Command(const pstring& cmd)
 
     SDL_Rect clip = { 0, 0, screen_surface->w, screen_surface->h };
     bg_info.blendOnSurface2(accumulation_surface, x, y, clip, 256);
+    textBelowChanged(accumulation_surface);
 
     return RET_CONTINUE;
 }
@@ -2858,10 +2863,7 @@ int PonscripterLabel::drawCommand(const pstring& cmd)
 
 int PonscripterLabel::deletescreenshotCommand(const pstring& cmd)
 {
-    if (screenshot_surface) {
-        SDL_FreeSurface(screenshot_surface);
-        screenshot_surface = NULL;
-    }
+    screenshot.discard();
     return RET_CONTINUE;
 }
 
@@ -2970,6 +2972,7 @@ int PonscripterLabel::cselbtnCommand(const pstring& cmd)
     csel_info.clear();
     buttons[button_no] = getSelectableSentence(text, &csel_info);
     buttons[button_no].sprite_no = csel_no;
+    invalidateButtonGrid();
 
     return RET_CONTINUE;
 }
@@ -3265,6 +3268,7 @@ int PonscripterLabel::btnCommand(const pstring& cmd)
     const int no = script_h.readIntValue();
 
     ButtonElt* button = &buttons[no];
+    invalidateButtonGrid();
     
     button->image_rect.x = script_h.readIntValue() *
 	screen_ratio1 / screen_ratio2;
@@ -3423,6 +3427,7 @@ int PonscripterLabel::bltCommand(const pstring& cmd)
 
         SDL_UnlockSurface(btndef_info.image_surface);
         SDL_UnlockSurface(accumulation_surface);
+        textBelowChanged(accumulation_surface);
 
         SDL_Rect dst_rect = { start_x, start_y, end_x - start_x, end_y - start_y };
         flushDirect(dst_rect, REFRESH_NONE_MODE);
@@ -3574,6 +3579,7 @@ int PonscripterLabel::endrollCommand(const pstring& cmd)
 
         SDL_UnlockSurface(btndef_info.image_surface);
         SDL_UnlockSurface(accumulation_surface);
+        textBelowChanged(accumulation_surface);
 
         SDL_Rect dst_rect = { start_x, start_y, end_x - start_x, end_y - start_y };
         flushDirect(dst_rect, REFRESH_NONE_MODE);
@@ -3593,6 +3599,7 @@ int PonscripterLabel::bidirectCommand(const pstring& cmd)
 int PonscripterLabel::bgcopyCommand(const pstring& cmd)
 {
     SDL_BlitSurface(screen_surface, NULL, accumulation_surface, NULL);
+    textBelowChanged(accumulation_surface);
     fprintf(stderr, "Likely partially-updated command used bgcopyCommand\n");
 
     bg_info.num_of_cells = 1;
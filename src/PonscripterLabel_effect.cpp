@@ -49,6 +49,7 @@ int PonscripterLabel::setEffect(Effect& effect, bool generate_effect_dst, bool u
         if (update_backup_surface && refresh_mode == REFRESH_NORMAL_MODE){
             SDL_BlitSurface(backup_surface, &dirty_rect.bounding_box,
                             effect_dst_surface, &dirty_rect.bounding_box);
+            textBelowChanged(effect_dst_surface);
         }
         else {
             if (effect_no == 1)
@@ -115,7 +116,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
     bool first_time = (effect_counter == 0);
 
     int prevduration = effect.duration;
-    if (ctrl_pressed_status || skip_to_wait) {
+    if (ctrl_pressed_status || skip_to_wait || skip_flag) {
         effect.duration = effect_counter = 1;
     }
 
@@ -127,6 +128,9 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
     int effect_no = effect.effect;
     if (effect_cut_flag && skip_flag) effect_no = 1;
 
+    // Every effect draws its frames straight onto accumulation_surface.
+    textBelowChanged(accumulation_surface);
+
     int i;
     int width, width2;
     int height, height2;
@@ -415,6 +419,10 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
     else {
         SDL_BlitSurface(effect_dst_surface, &dirty_rect.bounding_box,
 			accumulation_surface, &dirty_rect.bounding_box);
+        // Whatever was saved beneath the text of effect_dst_surface
+        // is now on screen.
+        text_below_source = text_below_source == effect_dst_surface
+                          ? accumulation_surface : NULL;
 
         if (effect_no)
 	    flush(REFRESH_NONE_MODE, NULL, clear_dirty_region);
@@ -447,9 +455,8 @@ void PonscripterLabel::drawEffect(SDL_Rect* dst_rect, SDL_Rect* src_rect, SDL_Su
 
 void PonscripterLabel::generateMosaic(SDL_Surface* src_surface, int level)
 {
-    int i, j, ii, jj;
     int width = 160;
-    for (i = 0; i < level; i++) width >>= 1;
+    for (int i = 0; i < level; i++) width >>= 1;
 
 #ifdef BPP16
     int total_width = accumulation_surface->pitch / 2;
@@ -460,26 +467,9 @@ void PonscripterLabel::generateMosaic(SDL_Surface* src_surface, int level)
     SDL_LockSurface(accumulation_surface);
     ONSBuf* src_buffer = (ONSBuf*) src_surface->pixels;
 
-    for (i = screen_height - 1; i >= 0; i -= width) {
-        for (j = 0; j < screen_width; j += width) {
-            ONSBuf  p = src_buffer[i * total_width + j];
-            ONSBuf* dst_buffer = (ONSBuf*) accumulation_surface->pixels + i * total_width + j;
-
-            int height2 = width;
-            if (i + 1 - width < 0) height2 = i + 1;
-
-            int width2 = width;
-            if (j + width > screen_width) width2 = screen_width - j;
-
-            for (ii = 0; ii < height2; ii++) {
-                for (jj = 0; jj < width2; jj++) {
-                    *dst_buffer++ = p;
-                }
-
-                dst_buffer -= total_width + width2;
-            }
-        }
-    }
+    AnimationInfo::imageFilterMosaic((ONSBuf*) accumulation_surface->pixels,
+                                     src_buffer, screen_width, screen_height,
+                                     total_width, width);
 
     SDL_UnlockSurface(accumulation_surface);
     SDL_UnlockSurface(src_surface);
@@ -34,6 +34,9 @@
 #define EDIT_MODE_PREFIX "[EDIT MODE]  "
 #define EDIT_SELECT_STRING "MP3 vol (m)  SE vol (s)  Voice vol (v)  Numeric variable (n)"
 
+// How long (ms) to keep running script between presents while skipping
+#define SKIP_FRAME_BUDGET 12
+
 static SDL_TimerID timer_id  = 0;
 
 // This block does two things: it sets up the timer id for mp3 fadeout, and it also sets up a timer id for midi looping --
@@ -84,6 +87,18 @@ extern "C" Uint32 SDLCALL mp3fadeoutCallback(Uint32 interval, void* param)
 }
 
 
+// Wakes the event loop to log memory use even when nothing else is
+// happening.
+extern "C" Uint32 SDLCALL memstatsCallback(Uint32 interval, void* param)
+{
+    SDL_Event event;
+    event.type = ONS_MEMSTATS_EVENT;
+    SDL_PushEvent(&event);
+
+    return interval;
+}
+
+
 SDL_Keycode transKey(SDL_Keycode key)
 {
 #ifdef IPODLINUX
@@ -244,8 +259,7 @@ void PonscripterLabel::flushEventSub(SDL_Event &event)
     }
     else if (event.type == ONS_WAVE_EVENT) { // for processing btntim2 and automode correctly
         if (wave_sample[event.user.code]) {
-            Mix_FreeChunk(wave_sample[event.user.code]);
-            wave_sample[event.user.code] = NULL;
+            setWaveSample(event.user.code, NULL);
             if (event.user.code == MIX_LOOPBGM_CHANNEL0
                 && loop_bgm_name[1]
                 && wave_sample[MIX_LOOPBGM_CHANNEL1])
@@ -292,6 +306,7 @@ void PonscripterLabel::advancePhase(int count) {
 }
 
 void PonscripterLabel::queueRerender() {
+    ++screen_generation;
     SDL_Event rerender_event;
     rerender_event.type = INTERNAL_REDRAW_EVENT;
     SDL_PushEvent(&rerender_event);
@@ -1334,10 +1349,13 @@ int PonscripterLabel::eventLoop()
             }
 
             current_time = SDL_GetTicks();
-            if((current_time - last_refresh) >= refresh_delay || last_refresh == 0) {
-                /* It has been longer than the refresh delay since we last started a refresh. Start another */
+            if(screen_generation != presented_generation &&
+               ((current_time - last_refresh) >= refresh_delay || last_refresh == 0)) {
+                /* Something has been drawn, and it has been longer than the
+                   refresh delay since we last started a refresh. Start another */
 
                 last_refresh = current_time;
+                presented_generation = screen_generation;
                 rerender();
 
                 /* Refresh time since rerender does take some odd ms */
@@ -1350,16 +1368,43 @@ int PonscripterLabel::eventLoop()
                 ;
 
             /* If there are any events on the queue, re-add us and let it get those events asap.
-             * It'll then come back to us with no events and we'll just sleep until it's time to redraw again.
-             * If there are no events, sleep right away
+             * It'll then come back to us with no events and we'll just sleep until the
+             * timer is due, the next redraw if the screen has changed, or new input.
              */
             if(SDL_PeepEvents(&tmp_event, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) == 0) {
                 if(timer_event_flag && timer_event_time <= current_time) {
                     timer_event_flag = false;
 
                     timerEvent();
-                } else if(last_refresh <= current_time && refresh_delay >= (current_time - last_refresh)) {
-                    SDL_Delay(std::min(refresh_delay / 3, refresh_delay - (current_time - last_refresh)));
+
+                    /* While skipping, carry on with whatever the script does
+                     * next until the frame's budget is used up, rather than
+                     * going round the event queue once per wait */
+                    while((skip_flag || ctrl_pressed_status) && timer_event_flag &&
+                          SDL_GetTicks() - current_time < SKIP_FRAME_BUDGET) {
+                        while(SDL_PeepEvents(&tmp_event, 1, SDL_GETEVENT, INTERNAL_REDRAW_EVENT, INTERNAL_REDRAW_EVENT) == 1)
+                            ;
+                        if(SDL_PeepEvents(&tmp_event, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT, INTERNAL_REDRAW_EVENT - 1) ||
+                           SDL_PeepEvents(&tmp_event, 1, SDL_PEEKEVENT, INTERNAL_REDRAW_EVENT + 1, SDL_LASTEVENT) ||
+                           timer_event_time > SDL_GetTicks())
+                            break;
+
+                        timer_event_flag = false;
+                        timerEvent();
+                    }
+                } else {
+                    int timeout = -1;
+                    if(timer_event_flag)
+                        timeout = timer_event_time - current_time;
+                    if(screen_generation != presented_generation) {
+                        Uint32 since = current_time - last_refresh;
+                        int next = since >= refresh_delay ? 0 : refresh_delay - since;
+                        if(timeout < 0 || next < timeout) timeout = next;
+                    }
+                    if(timeout < 0)
+                        SDL_WaitEvent(NULL);
+                    else if(timeout > 0)
+                        SDL_WaitEventTimeout(NULL, timeout);
                 }
             }
             tmp_event.type = INTERNAL_REDRAW_EVENT;
@@ -1367,6 +1412,11 @@ int PonscripterLabel::eventLoop()
 
             break;
 
+        case ONS_MEMSTATS_EVENT:
+            MemStats::printLine(stdout);
+            fflush(stdout);
+            break;
+
         case ONS_WAVE_EVENT:
             flushEventSub(event);
             //printf("ONS_WAVE_EVENT %d: %x %d %x\n", event.user.code, wave_sample[0], automode_flag, event_mode);
@@ -1435,11 +1485,14 @@ int PonscripterLabel::eventLoop()
               case SDL_WINDOWEVENT_RESTORED:
               case SDL_WINDOWEVENT_SHOWN:
               case SDL_WINDOWEVENT_EXPOSED:
-                /* If we weren't minimized, a rerender is already queued */
+                /* If we weren't minimized, a rerender is already queued;
+                   it just needs to know the window wants repainting */
                 if(minimized_flag) {
                     minimized_flag = false;
                     queueRerender();
                 }
+                else
+                    ++screen_generation;
                 break;
               case SDL_WINDOWEVENT_MINIMIZED:
               case SDL_WINDOWEVENT_HIDDEN:
@@ -239,6 +239,7 @@ int PonscripterLabel::haeleth_char_setCommand(const pstring& cmd)
     bool is_indent = ((cmd == "h_indentstr") || (cmd == "pindentstr"));
     std::set<wchar>& char_set = is_indent ? indent_chars : break_chars;
     char_set.clear();
+    if (is_indent) clearLookbackPages();
 
     Expression e = script_h.readStrExpr();
     pstring s = e.as_string();
@@ -307,6 +308,7 @@ int PonscripterLabel::haeleth_map_fontCommand(const pstring& cmd)
     int id = script_h.readIntValue();
     MapFont(id, script_h.readStrValue());
     if (script_h.hasMoreArgs()) MapMetrics(id, script_h.readStrValue());
+    clearLookbackPages();
     return RET_CONTINUE;
 }
 
@@ -338,6 +340,7 @@ int PonscripterLabel::haeleth_hinting_modeCommand(const pstring& cmd)
     else {
         lightrender = hinting == LightHinting;
     }
+    clearLookbackPages();
     return RET_CONTINUE;
 }
 
@@ -380,6 +383,7 @@ int PonscripterLabel::haeleth_ligate_controlCommand(const pstring& cmd)
 	    fprintf(stderr, "Unknown character `%s'\n",
 		    (const char*) l.debug_string());
     }
+    clearLookbackPages();
 
     return RET_CONTINUE;
 }
@@ -38,8 +38,11 @@ SDL_Surface *PonscripterLabel::loadImage(const pstring& filename,
 
     if (filename[0] == '>')
         tmp = createRectangleSurface(filename);
-    else
+    else {
+        // The script may be showing a screenshot it just saved.
+        screenshot.waitFor(filename);
         tmp = createSurfaceFromFile(filename, &location);
+    }
     if (tmp == NULL) return NULL;
 
     bool has_colorkey = false;
@@ -179,8 +182,18 @@ SDL_Surface *PonscripterLabel::createRectangleSurface(const pstring& filename)
 SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
                                                     int *location)
 {
+    pstring dat = "";
+    if (prefetch_lines > 0) {
+        SDL_Surface* tmp = prefetcher.takeSurface(filename, dat, location);
+        if (tmp) {
+            if (filelog_flag) script_h.file_log.add(filename);
+            return tmp;
+        }
+    }
+
     pstring alt_filename= "";
-    unsigned long length = script_h.cBR->getFileLength( filename );
+    unsigned long length = dat.length();
+    if (length == 0) length = script_h.cBR->getFileLength( filename );
 
     if (length == 0) {
         alt_filename = script_h.save_path + filename;
@@ -207,8 +220,10 @@ SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
     }
     if (filelog_flag) script_h.file_log.add(filename);
 
-    pstring dat = "";
-    if (!alt_filename) {
+    if (dat) {
+        // Prefetched, but SDL_image couldn't decode it.
+    }
+    else if (!alt_filename) {
         dat = script_h.cBR->getFile(filename, location);
     }
     else {
@@ -326,9 +341,9 @@ void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
 
 // alphaBlendText
 // dst: ONSBuf surface (accumulation_surface)
-// txt: 8bit surface (TTF_RenderGlyph_Shaded())
+// glyph: 8bit coverage (Font::render_glyph())
 void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
-                                      SDL_Surface *txt_surface, SDL_Color &color,
+                                      const Glyph &glyph, SDL_Color &color,
                                       SDL_Rect *clip, bool rotate_flag)
 {
     int x2=0, y2=0;
@@ -354,7 +369,6 @@ void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rec
     /* ---------------------------------------- */
 
     SDL_LockSurface( dst_surface );
-    SDL_LockSurface( txt_surface );
 
 #ifdef BPP16
     Uint32 src_color = ((color.r >> RLOSS) << RSHIFT) |
@@ -370,28 +384,26 @@ void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rec
                          dst_surface->w * dst_rect.y + dst_rect.x;
 
     if (!rotate_flag){
-        unsigned char *src_buffer = (unsigned char*)txt_surface->pixels +
-                                    txt_surface->pitch * y2 + x2;
+        const Uint8 *src_buffer = glyph.pixels + glyph.pitch * y2 + x2;
         for ( int i=dst_rect.h ; i>0 ; i-- ){
             for ( int j=dst_rect.w ; j>0 ; j--, dst_buffer++, src_buffer++ ){
                 BLEND_PIXEL8();
             }
             dst_buffer += dst_surface->w - dst_rect.w;
-            src_buffer += txt_surface->pitch - dst_rect.w;
+            src_buffer += glyph.pitch - dst_rect.w;
         }
     }
     else{
         for ( int i=0 ; i<dst_rect.h ; i++ ){
-            unsigned char *src_buffer = (unsigned char*)txt_surface->pixels + txt_surface->pitch*(txt_surface->h - x2 - 1) + y2 + i;
+            const Uint8 *src_buffer = glyph.pixels + glyph.pitch*(glyph.h - x2 - 1) + y2 + i;
             for ( int j=dst_rect.w ; j>0 ; j--, dst_buffer++ ){
                 BLEND_PIXEL8();
-                src_buffer -= txt_surface->pitch;
+                src_buffer -= glyph.pitch;
             }
             dst_buffer += dst_surface->w - dst_rect.w;
         }
     }
     
-    SDL_UnlockSurface( txt_surface );
     SDL_UnlockSurface( dst_surface );
 }
 
@@ -403,9 +415,14 @@ void PonscripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 
     ONSBuf mask = surface->format->Rmask | surface->format->Gmask | surface->format->Bmask;
     for ( int i=clip.h ; i>0 ; i-- ){
+#ifdef BPP16
         for ( int j=clip.w ; j>0 ; j-- )
             *buf++ ^= mask;
         buf += surface->w - clip.w;
+#else
+        AnimationInfo::imageFilterNega(buf, mask, clip.w);
+        buf += surface->w;
+#endif
     }
 
     SDL_UnlockSurface( surface );
@@ -417,20 +434,63 @@ void PonscripterLabel::makeMonochromeSurface( SDL_Surface *surface, SDL_Rect &cl
     SDL_LockSurface( surface );
     ONSBuf *buffer = (ONSBuf *)surface->pixels + clip.y * surface->w + clip.x;
 
+    //Mion: NScr seems to use more "equal" 85/86/85 RGB blending, instead
+    // of the 77/151/28 that onscr used to have. Using 85/86/85 now,
+    // might add a parameter to "monocro" to allow choosing 77/151/28
     for ( int i=clip.h ; i>0 ; i-- ){
-        for ( int j=clip.w ; j>0 ; j--, buffer++ ){
-            //Mion: NScr seems to use more "equal" 85/86/85 RGB blending, instead
-            // of the 77/151/28 that onscr used to have. Using 85/86/85 now,
-            // might add a parameter to "monocro" to allow choosing 77/151/28
+#ifdef BPP16
+        for ( int j=clip.w ; j>0 ; j--, buffer++ )
             MONOCRO_PIXEL();
-        }
         buffer += surface->w - clip.w;
+#else
+        AnimationInfo::imageFilterMonochrome(buffer, monocro_color, clip.w);
+        buffer += surface->w;
+#endif
     }
 
     SDL_UnlockSurface( surface );
 }
 
 
+// Drop the images of hidden sprites until the total is back under
+// memory_budget; restoreImage() loads them again when they are
+// needed.  keep has just been loaded and is left alone.  Text sprites
+// are never dropped, since they would be drawn with whatever font
+// settings are current when reloaded, nor are images that have been
+// changed since loading.
+void PonscripterLabel::checkMemoryBudget(AnimationInfo* keep)
+{
+    if (memory_budget == 0 || MemStats::total() <= memory_budget) return;
+
+    for (int i = 0; i < MAX_SPRITE_NUM + MAX_SPRITE2_NUM; ++i) {
+        AnimationInfo& si = i < MAX_SPRITE_NUM
+                          ? sprite_info[i] : sprite2_info[i - MAX_SPRITE_NUM];
+        if (&si == keep || !si.image_surface || si.showing() || si.is_copy
+            || si.image_changed || !si.image_name
+            || si.trans_mode == AnimationInfo::TRANS_STRING
+#ifndef NO_LAYER_EFFECTS
+            || si.trans_mode == AnimationInfo::TRANS_LAYER
+#endif
+            )
+            continue;
+
+        si.deleteImage();
+        si.image_evicted = true;
+        if (MemStats::total() <= memory_budget) break;
+    }
+}
+
+
+// Returns whether anim has an image, reloading it if
+// checkMemoryBudget() dropped it.
+bool PonscripterLabel::restoreImage(AnimationInfo& anim)
+{
+    if (anim.image_evicted) setupAnimationInfo(&anim);
+
+    return anim.image_surface != NULL;
+}
+
+
 void
 PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
 				 int refresh_mode)
@@ -450,7 +510,7 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
             top = z_order;
     
         for (i = MAX_SPRITE_NUM - 1; i > top; --i) {
-            if (sprite_info[i].image_surface && sprite_info[i].showing())
+            if (sprite_info[i].showing() && restoreImage(sprite_info[i]))
                 drawTaggedSurface(surface, &sprite_info[i], clip);
         }
     }
@@ -468,11 +528,14 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
 
         if (!all_sprite2_hide_flag) {
             for (i = MAX_SPRITE2_NUM - 1; i >= 0; --i) {
-                if (sprite2_info[i].image_surface && sprite2_info[i].showing())
+                if (sprite2_info[i].showing() && restoreImage(sprite2_info[i]))
                     drawTaggedSurface(surface, &sprite2_info[i], clip);
             }
         }
 
+        if (surface == accumulation_surface ||
+            surface == effect_dst_surface)
+            saveTextBelow(surface, clip);
         if (refresh_mode & REFRESH_SHADOW_MODE)
             shadowTextDisplay(surface, clip);
         if (refresh_mode & REFRESH_TEXT_MODE)
@@ -485,7 +548,7 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
         else
             top = 0;
         for (i = z_order; i >= top; --i) {
-            if (sprite_info[i].image_surface && sprite_info[i].showing())
+            if (sprite_info[i].showing() && restoreImage(sprite_info[i]))
                 drawTaggedSurface(surface, &sprite_info[i], clip);
         }
     }
@@ -494,7 +557,7 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
         //Mion - ogapee2008
         if (!all_sprite2_hide_flag) {
             for (i = MAX_SPRITE2_NUM - 1; i >= 0; --i) {
-                if (sprite2_info[i].image_surface && sprite2_info[i].showing())
+                if (sprite2_info[i].showing() && restoreImage(sprite2_info[i]))
                     drawTaggedSurface(surface, &sprite2_info[i], clip);
             }
         }
@@ -513,6 +576,9 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
     }
 
     if (!windowback_flag) {
+        if (surface == accumulation_surface ||
+            surface == effect_dst_surface)
+            saveTextBelow(surface, clip);
         if (refresh_mode & REFRESH_SHADOW_MODE)
             shadowTextDisplay(surface, clip);
         if (refresh_mode & REFRESH_TEXT_MODE)
@@ -532,6 +598,105 @@ PonscripterLabel::refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
 }
 
 
+// Keep a copy of the layers refreshSurface has drawn beneath the text
+// window, so that typing a glyph needn't redraw them.  A copy taken
+// from effect_dst_surface is put to use once doEffect has blitted that
+// surface to accumulation_surface.
+void PonscripterLabel::saveTextBelow(SDL_Surface* surface, SDL_Rect &clip)
+{
+    SDL_Rect rect = clip;
+    SDL_BlitSurface(surface, &rect, text_below_surface, &rect);
+    if (clip.x == 0 && clip.y == 0 &&
+        clip.w == screen_width && clip.h == screen_height)
+        text_below_source = surface;
+    else if (text_below_source == accumulation_surface)
+        text_below_source = surface;
+    else if (text_below_source != surface)
+        text_below_source = NULL;
+}
+
+
+// Something other than refreshSurface has drawn on surface, so the
+// copy of what lies beneath its text no longer matches it.
+void PonscripterLabel::textBelowChanged(SDL_Surface* surface)
+{
+    if (text_below_source == surface) text_below_source = NULL;
+}
+
+
+// Is anything drawn above the text within rect?
+bool PonscripterLabel::isTextOverlaid(SDL_Rect &rect, int refresh_mode)
+{
+    SDL_Rect r;
+    int i;
+    if (refresh_mode & REFRESH_CURSOR_MODE && !textgosub_label &&
+        (clickstr_state == CLICK_WAIT || clickstr_state == CLICK_NEWPAGE))
+        return true;
+
+    for (ButtonElt::iterator it = buttons.begin(); it != buttons.end(); ++it)
+        if (it->second.show_flag > 0) {
+            AnimationInfo* anim = it->second.anim[it->second.show_flag - 1];
+            r = anim->pos;
+            if (!anim->abs_flag || !AnimationInfo::doClipping(&r, &rect))
+                return true;
+        }
+
+    if (!windowback_flag) return false;
+
+    if (!all_sprite_hide_flag) {
+        int top = refresh_mode & REFRESH_SAYA_MODE ? 10 : 0;
+        for (i = z_order; i >= top; --i) {
+            AnimationInfo& anim = sprite_info[i];
+            if (!anim.image_surface || !anim.showing()) continue;
+            r = anim.pos;
+            if (!anim.abs_flag || anim.affine_flag ||
+                !AnimationInfo::doClipping(&r, &rect))
+                return true;
+        }
+    }
+
+    if (!(refresh_mode & REFRESH_SAYA_MODE)) {
+        for (i = 0; i < MAX_PARAM_NUM; ++i) {
+            if (bar_info[i]) {
+                r = bar_info[i]->pos;
+                if (!AnimationInfo::doClipping(&r, &rect)) return true;
+            }
+            if (prnum_info[i]) {
+                r = prnum_info[i]->pos;
+                if (!AnimationInfo::doClipping(&r, &rect)) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+// Bring rect of accumulation_surface up to date after text_info has
+// changed there: from the cached scene if nothing covers the text,
+// otherwise by a full recomposite.
+void PonscripterLabel::refreshTextRect(SDL_Rect &rect)
+{
+    int refresh_mode = refreshMode() | REFRESH_TEXT_MODE;
+    SDL_Rect clip = { 0, 0, screen_width, screen_height };
+    if (AnimationInfo::doClipping(&clip, &rect)) return;
+
+    if (text_below_source == accumulation_surface &&
+        !isTextOverlaid(clip, refresh_mode)) {
+        SDL_Rect r = clip;
+        SDL_BlitSurface(text_below_surface, &r, accumulation_surface, &r);
+        if (refresh_mode & REFRESH_SHADOW_MODE)
+            shadowTextDisplay(accumulation_surface, clip);
+        text_info.blendOnSurface(accumulation_surface, 0, 0, clip);
+        ++text_below_hits;
+    }
+    else {
+        refreshSurface(accumulation_surface, &clip, refresh_mode);
+        ++text_below_misses;
+    }
+}
+
+
 void PonscripterLabel::refreshSprite(int sprite_no, bool active_flag,
                                      int cell_no, SDL_Rect* check_src_rect,
                                      SDL_Rect* check_dst_rect)
@@ -54,6 +54,10 @@ typedef struct
   SMPEG_Frame *frame;
   int dirty;
   SDL_mutex *lock;
+  SDL_cond *ready; // signalled by UpdateMPEG when a frame arrives
+  SMPEG *mpeg;
+  double next_due; // movie time at which the frame after this one is due
+  int frames, dropped, late;
 } update_context;
 
 extern bool ext_music_play_once_flag;
@@ -182,6 +186,11 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
             return SOUND_NONE;
     }
 
+    if (format & (SOUND_MP3 | SOUND_OGG_STREAMING)) {
+        int ret = playStream(filename, format);
+        if (ret != SOUND_NONE) return ret;
+    }
+
     unsigned char* buffer;
 
     if ((format & (SOUND_MP3 | SOUND_OGG_STREAMING)) &&
@@ -190,8 +199,14 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
         buffer = music_buffer;
     }
     else{
-        buffer = new unsigned char[length];
-        script_h.cBR->getFile( filename, buffer );
+        size_t prefetched_length;
+        buffer = prefetch_lines > 0
+               ? prefetcher.takeData(filename, &prefetched_length) : NULL;
+        if (!buffer || (long) prefetched_length != length) {
+            delete[] buffer;
+            buffer = new unsigned char[length];
+            script_h.cBR->getFile( filename, buffer );
+        }
     }
 
     if (format & (SOUND_OGG | SOUND_OGG_STREAMING)) {
@@ -264,15 +279,55 @@ int PonscripterLabel::playSound(const pstring& filename, int format,
 }
 
 
+// Starts Ogg Vorbis or MP3 music reading straight from the archive, so
+// that the whole file never has to be held in memory.  Anything else
+// is left to playSound, which loads the file first.
+int PonscripterLabel::playStream(const pstring& filename, int format)
+{
+    SDL_RWops* src = ScriptHandler::cBR->openFile(filename);
+    if (!src) return SOUND_NONE;
+
+    // Keep the order playSound tries formats in: WAVE and MIDI files
+    // must not reach SMPEG, and WMA isn't played at all.
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    SDL_RWread(src, magic, 1, 4);
+    SDL_RWseek(src, 0, RW_SEEK_SET);
+    if (!memcmp(magic, "RIFF", 4) || !memcmp(magic, "FORM", 4) ||
+        !memcmp(magic, "Crea", 4) || !memcmp(magic, "MThd", 4) ||
+        (magic[0] == 0x30 && magic[1] == 0x26 &&
+         magic[2] == 0xb2 && magic[3] == 0x75)) {
+        SDL_RWclose(src);
+        return SOUND_NONE;
+    }
+
+    if (format & SOUND_OGG_STREAMING) {
+        int channels, rate;
+        OVInfo* ovi = openOggVorbis(src, channels, rate);
+        if (ovi) {
+            streamOGG(ovi, channels, rate);
+            return SOUND_OGG_STREAMING;
+        }
+        SDL_RWseek(src, 0, RW_SEEK_SET);
+    }
+
+    if ((format & SOUND_MP3) && !music_cmd) {
+        // SMPEG owns src from here on, even if it fails.
+        mp3_sample = SMPEG_new_rwops(src, NULL, 1, 0);
+        return playMP3() == 0 ? SOUND_MP3 : SOUND_NONE;
+    }
+
+    SDL_RWclose(src);
+    return SOUND_NONE;
+}
+
+
 int PonscripterLabel::playWave(Mix_Chunk* chunk, int format, bool loop_flag,
 			       int channel)
 {
     if (!chunk) return -1;
 
     Mix_Pause(channel);
-    if (wave_sample[channel]) Mix_FreeChunk(wave_sample[channel]);
-
-    wave_sample[channel] = chunk;
+    setWaveSample(channel, chunk);
 
     if (channel == 0)
         Mix_Volume(channel, !volume_on_flag? 0 : voice_volume * 128 / 100);
@@ -327,8 +382,12 @@ int PonscripterLabel::playMP3()
 int PonscripterLabel::playOGG(int format, unsigned char* buffer, long length, bool loop_flag, int channel)
 {
     int channels, rate;
-    OVInfo* ovi = openOggVorbis(buffer, length, channels, rate);
-    if (ovi == NULL) return SOUND_OTHER;
+    SDL_RWops* src = SDL_RWFromMem(buffer, length);
+    OVInfo* ovi = openOggVorbis(src, channels, rate);
+    if (ovi == NULL) {
+        SDL_RWclose(src);
+        return SOUND_OTHER;
+    }
 
     if (format & SOUND_OGG) {
         unsigned char* buffer2 = new unsigned char[sizeof(WAVE_HEADER) + ovi->decoded_length];
@@ -349,6 +408,17 @@ int PonscripterLabel::playOGG(int format, unsigned char* buffer, long length, bo
         return SOUND_OGG;
     }
 
+    streamOGG(ovi, channels, rate);
+
+    music_buffer = buffer;
+    music_buffer_length = length;
+
+    return SOUND_OGG_STREAMING;
+}
+
+
+void PonscripterLabel::streamOGG(OVInfo* ovi, int channels, int rate)
+{
     if ((audio_format.format != AUDIO_S16) ||
         (audio_format.freq != rate)) {
         Mix_CloseAudio();
@@ -370,11 +440,6 @@ int PonscripterLabel::playOGG(int format, unsigned char* buffer, long length, bo
     music_struct.volume = music_volume;
     music_struct.is_mute = !volume_on_flag;
     Mix_HookMusic(oggcallback, &music_struct);
-
-    music_buffer = buffer;
-    music_buffer_length = length;
-
-    return SOUND_OGG_STREAMING;
 }
 
 
@@ -496,7 +561,8 @@ int PonscripterLabel::setVolumeMute( bool do_mute )
 // simply must shift all this stuff into plain C variables.
 struct SubAndTexture {
   AnimationInfo *ai;
-  SDL_Texture *tex;
+  SDL_Texture *tex; // kept across subtitle changes; grown as needed
+  int tex_w, tex_h;
 };
 typedef std::vector<SubAndTexture*> olvec;
 static olvec overlays;
@@ -507,11 +573,22 @@ static SDL_Texture *video_texture = NULL;
  */
 static SDL_Renderer *video_renderer = NULL;
 
+// Called by SMPEG's video thread with c->lock held.
 void UpdateMPEG(void *data, SMPEG_Frame *frame) {
   update_context *c = (update_context *)data;
   c->frame = frame;
+  // SMPEG hands each frame over when it is due; it is late if it is
+  // still not on screen when the next one is.
+  SMPEG_Info info;
+  SMPEG_getinfo(c->mpeg, &info);
+  c->next_due = info.current_fps > 0
+      ? info.current_time + 1.0 / info.current_fps : 0;
+  ++c->frames;
+  // The previous frame was never shown
+  if (c->dirty) ++c->dropped;
   // Let ourselves know we've got a new frame to render
   c->dirty = 1;
+  SDL_CondSignal(c->ready);
 }
 
 int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
@@ -520,8 +597,12 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
     int ret = 0;
 #ifndef MP3_MAD
     bool different_spec = false;
-    pstring mpeg_dat = ScriptHandler::cBR->getFile(filename);
-    SMPEG* mpeg_sample = SMPEG_new_rwops(rwops(mpeg_dat), 0, 0, 0);
+    SDL_RWops* src = ScriptHandler::cBR->openFile(filename);
+    if (!src) {
+        errorAndCont(filename + " not found");
+        return 0;
+    }
+    SMPEG* mpeg_sample = SMPEG_new_rwops(src, 0, 1, 0);
     if (!SMPEG_error(mpeg_sample)) {
         SMPEG_enableaudio(mpeg_sample, 0);
 
@@ -551,6 +632,8 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
         update_context c;
         c.dirty = 0;
         c.lock = SDL_CreateMutex();
+        c.ready = SDL_CreateCond();
+        c.frames = c.dropped = c.late = 0;
 
         /* SMPEG wants the width to be a multiple of 16 */
         int texture_width = (screen_width + 15) & ~15;
@@ -567,6 +650,7 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
           overlays.assign(size_t(subtitles.numdefs()), NULL);
         }
 
+        c.mpeg = mpeg_sample;
         SMPEG_setdisplay(mpeg_sample, UpdateMPEG, &c, c.lock);
 
         SMPEG_setvolume(mpeg_sample, !volume_on_flag? 0 : music_volume);
@@ -638,25 +722,20 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
                 if (info.current_time >= subtitles.next()) {
                     Subtitle s = subtitles.pop();
 
-                    if (overlays[s.number]) {
-                      if(overlays[s.number]->tex) {
-                        SDL_DestroyTexture(overlays[s.number]->tex);
-                        overlays[s.number]->tex = NULL;
-                      }
-                      if(overlays[s.number]->ai) {
-                        delete overlays[s.number]->ai;
-                        overlays[s.number]->ai = NULL;
-                      }
-                      delete overlays[s.number];
-                      overlays[s.number] = NULL;
+                    SubAndTexture *sub = overlays[s.number];
+                    if (!sub) {
+                        sub = overlays[s.number] = new SubAndTexture();
+                        sub->ai = NULL;
+                        sub->tex = NULL;
+                        sub->tex_w = sub->tex_h = 0;
+                    }
+                    if (sub->ai) {
+                        delete sub->ai;
+                        sub->ai = NULL;
                     }
-
-                    AnimationInfo* overlay = 0;
-                    SDL_Texture *overlay_tex = NULL;
-
 
                     if (s.text) {
-                        overlay = new AnimationInfo();
+                        AnimationInfo* overlay = new AnimationInfo();
                         overlay->setImageName(s.text);
                         overlay->pos.x = screen_width / 2;
                         overlay->pos.y = subtitles.pos(s.number);
@@ -665,19 +744,31 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
                         setupAnimationInfo(overlay);
                         overlay->trans = subtitles.alpha(s.number);
 
-                        /* Create the texture that we'll use to render this */
-                        overlay_tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, texture_width, texture_height);
-                        SDL_UpdateTexture(overlay_tex, &overlay->pos, overlay->image_surface->pixels, overlay->image_surface->pitch);
-                        SDL_SetTextureBlendMode(overlay_tex, SDL_BLENDMODE_BLEND);
-                        SDL_SetTextureAlphaMod(overlay_tex, overlay->trans);
-
-
-                        overlays[s.number] = new SubAndTexture();
-                        overlays[s.number]->ai = overlay;
-                        overlays[s.number]->tex = overlay_tex;
+                        /* Reuse this line's texture unless the new text
+                           doesn't fit; only the text's own rect is uploaded */
+                        if (!sub->tex || overlay->pos.w > sub->tex_w
+                            || overlay->pos.h > sub->tex_h) {
+                            if (sub->tex) SDL_DestroyTexture(sub->tex);
+                            sub->tex_w = std::max(overlay->pos.w, sub->tex_w);
+                            sub->tex_h = std::max(overlay->pos.h, sub->tex_h);
+                            sub->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, sub->tex_w, sub->tex_h);
+                            SDL_SetTextureBlendMode(sub->tex, SDL_BLENDMODE_BLEND);
+                        }
+                        SDL_Rect r = { 0, 0, overlay->pos.w, overlay->pos.h };
+                        SDL_UpdateTexture(sub->tex, &r, overlay->image_surface->pixels, overlay->image_surface->pitch);
+                        SDL_SetTextureAlphaMod(sub->tex, overlay->trans);
+
+                        sub->ai = overlay;
                     }
                 }
             }
+
+            /* Wait for the next frame rather than polling; the timeout
+               keeps input and subtitle timing responsive */
+            SDL_mutexP(c.lock);
+            if (!c.dirty) SDL_CondWaitTimeout(c.ready, c.lock, 10);
+            SDL_mutexV(c.lock);
+
             if(c.dirty) {
               SDL_mutexP(c.lock);
               c.dirty = 0; //Flag that we're handling this; if a new frame appears we should deal with it too.
@@ -707,15 +798,20 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
                 /* render any subs onto the screen */
                 for(olvec::iterator it = overlays.begin(); it != overlays.end(); ++it) {
                   if((*it) && (*it)->ai && (*it)->tex) {
-                    SDL_RenderCopy(renderer, (*it)->tex, &(*it)->ai->pos, &(*it)->ai->pos);
+                    SDL_Rect r = { 0, 0, (*it)->ai->pos.w, (*it)->ai->pos.h };
+                    SDL_RenderCopy(renderer, (*it)->tex, &r, &(*it)->ai->pos);
                   }
                 }
               }
 
+              double next_due = c.next_due;
               SDL_mutexV(c.lock);
               SDL_RenderPresent(renderer);
+
+              SMPEG_Info info;
+              SMPEG_getinfo(mpeg_sample, &info);
+              if (next_due > 0 && info.current_time > next_due) ++c.late;
             }
-            SDL_Delay(10);
         }
 
         ctrl_pressed_status = 0;
@@ -725,6 +821,11 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
         SMPEG_delete(mpeg_sample);
         SDL_DestroyTexture(video_texture);
         video_texture = NULL;
+        SDL_DestroyCond(c.ready);
+
+        if (debug_level > 0)
+            printf("playMPEG: %d frames decoded, %d dropped, %d late\n",
+                   c.frames, c.dropped, c.late);
 
         if (different_spec) {
             //restart mixer with the old audio spec
@@ -762,7 +863,7 @@ int PonscripterLabel::playMPEG(const pstring& filename, bool click_flag,
 void PonscripterLabel::playAVI(const pstring& filename, bool click_flag)
 {
 #ifdef USE_AVIFILE
-    pstring abs_fname = archive_path + filename;
+    pstring abs_fname = archive_path.get_path(0) + filename;
     replace_ascii(abs_fname, '/', DELIMITER[0]);
     replace_ascii(abs_fname, '\\', DELIMITER[0]);
 
@@ -770,8 +871,8 @@ void PonscripterLabel::playAVI(const pstring& filename, bool click_flag)
 
     AVIWrapper* avi = new AVIWrapper();
     if (avi->init(abs_fname, false) == 0
-        && avi->initAV(screen_surface, audio_open_flag) == 0) {
-        if (avi->play(click_flag)) endCommand();
+        && avi->initAV(renderer, audio_open_flag) == 0) {
+        if (avi->play(click_flag)) endCommand("end");
     }
 
     delete avi;
@@ -812,8 +913,7 @@ void PonscripterLabel::stopBGM(bool continue_flag)
 
     if (wave_sample[MIX_BGM_CHANNEL]) {
         Mix_Pause(MIX_BGM_CHANNEL);
-        Mix_FreeChunk(wave_sample[MIX_BGM_CHANNEL]);
-        wave_sample[MIX_BGM_CHANNEL] = NULL;
+        setWaveSample(MIX_BGM_CHANNEL, NULL);
     }
 
     if (!continue_flag) {
@@ -854,13 +954,25 @@ void PonscripterLabel::stopBGM(bool continue_flag)
 }
 
 
+// Frees whatever was in the slot; everything that fills or empties
+// wave_sample[] goes through here so that MemStats sees it.
+void PonscripterLabel::setWaveSample(int channel, Mix_Chunk* chunk)
+{
+    if (wave_sample[channel]) {
+        MemStats::remove(MemStats::SOUNDS, wave_sample[channel]->alen);
+        Mix_FreeChunk(wave_sample[channel]);
+    }
+    if (chunk) MemStats::add(MemStats::SOUNDS, chunk->alen);
+    wave_sample[channel] = chunk;
+}
+
+
 void PonscripterLabel::stopAllDWAVE()
 {
     for (int ch = 0; ch < ONS_MIX_CHANNELS; ++ch) {
         if (wave_sample[ch]) {
             Mix_Pause(ch);
-            Mix_FreeChunk(wave_sample[ch]);
-            wave_sample[ch] = NULL;
+            setWaveSample(ch, NULL);
         }
     }
 }
@@ -928,14 +1040,7 @@ static size_t oc_read_func(void* ptr, size_t size, size_t nmemb,
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    ogg_int64_t len = size * nmemb;
-    if (ogg_vorbis_info->pos + len > ogg_vorbis_info->length)
-        len = ogg_vorbis_info->length - ogg_vorbis_info->pos;
-
-    memcpy(ptr, ogg_vorbis_info->buf + ogg_vorbis_info->pos, len);
-    ogg_vorbis_info->pos += len;
-
-    return len;
+    return SDL_RWread(ogg_vorbis_info->src, ptr, size, nmemb);
 }
 
 
@@ -943,17 +1048,18 @@ static int oc_seek_func(void* datasource, ogg_int64_t offset, int whence)
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    ogg_int64_t pos = 0;
+    SDL_RWops* src = ogg_vorbis_info->src;
+    Sint64 pos = 0;
     if (whence == 0)
         pos = offset;
     else if (whence == 1)
-        pos = ogg_vorbis_info->pos + offset;
+        pos = SDL_RWtell(src) + offset;
     else if (whence == 2)
-        pos = ogg_vorbis_info->length + offset;
+        pos = SDL_RWsize(src) + offset;
 
-    if (pos < 0 || pos > ogg_vorbis_info->length) return -1;
+    if (pos < 0 || pos > SDL_RWsize(src)) return -1;
 
-    ogg_vorbis_info->pos = pos;
+    SDL_RWseek(src, pos, RW_SEEK_SET);
 
     return 0;
 }
@@ -969,23 +1075,23 @@ static long oc_tell_func(void* datasource)
 {
     OVInfo* ogg_vorbis_info = (OVInfo*) datasource;
 
-    return ogg_vorbis_info->pos;
+    return SDL_RWtell(ogg_vorbis_info->src);
 }
 
 
 #endif
-OVInfo* PonscripterLabel::openOggVorbis(unsigned char* buf, long len,
-                                        int &channels, int &rate)
+// On success the returned OVInfo owns src; on failure the caller
+// still does.
+OVInfo* PonscripterLabel::openOggVorbis(SDL_RWops* src, int &channels,
+                                        int &rate)
 {
     OVInfo* ovi = NULL;
 
 #ifdef USE_OGG_VORBIS
     ovi = new OVInfo();
 
-    ovi->buf = buf;
+    ovi->src = src;
     ovi->decoded_length = 0;
-    ovi->length = len;
-    ovi->pos = 0;
 
     ov_callbacks oc;
     oc.read_func  = oc_read_func;
@@ -1024,13 +1130,12 @@ OVInfo* PonscripterLabel::openOggVorbis(unsigned char* buf, long len,
 
 int PonscripterLabel::closeOggVorbis(OVInfo* ovi)
 {
-    if (ovi->buf) {
-        ovi->buf = NULL;
+    if (ovi->src) {
 #ifdef USE_OGG_VORBIS
-        ovi->length = 0;
-        ovi->pos = 0;
         ov_clear(&ovi->ovf);
 #endif
+        SDL_RWclose(ovi->src);
+        ovi->src = NULL;
     }
 
     if (ovi->cvt.buf) {
@@ -30,12 +30,7 @@ PonscripterLabel::renderGlyph(Font* font, Uint16 text, int size,
                               float x_fractional_part)
 {
     font->set_size(size);
-     /* Initializing SDL_Color.unused here to silence warnings about unused
-       variables. 32 bit operations should be faster than 24 bit ones anyway.
-       Users will be delighted by this 0.0000001 microsecond increase in speed.
-     (contribution by Andrius, March 2010) */
-    static SDL_Color fcol={0xff, 0xff, 0xff, 0xff}, bcol={0, 0, 0, 0};
-    current_glyph = font->render_glyph(text, fcol, bcol, x_fractional_part);
+    current_glyph = font->render_glyph(text, x_fractional_part);
     return current_glyph;
 }
 
@@ -56,7 +51,7 @@ PonscripterLabel::drawGlyph(SDL_Surface* dst_surface, Fontinfo* info,
               x + minx - floor(x + minx));
     bool rotate_flag = false;
 
-    if (g.bitmap) {
+    if (g.pixels) {
     minx = g.left;
     maxy = g.top;
     }
@@ -72,23 +67,35 @@ PonscripterLabel::drawGlyph(SDL_Surface* dst_surface, Fontinfo* info,
         dst_rect.y += shade_distance[1];
     }
 
-    if (g.bitmap) {
-        dst_rect.w = g.bitmap->w;
-        dst_rect.h = g.bitmap->h;
+    if (g.pixels) {
+        dst_rect.w = g.w;
+        dst_rect.h = g.h;
 
-        if (cache_info == &text_info) {
+        if (cache_info && cache_info == glyph_batch_info && !dst_surface &&
+            !clip) {
+            AnimationInfo::GlyphBlend b;
+            b.glyph = g;
+            b.x = dst_rect.x;
+            b.y = dst_rect.y;
+            b.color = color;
+            glyph_batch.push_back(b);
+        }
+        else if (cache_info == &text_info) {
             // When rendering text
-            cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
+            cache_info->blendText(g, dst_rect.x, dst_rect.y,
                                   color, clip);
-            cache_info->blendOnSurface(dst_surface, 0, 0, dst_rect);
+            if (dst_surface == accumulation_surface)
+                refreshTextRect(dst_rect);
+            else
+                cache_info->blendOnSurface(dst_surface, 0, 0, dst_rect);
         }
         else {
             if (cache_info)
-                cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
+                cache_info->blendText(g, dst_rect.x, dst_rect.y,
                                       color, clip);
 
             if (dst_surface)
-                alphaBlendText(dst_surface, dst_rect, g.bitmap, color, clip,
+                alphaBlendText(dst_surface, dst_rect, g, color, clip,
                                rotate_flag);
         }
     }
@@ -221,18 +228,34 @@ PonscripterLabel::drawString(const char* str, rgb_t color, Fontinfo* info,
 }
 
 
+void PonscripterLabel::flushGlyphBatch()
+{
+    if (glyph_batch_info) glyph_batch_info->blendGlyphs(glyph_batch, NULL);
+    glyph_batch.clear();
+    glyph_batch_info = NULL;
+}
+
+
 void PonscripterLabel::restoreTextBuffer()
 {
     text_info.fill(0, 0, 0, 0);
 
     Fontinfo f_info = sentence_font;
     f_info.clear();
+
+    // The page still being written changes with every character, so
+    // only finished pages are worth keeping.
+    TextBuffer* page = current_text_buffer[current_language];
+    bool cacheable = page != cached_text_buffer[current_language];
+    if (cacheable && restoreLookbackPage(page, sentence_font)) return;
+
     const char* buffer = current_text_buffer[current_language]->contents;
     int buffer_count = current_text_buffer[current_language]->contents.length();
 
     const wchar first_ch = file_encoding->DecodeWithLigatures(buffer, f_info);
     if (is_indent_char(first_ch)) f_info.SetIndent(first_ch);
 
+    glyph_batch_info = &text_info;
     int i = 0;
     while (i < buffer_count) {
         if (buffer[i] == 0x0a) {
@@ -243,6 +266,135 @@ void PonscripterLabel::restoreTextBuffer()
             i += drawChar(buffer + i, &f_info, false, false, NULL, &text_info);
         }
     }
+    flushGlyphBatch();
+
+    if (cacheable) storeLookbackPage(page, sentence_font);
+}
+
+
+static bool sameLayout(Fontinfo& a, Fontinfo& b)
+{
+    return a.top_x == b.top_x && a.top_y == b.top_y
+        && a.area_x == b.area_x && a.area_y == b.area_y
+        && a.pitch_x == b.pitch_x && a.pitch_y == b.pitch_y
+        && a.size() == b.size() && a.style == b.style
+        && a.is_bold == b.is_bold && a.is_shadow == b.is_shadow
+        && a.color.r == b.color.r && a.color.g == b.color.g
+        && a.color.b == b.color.b
+        && a.getTateYoko() == b.getTateYoko() && a.getRTL() == b.getRTL();
+}
+
+
+bool PonscripterLabel::restoreLookbackPage(TextBuffer* buf, const Fontinfo& f)
+{
+#ifdef BPP16
+    return false;
+#else
+    lookback_pages_t::iterator it = lookback_pages.find(buf);
+    if (it == lookback_pages.end()) return false;
+
+    LookbackPage& page = it->second;
+    Fontinfo f_info = f;
+    f_info.clear();
+    if (page.contents != buf->contents || !sameLayout(page.font, f_info)) {
+        lookback_bytes -= page.surface->pitch * page.surface->h;
+        SDL_FreeSurface(page.surface);
+        lookback_pages.erase(it);
+        return false;
+    }
+
+    text_info.copySurface(page.surface, NULL, &page.rect);
+    page.serial = ++lookback_serial;
+    ++lookback_hits;
+    return true;
+#endif
+}
+
+
+// Called with text_info holding the freshly drawn page: keeps the part
+// of it that has any ink in it.
+void PonscripterLabel::storeLookbackPage(TextBuffer* buf, const Fontinfo& f)
+{
+#ifndef BPP16
+    ++lookback_misses;
+    SDL_Surface* src = text_info.image_surface;
+    if (!src) return;
+
+    SDL_LockSurface(src);
+    int x1 = src->w, y1 = src->h, x2 = -1, y2 = -1;
+    for (int y = 0; y < src->h; ++y) {
+        Uint32* row = (Uint32*) ((unsigned char*) src->pixels + src->pitch * y);
+        for (int x = 0; x < src->w; ++x) {
+            if (!(row[x] & src->format->Amask)) continue;
+            if (x < x1) x1 = x;
+            if (x > x2) x2 = x;
+            if (y < y1) y1 = y;
+            y2 = y;
+        }
+    }
+    SDL_UnlockSurface(src);
+
+    if (x2 < 0) x1 = y1 = x2 = y2 = 0; // blank page: keep one clear pixel
+
+    LookbackPage page;
+    page.contents = buf->contents;
+    page.font = f;
+    page.font.clear();
+    page.rect.x = x1;
+    page.rect.y = y1;
+    page.rect.w = x2 - x1 + 1;
+    page.rect.h = y2 - y1 + 1;
+    page.surface = AnimationInfo::allocSurface(page.rect.w, page.rect.h);
+    if (!page.surface) return;
+    size_t bytes = page.surface->pitch * page.surface->h;
+    if (bytes > LOOKBACK_CACHE_BYTES) {
+        SDL_FreeSurface(page.surface);
+        return;
+    }
+
+    SDL_LockSurface(src);
+    SDL_LockSurface(page.surface);
+    for (int y = 0; y < page.rect.h; ++y)
+        memcpy((unsigned char*) page.surface->pixels + page.surface->pitch * y,
+               (ONSBuf*) ((unsigned char*) src->pixels
+                          + src->pitch * (page.rect.y + y)) + page.rect.x,
+               page.rect.w * sizeof(ONSBuf));
+    SDL_UnlockSurface(page.surface);
+    SDL_UnlockSurface(src);
+
+    lookback_pages_t::iterator it = lookback_pages.find(buf);
+    if (it != lookback_pages.end()) {
+        lookback_bytes -= it->second.surface->pitch * it->second.surface->h;
+        SDL_FreeSurface(it->second.surface);
+        lookback_pages.erase(it);
+    }
+
+    // Drop the least recently viewed pages until the new one fits.
+    while (!lookback_pages.empty() &&
+           lookback_bytes + bytes > LOOKBACK_CACHE_BYTES) {
+        lookback_pages_t::iterator oldest = lookback_pages.begin();
+        for (it = lookback_pages.begin(); it != lookback_pages.end(); ++it)
+            if (it->second.serial < oldest->second.serial) oldest = it;
+        lookback_bytes -= oldest->second.surface->pitch
+                          * oldest->second.surface->h;
+        SDL_FreeSurface(oldest->second.surface);
+        lookback_pages.erase(oldest);
+    }
+
+    page.serial = ++lookback_serial;
+    lookback_pages[buf] = page;
+    lookback_bytes += bytes;
+#endif
+}
+
+
+void PonscripterLabel::clearLookbackPages()
+{
+    for (lookback_pages_t::iterator it = lookback_pages.begin();
+         it != lookback_pages.end(); ++it)
+        SDL_FreeSurface(it->second.surface);
+    lookback_pages.clear();
+    lookback_bytes = 0;
 }
 
 
@@ -301,6 +453,7 @@ int PonscripterLabel::leaveTextDisplayMode(bool force_leave_flag)
             refreshSurface(backup_surface, &dirty_rect.bounding_box, REFRESH_NORMAL_MODE);
             SDL_BlitSurface(backup_surface, NULL, effect_dst_surface, NULL);
             SDL_BlitSurface(accumulation_surface, NULL, backup_surface, NULL);
+            textBelowChanged(effect_dst_surface);
 
             return setEffect(window_effect, false, false);
         }
@@ -692,6 +845,31 @@ int PonscripterLabel::processText()
                  flush_flag, true, accumulation_surface, &text_info);
         ++num_chars_in_sentence;
 
+        // Nothing is shown until the next flush anyway, so lay out the
+        // rest of the run here rather than going back through
+        // executeLabel for every character.  The run stops short of
+        // anything processText would treat as a command or a wait, and
+        // leaves the last character drawn for parseLine to finish.
+        if (!flush_flag && (current_read_language == -1 ||
+                            current_read_language == current_language)) {
+            while (sentence_font.GetXOffset() != 0 ||
+                   sentence_font.GetYOffset() != 0) {
+                int lf;
+                file_encoding->DecodeWithLigatures
+                    (script_h.getStrBuf(string_buffer_offset),
+                     sentence_font, lf);
+                const char* c = script_h.getStrBuf(string_buffer_offset + lf);
+                if (*c == 0 || *c == 0x0a || strchr("@\\_!#/", *c) ||
+                    script_h.checkClickstr(c))
+                    break;
+
+                string_buffer_offset += checkLineBreak();
+                drawChar(c, &sentence_font, false, true, accumulation_surface,
+                         &text_info);
+                ++num_chars_in_sentence;
+            }
+        }
+
         if (flush_flag) {
             event_mode = WAIT_SLEEP_MODE;
             int wait_time = 0;
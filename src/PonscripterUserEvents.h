@@ -7,3 +7,6 @@
 
 // This sets up the fadeout event flag for use in mp3 fadeout.  Recommend for integration.  [Seung Park, 20060621]
 #define ONS_FADE_EVENT (SDL_USEREVENT + 6)
+
+// Time to log a line of memory use (--memstats)
+#define ONS_MEMSTATS_EVENT (SDL_USEREVENT + 7)
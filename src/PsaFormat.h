@@ -0,0 +1,118 @@
+/* -*- C++ -*-
+ *
+ *  PsaFormat.h - On-disk layout of Ponscripter archives (.psa)
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Shared by PsaReader and the psapack tool, so this must not depend
+// on SDL or pstring.
+//
+// All integers are little-endian.  The file is laid out as
+//
+//   header     24 bytes
+//   data       entry contents, back to back
+//   directory  count records of 40 bytes, sorted by (hash, name)
+//   names      names_length bytes of NUL-terminated names
+//
+// Header:    magic[4] version:u16 flags:u16 count:u32 names_length:u32
+//            dir_offset:u64
+// Record:    hash:u32 name_offset:u32 offset:u64 length:u64
+//            original_length:u64 codec:u8 reserved[3] crc32:u32
+//
+// Names use '\' as the separator, as in NSA archives.  The hash is
+// FNV-1a over the name with ASCII letters folded to upper case, so a
+// lookup is a binary search on the hash followed by a caseless compare.
+// crc32 covers the original (decompressed) contents.  A compressed
+// entry is a single LZ4 block, so it is limited to LZ4_MAX_INPUT_SIZE
+// bytes; anything larger is stored.
+
+#ifndef __PSA_FORMAT_H__
+#define __PSA_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PSA_MAGIC "PSA\x1a"
+#define PSA_VERSION 1
+#define PSA_HEADER_SIZE 24
+#define PSA_RECORD_SIZE 40
+
+enum {
+    PSA_CODEC_STORED = 0,
+    PSA_CODEC_LZ4    = 1
+};
+
+
+inline uint32_t psa_get32(const unsigned char* p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+
+inline uint64_t psa_get64(const unsigned char* p)
+{
+    return psa_get32(p) | (uint64_t) psa_get32(p + 4) << 32;
+}
+
+
+inline void psa_put32(unsigned char* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+
+inline void psa_put64(unsigned char* p, uint64_t v)
+{
+    psa_put32(p, (uint32_t) v);
+    psa_put32(p + 4, (uint32_t) (v >> 32));
+}
+
+
+inline uint32_t psa_hash(const char* name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; ++name) {
+        unsigned char c = *name;
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        else if (c == '/') c = '\\';
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+
+// Standard CRC-32 (as in zip and PNG).  Start with crc = 0 and feed
+// the result back in to checksum data in pieces.  The table is built
+// on first use, so make one call before sharing this across threads.
+inline uint32_t psa_crc32(uint32_t crc, const unsigned char* data, size_t len)
+{
+    static uint32_t table[256];
+    if (!table[255]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ c >> 1 : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (len--) crc = table[(crc ^ *data++) & 0xff] ^ crc >> 8;
+    return ~crc;
+}
+
+#endif // __PSA_FORMAT_H__
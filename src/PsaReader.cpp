@@ -0,0 +1,323 @@
+/* -*- C++ -*-
+ *
+ *  PsaReader.cpp - Reader from Ponscripter archives (.psa)
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "PsaReader.h"
+#include "PsaFormat.h"
+#include <lz4.h>
+#include <string.h>
+#include <algorithm>
+
+struct PsaHashLess {
+    template <class E>
+    bool operator()(const E& e, Uint32 hash) const { return e.hash < hash; }
+};
+
+
+PsaReader::PsaReader(DirPaths *path, const unsigned char* key_table)
+    : NsaReader(path, key_table),
+      num_of_psa_archives(0),
+      num_of_psa_files(0)
+{
+    for (int i = 0; i <= MAX_EXTRA_ARCHIVE; ++i)
+        psa_archive[i].file_handle = NULL;
+
+    // Build the CRC table now, before any reader threads exist.
+    psa_crc32(0, NULL, 0);
+}
+
+
+PsaReader::~PsaReader()
+{
+    close();
+}
+
+
+int PsaReader::open(const pstring& nsa_path, int archive_type)
+{
+    pstring archive_name, path;
+    int n = 0, j = 0;
+
+    while (num_of_psa_archives <= MAX_EXTRA_ARCHIVE
+           && n < archive_path->get_num_paths()) {
+        if (j == 0)
+            archive_name = nsa_path + "arc.psa";
+        else
+            archive_name.format("%sarc%d.psa", (const char*) nsa_path, j);
+        path = archive_path->get_path(n) + archive_name;
+
+        FILE* fp = fopen(path, "rb");
+        if (!fp) {
+            j = 0;
+            n++;
+            continue;
+        }
+
+        Archive& arc = psa_archive[num_of_psa_archives];
+        arc.file_handle = fp;
+        arc.file_name = path;
+        if (readDirectory(arc)) {
+            num_of_psa_files += arc.entries.size();
+            num_of_psa_archives++;
+        }
+        else {
+            fclose(fp);
+            arc.file_handle = NULL;
+            arc.entries.clear();
+        }
+        j++;
+    }
+
+    nsa_optional = num_of_psa_archives > 0;
+    int ret = NsaReader::open(nsa_path, archive_type);
+    return nsa_optional ? 0 : ret;
+}
+
+
+int PsaReader::close()
+{
+    for (int i = 0; i < num_of_psa_archives; ++i) {
+        fclose(psa_archive[i].file_handle);
+        psa_archive[i].file_handle = NULL;
+        psa_archive[i].entries.clear();
+    }
+    num_of_psa_archives = num_of_psa_files = 0;
+
+    return NsaReader::close();
+}
+
+
+bool PsaReader::readDirectory(Archive& arc)
+{
+    const char* name = arc.file_name;
+    unsigned char header[PSA_HEADER_SIZE];
+    if (readAt(arc.file_handle, 0, header, PSA_HEADER_SIZE) != PSA_HEADER_SIZE
+        || memcmp(header, PSA_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a PSA archive\n", name);
+        return false;
+    }
+    if ((header[4] | header[5] << 8) > PSA_VERSION) {
+        fprintf(stderr, "%s needs a newer version of Ponscripter\n", name);
+        return false;
+    }
+
+    Uint32 count = psa_get32(header + 8);
+    Uint32 names_length = psa_get32(header + 12);
+    Uint64 dir_offset = psa_get64(header + 16);
+    Uint64 dir_length = (Uint64) count * PSA_RECORD_SIZE + names_length;
+
+    // If ftell() can't represent the size, this check is skipped.
+    fseek(arc.file_handle, 0, SEEK_END);
+    Uint64 file_length = (Uint64) ftell(arc.file_handle);
+    if (dir_offset > file_length || dir_length > file_length - dir_offset
+        || dir_offset + dir_length > (size_t) -1) {
+        fprintf(stderr, "%s: directory is damaged or too large\n", name);
+        return false;
+    }
+
+    std::vector<unsigned char> dir(dir_length + 1);
+    if (readAt(arc.file_handle, dir_offset, &dir[0], dir_length)
+        != dir_length) {
+        fprintf(stderr, "%s: can't read directory\n", name);
+        return false;
+    }
+    const char* names = (const char*) &dir[count * PSA_RECORD_SIZE];
+    dir[dir_length] = 0;
+
+    arc.entries.resize(count);
+    for (Uint32 i = 0; i < count; ++i) {
+        const unsigned char* r = &dir[i * PSA_RECORD_SIZE];
+        Entry& e = arc.entries[i];
+        Uint32 name_offset = psa_get32(r + 4);
+        Uint64 offset = psa_get64(r + 8);
+        Uint64 length = psa_get64(r + 16);
+        Uint64 original_length = psa_get64(r + 24);
+
+        if (name_offset >= names_length || offset > dir_offset
+            || length > dir_offset - offset
+            || original_length > (size_t) -1
+            || (r[32] == PSA_CODEC_STORED && original_length != length)
+            || (i && psa_get32(r) < arc.entries[i - 1].hash)) {
+            fprintf(stderr, "%s: directory is damaged or too large\n", name);
+            return false;
+        }
+
+        e.hash  = psa_get32(r);
+        e.codec = r[32];
+        e.crc   = psa_get32(r + 36);
+        e.info.name = names + name_offset;
+        e.info.compression_type = NO_COMPRESSION;
+        e.info.offset = offset;
+        e.info.length = length;
+        e.info.original_length = original_length;
+    }
+
+    return true;
+}
+
+
+const PsaReader::Entry* PsaReader::findEntry(const pstring& file_name,
+                                             Archive** arc)
+{
+    pstring name = file_name;
+    replace_ascii(name, '/', '\\');
+    Uint32 hash = psa_hash(name);
+
+    for (int i = 0; i < num_of_psa_archives; ++i) {
+        entries_t& entries = psa_archive[i].entries;
+        entries_t::const_iterator e =
+            std::lower_bound(entries.begin(), entries.end(), hash,
+                             PsaHashLess());
+        for (; e != entries.end() && e->hash == hash; ++e) {
+            if (name.caselessEqual(e->info.name)) {
+                *arc = &psa_archive[i];
+                return &*e;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// Reads and checks a whole entry; buf must hold original_length bytes.
+size_t PsaReader::readEntry(Archive& arc, const Entry& e, unsigned char* buf)
+{
+    size_t length = e.info.original_length;
+    if (!length) return 0;
+
+    if (e.codec == PSA_CODEC_STORED) {
+        if (readAt(arc.file_handle, e.info.offset, buf, length) != length)
+            length = 0;
+    }
+    else if (e.codec == PSA_CODEC_LZ4
+             && e.info.length <= (size_t) LZ4_COMPRESSBOUND(LZ4_MAX_INPUT_SIZE)
+             && e.info.original_length <= LZ4_MAX_INPUT_SIZE) {
+        unsigned char* span = new unsigned char[e.info.length];
+        if (readAt(arc.file_handle, e.info.offset, span, e.info.length)
+            != e.info.length
+            || LZ4_decompress_safe((const char*) span, (char*) buf,
+                                   e.info.length, length) != (int) length)
+            length = 0;
+        delete[] span;
+    }
+    else {
+        fprintf(stderr, "%s: %s uses unknown compression %d\n",
+                (const char*) arc.file_name, (const char*) e.info.name,
+                e.codec);
+        return 0;
+    }
+
+    if (!length || psa_crc32(0, buf, length) != e.crc) {
+        fprintf(stderr, "%s: %s is damaged\n", (const char*) arc.file_name,
+                (const char*) e.info.name);
+        return 0;
+    }
+
+    return length;
+}
+
+
+// Loose files take priority over archives; a file in neither a loose
+// file nor a PSA archive gets checked for again by NsaReader, but
+// DirectReader caches directory listings so that costs little.
+size_t PsaReader::getFileLength(const pstring& file_name)
+{
+    if (!num_of_psa_archives) return NsaReader::getFileLength(file_name);
+
+    size_t ret;
+    if ((ret = DirectReader::getFileLength(file_name))) return ret;
+
+    Archive* arc;
+    const Entry* e = findEntry(file_name, &arc);
+    if (e) return e->info.original_length;
+
+    return NsaReader::getFileLength(file_name);
+}
+
+
+size_t PsaReader::getFile(const pstring& file_name, unsigned char* buffer,
+                          int* location)
+{
+    if (!num_of_psa_archives)
+        return NsaReader::getFile(file_name, buffer, location);
+
+    size_t ret;
+    if ((ret = DirectReader::getFile(file_name, buffer, location)))
+        return ret;
+
+    Archive* arc;
+    const Entry* e = findEntry(file_name, &arc);
+    if (e) {
+        if (location) *location = ARCHIVE_TYPE_PSA;
+
+        return readEntry(*arc, *e, buffer);
+    }
+
+    return NsaReader::getFile(file_name, buffer, location);
+}
+
+
+SDL_RWops* PsaReader::openFile(const pstring& file_name, int* location)
+{
+    if (!num_of_psa_archives)
+        return NsaReader::openFile(file_name, location);
+
+    SDL_RWops* src;
+    if ((src = DirectReader::openFile(file_name, location)))
+        return src;
+
+    Archive* arc;
+    const Entry* e = findEntry(file_name, &arc);
+    if (!e) return NsaReader::openFile(file_name, location);
+
+    if (location) *location = ARCHIVE_TYPE_PSA;
+
+    // Stored entries are streamed, so their checksum isn't checked.
+    if (e->codec == PSA_CODEC_STORED)
+        return openEntry(arc->file_handle, e->info.offset, e->info.length,
+                         false);
+
+    unsigned char* buf = new unsigned char[e->info.original_length];
+    size_t len = readEntry(*arc, *e, buf);
+    if (!len) {
+        delete[] buf;
+        return NULL;
+    }
+    return openBuffer(buf, len);
+}
+
+
+int PsaReader::getNumFiles()
+{
+    return num_of_psa_files + NsaReader::getNumFiles();
+}
+
+
+PsaReader::FileInfo PsaReader::getFileByIndex(unsigned int index)
+{
+    for (int i = 0; i < num_of_psa_archives; ++i) {
+        if (index < psa_archive[i].entries.size())
+            return psa_archive[i].entries[index].info;
+
+        index -= psa_archive[i].entries.size();
+    }
+
+    return NsaReader::getFileByIndex(index);
+}
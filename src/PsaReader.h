@@ -0,0 +1,69 @@
+/* -*- C++ -*-
+ *
+ *  PsaReader.h - Reader from Ponscripter archives (.psa), falling back
+ *  to NSA and SAR archives
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __PSA_READER_H__
+#define __PSA_READER_H__
+
+#include "NsaReader.h"
+#include <vector>
+
+// Files are looked up in loose files first, then arc.psa, arc1.psa
+// ... arc9.psa, then whatever NsaReader finds.  See PsaFormat.h for
+// the archive layout; psapack builds and unpacks these archives.
+class PsaReader : public NsaReader {
+public:
+    PsaReader(DirPaths *path = NULL, const unsigned char* key_table = NULL);
+    ~PsaReader();
+
+    int open(const pstring& nsa_path = "", int archive_type = ARCHIVE_TYPE_NSA);
+    int close();
+    pstring getArchiveName() const { return "psa"; }
+    int getNumFiles();
+
+    size_t getFileLength(const pstring& file_name);
+    size_t getFile(const pstring& file_name, unsigned char* buf,
+		   int* location = NULL);
+    SDL_RWops* openFile(const pstring& file_name, int* location = NULL);
+    FileInfo getFileByIndex(unsigned int index);
+
+private:
+    struct Entry {
+        Uint32 hash;
+        Uint32 crc;
+        int codec;
+        FileInfo info;
+    };
+    typedef std::vector<Entry> entries_t;
+
+    struct Archive {
+        FILE* file_handle;
+        pstring file_name;
+        entries_t entries;
+    } psa_archive[MAX_EXTRA_ARCHIVE + 1];
+    int num_of_psa_archives;
+    int num_of_psa_files;
+
+    bool readDirectory(Archive& arc);
+    const Entry* findEntry(const pstring& file_name, Archive** arc);
+    size_t readEntry(Archive& arc, const Entry& e, unsigned char* buf);
+};
+
+#endif // __PSA_READER_H__
@@ -26,11 +26,16 @@
 #include "SarReader.h"
 #define WRITE_LENGTH 4096
 
+// Guards the original_length fields that getOriginalLength() fills
+// in lazily, since reads may run on several threads.
+static SDL_mutex* length_lock = NULL;
+
 SarReader::SarReader(DirPaths *path, const unsigned char* key_table)
     : DirectReader(path, key_table),
       num_of_sar_archives(0)
 {
     root_archive_info   = last_archive_info = &archive_info;
+    if (!length_lock) length_lock = SDL_CreateMutex();
 }
 
 
@@ -203,18 +208,34 @@ size_t SarReader::getFileLength(const pstring& file_name)
 
     if (!info) return 0;
 
-    if ( info->fi_list[j].original_length != 0 ){
-        return info->fi_list[j].original_length;
-    }
+    return getOriginalLength(info, j, file_name);
+}
 
-    int type = info->fi_list[j].compression_type;
-    if ( type == NO_COMPRESSION )
-        type = getRegisteredCompressionType( file_name );
-    if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION ) {
-        info->fi_list[j].original_length = getDecompressedFileLength( type, info->file_handle, info->fi_list[j].offset );
+
+size_t SarReader::getOriginalLength(ArchiveInfo* ai, unsigned int i,
+                                    const pstring& file_name)
+{
+    FileInfo& fi = ai->fi_list[i];
+    SDL_mutexP(length_lock);
+    if (fi.original_length == 0) {
+        int type = fi.compression_type;
+        if ( type == NO_COMPRESSION )
+            type = getRegisteredCompressionType( file_name );
+        if ( type == NBZ_COMPRESSION || type == SPB_COMPRESSION )
+            fi.original_length = getDecompressedFileLength( type, ai->file_handle, fi.offset );
     }
+    size_t length = fi.original_length;
+    SDL_mutexV(length_lock);
+    return length;
+}
+
 
-    return info->fi_list[j].original_length;
+SarReader::FileInfo SarReader::getFileInfo(ArchiveInfo* ai, unsigned int i)
+{
+    SDL_mutexP(length_lock);
+    FileInfo fi = ai->fi_list[i];
+    SDL_mutexV(length_lock);
+    return fi;
 }
 
 
@@ -228,17 +249,19 @@ size_t SarReader::getFileSub(ArchiveInfo* ai, const pstring& file_name,
     if (type == NO_COMPRESSION) type = getRegisteredCompressionType(file_name);
 
     if (type == NBZ_COMPRESSION) {
-        return decodeNBZ(ai->file_handle, ai->fi_list[i].offset, buf);
+        return decodeNBZ(ai->file_handle, ai->fi_list[i].offset,
+                         ai->fi_list[i].length, buf);
     }
     else if (type == LZSS_COMPRESSION) {
         return decodeLZSS(ai, i, buf);
     }
     else if (type == SPB_COMPRESSION) {
-        return decodeSPB(ai->file_handle, ai->fi_list[i].offset, buf);
+        return decodeSPB(ai->file_handle, ai->fi_list[i].offset,
+                         ai->fi_list[i].length, buf);
     }
 
-    fseek(ai->file_handle, ai->fi_list[i].offset, SEEK_SET);
-    size_t ret = fread(buf, 1, ai->fi_list[i].length, ai->file_handle);
+    size_t ret = readAt(ai->file_handle, ai->fi_list[i].offset, buf,
+                        ai->fi_list[i].length);
     for (size_t j = 0; j < ret; j++) buf[j] = key_table[buf[j]];
 
     return ret;
@@ -265,11 +288,60 @@ size_t SarReader::getFile(const pstring& file_name, unsigned char* buf,
 }
 
 
+SDL_RWops* SarReader::openFileSub(ArchiveInfo* ai, const pstring& file_name)
+{
+    unsigned int i = getIndexFromFile(ai, file_name);
+    if (i == ai->num_of_files) return NULL;
+
+    int type = ai->fi_list[i].compression_type;
+    if (type == NO_COMPRESSION) type = getRegisteredCompressionType(file_name);
+
+    if (type == NO_COMPRESSION)
+        return openEntry(ai->file_handle, ai->fi_list[i].offset,
+                         ai->fi_list[i].length, true);
+
+    // This is the first archive holding the file, so getFileLength()
+    // finds this same entry.
+    size_t len = getFileLength(file_name);
+    if (!len) return NULL;
+
+    if (type == NBZ_COMPRESSION || type == LZSS_COMPRESSION)
+        return openCompressedEntry(ai->file_handle, ai->fi_list[i].offset,
+                                   ai->fi_list[i].length, type, len);
+
+    // SPB is stored bottom-up, so it can't be decoded in order; decode
+    // it whole.
+    unsigned char* buf = new unsigned char[len];
+    memset(buf, 0, len); // SPB leaves row padding unwritten
+    return openBuffer(buf, getFileSub(ai, file_name, buf));
+}
+
+
+SDL_RWops* SarReader::openFile(const pstring& file_name, int* location)
+{
+    SDL_RWops* src;
+    if ((src = DirectReader::openFile(file_name, location))) return src;
+
+    ArchiveInfo* info = archive_info.next;
+    for (int i = 0; i < num_of_sar_archives; i++) {
+        if ((src = openFileSub(info, file_name))) {
+            if (location) *location = ARCHIVE_TYPE_SAR;
+
+            return src;
+        }
+
+        info = info->next;
+    }
+
+    return NULL;
+}
+
+
 SarReader::FileInfo SarReader::getFileByIndex(unsigned int index)
 {
     ArchiveInfo* info = archive_info.next;
     for (int i = 0; i < num_of_sar_archives; i++) {
-        if (index < info->num_of_files) return info->fi_list[index];
+        if (index < info->num_of_files) return getFileInfo(info, index);
 
         index -= info->num_of_files;
         info = info->next;
@@ -278,5 +350,5 @@ SarReader::FileInfo SarReader::getFileByIndex(unsigned int index)
     fprintf(stderr, "SarReader::getFileByIndex  Index %d is out of range\n",
 	    index);
 
-    return archive_info.fi_list[index];
+    return getFileInfo(&archive_info, index);
 }
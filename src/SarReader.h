@@ -41,6 +41,7 @@ public:
     size_t getFileLength(const pstring& file_name);
     size_t getFile(const pstring& file_name, unsigned char* buf,
 		   int* location = NULL);
+    SDL_RWops* openFile(const pstring& file_name, int* location = NULL);
     FileInfo getFileByIndex(unsigned int index);
 
 protected:
@@ -50,8 +51,14 @@ protected:
 
     int readArchive(ArchiveInfo* ai, int archive_type = ARCHIVE_TYPE_SAR);
     int getIndexFromFile(ArchiveInfo* ai, pstring file_name);
+    // Entry i of ai, with its decoded length filled in if readArchive()
+    // left it to be worked out on first use.
+    size_t getOriginalLength(ArchiveInfo* ai, unsigned int i,
+                             const pstring& file_name);
+    FileInfo getFileInfo(ArchiveInfo* ai, unsigned int i);
     size_t getFileSub(ArchiveInfo* ai, const pstring& file_name,
 		      unsigned char* buf);
+    SDL_RWops* openFileSub(ArchiveInfo* ai, const pstring& file_name);
 };
 
 #endif // __SAR_READER_H__
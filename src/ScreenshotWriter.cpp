@@ -0,0 +1,238 @@
+/* -*- C++ -*-
+ *
+ *  ScreenshotWriter.cpp - Scaling and saving screenshots in the
+ *  background
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ScreenshotWriter.h"
+#include "resize_image.h"
+
+ScreenshotWriter::ScreenshotWriter()
+    : thread(NULL), quit(false), busy(false), screenshot(NULL)
+{
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+    idle_cond = SDL_CreateCond();
+}
+
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+    // The worker empties the queue before it stops, so nothing that
+    // was saved is lost.
+    if (thread) {
+        SDL_LockMutex(mutex);
+        quit = true;
+        SDL_CondSignal(cond);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+    }
+    if (screenshot) SDL_FreeSurface(screenshot);
+    SDL_DestroyCond(idle_cond);
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+
+void ScreenshotWriter::capture(SDL_Surface* src, Uint32 format, int w, int h)
+{
+    Job job;
+    job.type = CAPTURE;
+    job.format = format;
+    job.w = w;
+    job.h = h;
+    job.surface = SDL_CreateRGBSurface(0, src->w, src->h,
+                                       src->format->BitsPerPixel,
+                                       src->format->Rmask, src->format->Gmask,
+                                       src->format->Bmask, src->format->Amask);
+    if (!job.surface) {
+        fprintf(stderr, "getscreenshot: can't copy the screen: %s\n",
+                SDL_GetError());
+        return;
+    }
+
+    SDL_LockSurface(src);
+    if (job.surface->pitch == src->pitch)
+        memcpy(job.surface->pixels, src->pixels, src->pitch * src->h);
+    else {
+        const int len = std::min(job.surface->pitch, src->pitch);
+        for (int y = 0; y < src->h; ++y)
+            memcpy((char*) job.surface->pixels + y * job.surface->pitch,
+                   (char*) src->pixels + y * src->pitch, len);
+    }
+    SDL_UnlockSurface(src);
+
+    push(job);
+}
+
+
+void ScreenshotWriter::save(const pstring& filename)
+{
+    Job job;
+    job.type = SAVE;
+    job.filename = filename;
+    push(job);
+}
+
+
+void ScreenshotWriter::discard()
+{
+    Job job;
+    job.type = DISCARD;
+    push(job);
+}
+
+
+void ScreenshotWriter::waitFor(const pstring& filename)
+{
+    SDL_LockMutex(mutex);
+    while (savePending(filename)) SDL_CondWait(idle_cond, mutex);
+    SDL_UnlockMutex(mutex);
+}
+
+
+void ScreenshotWriter::flush()
+{
+    SDL_LockMutex(mutex);
+    while (busy || !queue.empty()) SDL_CondWait(idle_cond, mutex);
+    SDL_UnlockMutex(mutex);
+}
+
+
+// Called with the mutex held.
+bool ScreenshotWriter::savePending(const pstring& filename)
+{
+    if (!busy && queue.empty()) return false;
+
+    pstring name = filename;
+    replace_ascii(name, '\\', '/');
+    for (int i = -1; i < (int) queue.size(); ++i) {
+        const Job& job = i < 0 ? current_job : queue[i];
+        if ((i < 0 && !busy) || job.type != SAVE ||
+            job.filename.length() < name.length())
+            continue;
+
+        pstring tail = job.filename.midstr(job.filename.length()
+                                           - name.length(), name.length());
+        replace_ascii(tail, '\\', '/');
+        if (tail.caselessEqual(name)) return true;
+    }
+    return false;
+}
+
+
+void ScreenshotWriter::push(const Job& job)
+{
+    SDL_LockMutex(mutex);
+    // A capture that hasn't been used yet is superseded by a newer one.
+    if (job.type == CAPTURE && !queue.empty() && queue.back().type == CAPTURE) {
+        SDL_FreeSurface(queue.back().surface);
+        queue.back() = job;
+    }
+    else
+        queue.push_back(job);
+    if (!thread)
+        thread = SDL_CreateThread(threadFunc, "screenshot", this);
+    SDL_CondSignal(cond);
+    SDL_UnlockMutex(mutex);
+}
+
+
+int ScreenshotWriter::threadFunc(void* data)
+{
+    ((ScreenshotWriter*) data)->run();
+    return 0;
+}
+
+
+void ScreenshotWriter::run()
+{
+    SDL_LockMutex(mutex);
+    while (true) {
+        while (!quit && queue.empty()) SDL_CondWait(cond, mutex);
+        if (queue.empty()) break;
+
+        current_job = queue.front();
+        queue.pop_front();
+        busy = true;
+        SDL_UnlockMutex(mutex);
+
+        process(current_job);
+
+        SDL_LockMutex(mutex);
+        busy = false;
+        current_job = Job();
+        SDL_CondBroadcast(idle_cond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+
+// Runs on the worker without the mutex; only the worker touches
+// screenshot and the job's surface.
+void ScreenshotWriter::process(Job& job)
+{
+    if (job.type == CAPTURE) {
+        SDL_Surface* src = job.surface;
+        if (src->format->format != job.format) {
+            src = SDL_ConvertSurfaceFormat(job.surface, job.format, 0);
+            SDL_FreeSurface(job.surface);
+        }
+        job.surface = NULL;
+
+        if (screenshot &&
+            (screenshot->w != job.w || screenshot->h != job.h)) {
+            SDL_FreeSurface(screenshot);
+            screenshot = NULL;
+        }
+        if (!screenshot)
+            screenshot = SDL_CreateRGBSurface(0, job.w, job.h, 32, 0, 0, 0, 0);
+        if (!src || !screenshot) {
+            fprintf(stderr, "getscreenshot: %s\n", SDL_GetError());
+            if (src) SDL_FreeSurface(src);
+            return;
+        }
+
+        // As AnimationInfo::resizeSurface(), but with a buffer of our
+        // own, since that one belongs to the main thread.
+        unsigned char* buffer = new unsigned char[src->w * (src->h + 1) * 4 + 4];
+        SDL_LockSurface(screenshot);
+        SDL_LockSurface(src);
+        resizeImage((unsigned char*) screenshot->pixels, screenshot->w,
+                    screenshot->h, screenshot->w * 4,
+                    (unsigned char*) src->pixels, src->w, src->h, src->w * 4,
+                    4, buffer, src->w * 4);
+        SDL_UnlockSurface(src);
+        SDL_UnlockSurface(screenshot);
+        delete[] buffer;
+        SDL_FreeSurface(src);
+    }
+    else if (job.type == SAVE) {
+        if (screenshot == NULL) {
+            printf("savescreenshot: no screenshot buffer, creating a blank 1x1 surface.\n");
+            screenshot = SDL_CreateRGBSurface(0, 1, 1, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+        }
+        if (SDL_SaveBMP(screenshot, job.filename) < 0)
+            fprintf(stderr, "savescreenshot: can't write %s: %s\n",
+                    (const char*) job.filename, SDL_GetError());
+    }
+    else {
+        if (screenshot) SDL_FreeSurface(screenshot);
+        screenshot = NULL;
+    }
+}
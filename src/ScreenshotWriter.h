@@ -0,0 +1,86 @@
+/* -*- C++ -*-
+ *
+ *  ScreenshotWriter.h - Scaling and saving screenshots in the
+ *  background
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SCREENSHOT_WRITER_H__
+#define __SCREENSHOT_WRITER_H__
+
+#include "defs.h"
+#include <deque>
+
+// getscreenshot, savescreenshot and deletescreenshot become jobs run
+// in order on a worker thread.  The main thread only copies the
+// screen; scaling it and writing the BMP happen on the worker, which
+// also owns the current screenshot.
+class ScreenshotWriter {
+public:
+    ScreenshotWriter();
+    ~ScreenshotWriter();
+
+    // Copy src now; scale the copy to w x h in the given pixel
+    // format later, and make that the current screenshot.
+    void capture(SDL_Surface* src, Uint32 format, int w, int h);
+
+    // Write the current screenshot to filename as a BMP, or a blank
+    // 1x1 image if there is none.
+    void save(const pstring& filename);
+
+    // Drop the current screenshot.
+    void discard();
+
+    // Wait for queued saves to filename (matched against the end of
+    // the saved path, ignoring case and separators), so that it can
+    // be read back.  Waits for nothing if there are none.
+    void waitFor(const pstring& filename);
+
+    // Wait for all queued jobs.
+    void flush();
+
+private:
+    enum Type { CAPTURE, SAVE, DISCARD };
+
+    struct Job {
+        Type type;
+        SDL_Surface* surface; // CAPTURE: copy of the screen
+        Uint32 format;
+        int w, h;
+        pstring filename;     // SAVE
+        Job() : type(CAPTURE), surface(NULL), format(0), w(0), h(0) {}
+    };
+
+    static int threadFunc(void* data);
+    void run();
+    void push(const Job& job);
+    void process(Job& job);
+    bool savePending(const pstring& filename);
+
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* cond;      // signalled when jobs are queued or on quit
+    SDL_cond* idle_cond; // signalled when a job finishes
+    bool quit;
+    bool busy;           // the worker is running current_job
+    Job current_job;
+
+    std::deque<Job> queue;
+    SDL_Surface* screenshot; // only touched by the worker
+};
+
+#endif // __SCREENSHOT_WRITER_H__
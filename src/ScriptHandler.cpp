@@ -26,6 +26,7 @@
 #include "ScriptHandler.h"
 #include "PonscripterMessage.h"
 #include "Fontinfo.h"
+#include "MemStats.h"
 #include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -43,7 +44,7 @@
 
 #define SKIP_SPACE(p) while (*(p) == ' ' || *(p) == '\t') (p)++
 
-BaseReader* ScriptHandler::cBR = NULL;
+SynchronizedReader* ScriptHandler::cBR = NULL;
 
 FILE* cout = stdout;
 FILE* cerr = stderr;
@@ -52,7 +53,9 @@ static bool warned_unmarked = false;
 
 ScriptHandler::ScriptHandler()
     : game_identifier(),
-      variable_data(VARIABLE_RANGE + 1)
+      variable_data(VARIABLE_RANGE + 1),
+      last_ext_page_no(0),
+      last_ext_page(NULL)
 {
     for (int i = 0; i < VARIABLE_RANGE; ++i)
         variable_data[i].owner = this;
@@ -60,12 +63,16 @@ ScriptHandler::ScriptHandler()
     utf_encoding = NULL;
     raw_script_buffer = NULL;
     script_buffer = NULL;
+    script_buffer_size = 0;
     kidoku_buffer = NULL;
     label_log.filename = "NScrllog.dat";
     file_log.filename  = "NScrflog.dat";
     clickstr_list.clear();
 
-    arrays.clear();
+    clearArrays();
+
+    for (int i = 0; i < EXPR_CACHE_SIZE; ++i) expr_cache[i] = NULL;
+    spare_expr = NULL;
 
     screen_size = SCREEN_SIZE_640x480;
     global_variable_border = 200;
@@ -86,8 +93,14 @@ ScriptHandler::ScriptHandler()
 ScriptHandler::~ScriptHandler()
 {
     reset();
-    if (script_buffer) delete[] script_buffer;
-    if (kidoku_buffer) delete[] kidoku_buffer;
+    if (script_buffer) {
+        MemStats::remove(MemStats::SCRIPT, script_buffer_size);
+        delete[] script_buffer;
+    }
+    if (kidoku_buffer) {
+        MemStats::remove(MemStats::SCRIPT, script_buffer_length / 8 + 1);
+        delete[] kidoku_buffer;
+    }
     if (utf_encoding != file_encoding) delete utf_encoding;
 }
 
@@ -96,9 +109,9 @@ void ScriptHandler::reset()
 {
     for (int i = 0; i < VARIABLE_RANGE; i++)
         variable_data[i].reset(true);
-    extended_variable_data.clear();
+    clearExtendedVariableData();
 
-    arrays.clear();
+    clearArrays();
 
     // reset log info
     label_log.clear();
@@ -107,6 +120,7 @@ void ScriptHandler::reset()
     // reset aliases
     num_aliases.clear();
     str_aliases.clear();
+    clearExprCache();
 
     // reset misc. variables
     end_status = END_NONE;
@@ -457,7 +471,16 @@ int ScriptHandler::readInt()
     SKIP_SPACE(current_script);
     const char* buf = current_script;
 
-    int ret = parseIntExpression(&buf);
+    int ret;
+    CompiledExpr* ce = findCompiledExpr(buf);
+    if (ce) {
+        ret = evalExpr(*ce, ce->root);
+        buf = ce->end;
+    }
+    else {
+        ret = parseIntExpression(&buf);
+        compileExpr(current_script, buf);
+    }
 
     next_script = checkComma(buf);
 
@@ -668,7 +691,12 @@ void ScriptHandler::loadKidokuData()
     FILE* fp;
     pstring fnam = "kidoku.dat";
     setKidokuskip(true);
+    if (kidoku_buffer) {
+        MemStats::remove(MemStats::SCRIPT, script_buffer_length / 8 + 1);
+        delete[] kidoku_buffer;
+    }
     kidoku_buffer = new char[script_buffer_length / 8 + 1];
+    MemStats::add(MemStats::SCRIPT, script_buffer_length / 8 + 1);
     memset(kidoku_buffer, 0, script_buffer_length / 8 + 1);
 
     if ((fp = fileopen(fnam, "rb", true, true)) != NULL) {
@@ -927,9 +955,15 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         }
     }
 
-    if (raw_script_buffer) delete[] raw_script_buffer;
+    clearExprCache();
+    if (raw_script_buffer) {
+        MemStats::remove(MemStats::SCRIPT, script_buffer_size);
+        delete[] raw_script_buffer;
+    }
 
     char* p_script_buffer = new char[estimated_buffer_length];
+    script_buffer_size = estimated_buffer_length;
+    MemStats::add(MemStats::SCRIPT, script_buffer_size);
 
     current_script = raw_script_buffer = p_script_buffer;
     tmp_script_buf = new char[TMP_SCRIPT_BUF_LEN];
@@ -1124,21 +1158,63 @@ void ScriptHandler::errorWarning(pstring s)
 }
 
 
-ScriptHandler::VariableData &ScriptHandler::getVariableData(int no)
+ScriptHandler::VariableData&
+ScriptHandler::getExtendedVariableData(int no)
 {
-    if (no >= 0 && no < VARIABLE_RANGE)
-        return variable_data[no];
-
-    for (size_t i=0 ; i<extended_variable_data.size() ; i++) {
-        if (extended_variable_data[i].no == no) 
-            return extended_variable_data[i].vd;
+    const int page_no = no >> EXT_PAGE_BITS;
+    if (!last_ext_page || page_no != last_ext_page_no) {
+        ext_pages_t::iterator it = extended_pages.find(page_no);
+        if (it == extended_pages.end()) {
+            VariableData* page = new VariableData[EXT_PAGE_SIZE];
+            for (int i = 0; i < EXT_PAGE_SIZE; ++i) page[i].owner = this;
+            it = extended_pages.insert(std::make_pair(page_no, page)).first;
+        }
+        last_ext_page_no = page_no;
+        last_ext_page = it->second;
     }
-    extended_variable_data.push_back(ExtendedVariableData(no));
-    //printf("SHandler.getVariableData: adding extended variable for var no %d "
-    //       "(vector size/capacity is now %d/%d\n", no, 
-    //       extended_variable_data.size(), extended_variable_data.capacity());
+    return last_ext_page[no & (EXT_PAGE_SIZE - 1)];
+}
+
+
+void ScriptHandler::clearExtendedVariableData()
+{
+    for (ext_pages_t::iterator it = extended_pages.begin();
+         it != extended_pages.end(); ++it)
+        delete[] it->second;
+    extended_pages.clear();
+    last_ext_page = NULL;
+}
 
-    return extended_variable_data.back().vd;
+
+void ScriptHandler::VariableData::watch(int val)
+{
+    fprintf(stderr, "WATCH (line %d): %%%d: %d -> %d\n",
+            owner->getLineByAddress(owner->getCurrent(), true),
+            watch_int_variable, num, val);
+}
+
+
+ScriptHandler::ArrayVariable*
+ScriptHandler::findArray(int no, const char* site)
+{
+    ArraySite& s = array_sites[((size_t) site) % ARRAY_SITE_CACHE_SIZE];
+    if (s.array && s.address == site && s.no == no) return s.array;
+
+    ArrayVariable::iterator i = arrays.find(no);
+    if (i == arrays.end()) return NULL;
+
+    s.address = site;
+    s.no = no;
+    s.array = &i->second;
+    return s.array;
+}
+
+
+void ScriptHandler::clearArrays()
+{
+    arrays.clear();
+    for (int i = 0; i < ARRAY_SITE_CACHE_SIZE; ++i)
+        array_sites[i].array = NULL;
 }
 
 
@@ -1270,8 +1346,8 @@ pstring ScriptHandler::parseStr(const char** buf)
     }
     else { // bareword
         char ch;
-        pstring alias_buf;
         bool first_flag = true;
+        const char* const start = *buf;
 
         while (1) {
             ch = **buf;
@@ -1279,10 +1355,7 @@ pstring ScriptHandler::parseStr(const char** buf)
             if ((ch >= 'a' && ch <= 'z')
                 || (ch >= 'A' && ch <= 'Z')
                 || ch == '_') {
-                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
-
                 first_flag = false;
-                alias_buf += ch;
             }
             else if (ch >= '0' && ch <= '9') {
                 if (first_flag)
@@ -1290,18 +1363,19 @@ pstring ScriptHandler::parseStr(const char** buf)
                       "first letter of str alias.");
 
                 first_flag = false;
-                alias_buf += ch;
             }
             else break;
 
             (*buf)++;
         }
 
-        if (!alias_buf) {
+        if (*buf == start) {
             current_variable.type = VAR_NONE;
             return "";
         }
 
+        pstring alias_buf(start, *buf - start);
+        alias_buf.tolower();
 	stralias_t::iterator a = str_aliases.find(alias_buf);
 	if (a == str_aliases.end()) {
             current_variable.type = VAR_NONE;
@@ -1327,21 +1401,22 @@ int ScriptHandler::parseInt(const char** buf)
         return getVariableData(current_variable.var_no).get_num();
     }
     else if (**buf == '?') {
+	const char* site = *buf;
 	array_ref arr = parseArray(buf);
+	ArrayVariable* av = findArray(arr.first, site);
 	current_variable.var_no = arr.first;
 	current_variable.array = arr.second;
+	current_variable.array_site = site;
         current_variable.type  = VAR_ARRAY;
-	ArrayVariable::iterator i = arrays.find(arr.first);
-	if (i != arrays.end()) {
-	    if (arr.second.size() < i->second.dimensions())
+	if (av) {
+	    if (arr.second.size() < av->dimensions())
 		arr.second.push_back(0);
-	    return i->second.getValue(arr.second);
+	    return av->getValue(arr.second);
 	}
 	return 0;
     }
     else {
         char ch;
-	pstring alias_buf;
         int alias_no = 0;
         bool direct_num_flag = false;
         bool num_alias_flag  = false;
@@ -1363,16 +1438,11 @@ int ScriptHandler::parseInt(const char** buf)
 
                 if (direct_num_flag)
                     alias_no = alias_no * 10 + ch - '0';
-                else
-                    alias_buf += ch;
             }
             else if (isalpha(ch) || ch == '_') {
-                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
-
                 if (hex_num_flag || direct_num_flag) break;
 
                 num_alias_flag = true;
-                alias_buf += ch;
             }
             else break;
 
@@ -1387,7 +1457,9 @@ int ScriptHandler::parseInt(const char** buf)
         /* ---------------------------------------- */
         /* Solve num aliases */
         if (num_alias_flag) {
-
+            // Only build the name once we know there is one.
+            pstring alias_buf(buf_start, *buf - buf_start);
+            alias_buf.tolower();
 	    numalias_t::iterator a = num_aliases.find(alias_buf);
 	    if (a == num_aliases.end()) {
                 printf("can't find num alias for %s... assume 0.\n",
@@ -27,7 +27,7 @@
 #define __SCRIPT_HANDLER_H__
 
 #include "defs.h"
-#include "BaseReader.h"
+#include "SynchronizedReader.h"
 #include "DirPaths.h"
 #include "expression.h"
 
@@ -78,16 +78,21 @@ public:
 	
 	ArrayVariable(ScriptHandler* o, h_index_t sizes);
 
-	h_index_t::iterator begin() { return data.begin(); }
-	h_index_t::iterator end()   { return data.end(); }
+	typedef std::vector<int>::iterator data_iterator;
+	data_iterator begin() { return data.begin(); }
+	data_iterator end()   { return data.end(); }
     private:
 	ScriptHandler* owner;
         h_index_t dim;
-	h_index_t data;
+	std::vector<int> data;
 	int& getoffs(const h_index_t& indices);
     };
     ArrayVariable::map arrays;
 
+    // Look up array variable NO as referenced from script address
+    // SITE.  Returns NULL if the array has not been declared.
+    ArrayVariable* findArray(int no, const char* site);
+
     enum { VAR_NONE  = 0,
            VAR_INT   = 1,  // integer
            VAR_ARRAY = 2,  // array
@@ -100,7 +105,8 @@ public:
         int type;
         int var_no;   // for integer(%), array(?), string($) variable
         h_index_t array; // for array(?)
-	VariableInfo() {}
+        const char* array_site; // for array(?): address of reference
+	VariableInfo() : array_site(NULL) {}
     };
 
     ScriptHandler();
@@ -221,9 +227,15 @@ public:
     void loadArrayVariable(FILE* fp);
 
     void addNumAlias(const pstring& str, int val)
-	{ checkalias(str); num_aliases[str] = val; }
+	{ checkalias(str); num_aliases[str] = val; clearExprCache(); }
     void addStrAlias(const pstring& str, const pstring& val)
-	{ checkalias(str); str_aliases[str] = val; }
+	{ checkalias(str); str_aliases[str] = val; clearExprCache(); }
+    bool findStrAlias(const pstring& str, pstring& val) {
+	stralias_t::iterator a = str_aliases.find(str);
+	if (a == str_aliases.end()) return false;
+	val = a->second;
+	return true;
+    }
 
 
     class LogInfo {
@@ -257,10 +269,7 @@ public:
             return num;
         }
         void set_num(int val) {
-            if (watch_int_variable >= 0)
-                fprintf(stderr, "WATCH (line %d): %%%d: %d -> %d\n",
-                        owner->getLineByAddress(owner->getCurrent(), true),
-                        watch_int_variable, num, val);
+            if (watch_int_variable >= 0) watch(val);
             num = val;
         }
 
@@ -274,8 +283,13 @@ public:
             if (limit_reset_flag) num_limit_flag = false;
             if (str) str.trunc(0);
         };
+    private:
+        void watch(int val) __attribute__((noinline));
     };
-    VariableData &getVariableData(int no);
+    VariableData &getVariableData(int no) {
+        if (no >= 0 && no < VARIABLE_RANGE) return variable_data[no];
+        return getExtendedVariableData(no);
+    }
 
     VariableInfo current_variable;
 
@@ -294,7 +308,7 @@ public:
     pstring savedir;
     pstring script_path;
 
-    static BaseReader* cBR;
+    static SynchronizedReader* cBR;
 
 private:
     enum { OP_INVALID = 0, // 000
@@ -314,16 +328,75 @@ private:
     int  calcArithmetic(int num1, int op, int num2);
     typedef std::pair<int, h_index_t> array_ref;
     array_ref parseArray(const char** buf);
+
+    // Integer expressions read from the script buffer are compiled on
+    // first use and cached by script offset, so that expressions in
+    // loops are not re-parsed on every evaluation.  The compiled form
+    // has constants folded, numeric aliases resolved and fixed
+    // variable numbers bound to their slots; evaluating it updates
+    // current_variable exactly as parseIntExpression() would.
+    // Implementation in expression.cpp.
+    struct ExprNode {
+        enum kind_t { CONST, NONE, VAR, SLOT, ARRAY, NEG, BINOP, SEQ };
+        kind_t kind;
+        // CONST: value; SLOT: variable number; BINOP: operator;
+        // ARRAY: first index in CompiledExpr::indices; NONE: alias to
+        // complain about in CompiledExpr::missing_aliases, or -1
+        int value;
+        int a, b;   // child nodes, or -1; ARRAY: b is the index count
+        const char* site;         // ARRAY: script address of reference
+        VariableData* slot;       // SLOT
+        ExprNode(kind_t k, int v, int a_, int b_)
+            : kind(k), value(v), a(a_), b(b_), site(NULL), slot(NULL) {}
+    };
+    // Nodes hold no strings or vectors of their own, so compiling an
+    // expression allocates little beyond the nodes array itself.
+    struct CompiledExpr {
+        int offset;
+        const char* end;
+        int root;
+        std::vector<ExprNode> nodes;
+        std::vector<int> indices;  // ARRAY index expressions, by node
+        std::vector<pstring> missing_aliases;
+    };
+    enum { EXPR_CACHE_SIZE = 4096 };
+    CompiledExpr* expr_cache[EXPR_CACHE_SIZE];
+    CompiledExpr* spare_expr; // evicted entry, reused for the next compile
+    void clearExprCache();
+    CompiledExpr* findCompiledExpr(const char* buf);
+    void compileExpr(const char* start, const char* end);
+    int compileIntExpression(CompiledExpr& ce, const char** buf);
+    int compileNextOp(CompiledExpr& ce, const char** buf, int* op);
+    int compileInt(CompiledExpr& ce, const char** buf);
+    int addExprNode(CompiledExpr& ce, ExprNode::kind_t kind, int value,
+                    int a = -1, int b = -1);
+    int evalExpr(const CompiledExpr& ce, int node);
     
     /* ---------------------------------------- */
     /* Variable */
     std::vector<VariableData> variable_data;
-    struct ExtendedVariableData{
+
+    // Variables outside VARIABLE_RANGE are kept in fixed-size pages
+    // created on first use, so that scripts using high-numbered
+    // globals don't pay for a search on every access.
+    enum { EXT_PAGE_BITS = 8,
+           EXT_PAGE_SIZE = 1 << EXT_PAGE_BITS };
+    typedef dictionary<int, VariableData*>::t ext_pages_t;
+    ext_pages_t extended_pages;
+    int last_ext_page_no;
+    VariableData* last_ext_page;
+    VariableData& getExtendedVariableData(int no);
+    void clearExtendedVariableData();
+
+    // Direct-mapped cache of array lookups keyed by the script
+    // address of the reference; see findArray().
+    enum { ARRAY_SITE_CACHE_SIZE = 256 };
+    struct ArraySite {
+        const char* address;
         int no;
-        VariableData vd;
-        ExtendedVariableData(int n): no(n) {}
-    };
-    std::vector<ExtendedVariableData> extended_variable_data;
+        ArrayVariable* array;
+    } array_sites[ARRAY_SITE_CACHE_SIZE];
+    void clearArrays();
 
     typedef dictionary<pstring, int>::t    numalias_t;
     typedef dictionary<pstring, pstring>::t stralias_t;
@@ -333,6 +406,7 @@ private:
 
     DirPaths *archive_path;
     int   script_buffer_length;
+    int   script_buffer_size; // bytes allocated for raw_script_buffer
     char* raw_script_buffer;
     char* script_buffer;
     char* tmp_script_buf;
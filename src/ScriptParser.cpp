@@ -326,7 +326,8 @@ void ScriptParser::reset()
 
 int ScriptParser::open(const char* preferred_script)
 {
-    ScriptHandler::cBR = new DirectReader(&archive_path, key_table);
+    ScriptHandler::cBR =
+        new SynchronizedReader(new DirectReader(&archive_path, key_table));
     ScriptHandler::cBR->open();
 
     script_h.game_identifier = cmdline_game_id;
@@ -728,7 +729,7 @@ void ScriptParser::writeArrayVariable(bool output_flag)
 {
     ScriptHandler::ArrayVariable::iterator it = script_h.arrays.begin();
     while (it != script_h.arrays.end()) {
-        for (h_index_t::iterator d = it->second.begin();
+        for (ScriptHandler::ArrayVariable::data_iterator d = it->second.begin();
 	     d != it->second.end(); ++d) {
             unsigned long ch = *d;
             if (output_flag) {
@@ -749,7 +750,7 @@ void ScriptParser::readArrayVariable()
 {
     ScriptHandler::ArrayVariable::iterator it = script_h.arrays.begin();
     while (it != script_h.arrays.end()) {
-        for (h_index_t::iterator d = it->second.begin();
+        for (ScriptHandler::ArrayVariable::data_iterator d = it->second.begin();
 	     d != it->second.end(); ++d) {
             unsigned long ret;
             if (file_io_buf_ptr + 3 >= file_io_buf_len) return;
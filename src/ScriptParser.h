@@ -29,7 +29,7 @@
 #include <SDL_mixer.h>
 #include "DirPaths.h"
 #include "ScriptHandler.h"
-#include "NsaReader.h"
+#include "PsaReader.h"
 #include "DirectReader.h"
 #include "AnimationInfo.h"
 #include "Fontinfo.h"
@@ -62,11 +62,9 @@ struct OVInfo{
     int cvt_len;
     int mult1;
     int mult2;
-    unsigned char *buf;
+    SDL_RWops *src;
     long decoded_length;
 #if defined(USE_OGG_VORBIS)
-    ogg_int64_t length;
-    ogg_int64_t pos;
     OggVorbis_File ovf;
 #endif
 };
@@ -424,8 +424,7 @@ int ScriptParser::nsaCommand(const pstring& cmd)
         archive_type = NsaReader::ARCHIVE_TYPE_NS3;
     }
 
-    delete ScriptHandler::cBR;
-    ScriptHandler::cBR = new NsaReader(&archive_path, key_table);
+    ScriptHandler::cBR->reset(new PsaReader(&archive_path, key_table));
     if (ScriptHandler::cBR->open(nsa_path, archive_type))
         fprintf(stderr, " *** failed to open Nsa archive, ignored.  ***\n");
 
@@ -1182,8 +1181,7 @@ int ScriptParser::arcCommand(const pstring& cmd)
     if (buf.find('|', 0) > 0)
         buf.trunc(buf.find('|', 0)); // TODO: check this removes the |
     if (ScriptHandler::cBR->getArchiveName() == "direct") {
-        delete ScriptHandler::cBR;
-        ScriptHandler::cBR = new SarReader(&archive_path, key_table);
+        ScriptHandler::cBR->reset(new SarReader(&archive_path, key_table));
         if (ScriptHandler::cBR->open(buf))
             fprintf(stderr, " *** failed to open archive %s, ignored.  ***\n",
 		    (const char*) buf);
@@ -0,0 +1,125 @@
+/* -*- C++ -*-
+ *
+ *  SynchronizedReader.h - Reader wrapper that lets the wrapped reader
+ *  be replaced while other threads are reading from it
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SYNCHRONIZED_READER_H__
+#define __SYNCHRONIZED_READER_H__
+
+#include "BaseReader.h"
+
+// Reads run concurrently (see BaseReader); configuration calls and
+// reset() wait until no read is in progress.  A waiting writer holds
+// off new reads, so a steady stream of them can't starve it.
+class SynchronizedReader : public BaseReader {
+public:
+    SynchronizedReader(BaseReader* r)
+        : reader(r), readers(0), writers(0), writing(false),
+          lock(SDL_CreateMutex()), changed(SDL_CreateCond()) {}
+    ~SynchronizedReader()
+        { delete reader; SDL_DestroyCond(changed); SDL_DestroyMutex(lock); }
+
+    // Replace the wrapped reader (nsa/arc switch archive types while
+    // the prefetcher may be reading).
+    void reset(BaseReader* r)
+        { Exclusive e(this); delete reader; reader = r; }
+
+    int open(const pstring& name = "", int archive_type = ARCHIVE_TYPE_NONE)
+        { Exclusive e(this); return reader->open(name, archive_type); }
+
+    int close()
+        { Exclusive e(this); return reader->close(); }
+
+    pstring getArchiveName() const
+        { Shared s(this); return s.reader->getArchiveName(); }
+
+    int getNumFiles()
+        { Shared s(this); return s.reader->getNumFiles(); }
+
+    void registerCompressionType(const pstring& ext, int type)
+        { Exclusive e(this); reader->registerCompressionType(ext, type); }
+
+    FileInfo getFileByIndex(unsigned int index)
+        { Shared s(this); return s.reader->getFileByIndex(index); }
+
+    size_t getFileLength(const pstring& file_name)
+        { Shared s(this); return s.reader->getFileLength(file_name); }
+
+    size_t getFile(const pstring& file_name, unsigned char* buffer,
+                   int* location = NULL)
+        { Shared s(this); return s.reader->getFile(file_name, buffer, location); }
+
+    SDL_RWops* openFile(const pstring& file_name, int* location = NULL)
+        { Shared s(this); return s.reader->openFile(file_name, location); }
+
+    // Length lookup and read from the same reader, so a reset() in
+    // between cannot hand us a different file.
+    pstring getFile(const pstring& file_name, int* location = NULL)
+    {
+        Shared s(this);
+        return s.reader->BaseReader::getFile(file_name, location);
+    }
+
+private:
+    struct Shared {
+        const SynchronizedReader* owner;
+        BaseReader* reader;
+        Shared(const SynchronizedReader* o) : owner(o) {
+            SDL_LockMutex(owner->lock);
+            while (owner->writers)
+                SDL_CondWait(owner->changed, owner->lock);
+            ++owner->readers;
+            reader = owner->reader;
+            SDL_UnlockMutex(owner->lock);
+        }
+        ~Shared() {
+            SDL_LockMutex(owner->lock);
+            if (--owner->readers == 0) SDL_CondBroadcast(owner->changed);
+            SDL_UnlockMutex(owner->lock);
+        }
+    };
+
+    struct Exclusive {
+        const SynchronizedReader* owner;
+        Exclusive(const SynchronizedReader* o) : owner(o) {
+            SDL_LockMutex(owner->lock);
+            ++owner->writers;
+            while (owner->readers || owner->writing)
+                SDL_CondWait(owner->changed, owner->lock);
+            owner->writing = true;
+            SDL_UnlockMutex(owner->lock);
+        }
+        ~Exclusive() {
+            SDL_LockMutex(owner->lock);
+            owner->writing = false;
+            --owner->writers;
+            SDL_CondBroadcast(owner->changed);
+            SDL_UnlockMutex(owner->lock);
+        }
+    };
+
+    BaseReader* reader;
+    mutable int readers;
+    mutable int writers; // waiting or writing
+    mutable bool writing;
+    SDL_mutex* lock;
+    SDL_cond* changed;   // readers, writers or writing changed
+};
+
+#endif // __SYNCHRONIZED_READER_H__
@@ -0,0 +1,151 @@
+/* -*- C++ -*-
+ *
+ *  VideoPipeline.cpp - Decoding video frames ahead on a worker thread
+ *  and picking the one to show for a clock
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "VideoPipeline.h"
+#include <stdio.h>
+
+VideoPipeline::VideoPipeline(VideoFrameSource* source, int capacity)
+    : source(source), thread(NULL), quit(false), eof(false),
+      ring(capacity < 2 ? 2 : capacity), head(0), count(0), dropped(0)
+{
+    mutex = SDL_CreateMutex();
+    not_full = SDL_CreateCond();
+}
+
+
+VideoPipeline::~VideoPipeline()
+{
+    stop();
+    SDL_DestroyCond(not_full);
+    SDL_DestroyMutex(mutex);
+}
+
+
+void VideoPipeline::start()
+{
+    if (thread) return;
+
+    quit = eof = false;
+    thread = SDL_CreateThread(threadFunc, "video", this);
+    if (!thread) {
+        fprintf(stderr, "can't start video decoding: %s\n", SDL_GetError());
+        eof = true;
+    }
+}
+
+
+void VideoPipeline::stop()
+{
+    if (thread) {
+        SDL_LockMutex(mutex);
+        quit = true;
+        SDL_CondSignal(not_full);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+    }
+    clear();
+}
+
+
+void VideoPipeline::clear()
+{
+    for (; count > 0; --count) {
+        source->releaseFrame(ring[head].frame);
+        head = (head + 1) % ring.size();
+    }
+    head = 0;
+}
+
+
+void* VideoPipeline::frameAt(double clock, double& wait)
+{
+    void* frame = NULL;
+    wait = 0;
+
+    SDL_LockMutex(mutex);
+    // Frames are in time order, so only the two oldest need looking
+    // at: the oldest is late if the one after it is already due.
+    while (count >= 2 && ring[(head + 1) % ring.size()].time <= clock) {
+        source->releaseFrame(ring[head].frame);
+        head = (head + 1) % ring.size();
+        --count;
+        ++dropped;
+    }
+    if (count > 0) {
+        if (ring[head].time <= clock) {
+            frame = ring[head].frame;
+            head = (head + 1) % ring.size();
+            --count;
+        }
+        else
+            wait = ring[head].time - clock;
+    }
+    if (count < (int) ring.size()) SDL_CondSignal(not_full);
+    SDL_UnlockMutex(mutex);
+
+    return frame;
+}
+
+
+bool VideoPipeline::finished()
+{
+    SDL_LockMutex(mutex);
+    bool ret = eof && count == 0;
+    SDL_UnlockMutex(mutex);
+    return ret;
+}
+
+
+int VideoPipeline::threadFunc(void* data)
+{
+    ((VideoPipeline*) data)->run();
+    return 0;
+}
+
+
+void VideoPipeline::run()
+{
+    SDL_LockMutex(mutex);
+    while (!quit) {
+        if (count == (int) ring.size()) {
+            SDL_CondWait(not_full, mutex);
+            continue;
+        }
+        SDL_UnlockMutex(mutex);
+
+        // Decoding is the slow part, so it happens unlocked; only
+        // this thread adds to the ring, so the free slot stays free.
+        double time = 0;
+        void* frame = source->decodeFrame(time);
+
+        SDL_LockMutex(mutex);
+        if (!frame) {
+            eof = true;
+            break;
+        }
+        Slot& slot = ring[(head + count) % ring.size()];
+        slot.frame = frame;
+        slot.time = time;
+        ++count;
+    }
+    SDL_UnlockMutex(mutex);
+}
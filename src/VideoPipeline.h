@@ -0,0 +1,94 @@
+/* -*- C++ -*-
+ *
+ *  VideoPipeline.h - Decoding video frames ahead on a worker thread
+ *  and picking the one to show for a clock
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __VIDEO_PIPELINE_H__
+#define __VIDEO_PIPELINE_H__
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <vector>
+
+// Where frames come from.  Frames are opaque to the pipeline; they
+// must come out in presentation order.
+class VideoFrameSource {
+public:
+    virtual ~VideoFrameSource() {}
+
+    // Decode the next frame and set time to when it is due, in
+    // seconds.  Return NULL at the end of the stream.  Only called on
+    // the decode thread.
+    virtual void* decodeFrame(double& time) = 0;
+
+    // Free a frame returned by decodeFrame().  Called on either thread.
+    virtual void releaseFrame(void* frame) = 0;
+};
+
+
+// A decode thread keeps a ring of up to `capacity' frames filled
+// ahead; the presenter asks for the frame due at its clock, and
+// frames that were overtaken before it asked are dropped.
+class VideoPipeline {
+public:
+    enum { DEFAULT_CAPACITY = 8 };
+
+    VideoPipeline(VideoFrameSource* source, int capacity = DEFAULT_CAPACITY);
+    ~VideoPipeline();
+
+    void start();
+    void stop();
+
+    // Return the newest frame due at clock, which the caller must
+    // release with release(); earlier frames are dropped.  If none is
+    // due yet, return NULL and set wait to the seconds until the next
+    // one, or 0 if the decoder hasn't produced it.
+    void* frameAt(double clock, double& wait);
+    void release(void* frame) { source->releaseFrame(frame); }
+
+    // True once the source has ended and every frame was taken.
+    bool finished();
+
+    unsigned long droppedFrames() { return dropped; }
+
+private:
+    struct Slot {
+        void* frame;
+        double time;
+    };
+
+    static int threadFunc(void* data);
+    void run();
+    void clear();
+
+    VideoFrameSource* source;
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* not_full;
+    bool quit;
+    bool eof;
+
+    std::vector<Slot> ring;
+    int head;  // oldest frame
+    int count;
+
+    unsigned long dropped;
+};
+
+#endif // __VIDEO_PIPELINE_H__
@@ -62,7 +62,61 @@ struct set {
     typedef std::set<T> t;
 #endif
 };
-typedef std::vector<int> h_index_t;
+
+// Indices into an array variable.  Arrays rarely have more than a few
+// dimensions, so up to inline_size indices are held inline and parsing
+// an array reference does not touch the heap.
+class h_index_t {
+public:
+    typedef int value_type;
+    typedef int* iterator;
+    typedef const int* const_iterator;
+    typedef size_t size_type;
+    enum { inline_size = 4 };
+
+    h_index_t() : data_(inline_), size_(0), cap_(inline_size) {}
+    h_index_t(const h_index_t& o)
+        : data_(inline_), size_(0), cap_(inline_size) { *this = o; }
+    ~h_index_t() { if (data_ != inline_) delete[] data_; }
+
+    h_index_t& operator=(const h_index_t& o) {
+        if (&o == this) return *this;
+        reserve(o.size_);
+        std::copy(o.begin(), o.end(), data_);
+        size_ = o.size_;
+        return *this;
+    }
+
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear() { size_ = 0; }
+    void reserve(size_type n) {
+        if (n <= cap_) return;
+        int* d = new int[n];
+        std::copy(data_, data_ + size_, d);
+        if (data_ != inline_) delete[] data_;
+        data_ = d;
+        cap_ = n;
+    }
+    void push_back(int v) {
+        if (size_ == cap_) reserve(cap_ * 2);
+        data_[size_++] = v;
+    }
+
+    int& operator[](size_type i) { return data_[i]; }
+    int  operator[](size_type i) const { return data_[i]; }
+    int& back() { return data_[size_ - 1]; }
+    int  back() const { return data_[size_ - 1]; }
+
+    iterator begin() { return data_; }
+    iterator end()   { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end()   const { return data_ + size_; }
+private:
+    int* data_;
+    size_type size_, cap_;
+    int inline_[inline_size];
+};
 
 struct __attribute__((__packed__))
 rgb_t {
@@ -32,83 +32,122 @@ struct ligature {
     ligature() : codepoint(0), seqlen(0) {}
 };
 
-// A "tree" mapping character sequences to particular ligatures
+// Ligatures are edited as a sorted map from character sequences, and
+// compiled after each change into a trie held in two flat arrays: node
+// 0 is the root, and each node's children are a run of edges sorted by
+// byte.  The root's children are also indexed directly by byte, since
+// most characters start no ligature at all.
 class ligatures {
-    typedef std::map<char, ligatures*> ligmap;
-    typedef ligmap::iterator ligmap_iter;
-    typedef std::pair<char, ligatures*> lignode;
-    typedef std::pair<ligmap_iter, bool> ligmap_insertion;
-    ligature val;
-    ligmap children;
+    typedef std::map<pstring, wchar> seqmap;
+    struct node {
+        ligature val;
+        int first, count; // run of edges
+    };
+    struct edge {
+        unsigned char ch;
+        int node;
+        bool operator<(const edge& o) const { return ch < o.ch; }
+    };
+    seqmap seqs;
+    std::vector<node> nodes;
+    std::vector<edge> edges;
+    int root[256];
+
+    void build();
+    int build(seqmap::const_iterator b, seqmap::const_iterator e, int depth);
+    const ligature* find(int n, const char* seq, const Fontinfo* face) const;
+    const ligature* accept(const ligature& val, const Fontinfo* face) const
+    {
+        return val.codepoint &&
+            (!face || face->font()->has_char(val.codepoint)) ? &val : 0;
+    }
     
 public:
-    void clear();
-    ligature* find(const char* seq, const Fontinfo* face);
-    void add(const char* seq, wchar value, int depth = 0);
-    void del(const char* seq);
-    
-    ~ligatures() { clear(); }
+    void clear() { seqs.clear(); build(); }
+    const ligature* find(const char* seq, const Fontinfo* face) const;
+    void add(const char* seq, wchar value) { seqs[seq] = value; build(); }
+    void del(const char* seq) { seqs.erase(seq); build(); }
+
+    ligatures() { build(); }
 };
 static ligatures ligs;
 
-void ligatures::clear()
+void ligatures::build()
 {
-    for (ligmap_iter it=children.begin() ; it != children.end(); ) {
-        if (it->second) delete it->second;
-        it->second = 0;
-        children.erase(it++);
-    }
-}
+    nodes.clear();
+    edges.clear();
+    build(seqs.begin(), seqs.end(), 0);
 
-ligature* ligatures::find(const char* seq, const Fontinfo* face)
-{
-    ligature* v = 0;
-    ligmap_iter e = children.find(*seq);
-    if (e != children.end())
-        v = e->second->find(seq + 1, face);
-    if (!v && val.codepoint &&
-        (!face || face->font()->has_char(val.codepoint)))
-        v = &val;
-    return v;
+    for (int i = 0; i < 256; ++i) root[i] = -1;
+    for (int i = nodes[0].first; i < nodes[0].first + nodes[0].count; ++i)
+        root[edges[i].ch] = edges[i].node;
 }
 
-void ligatures::add(const char* seq, wchar value, int depth)
+// Adds the node for the sequences in [b, e), which all share their
+// first depth bytes, and returns its index.
+int ligatures::build(seqmap::const_iterator b, seqmap::const_iterator e,
+                     int depth)
 {
-    if (*seq) {
-        // add/retrieve the branch to the node for *seq char
-        ligmap_insertion p = children.insert(lignode(*seq, 0));
-        if (p.second) {
-            if (p.first->second) delete p.first->second;
-            p.first->second = new ligatures;
-        }
-        // process the *seq node (p.first->second), adding more of the sequence
-        p.first->second->add(seq + 1, value, depth + 1);
+    const int n = nodes.size();
+    nodes.push_back(node());
+    if (b != e && b->first.length() == depth) {
+        nodes[n].val.codepoint = b->second;
+        nodes[n].val.seqlen = depth;
+        ++b;
     }
-    else {
-        //end of the sequence - put the ligature code into the contents
-        val.codepoint = value;
-        val.seqlen = depth;
+
+    // Sequences with the same next byte are adjacent; give each group
+    // an edge, then fill the edges in once the run is reserved, since
+    // the children add runs of their own.
+    int count = 0;
+    unsigned char prev = 0;
+    for (seqmap::const_iterator it = b; it != e; ++it) {
+        if (it == b || it->first[depth] != prev) ++count;
+        prev = it->first[depth];
     }
+    const int first = edges.size();
+    edges.resize(first + count);
+    nodes[n].first = first;
+    nodes[n].count = count;
+
+    int i = first;
+    while (b != e) {
+        const unsigned char ch = b->first[depth];
+        seqmap::const_iterator group_end = b;
+        while (group_end != e && group_end->first[depth] == ch) ++group_end;
+        const int child = build(b, group_end, depth + 1);
+        edges[i].ch = ch;
+        edges[i++].node = child;
+        b = group_end;
+    }
+    std::sort(edges.begin() + first, edges.begin() + first + count);
+
+    return n;
 }
 
-void ligatures::del(const char* seq)
+// Prefers the longest sequence whose ligature the face can render.
+const ligature* ligatures::find(const char* seq, const Fontinfo* face) const
 {
-    if (*seq) {
-        // retrieve the branch to the node for *seq char
-        ligmap_iter e = children.find(*seq);
-        if (e != children.end()) {
-            // got the branch, now process the *seq node (e->second),
-            // deleting further along the sequence
-            e->second->del(seq + 1);
-            // if *seq node is now empty (no branches or content),
-            // remove it entirely
-            if (!e->second->val.codepoint && e->second->children.empty())
-                children.erase(e);
-        }
-    }
-    else {
-        val.codepoint = 0;
+    const int child = root[(unsigned char) *seq];
+    const ligature* v = child >= 0 ? find(child, seq + 1, face) : 0;
+    return v ? v : accept(nodes[0].val, face);
+}
+
+const ligature* ligatures::find(int n, const char* seq,
+                                const Fontinfo* face) const
+{
+    const node& nd = nodes[n];
+    const ligature* v = 0;
+    if (nd.count) {
+        edge key;
+        key.ch = *seq;
+        std::vector<edge>::const_iterator
+            e = edges.begin() + nd.first + nd.count,
+            it = std::lower_bound(edges.begin() + nd.first, e, key);
+        if (it != e && it->ch == key.ch && *seq)
+            v = find(it->node, seq + 1, face);
     }
+    return v ? v : accept(nd.val, face);
 }
 
 
@@ -284,7 +323,7 @@ wchar UTF8Encoding::Decode_impl(const char* string, int& bytes,
             }
             fprintf(stderr, "Warning: UTF8Encoding::Decode called on "
                     "incomplete character (string: %s)\n", string);
-            if (save) *(char*)(string + 128) = save;
+            if (len > 128) *(char*)(string + 128) = save;
         }
 
         wchar wc = 0;
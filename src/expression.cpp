@@ -62,10 +62,10 @@ pstring Expression::debug_string() const
     return rv;
 }
 
-bool Expression::is_bareword(pstring what) const
+bool Expression::is_bareword(const char* what) const
 {
     if (type_ != Bareword) return false;
-    return what.caselessEqual(strval_);
+    return biseqcstrcaseless(&strval_, what) == 1;
 }
 
 void Expression::require(type_t t) const
@@ -117,7 +117,7 @@ int Expression::as_int() const
     if (is_numeric() && is_constant())
 	return intval_;
     else if (type_ == Array)
-	return h.arrays.find(intval_)->second.getValue(index_);
+	return h.findArray(intval_, site_)->getValue(index_);
     else if (type_ == Int)
 	return h.getVariableData(intval_).get_num();
     else if (is_textual())
@@ -134,7 +134,7 @@ int Expression::var_no() const
 int Expression::dim() const
 {
     require(Array, true);
-    return h.arrays.find(intval_)->second.dimension_size(index_.size());
+    return h.findArray(intval_, site_)->dimension_size(index_.size());
 }
 
 void Expression::mutate(int newval, int offset, bool as_array)
@@ -153,7 +153,7 @@ void Expression::mutate(int newval, int offset, bool as_array)
 	    else
 		i.back() += offset;
         }
-	h.arrays.find(intval_)->second.setValue(i, newval);
+	h.findArray(intval_, site_)->setValue(i, newval);
     }
     else
 	require(Int, true);
@@ -178,21 +178,27 @@ void Expression::append(wchar newval)
 }
 
 Expression::Expression(ScriptHandler& sh)
-    : h(sh), type_(Int), var_(false), strval_(""), intval_(0)
+    : h(sh), type_(Int), var_(false), site_(NULL), strval_(""), intval_(0)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v, int val)
-    : h(sh), type_(t), var_(is_v), strval_(""), intval_(val)
+    : h(sh), type_(t), var_(is_v), site_(NULL), strval_(""), intval_(val)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v, int val,
-                       const h_index_t& idx)
-    : h(sh), type_(t), var_(is_v), index_(idx), strval_(""), intval_(val)
+                       const h_index_t& idx, const char* site)
+    : h(sh), type_(t), var_(is_v), index_(idx), site_(site), strval_(""),
+      intval_(val)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v,
                        const pstring& val)
-    : h(sh), type_(t), var_(is_v), strval_(val), intval_(0)
+    : h(sh), type_(t), var_(is_v), site_(NULL), strval_(val), intval_(0)
+{}
+
+Expression::Expression(ScriptHandler& sh, type_t t, bool is_v,
+                       const char* val)
+    : h(sh), type_(t), var_(is_v), site_(NULL), strval_(val), intval_(0)
 {}
 
 Expression& Expression::operator=(const Expression& src)
@@ -203,6 +209,7 @@ Expression& Expression::operator=(const Expression& src)
     type_ = src.type_;
     var_ = src.var_;
     index_ = src.index_;
+    site_ = src.site_;
     strval_ = src.strval_;
     intval_ = src.intval_;
     return *this;
@@ -216,14 +223,13 @@ Expression ScriptHandler::readStrExpr(bool trace)
     // Currently this is a sane wrapper around the existing unsafe
     // plumbing.  It can be replaced with a safe implementation once
     // everything is going through a safe interface like this.
-    pstring s = readStr();
+    // s points into string_buffer; the Expression takes the only copy.
+    const char* s = readStr();
     if (current_variable.type == VAR_STR)
 	return Expression(*this, Expression::String, 1,
 			  current_variable.var_no);
-    else if (current_variable.type & VAR_LABEL) {
-	s.remove(0, 1);
-	return Expression(*this, Expression::Label, 0, s);
-    }
+    else if (current_variable.type & VAR_LABEL)
+	return Expression(*this, Expression::Label, 0, *s ? s + 1 : s);
     else if (current_variable.type == VAR_NONE)
 	return Expression(*this, Expression::Bareword, 0, s);
     else
@@ -240,7 +246,7 @@ Expression ScriptHandler::readIntExpr()
 	return Expression(*this, Expression::Int, 1, current_variable.var_no);
     else if (current_variable.type == VAR_ARRAY)
 	return Expression(*this, Expression::Array, 1, current_variable.var_no,
-			  current_variable.array);
+			  current_variable.array, current_variable.array_site);
     else
 	return Expression(*this, Expression::Int, 0, i);
 }
@@ -257,14 +263,17 @@ Expression ScriptHandler::readExpr()
 	 *buf != '-' && *buf != '+')
 	? readStrExpr()
 	: readIntExpr();
+    // Resolve aliases in place, so that e is the only return value and
+    // the compiler can construct it directly in the caller.
     if (e.type() == Expression::Bareword) {
-	numalias_t::iterator a = num_aliases.find(e.as_string());
-	if (a != num_aliases.end()) {
-	    return Expression(*this, Expression::Int, 0, a->second);
-	}
-	stralias_t::iterator b = str_aliases.find(e.as_string());
-	if (b != str_aliases.end()) {
-	    return Expression(*this, Expression::String, 0, a->second);
+	const pstring name = e.as_string();
+	numalias_t::iterator a = num_aliases.find(name);
+	if (a != num_aliases.end())
+	    e = Expression(*this, Expression::Int, 0, a->second);
+	else {
+	    stralias_t::iterator b = str_aliases.find(name);
+	    if (b != str_aliases.end())
+		e = Expression(*this, Expression::String, 0, b->second);
 	}
     }
     return e;
@@ -304,3 +313,342 @@ bool ScriptHandler::hasMoreArgs()
     // preceding commas)
     return end_status & END_COMMA;
 }
+
+
+// Compiled integer expressions
+
+static inline void skip_space(const char** buf)
+{
+    while (**buf == ' ' || **buf == '\t') ++*buf;
+}
+
+void ScriptHandler::clearExprCache()
+{
+    for (int i = 0; i < EXPR_CACHE_SIZE; ++i) {
+        delete expr_cache[i];
+        expr_cache[i] = NULL;
+    }
+    delete spare_expr;
+    spare_expr = NULL;
+}
+
+ScriptHandler::CompiledExpr* ScriptHandler::findCompiledExpr(const char* buf)
+{
+    if (!script_buffer || buf < script_buffer ||
+        buf >= script_buffer + script_buffer_length)
+        return NULL;
+    const int offset = buf - script_buffer;
+    CompiledExpr* ce = expr_cache[offset % EXPR_CACHE_SIZE];
+    return ce && ce->offset == offset ? ce : NULL;
+}
+
+void ScriptHandler::compileExpr(const char* start, const char* end)
+{
+    if (!script_buffer || start < script_buffer ||
+        start >= script_buffer + script_buffer_length)
+        return;
+
+    // Reuse the last evicted (or rejected) entry, keeping its buffers,
+    // so that a script too big for the cache doesn't allocate on every
+    // compile.
+    CompiledExpr* ce = spare_expr ? spare_expr : new CompiledExpr;
+    spare_expr = NULL;
+    ce->nodes.clear();
+    ce->indices.clear();
+    ce->missing_aliases.clear();
+    ce->nodes.reserve(8);
+    ce->offset = start - script_buffer;
+    const char* buf = start;
+    ce->root = compileIntExpression(*ce, &buf);
+    ce->end = buf;
+
+    // The compiler mirrors the parser; if they ever disagree about
+    // where the expression ends, don't trust the compiled version.
+    if (ce->end != end) {
+        spare_expr = ce;
+        return;
+    }
+
+    CompiledExpr*& slot = expr_cache[ce->offset % EXPR_CACHE_SIZE];
+    spare_expr = slot;
+    slot = ce;
+}
+
+int ScriptHandler::addExprNode(CompiledExpr& ce, ExprNode::kind_t kind,
+                               int value, int a, int b)
+{
+    // Fold constants.  Division by zero or -1 is left for run time so
+    // that it fails the same way it always has.
+    if (kind == ExprNode::NEG && ce.nodes[a].kind == ExprNode::CONST) {
+        kind = ExprNode::CONST;
+        value = -ce.nodes[a].value;
+        a = -1;
+    }
+    else if (kind == ExprNode::BINOP &&
+             ce.nodes[a].kind == ExprNode::CONST &&
+             ce.nodes[b].kind == ExprNode::CONST) {
+        const int num1 = ce.nodes[a].value, num2 = ce.nodes[b].value;
+        const bool divides = value == OP_DIV || value == OP_MOD;
+        if (!divides || (num2 != 0 && num2 != -1)) {
+            kind = ExprNode::CONST;
+            value = value == OP_PLUS  ? num1 + num2
+                  : value == OP_MINUS ? num1 - num2
+                  : value == OP_MULT  ? num1 * num2
+                  : value == OP_DIV   ? num1 / num2
+                  : num1 % num2;
+            a = b = -1;
+        }
+    }
+    ce.nodes.push_back(ExprNode(kind, value, a, b));
+    return ce.nodes.size() - 1;
+}
+
+// Follows parseIntExpression().
+int ScriptHandler::compileIntExpression(CompiledExpr& ce, const char** buf)
+{
+    int num[3], op[2];
+
+    skip_space(buf);
+
+    num[0] = compileNextOp(ce, buf, NULL);
+
+    num[1] = compileNextOp(ce, buf, &op[0]);
+    if (op[0] == OP_INVALID) {
+        // A failed operand after an operator still leaves its mark
+        // on current_variable.
+        return num[1] < 0 ? num[0]
+                          : addExprNode(ce, ExprNode::SEQ, 0, num[0], num[1]);
+    }
+
+    while (1) {
+        num[2] = compileNextOp(ce, buf, &op[1]);
+        if (op[1] == OP_INVALID) {
+            if (num[2] >= 0)
+                num[1] = addExprNode(ce, ExprNode::SEQ, 0, num[1], num[2]);
+            break;
+        }
+
+        if (!(op[0] & 0x04) && (op[1] & 0x04)) {
+            num[1] = addExprNode(ce, ExprNode::BINOP, op[1], num[1], num[2]);
+        }
+        else {
+            num[0] = addExprNode(ce, ExprNode::BINOP, op[0], num[0], num[1]);
+            op[0]  = op[1];
+            num[1] = num[2];
+        }
+    }
+    return addExprNode(ce, ExprNode::BINOP, op[0], num[0], num[1]);
+}
+
+// Follows readNextOp().  Returns the operand node, or -1 if no operand
+// was read.
+int ScriptHandler::compileNextOp(CompiledExpr& ce, const char** buf, int* op)
+{
+    bool minus_flag = false;
+    skip_space(buf);
+    const char* buf_start = *buf;
+
+    if (op) {
+        if ((*buf)[0] == '+') *op = OP_PLUS;
+        else if ((*buf)[0] == '-') *op = OP_MINUS;
+        else if ((*buf)[0] == '*') *op = OP_MULT;
+        else if ((*buf)[0] == '/') *op = OP_DIV;
+        else if ((*buf)[0] == 'm'
+                 && (*buf)[1] == 'o'
+                 && (*buf)[2] == 'd'
+                 && ((*buf)[3] == ' '
+                     || (*buf)[3] == '\t'
+                     || (*buf)[3] == '$'
+                     || (*buf)[3] == '%'
+                     || (*buf)[3] == '?'
+                     || ((*buf)[3] >= '0' && (*buf)[3] <= '9')))
+            *op = OP_MOD;
+        else {
+            *op = OP_INVALID;
+            return -1;
+        }
+
+        if (*op == OP_MOD) *buf += 3;
+        else (*buf)++;
+
+        skip_space(buf);
+    }
+    else {
+        if ((*buf)[0] == '-') {
+            minus_flag = true;
+            (*buf)++;
+            skip_space(buf);
+        }
+    }
+
+    int n;
+    if ((*buf)[0] == '(') {
+        (*buf)++;
+        n = compileIntExpression(ce, buf);
+        if (minus_flag) n = addExprNode(ce, ExprNode::NEG, 0, n);
+        skip_space(buf);
+        (*buf)++; // ')'
+    }
+    else {
+        n = compileInt(ce, buf);
+        if (ce.nodes[n].kind == ExprNode::NONE) {
+            if (op) *op = OP_INVALID;
+            *buf = buf_start;
+        }
+        else if (minus_flag)
+            n = addExprNode(ce, ExprNode::NEG, 0, n);
+    }
+    return n;
+}
+
+// Follows parseInt() and parseArray().
+int ScriptHandler::compileInt(CompiledExpr& ce, const char** buf)
+{
+    skip_space(buf);
+
+    if (**buf == '%') {
+        (*buf)++;
+        int no = compileInt(ce, buf);
+        const ExprNode& nn = ce.nodes[no];
+        if (nn.kind == ExprNode::CONST &&
+            nn.value >= 0 && nn.value < VARIABLE_RANGE) {
+            int n = addExprNode(ce, ExprNode::SLOT, nn.value);
+            ce.nodes[n].slot = &variable_data[ce.nodes[n].value];
+            return n;
+        }
+        return addExprNode(ce, ExprNode::VAR, 0, no);
+    }
+    else if (**buf == '?') {
+        const char* site = *buf;
+        (*buf)++;
+        int no = compileInt(ce, buf);
+        skip_space(buf);
+        // Index expressions may hold arrays of their own, so gather
+        // this reference's indices before adding them to ce.indices.
+        h_index_t indices;
+        while (**buf == '[') {
+            (*buf)++;
+            indices.push_back(compileIntExpression(ce, buf));
+            skip_space(buf);
+            (*buf)++; // ']'
+        }
+        int n = addExprNode(ce, ExprNode::ARRAY, ce.indices.size(), no,
+                            indices.size());
+        ce.indices.insert(ce.indices.end(), indices.begin(), indices.end());
+        ce.nodes[n].site = site;
+        return n;
+    }
+
+    char ch;
+    int alias_no = 0;
+    bool direct_num_flag = false;
+    bool num_alias_flag  = false;
+    bool hex_num_flag = (*buf)[0] == '0' && (*buf)[1] == 'x';
+    if (hex_num_flag) *buf += 2;
+
+    const char* buf_start = *buf;
+    while (1) {
+        ch = **buf;
+
+        if (hex_num_flag && isaxdigit(ch)) {
+            alias_no *= 16;
+            if (isadigit(ch)) alias_no += ch - '0';
+            else if (isupper(ch)) alias_no += ch - 'A' + 10;
+            else alias_no += ch - 'a' + 10;
+        }
+        else if (isadigit(ch)) {
+            if (!num_alias_flag) direct_num_flag = true;
+
+            if (direct_num_flag)
+                alias_no = alias_no * 10 + ch - '0';
+        }
+        else if (isalpha(ch) || ch == '_') {
+            if (hex_num_flag || direct_num_flag) break;
+
+            num_alias_flag = true;
+        }
+        else break;
+
+        (*buf)++;
+    }
+
+    if (*buf - buf_start == 0)
+        return addExprNode(ce, ExprNode::NONE, -1);
+
+    if (num_alias_flag) {
+        pstring alias_buf(buf_start, *buf - buf_start);
+        alias_buf.tolower();
+        numalias_t::iterator a = num_aliases.find(alias_buf);
+        if (a == num_aliases.end()) {
+            *buf = buf_start;
+            ce.missing_aliases.push_back(alias_buf);
+            return addExprNode(ce, ExprNode::NONE,
+                               ce.missing_aliases.size() - 1);
+        }
+        alias_no = a->second;
+    }
+
+    skip_space(buf);
+    return addExprNode(ce, ExprNode::CONST, alias_no);
+}
+
+int ScriptHandler::evalExpr(const CompiledExpr& ce, int node)
+{
+    const ExprNode& n = ce.nodes[node];
+    switch (n.kind) {
+    case ExprNode::CONST:
+        current_variable.type = VAR_INT | VAR_CONST;
+        return n.value;
+
+    case ExprNode::NONE:
+        if (n.value >= 0)
+            printf("can't find num alias for %s... assume 0.\n",
+                   (const char*) ce.missing_aliases[n.value]);
+        current_variable.type = VAR_NONE;
+        return 0;
+
+    case ExprNode::SLOT:
+        current_variable.var_no = n.value;
+        current_variable.type = VAR_INT;
+        return n.slot->get_num();
+
+    case ExprNode::VAR:
+        current_variable.var_no = evalExpr(ce, n.a);
+        current_variable.type = VAR_INT;
+        return getVariableData(current_variable.var_no).get_num();
+
+    case ExprNode::ARRAY: {
+        int no = evalExpr(ce, n.a);
+        h_index_t indices;
+        for (int i = n.value; i < n.value + n.b; ++i)
+            indices.push_back(evalExpr(ce, ce.indices[i]));
+        ArrayVariable* av = findArray(no, n.site);
+        current_variable.var_no = no;
+        current_variable.array = indices;
+        current_variable.array_site = n.site;
+        current_variable.type = VAR_ARRAY;
+        if (av) {
+            if (indices.size() < av->dimensions())
+                indices.push_back(0);
+            return av->getValue(indices);
+        }
+        return 0;
+    }
+
+    case ExprNode::NEG:
+        return -evalExpr(ce, n.a);
+
+    case ExprNode::BINOP: {
+        int num1 = evalExpr(ce, n.a);
+        int num2 = evalExpr(ce, n.b);
+        return calcArithmetic(num1, n.value, num2);
+    }
+
+    case ExprNode::SEQ: {
+        int rv = evalExpr(ce, n.a);
+        evalExpr(ce, n.b);
+        return rv;
+    }
+    }
+    return 0;
+}
@@ -26,7 +26,7 @@ public:
     bool is_array() const { return type_ == Array; }
     bool is_label() const { return type_ == Label; }
     bool is_bareword() const { return type_ == Bareword; }
-    bool is_bareword(pstring s) const;
+    bool is_bareword(const char* s) const;
 
     // Fail if attributes are missing
     void require(type_t t) const;
@@ -52,8 +52,9 @@ public:
     Expression(ScriptHandler& sh);
     Expression(ScriptHandler& sh, type_t t, bool is_v, int val);
     Expression(ScriptHandler& sh, type_t t, bool is_v, int val,
-	       const h_index_t& idx);
+	       const h_index_t& idx, const char* site);
     Expression(ScriptHandler& sh, type_t t, bool is_v, const pstring& val);
+    Expression(ScriptHandler& sh, type_t t, bool is_v, const char* val);
 
     Expression& operator=(const Expression& src);    
 private:
@@ -62,6 +63,7 @@ private:
     type_t type_;
     bool var_;
     h_index_t index_;
+    const char* site_; // script address of an array reference
     pstring strval_;
     int intval_;
 };
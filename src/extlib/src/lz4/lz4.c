@@ -0,0 +1,243 @@
+/*
+ *  lz4.c - LZ4 block compression
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+/* A block is a series of sequences, each
+ *
+ *   token        literal length in the high nibble, match length - 4
+ *                in the low; 15 in either means more follows
+ *   [lengths]    bytes added to a literal length of 15 while they're 255
+ *   literals
+ *   offset       2 bytes, little-endian, back from the current position
+ *   [lengths]    likewise for a match length of 15 + 4
+ *
+ * except the last, which ends after its literals.  A match must start
+ * at least 12 bytes before the end of the block, and the last 5 bytes
+ * are always literals.  The compressor is greedy, finding matches
+ * through a table of 4-byte hashes, much as the reference's fast mode
+ * does. */
+
+#include "lz4.h"
+#include <string.h>
+
+#define MINMATCH     4
+#define MFLIMIT      12
+#define LASTLITERALS 5
+#define MAX_DISTANCE 65535
+#define HASH_LOG     12
+#define RUN_MASK     15
+#define ML_MASK      15
+
+typedef unsigned char byte;
+typedef unsigned int  u32;
+
+static u32 read32(const byte* p)
+{
+    u32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static u32 hash4(u32 v)
+{
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/* Writes the extra bytes of a length that didn't fit in its nibble. */
+static byte* put_length(byte* op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (byte) len;
+    return op;
+}
+
+
+int LZ4_compressBound(int srcSize)
+{
+    return LZ4_COMPRESSBOUND(srcSize);
+}
+
+
+int LZ4_compress_default(const char* source, char* dest, int srcSize,
+                         int dstCapacity)
+{
+    const byte* src = (const byte*) source;
+    const byte* ip = src;
+    const byte* anchor = src;
+    const byte* const iend = src + srcSize;
+    const byte* const mflimit = iend - MFLIMIT;
+    const byte* const matchlimit = iend - LASTLITERALS;
+    byte* op = (byte*) dest;
+    byte* const oend = op + dstCapacity;
+    u32 table[1 << HASH_LOG];
+    size_t lit;
+
+    if (srcSize < 0 || srcSize > LZ4_MAX_INPUT_SIZE || dstCapacity < 0)
+        return 0;
+
+    if (srcSize > MFLIMIT) {
+        unsigned misses = 0;
+        memset(table, 0, sizeof table);
+        table[hash4(read32(ip))] = 0;
+        ++ip;
+
+        while (ip <= mflimit) {
+            u32 h = hash4(read32(ip));
+            const byte* ref = src + table[h];
+            size_t len;
+            byte* token;
+            table[h] = (u32) (ip - src);
+
+            if (ref >= ip || ip - ref > MAX_DISTANCE
+                || read32(ref) != read32(ip)) {
+                /* Step faster through data that doesn't compress. */
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            len = MINMATCH;
+            while (ip + len < matchlimit && ip[len] == ref[len]) ++len;
+
+            lit = ip - anchor;
+            if ((size_t) (oend - op) <
+                1 + lit / 255 + 1 + lit + 2 + (len - MINMATCH) / 255 + 1)
+                return 0;
+
+            token = op++;
+            if (lit >= RUN_MASK) {
+                *token = RUN_MASK << 4;
+                op = put_length(op, lit - RUN_MASK);
+            }
+            else {
+                *token = (byte) (lit << 4);
+            }
+            memcpy(op, anchor, lit);
+            op += lit;
+
+            *op++ = (byte) (ip - ref);
+            *op++ = (byte) ((ip - ref) >> 8);
+
+            if (len - MINMATCH >= ML_MASK) {
+                *token |= ML_MASK;
+                op = put_length(op, len - MINMATCH - ML_MASK);
+            }
+            else {
+                *token |= (byte) (len - MINMATCH);
+            }
+
+            ip += len;
+            anchor = ip;
+            /* The position just before the end of the match is a good
+               candidate for what comes next. */
+            table[hash4(read32(ip - 2))] = (u32) (ip - 2 - src);
+        }
+    }
+
+    /* The rest are literals. */
+    lit = iend - anchor;
+    if ((size_t) (oend - op) < 1 + lit / 255 + 1 + lit)
+        return 0;
+    if (lit >= RUN_MASK) {
+        *op++ = RUN_MASK << 4;
+        op = put_length(op, lit - RUN_MASK);
+    }
+    else {
+        *op++ = (byte) (lit << 4);
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return (int) (op - (byte*) dest);
+}
+
+
+int LZ4_decompress_safe(const char* source, char* dest, int compressedSize,
+                        int dstCapacity)
+{
+    const byte* ip = (const byte*) source;
+    const byte* const iend = ip + compressedSize;
+    byte* op = (byte*) dest;
+    byte* const ostart = op;
+    byte* const oend = op + dstCapacity;
+
+    if (compressedSize <= 0 || dstCapacity < 0) return -1;
+
+    for (;;) {
+        unsigned token;
+        size_t lit, len, offset;
+        const byte* match;
+
+        if (ip >= iend) return -1;
+        token = *ip++;
+
+        lit = token >> 4;
+        if (lit == RUN_MASK) {
+            unsigned s;
+            do {
+                if (ip >= iend) return -1;
+                s = *ip++;
+                lit += s;
+            } while (s == 255);
+        }
+        if (lit > (size_t) (iend - ip) || lit > (size_t) (oend - op))
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        /* The last sequence has no match. */
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - ostart)) return -1;
+
+        len = token & ML_MASK;
+        if (len == ML_MASK) {
+            unsigned s;
+            do {
+                if (ip >= iend) return -1;
+                s = *ip++;
+                len += s;
+            } while (s == 255);
+        }
+        len += MINMATCH;
+        if (len > (size_t) (oend - op)) return -1;
+
+        match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        }
+        else {
+            /* Overlapping: later bytes repeat ones just written. */
+            while (len--) *op++ = *match++;
+        }
+    }
+
+    return (int) (op - ostart);
+}
@@ -0,0 +1,56 @@
+/*
+ *  lz4.h - LZ4 block compression
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+/* The block functions of the reference LZ4 library, with the same
+   names, types and results, so either can be linked.  See README. */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZ4_MAX_INPUT_SIZE 0x7E000000
+#define LZ4_COMPRESSBOUND(isize) \
+    ((unsigned) (isize) > (unsigned) LZ4_MAX_INPUT_SIZE ? 0 : \
+     (isize) + (isize) / 255 + 16)
+
+/* The most srcSize bytes can take compressed, or 0 if srcSize is
+   more than LZ4_MAX_INPUT_SIZE. */
+int LZ4_compressBound(int srcSize);
+
+/* Compresses srcSize bytes from src into dst.  Returns the compressed
+   size, or 0 if it wouldn't fit in dstCapacity bytes; it always fits
+   in LZ4_compressBound(srcSize). */
+int LZ4_compress_default(const char* src, char* dst, int srcSize,
+                         int dstCapacity);
+
+/* Decompresses a block of exactly compressedSize bytes into at most
+   dstCapacity bytes.  Returns the decompressed size, or a negative
+   number if the block is malformed or too big; never reads or writes
+   outside the buffers given. */
+int LZ4_decompress_safe(const char* src, char* dst, int compressedSize,
+                        int dstCapacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LZ4_H */
@@ -28,6 +28,17 @@
 #include FT_TRUETYPE_IDS_H
 
 #include "font.h"
+#include "MemStats.h"
+#include <vector>
+
+#if !defined (WIN32) && !defined (PSP) && !defined (__OS2__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#define HAVE_MMAP
+#endif
 
 
 FT_Library freetype;
@@ -77,23 +88,248 @@ kerning_mode()
 #define FT_FLOOR(X) (((X) & - 64) / 64)
 #define FT_CEIL(X) ((((X) +63) & - 64) / 64)
 
+// Never freed: fonts are still being released by the static Fonts
+// table in Fontinfo.cpp at exit.
+typedef dictionary<pstring, FontData*>::t fontdata_t;
+static fontdata_t* fontdata = new fontdata_t;
+
+size_t FontData::mapped_bytes = 0, FontData::heap_bytes = 0;
+
+FontData::FontData(const pstring& key, const Uint8* data, size_t len,
+                   Kind kind)
+    : key(key), refs(1), kind(kind), data(data), len(len)
+{
+    if (kind == Mapped) mapped_bytes += len;
+    if (kind == Heap) heap_bytes += len;
+    if (key) (*fontdata)[key] = this;
+}
+
+
+FontData* FontData::find(const pstring& key)
+{
+    fontdata_t::iterator it = fontdata->find(key);
+    if (it == fontdata->end()) return NULL;
+    ++it->second->refs;
+    return it->second;
+}
+
+
+FontData* FontData::file(const char* filename)
+{
+    pstring key = filename;
+#ifdef HAVE_MMAP
+    char resolved[PATH_MAX];
+    if (realpath(filename, resolved)) key = resolved;
+#endif
+    FontData* rv = find(key);
+    if (rv) return rv;
+
+#ifdef HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            return new FontData(key, (const Uint8*) map, st.st_size, Mapped);
+        }
+    }
+    close(fd);
+#endif
+
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    size_t len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    Uint8* data = new Uint8[len];
+    fread(data, 1, len, fp);
+    fclose(fp);
+    return new FontData(key, data, len, Heap);
+}
+
+
+FontData* FontData::adopt(const pstring& key, Uint8* data, size_t len)
+{
+    return new FontData(key, data, len, Heap);
+}
+
+
+FontData* FontData::resource(const InternalResource* res)
+{
+    if (!res) return NULL;
+    return new FontData("", res->buffer, res->size, Static);
+}
+
+
+void FontData::release()
+{
+    if (--refs) return;
+    if (key) fontdata->erase(key);
+    if (kind == Mapped) {
+#ifdef HAVE_MMAP
+        munmap((void*) data, len);
+#endif
+        mapped_bytes -= len;
+    }
+    else if (kind == Heap) {
+        delete[] data;
+        heap_bytes -= len;
+    }
+    delete this;
+}
+
+
+// Glyphs are loaded and rendered once per size and rendering mode;
+// each cache is simply emptied when it fills up.
+static const size_t max_cached_metrics = 8192;
+static const size_t max_cached_glyphs = 2048;
+
+// Rendered glyphs are packed into A8 pages of this size, up to
+// max_atlas_pages per face; a glyph too big for one gets a page to
+// itself.
+static const int atlas_page_size = 512;
+static const size_t max_atlas_pages = 8;
+
+// Rows of glyphs are packed on shelves, each the height of the first
+// glyph placed on it rounded up, so that others of about that size can
+// share it.
+struct GlyphPage {
+    int refcount;
+    int w, h;
+    Uint8* pixels;
+
+    struct Shelf {
+        int y, h, x;
+    };
+    std::vector<Shelf> shelves;
+    int next_y;
+
+    GlyphPage(int w, int h)
+        : refcount(1), w(w), h(h), pixels(new Uint8[w * h]), next_y(0)
+    {
+        memset(pixels, 0, w * h);
+        MemStats::add(MemStats::GLYPHS, w * h);
+    }
+
+    ~GlyphPage()
+    {
+        MemStats::remove(MemStats::GLYPHS, w * h);
+        delete[] pixels;
+    }
+
+    void release() { if (--refcount == 0) delete this; }
+
+    // Finds room for a gw x gh glyph on the shelf that fits it best.
+    bool allocate(int gw, int gh, int& x, int& y)
+    {
+        if (gw > w) return false;
+        Shelf* best = NULL;
+        for (size_t i = 0; i < shelves.size(); ++i) {
+            Shelf& s = shelves[i];
+            if (s.h >= gh && s.x + gw <= w && (!best || s.h < best->h))
+                best = &s;
+        }
+        if (!best) {
+            int sh = (gh + 3) & ~3;
+            if (next_y + sh > h) sh = h - next_y;
+            if (sh < gh) return false;
+            Shelf s = { next_y, sh, 0 };
+            shelves.push_back(s);
+            next_y += sh;
+            best = &shelves.back();
+        }
+        x = best->x;
+        y = best->y;
+        best->x += gw;
+        return true;
+    }
+
+private:
+    GlyphPage(const GlyphPage&);
+    GlyphPage& operator= (const GlyphPage&);
+};
+
+// Stands in for the pixels of empty glyphs such as spaces.
+static const Uint8 empty_glyph = 0;
+
+
+Glyph::Glyph(const Glyph& other)
+    : pixels(other.pixels), w(other.w), h(other.h), pitch(other.pitch),
+      left(other.left), top(other.top), page(other.page)
+{
+    if (page) ++page->refcount;
+}
+
+
+Glyph& Glyph::operator= (const Glyph& other)
+{
+    if (other.page) ++other.page->refcount;
+    if (page) page->release();
+    pixels = other.pixels;
+    w = other.w;
+    h = other.h;
+    pitch = other.pitch;
+    left = other.left;
+    top = other.top;
+    page = other.page;
+    return *this;
+}
+
+
+Glyph::~Glyph()
+{
+    if (page) page->release();
+}
+
+
 struct FontInternals {
     FT_Open_Args args, met;
     FT_Face face;
     FT_Error err;
 
     int currsize;
-    bool del_data;
+    FontData *fdat, *mdat;
+
+    typedef std::map<Uint64, FT_Glyph_Metrics> metrics_t;
+    metrics_t metrics_cache;
 
-    FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
-		  size_t mlen, bool own);
+    typedef std::map<Uint64, Glyph> rendered_t;
+    rendered_t glyph_cache;
+    std::vector<GlyphPage*> atlas;
+
+    Uint64 cache_key(Uint16 unicode) const
+    {
+        return (Uint64) unicode | (Uint64) currsize << 16 |
+            (Uint64) hinting << 48 | (Uint64) lightrender << 50 |
+            (Uint64) subpixel << 51;
+    }
+
+    const FT_Glyph_Metrics& glyph_metrics(Uint16 unicode)
+    {
+        Uint64 key = cache_key(unicode);
+        metrics_t::iterator it = metrics_cache.find(key);
+        if (it != metrics_cache.end()) return it->second;
+
+        FT_GlyphSlot glyph = load_glyph(unicode);
+        if (err) return glyph->metrics;
+        if (metrics_cache.size() >= max_cached_metrics) metrics_cache.clear();
+        return metrics_cache[key] = glyph->metrics;
+    }
+
+    // Finds room in the atlas for a w x h glyph, starting afresh when it
+    // is full.
+    GlyphPage* place_glyph(int w, int h, int& x, int& y);
+    void clear_glyphs();
+
+    FontInternals(FontData* fdat, FontData* mdat);
 
     ~FontInternals() {
+        clear_glyphs();
         FT_Done_Face(face);
-        if (del_data) {
-            delete[] (const Uint8*) args.memory_base;
-            if (met.memory_base) delete[] (const Uint8*) met.memory_base;
-        }
+        fdat->release();
+        if (mdat) mdat->release();
     }
 
     FT_GlyphSlot load_glyph(Uint16 unicode)
@@ -104,16 +340,15 @@ struct FontInternals {
     }
 };
 
-FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
-                             size_t mlen, bool own)
-    : currsize(0), del_data(own)
+FontInternals::FontInternals(FontData* fdat, FontData* mdat)
+    : currsize(0), fdat(fdat), mdat(mdat)
 {
     args.flags = FT_OPEN_MEMORY;
-    args.memory_base = (const FT_Byte*) data;
-    args.memory_size = len;
+    args.memory_base = (const FT_Byte*) fdat->data;
+    args.memory_size = fdat->len;
     met.flags = FT_OPEN_MEMORY;
-    met.memory_base = mdat;
-    met.memory_size = mlen;
+    met.memory_base = mdat ? (const FT_Byte*) mdat->data : NULL;
+    met.memory_size = mdat ? mdat->len : 0;
     FT_Error err = FT_Open_Face(freetype, &args, 0, &face);
     if (err) {
 	fprintf(stderr, "ERROR: Failed to open face.\n");
@@ -124,58 +359,67 @@ FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
 }
 
 
+GlyphPage* FontInternals::place_glyph(int w, int h, int& x, int& y)
+{
+    if (w > atlas_page_size || h > atlas_page_size) {
+        GlyphPage* page = new GlyphPage(w, h);
+        x = y = 0;
+        return page;
+    }
+    for (size_t i = 0; i < atlas.size(); ++i)
+        if (atlas[i]->allocate(w, h, x, y)) {
+            ++atlas[i]->refcount;
+            return atlas[i];
+        }
+    if (atlas.size() >= max_atlas_pages) clear_glyphs();
+    GlyphPage* page = new GlyphPage(atlas_page_size, atlas_page_size);
+    atlas.push_back(page);
+    page->allocate(w, h, x, y);
+    ++page->refcount;
+    return page;
+}
+
+
+// Glyphs still held elsewhere keep their pages until they are done.
+void FontInternals::clear_glyphs()
+{
+    glyph_cache.clear();
+    for (size_t i = 0; i < atlas.size(); ++i) atlas[i]->release();
+    atlas.clear();
+}
+
+
+Font::Font(FontData* font, FontData* metrics)
+{
+    priv = new FontInternals(font, metrics);
+}
+
+
 Font::Font(const char* filename, const char* metrics)
 {
-    Uint8* data, * mdat;
-    size_t len, mlen;
-    FILE*  fp = fopen(filename, "rb");
-    if (!fp) {
+    FontData* fdat = FontData::file(filename);
+    FontData* mdat = metrics ? FontData::file(metrics) : NULL;
+    if (!fdat || (metrics && !mdat)) {
 	fprintf(stderr, "ERROR: This should never happen.\n");
 	exit(1);
     }
 
-    fseek(fp, 0, SEEK_END);
-    len = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    data = new Uint8[len];
-    fread(data, 1, len, fp);
-    fclose(fp);
-    if (metrics) {
-        fp = fopen(metrics, "rb");
-        if (!fp) {
-	    fprintf(stderr, "ERROR: This should never happen.\n");
-	    exit(1);
-	}
-
-        fseek(fp, 0, SEEK_END);
-        mlen = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        mdat = new Uint8[mlen];
-        fread(mdat, 1, mlen, fp);
-        fclose(fp);
-    }
-    else {
-        mdat = NULL;
-        mlen = 0;
-    }
-
-    priv = new FontInternals(data, len, mdat, mlen, true);
+    priv = new FontInternals(fdat, mdat);
 }
 
 
 Font::Font(const Uint8* data, size_t len, const Uint8* mdat, size_t mlen)
 {
-    priv = new FontInternals(data, len, mdat, mlen, true);
+    priv = new FontInternals(FontData::adopt("", (Uint8*) data, len),
+                             mdat ? FontData::adopt("", (Uint8*) mdat, mlen)
+                                  : NULL);
 }
 
 
 Font::Font(const InternalResource* font, const InternalResource* metrics)
 {
-    if (metrics)
-        priv = new FontInternals(font->buffer, font->size, metrics->buffer,
-                   metrics->size, false);
-    else
-        priv = new FontInternals(font->buffer, font->size, NULL, 0, false);
+    priv = new FontInternals(FontData::resource(font),
+                             FontData::resource(metrics));
 }
 
 
@@ -187,7 +431,7 @@ Font::~Font()
 
 void Font::get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float* maxy)
 {
-    FT_Glyph_Metrics& metrics = priv->load_glyph(ch)->metrics;
+    const FT_Glyph_Metrics& metrics = priv->glyph_metrics(ch);
     float hbx = float (metrics.horiBearingX) / 64.0;
     float hby = float (metrics.horiBearingY) / 64.0;
     if (!subpixel) {
@@ -213,7 +457,7 @@ void Font::get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float*
 
 float Font::advance(Uint16 ch)
 {
-    FT_Glyph_Metrics& metrics = priv->load_glyph(ch)->metrics;
+    const FT_Glyph_Metrics& metrics = priv->glyph_metrics(ch);
     float rv = float (metrics.horiAdvance) / 64.0;
     return subpixel ? rv : floor(rv);
 }
@@ -256,12 +500,17 @@ void Font::set_size(int val)
 }
 
 
-Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part)
+Glyph Font::render_glyph(Uint16 ch, float x_fractional_part)
 {
     Glyph rv;
     FT_Vector v;
     v.x = subpixel ? FT_Pos(x_fractional_part * 64.0) : 0;
     v.y = 0;
+
+    Uint64 key = priv->cache_key(ch) | (Uint64) (v.x & 0xff) << 52;
+    FontInternals::rendered_t::iterator it = priv->glyph_cache.find(key);
+    if (it != priv->glyph_cache.end()) return it->second;
+
     FT_Set_Transform(priv->face, 0, &v);
 
     FT_GlyphSlot glyph = priv->load_glyph(ch);
@@ -270,37 +519,32 @@ Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fraction
     FT_Error err = FT_Render_Glyph(glyph, render_mode());
     if (err) return rv;
 
-    rv.bitmap = SDL_CreateRGBSurface(0,
-                          glyph->bitmap.width, glyph->bitmap.rows,
-                          8, 0, 0, 0, 0);
-    if (!rv.bitmap) return rv;
+    rv.w = glyph->bitmap.width;
+    rv.h = glyph->bitmap.rows;
     rv.left = glyph->bitmap_left;
     rv.top = glyph->bitmap_top;
-
-    // Fill palette with 256 shades interpolating between foreground
-    // and background colours.
-    SDL_Palette* pal = rv.bitmap->format->palette;
-    int dr = fg.r - bg.r;
-    int dg = fg.g - bg.g;
-    int db = fg.b - bg.b;
-    for (int i = 0; i < 256; ++i) {
-        pal->colors[i].r = bg.r + i * dr / 255;
-        pal->colors[i].g = bg.g + i * dg / 255;
-        pal->colors[i].b = bg.b + i * db / 255;
+    if (rv.w == 0 || rv.h == 0) {
+        rv.pixels = &empty_glyph;
     }
-
-    // Copy the character from the pixmap
-    Uint8* src = (Uint8*) glyph->bitmap.buffer;
-    SDL_LockSurface(rv.bitmap);
-    Uint8* dst = (Uint8*) rv.bitmap->pixels;
-    for (int row = 0; row < rv.bitmap->h; ++row) {
-        memcpy(dst, src, glyph->bitmap.pitch);
-        src += glyph->bitmap.pitch;
-        dst += rv.bitmap->pitch;
+    else {
+        if (priv->glyph_cache.size() >= max_cached_glyphs)
+            priv->clear_glyphs();
+        int x, y;
+        rv.page = priv->place_glyph(rv.w, rv.h, x, y);
+        rv.pitch = rv.page->w;
+        Uint8* dst = rv.page->pixels + y * rv.pitch + x;
+        rv.pixels = dst;
+
+        // Copy the character from the pixmap
+        Uint8* src = (Uint8*) glyph->bitmap.buffer;
+        for (int row = 0; row < rv.h; ++row) {
+            memcpy(dst, src, rv.w);
+            src += glyph->bitmap.pitch;
+            dst += rv.pitch;
+        }
     }
 
-    SDL_UnlockSurface(rv.bitmap);
-
+    priv->glyph_cache[key] = rv;
     return rv;
 }
 
@@ -25,6 +25,7 @@
 
 #include <SDL.h>
 #include "resources.h"
+#include "pstring.h"
 
 enum HintingMode { NoHinting = 0, LightHinting = 1, FullHinting = 2 };
 
@@ -37,33 +38,56 @@ struct FontInternals;
 void FontInitialise();
 void FontFinished();
 
+struct GlyphPage;
+
+// A rendered glyph: 8-bit coverage, packed with others into an A8 page
+// of its face's glyph atlas.  Copies share the page, which lives on
+// until the last of them is gone even if the atlas has moved on.
 struct Glyph {
-    SDL_Surface* bitmap;
+    const Uint8* pixels; // NULL if rendering failed
+    int w, h, pitch;
     float left, top;
 
-    Glyph() : bitmap(NULL), left(0), top(0) {}
-    
-    Glyph(const Glyph& other) :
-	bitmap(other.bitmap), left(other.left), top(other.top)
-    {
-	++bitmap->refcount;
-    }
-
-    Glyph& operator= (const Glyph& other) {
-	++other.bitmap->refcount;
-	if (bitmap) SDL_FreeSurface(bitmap);
-	bitmap = other.bitmap;
-	left = other.left;
-	top = other.top;
-	return *this;
-    }
-
-    ~Glyph() { if (bitmap) SDL_FreeSurface(bitmap); }
+    Glyph() : pixels(NULL), w(0), h(0), pitch(0), left(0), top(0),
+              page(NULL) {}
+    Glyph(const Glyph& other);
+    Glyph& operator= (const Glyph& other);
+    ~Glyph();
+
+private:
+    friend class Font;
+    GlyphPage* page;
+};
+
+// The contents of a font or metrics file, shared by every Font opened
+// from the same source and released when the last of them closes.
+class FontData {
+    pstring key;
+    int refs;
+    enum Kind { Heap, Mapped, Static } kind;
+
+    FontData(const pstring& key, const Uint8* data, size_t len, Kind kind);
+public:
+    const Uint8* data;
+    size_t len;
+
+    // Each of these returns a new reference, or NULL.
+    static FontData* find(const pstring& key);
+    static FontData* file(const char* filename); // mapped where possible
+    static FontData* adopt(const pstring& key, Uint8* data, size_t len);
+    // ^-- takes ownership of data, allocated with new[]; key may be empty
+    static FontData* resource(const InternalResource* res);
+
+    void release();
+
+    static size_t mapped_bytes, heap_bytes;
 };
 
 class Font {
     FontInternals* priv;
 public:
+    Font(FontData* font, FontData* metrics = 0);
+    // ^-- takes over the references
     Font(const char* filename, const char* metrics = 0);
     Font(const Uint8* data, size_t len, const Uint8* mdat = 0, size_t mlen = 0);
     // ^-- takes ownership of data and mdat
@@ -74,7 +98,7 @@ public:
     void get_metrics(Uint16 ch, float* minx, float* maxx, float* miny, float* maxy);
 
     void set_size(int val);
-    Glyph render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part);
+    Glyph render_glyph(Uint16 ch, float x_fractional_part);
 
     int ascent();
     int lineskip();
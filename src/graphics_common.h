@@ -66,6 +66,11 @@
 #define RBMASK  0x00ff00ff
 #define MEDGRAY 0x88888888
 
+// x / a == x * blend_recip[a] >> 24 for any x < 65536 and 0 < a < 256;
+// used to take the divisions out of BLEND_PIXEL8_ALPHA.
+extern Uint32 blend_recip[256];
+#define BLEND_DIV(x, a) ((Uint32) ((Uint64) (x) * blend_recip[a] >> 24))
+
 #define SET_PIXEL32(rgb, alpha) {\
     *dst_buffer = (rgb);\
     *alphap = (alpha);\
@@ -103,7 +108,7 @@
     Uint32 mask2 = *src_buffer; \
     if (mask2 != 0){ \
         *alphap = 0xff ^ ((0xff ^ *alphap)*(0xff ^ *src_buffer) >> 8); \
-        mask2 = (mask2 << 5) / *alphap; \
+        mask2 = BLEND_DIV(mask2 << 5, *alphap); \
         Uint32 d1 = (*dst_buffer | *dst_buffer << 16) & BLENDMASK; \
         Uint32 mask = (d1 + ((src_color-d1) * mask2 >> BLENDSHIFT)) & BLENDMASK; \
         *dst_buffer = mask | mask >> 16; \
@@ -175,10 +180,11 @@
         alpha = 0xff ^ ((0xff ^ alpha)*(0xff ^ mask2) >> 8); \
         Uint32 mask_rb = (*dst_buffer & RBMASK) * mask1 + \
                          src_color1 * mask2; \
-        mask_rb = ((mask_rb / alpha) & RMASK) | \
-                  (((mask_rb & GBMASK) / alpha) & BMASK); \
-        Uint32 mask_g = (((*dst_buffer & GMASK) * mask1 + \
-                          src_color2 * mask2) / alpha) & GMASK; \
+        mask_rb = ((BLEND_DIV(mask_rb >> 16, alpha) << 16) & RMASK) | \
+                  (BLEND_DIV(mask_rb & GBMASK, alpha) & BMASK); \
+        Uint32 mask_g = (BLEND_DIV(((*dst_buffer & GMASK) * mask1 + \
+                                    src_color2 * mask2) >> 8, alpha) << 8) \
+                        & GMASK; \
         *dst_buffer = mask_rb | mask_g | (alpha << ASHIFT); \
     } \
 }
@@ -245,6 +251,19 @@
               monocro_color_lut[c].b; \
 }
 
+// As MONOCRO_PIXEL, but scaling by monocro_r/g/b directly; entry c of
+// monocro_color_lut is (monocro_color * c) >> 8, so the result is the same.
+#define MONOCRO_COLOR_PIXEL(){\
+    const Uint32 tmp = ((*buffer & GMASK) >> GSHIFT); \
+    Uint32 c = ((*buffer & RMASK) >> RSHIFT) + (*buffer & BMASK) + tmp; \
+    c += c<<2; \
+    c += (c<<4) + tmp; \
+    c >>= 8; \
+    *buffer = (((monocro_r * c) >> 8) << RSHIFT) | \
+              (((monocro_g * c) >> 8) << GSHIFT) | \
+              ((monocro_b * c) >> 8); \
+}
+
 #endif //ndef BPP16
 
 
@@ -306,3 +325,21 @@
     } \
 }
 
+#define NEGA_PIXEL(){\
+    *buffer ^= mask;  \
+}
+
+#define BASIC_NEGA(){\
+    while(--n > 0) {  \
+        NEGA_PIXEL();  \
+        ++buffer;  \
+    } \
+}
+
+#define BASIC_MONOCRO(){\
+    while(--n > 0) {  \
+        MONOCRO_COLOR_PIXEL();  \
+        ++buffer;  \
+    } \
+}
+
@@ -26,6 +26,7 @@
 
 #ifdef USE_X86_GFX
 
+#include <SDL.h>
 #include <mmintrin.h>
 #include <math.h>
 #ifndef M_PI
@@ -29,6 +29,7 @@
 #include <SDL.h>
 #include <emmintrin.h>
 #include <math.h>
+#include <string.h>
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -179,4 +180,135 @@ void imageFilterBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap
     BASIC_BLEND();
 }
 
+
+void imageFilterNega_SSE2(Uint32 *buffer, Uint32 mask, int length)
+{
+    int n = length;
+
+    // Compute first few values so we're on a 16-byte boundary in buffer
+    while( (((long)buffer & 0xF) > 0) && (n > 0) ) {
+        NEGA_PIXEL();
+        --n; ++buffer;
+    }
+
+    // Do bulk of processing using SSE2 (invert 4 32bit pixels)
+    __m128i m = _mm_set1_epi32(mask);
+    while(n >= 4) {
+        __m128i b = _mm_load_si128((__m128i*)buffer);
+        _mm_store_si128((__m128i*)buffer, _mm_xor_si128(b, m));
+
+        n -= 4; buffer += 4;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_NEGA();
+}
+
+
+#ifndef BPP16
+void imageFilterMonochrome_SSE2(Uint32 *buffer, int monocro_r, int monocro_g, int monocro_b, int length)
+{
+    int n = length;
+
+    // Compute first few values so we're on a 16-byte boundary in buffer
+    while( (((long)buffer & 0xF) > 0) && (n > 0) ) {
+        MONOCRO_COLOR_PIXEL();
+        --n; ++buffer;
+    }
+
+    // Do bulk of processing using SSE2 (process 4 32bit (BGRA) pixels,
+    // two at a time as 16-bit channels)
+    __m128i zero = _mm_setzero_si128();
+    // madd with these leaves 85*b + 86*g and 85*r in adjacent dwords
+    __m128i weights = _mm_set_epi16(0, 85, 86, 85, 0, 85, 86, 85);
+    __m128i color = _mm_set_epi16(0, monocro_r, monocro_g, monocro_b,
+                                  0, monocro_r, monocro_g, monocro_b);
+    while(n >= 4) {
+        __m128i buf = _mm_load_si128((__m128i*)buffer);
+        __m128i lo = _mm_unpacklo_epi8(buf, zero);
+        __m128i hi = _mm_unpackhi_epi8(buf, zero);
+        // c = (85*r + 86*g + 85*b) >> 8, in both dwords of each pixel
+        lo = _mm_madd_epi16(lo, weights);
+        hi = _mm_madd_epi16(hi, weights);
+        lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        lo = _mm_srli_epi32(lo, 8);
+        hi = _mm_srli_epi32(hi, 8);
+        // spread c over all four words of the pixel
+        lo = _mm_or_si128(lo, _mm_slli_epi32(lo, 16));
+        hi = _mm_or_si128(hi, _mm_slli_epi32(hi, 16));
+        // channel = (color * c) >> 8; alpha ends up 0, as in the LUT path
+        lo = _mm_srli_epi16(_mm_mullo_epi16(lo, color), 8);
+        hi = _mm_srli_epi16(_mm_mullo_epi16(hi, color), 8);
+        _mm_store_si128((__m128i*)buffer, _mm_packus_epi16(lo, hi));
+
+        n -= 4; buffer += 4;
+    }
+
+    // If any pixels are left over, deal with them individually
+    ++n;
+    BASIC_MONOCRO();
+}
+
+
+// Blends a row of 8-bit glyph coverage onto 32-bit pixels in colour
+// 0x00RRGGBB, as BLEND_PIXEL8_ALPHA does one pixel at a time.  Every
+// product fits in 16 bits and every sum below 2^24, so the divisions
+// by the new alpha can be done exactly in single floats.
+void imageFilterBlendText_SSE2(Uint32 *dst_buffer, const Uint8 *src_buffer, Uint32 color, int length)
+{
+    int n = length;
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i ff = _mm_set1_epi32(0xff);
+    __m128i color_r = _mm_set1_epi32((color >> RSHIFT) & 0xff);
+    __m128i color_g = _mm_set1_epi32((color >> GSHIFT) & 0xff);
+    __m128i color_b = _mm_set1_epi32((color >> BSHIFT) & 0xff);
+    while (n >= 4) {
+        int cov;
+        memcpy(&cov, src_buffer, 4);
+        if (cov != 0) {
+            __m128i m = _mm_cvtsi32_si128(cov);
+            m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(m, zero), zero);
+            __m128i d = _mm_loadu_si128((__m128i*)dst_buffer);
+            __m128i inv_m = _mm_xor_si128(m, ff);
+            // mask1 = (255 - m) * a >> 8
+            // alpha = 255 - ((255 - a) * (255 - m) >> 8)
+            __m128i a = _mm_srli_epi32(d, ASHIFT);
+            __m128i mask1 = _mm_srli_epi32(_mm_mullo_epi16(inv_m, a), 8);
+            __m128i alpha = _mm_xor_si128(_mm_srli_epi32(
+                _mm_mullo_epi16(inv_m, _mm_xor_si128(a, ff)), 8), ff);
+            __m128 alpha_f = _mm_cvtepi32_ps(alpha);
+            // channel = (d * mask1 + colour * m) / alpha
+#define BLEND_TEXT_CHANNEL(shift, c) \
+            _mm_slli_epi32(_mm_and_si128(_mm_cvttps_epi32(_mm_div_ps( \
+                _mm_cvtepi32_ps(_mm_add_epi32( \
+                    _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(d, shift), \
+                                                  ff), mask1), \
+                    _mm_mullo_epi16(c, m))), alpha_f)), ff), shift)
+            __m128i r = _mm_or_si128(
+                _mm_or_si128(BLEND_TEXT_CHANNEL(RSHIFT, color_r),
+                             BLEND_TEXT_CHANNEL(GSHIFT, color_g)),
+                _mm_or_si128(BLEND_TEXT_CHANNEL(BSHIFT, color_b),
+                             _mm_slli_epi32(alpha, ASHIFT)));
+#undef BLEND_TEXT_CHANNEL
+            // pixels with no coverage are left alone
+            __m128i keep = _mm_cmpeq_epi32(m, zero);
+            r = _mm_or_si128(_mm_and_si128(keep, d),
+                             _mm_andnot_si128(keep, r));
+            _mm_storeu_si128((__m128i*)dst_buffer, r);
+        }
+        n -= 4; dst_buffer += 4; src_buffer += 4;
+    }
+
+    // If any pixels are left over, deal with them individually
+    Uint32 src_color1 = color & RBMASK;
+    Uint32 src_color2 = color & GMASK;
+    for (; n > 0; n--, dst_buffer++, src_buffer++) {
+        BLEND_PIXEL8_ALPHA();
+    }
+}
+#endif
+
 #endif
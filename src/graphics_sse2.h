@@ -28,5 +28,10 @@ void imageFilterMean_SSE2(unsigned char *src1, unsigned char *src2, unsigned cha
 void imageFilterAddTo_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterSubFrom_SSE2(unsigned char *dst, unsigned char *src, int length);
 void imageFilterBlend_SSE2(Uint32 *dst_buffer, Uint32 *src_buffer, Uint8 *alphap, int alpha, int length);
+void imageFilterNega_SSE2(Uint32 *buffer, Uint32 mask, int length);
+#ifndef BPP16
+void imageFilterMonochrome_SSE2(Uint32 *buffer, int monocro_r, int monocro_g, int monocro_b, int length);
+void imageFilterBlendText_SSE2(Uint32 *dst_buffer, const Uint8 *src_buffer, Uint32 color, int length);
+#endif
 
 #endif
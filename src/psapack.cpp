@@ -0,0 +1,450 @@
+// A simple program to create and unpack Ponscripter archives (.psa)
+// Usage: psapack [-0] archive.psa directory   pack a directory tree
+//        psapack -l archive.psa               list contents
+//        psapack -t archive.psa               check every entry
+//        psapack -x archive.psa [directory]   unpack
+//
+// -0 stores everything uncompressed.  Otherwise files are compressed
+// with LZ4 when that saves at least 1/16 of their size.
+
+#define _FILE_OFFSET_BITS 64
+
+#include "PsaFormat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <lz4.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#ifdef WIN32
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#define seek64(f, off) _fseeki64(f, off, SEEK_SET)
+#else
+#define make_dir(path) mkdir(path, 0777)
+#define seek64(f, off) fseeko(f, off, SEEK_SET)
+#endif
+
+// Files larger than this are stored rather than compressed, so that
+// packing never has to hold more than this much in memory.
+#define MAX_COMPRESS (256 << 20)
+#define CHUNK 65536
+
+struct entry {
+    std::string name;
+    uint32_t hash;
+    uint64_t offset, length, original_length;
+    int codec;
+    uint32_t crc;
+
+    bool operator<(const entry& e) const
+    {
+        return hash != e.hash ? hash < e.hash : name < e.name;
+    }
+};
+
+typedef std::vector< entry > evec;
+typedef std::vector< unsigned char > bytes;
+
+
+static std::string upper(std::string s)
+{
+    for (size_t i = 0; i < s.size(); ++i)
+        if (s[i] >= 'a' && s[i] <= 'z') s[i] -= 'a' - 'A';
+    return s;
+}
+
+
+// Collects regular files below root + "/" + dir, named relative to
+// root with '\' separators.
+static void scan(const std::string& root, const std::string& dir,
+                 std::vector< std::string >& files)
+{
+    std::string path = dir.empty() ? root : root + "/" + dir;
+    DIR* d = opendir(path.c_str());
+    if (!d) {
+        fprintf(stderr, "psapack: can't read %s: %s\n", path.c_str(),
+                strerror(errno));
+        exit(1);
+    }
+
+    while (dirent* de = readdir(d)) {
+        std::string name = de->d_name;
+        if (name == "." || name == "..") continue;
+
+        std::string rel = dir.empty() ? name : dir + "\\" + name;
+        std::string full = path + "/" + name;
+        struct stat st;
+        if (stat(full.c_str(), &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            std::string sub = rel;
+            std::replace(sub.begin(), sub.end(), '\\', '/');
+            scan(root, sub, files);
+        }
+        else if (S_ISREG(st.st_mode)) {
+            std::replace(rel.begin(), rel.end(), '/', '\\');
+            files.push_back(rel);
+        }
+    }
+    closedir(d);
+}
+
+
+static void write_or_die(FILE* f, const void* data, size_t len)
+{
+    if (len && fwrite(data, 1, len, f) != len) {
+        fprintf(stderr, "psapack: write failed: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+
+// Appends one file to the archive, filling in everything but the
+// name and hash.
+static void pack_file(FILE* out, FILE* in, bool compress, entry& e)
+{
+    bytes data(CHUNK);
+    size_t len = fread(&data[0], 1, CHUNK, in);
+
+    // Read small enough files whole, and try compressing them.
+    if (compress && len == CHUNK) {
+        while (data.size() < MAX_COMPRESS) {
+            size_t old = data.size();
+            data.resize(std::min(old * 2, (size_t) MAX_COMPRESS));
+            size_t n = fread(&data[old], 1, data.size() - old, in);
+            len += n;
+            if (len < data.size()) break;
+        }
+    }
+
+    e.crc = psa_crc32(0, &data[0], len);
+    e.original_length = len;
+    e.codec = PSA_CODEC_STORED;
+
+    if (compress && len > 0 && len < data.size()) {
+        bytes packed(LZ4_compressBound(len));
+        int clen = LZ4_compress_default((const char*) &data[0],
+                                        (char*) &packed[0], len,
+                                        packed.size());
+        if (clen > 0 && (size_t) clen < len - len / 16) {
+            write_or_die(out, &packed[0], clen);
+            e.codec = PSA_CODEC_LZ4;
+            e.length = clen;
+            return;
+        }
+    }
+
+    // Store, copying whatever is left of the file in chunks.
+    write_or_die(out, &data[0], len);
+    while ((len = fread(&data[0], 1, CHUNK, in)) > 0) {
+        e.crc = psa_crc32(e.crc, &data[0], len);
+        e.original_length += len;
+        write_or_die(out, &data[0], len);
+    }
+    e.length = e.original_length;
+}
+
+
+static int create(const char* archive, const char* root, bool compress)
+{
+    std::vector< std::string > files;
+    scan(root, "", files);
+
+    FILE* out = fopen(archive, "wb");
+    if (!out) {
+        fprintf(stderr, "psapack: can't create %s: %s\n", archive,
+                strerror(errno));
+        return 1;
+    }
+
+    unsigned char header[PSA_HEADER_SIZE] = { 0 };
+    write_or_die(out, header, PSA_HEADER_SIZE);
+
+    evec entries;
+    std::set< std::string > seen;
+    uint64_t offset = PSA_HEADER_SIZE;
+    for (size_t i = 0; i < files.size(); ++i) {
+        // The reader ignores case, so names differing only in case
+        // would shadow one another.
+        std::string key = upper(files[i]);
+        if (seen.count(key)) {
+            fprintf(stderr, "psapack: skipping %s: name clashes with "
+                    "another file\n", files[i].c_str());
+            continue;
+        }
+
+        std::string path = std::string(root) + "/" + files[i];
+        std::replace(path.begin(), path.end(), '\\', '/');
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in) {
+            fprintf(stderr, "psapack: can't read %s: %s\n", path.c_str(),
+                    strerror(errno));
+            continue;
+        }
+
+        entry e;
+        e.name = files[i];
+        e.hash = psa_hash(e.name.c_str());
+        e.offset = offset;
+        pack_file(out, in, compress, e);
+        fclose(in);
+        offset += e.length;
+        entries.push_back(e);
+        seen.insert(key);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::string names;
+    bytes dir(entries.size() * PSA_RECORD_SIZE);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        unsigned char* r = &dir[i * PSA_RECORD_SIZE];
+        psa_put32(r, entries[i].hash);
+        psa_put32(r + 4, names.size());
+        psa_put64(r + 8, entries[i].offset);
+        psa_put64(r + 16, entries[i].length);
+        psa_put64(r + 24, entries[i].original_length);
+        r[32] = entries[i].codec;
+        psa_put32(r + 36, entries[i].crc);
+        names += entries[i].name;
+        names += '\0';
+    }
+    if (!dir.empty()) write_or_die(out, &dir[0], dir.size());
+    write_or_die(out, names.data(), names.size());
+
+    memcpy(header, PSA_MAGIC, 4);
+    header[4] = PSA_VERSION;
+    psa_put32(header + 8, entries.size());
+    psa_put32(header + 12, names.size());
+    psa_put64(header + 16, offset);
+    if (fseek(out, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "psapack: can't rewind %s\n", archive);
+        return 1;
+    }
+    write_or_die(out, header, PSA_HEADER_SIZE);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "psapack: can't write %s: %s\n", archive,
+                strerror(errno));
+        return 1;
+    }
+
+    printf("%s: %lu files, %llu bytes of data\n", archive,
+           (unsigned long) entries.size(),
+           (unsigned long long) (offset - PSA_HEADER_SIZE));
+    return 0;
+}
+
+
+static bool read_at(FILE* f, uint64_t offset, void* buf, size_t len)
+{
+    return seek64(f, offset) == 0 && fread(buf, 1, len, f) == len;
+}
+
+
+static bool read_directory(FILE* f, const char* archive, evec& entries)
+{
+    unsigned char header[PSA_HEADER_SIZE];
+    if (!read_at(f, 0, header, PSA_HEADER_SIZE)
+        || memcmp(header, PSA_MAGIC, 4) != 0) {
+        fprintf(stderr, "psapack: %s is not a PSA archive\n", archive);
+        return false;
+    }
+    if ((header[4] | header[5] << 8) > PSA_VERSION) {
+        fprintf(stderr, "psapack: %s is from a newer version\n", archive);
+        return false;
+    }
+
+    uint32_t count = psa_get32(header + 8);
+    uint32_t names_length = psa_get32(header + 12);
+    uint64_t dir_offset = psa_get64(header + 16);
+    bytes dir((size_t) count * PSA_RECORD_SIZE + names_length + 1);
+    if (!read_at(f, dir_offset, &dir[0], dir.size() - 1)) {
+        fprintf(stderr, "psapack: can't read directory of %s\n", archive);
+        return false;
+    }
+    const char* names = (const char*) &dir[count * PSA_RECORD_SIZE];
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const unsigned char* r = &dir[i * PSA_RECORD_SIZE];
+        entry e;
+        e.hash = psa_get32(r);
+        if (psa_get32(r + 4) >= names_length) {
+            fprintf(stderr, "psapack: %s: directory is damaged\n", archive);
+            return false;
+        }
+        e.name = names + psa_get32(r + 4);
+        e.offset = psa_get64(r + 8);
+        e.length = psa_get64(r + 16);
+        e.original_length = psa_get64(r + 24);
+        e.codec = r[32];
+        e.crc = psa_get32(r + 36);
+        entries.push_back(e);
+    }
+    return true;
+}
+
+
+// Reads an entry and checks it against its CRC, writing the contents
+// to out if that isn't NULL.  Stored entries are copied in chunks.
+static bool unpack_entry(FILE* f, const entry& e, FILE* out)
+{
+    bytes data;
+    uint32_t crc = 0;
+
+    if (e.codec == PSA_CODEC_STORED) {
+        data.resize(CHUNK);
+        if (seek64(f, e.offset) != 0) return false;
+        for (uint64_t left = e.length; left > 0; ) {
+            size_t n = left < CHUNK ? left : CHUNK;
+            if (fread(&data[0], 1, n, f) != n) return false;
+            crc = psa_crc32(crc, &data[0], n);
+            if (out) write_or_die(out, &data[0], n);
+            left -= n;
+        }
+        return crc == e.crc;
+    }
+
+    if (e.codec != PSA_CODEC_LZ4
+        || e.length > (uint64_t) LZ4_COMPRESSBOUND(LZ4_MAX_INPUT_SIZE)
+        || e.original_length > LZ4_MAX_INPUT_SIZE)
+        return false;
+
+    bytes packed(e.length + 1);
+    data.resize(e.original_length + 1);
+    if (!read_at(f, e.offset, &packed[0], e.length)) return false;
+    int len = LZ4_decompress_safe((const char*) &packed[0],
+                                  (char*) &data[0], e.length,
+                                  e.original_length);
+    if (len != (int) e.original_length
+        || psa_crc32(0, &data[0], len) != e.crc)
+        return false;
+
+    if (out) write_or_die(out, &data[0], len);
+    return true;
+}
+
+
+// Refuses names that would unpack outside the target directory.
+static bool safe_name(const std::string& name)
+{
+    std::string n = "\\" + name + "\\";
+    std::replace(n.begin(), n.end(), '/', '\\');
+    return name[0] != '\\' && name[0] != '/'
+        && n.find("\\..\\") == std::string::npos
+        && name.find(':') == std::string::npos;
+}
+
+
+// Creates the directories leading up to path.
+static void make_parents(const std::string& path)
+{
+    for (size_t i = path.find('/', 1); i != std::string::npos;
+         i = path.find('/', i + 1))
+        make_dir(path.substr(0, i).c_str());
+}
+
+
+static int unpack(const char* archive, const char* root, char mode)
+{
+    FILE* f = fopen(archive, "rb");
+    if (!f) {
+        fprintf(stderr, "psapack: can't open %s: %s\n", archive,
+                strerror(errno));
+        return 1;
+    }
+
+    evec entries;
+    if (!read_directory(f, archive, entries)) {
+        fclose(f);
+        return 1;
+    }
+
+    int errors = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const entry& e = entries[i];
+        if (mode == 'l') {
+            printf("%12llu %12llu %s %s\n",
+                   (unsigned long long) e.original_length,
+                   (unsigned long long) e.length,
+                   e.codec == PSA_CODEC_LZ4 ? "lz4   " : "stored",
+                   e.name.c_str());
+            continue;
+        }
+
+        FILE* out = NULL;
+        std::string path;
+        if (mode == 'x') {
+            if (!safe_name(e.name)) {
+                fprintf(stderr, "psapack: skipping unsafe name %s\n",
+                        e.name.c_str());
+                ++errors;
+                continue;
+            }
+            path = std::string(root) + "/" + e.name;
+            std::replace(path.begin(), path.end(), '\\', '/');
+            make_parents(path);
+            out = fopen(path.c_str(), "wb");
+            if (!out) {
+                fprintf(stderr, "psapack: can't create %s: %s\n",
+                        path.c_str(), strerror(errno));
+                ++errors;
+                continue;
+            }
+        }
+
+        if (!unpack_entry(f, e, out)) {
+            fprintf(stderr, "psapack: %s is damaged\n", e.name.c_str());
+            ++errors;
+        }
+        if (out && fclose(out) != 0) {
+            fprintf(stderr, "psapack: can't write %s: %s\n", path.c_str(),
+                    strerror(errno));
+            ++errors;
+        }
+    }
+    fclose(f);
+
+    if (mode == 't')
+        printf("%s: %lu files, %d damaged\n", archive,
+               (unsigned long) entries.size(), errors);
+    return errors ? 1 : 0;
+}
+
+
+static int usage()
+{
+    fputs("Usage: psapack [-0] archive.psa directory\n"
+          "       psapack -l archive.psa\n"
+          "       psapack -t archive.psa\n"
+          "       psapack -x archive.psa [directory]\n", stderr);
+    return 2;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+
+    const char* opt = argv[1];
+    if (opt[0] == '-' && opt[1] && !opt[2]) {
+        switch (opt[1]) {
+        case '0':
+            return argc == 4 ? create(argv[2], argv[3], false) : usage();
+        case 'l': case 't':
+            return argc == 3 ? unpack(argv[2], NULL, opt[1]) : usage();
+        case 'x':
+            if (argc > 4) return usage();
+            return unpack(argv[2], argc == 4 ? argv[3] : ".", 'x');
+        }
+        return usage();
+    }
+
+    return argc == 3 ? create(argv[1], argv[2], true) : usage();
+}
@@ -27,26 +27,30 @@
 #include <stdio.h>
 #include <string.h>
 
-static unsigned long *pixel_accum=NULL;
-static unsigned long *pixel_accum_num=NULL;
-static int pixel_accum_size=0;
-static unsigned long tmp_acc[4];
-static unsigned long tmp_acc_num[4];
-
-static void calcWeightedSumColumnInit(unsigned char **src,
+// Running sums for one resizeImage() call, kept per call so that a
+// screenshot can be scaled on a worker thread while the main thread
+// resizes sprites.
+struct resize_state {
+    unsigned long *pixel_accum;
+    unsigned long *pixel_accum_num;
+    unsigned long tmp_acc[4];
+    unsigned long tmp_acc_num[4];
+};
+
+static void calcWeightedSumColumnInit(resize_state &st, unsigned char **src,
                                       int interpolation_height,
                                       int image_width, int image_height,
                                       int image_pixel_width, int byte_per_pixel)
 {
     int y_end   = -interpolation_height/2+interpolation_height;
 
-    memset(pixel_accum, 0, image_width*byte_per_pixel*sizeof(unsigned long));
-    memset(pixel_accum_num, 0, image_width*byte_per_pixel*sizeof(unsigned long));
+    memset(st.pixel_accum, 0, image_width*byte_per_pixel*sizeof(unsigned long));
+    memset(st.pixel_accum_num, 0, image_width*byte_per_pixel*sizeof(unsigned long));
     for (int s=0 ; s<byte_per_pixel ; s++){
         for (int i=0 ; i<y_end-1 ; i++){
             if (i >= image_height) break;
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
+            unsigned long *pa = st.pixel_accum + image_width*s;
+            unsigned long *pan = st.pixel_accum_num + image_width*s;
             unsigned char *p = *src+image_pixel_width*i+s;
             for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
                 *pa++ += *p;
@@ -56,7 +60,7 @@ static void calcWeightedSumColumnInit(unsigned char **src,
     }
 }
 
-static void calcWeightedSumColumn(unsigned char **src, int y,
+static void calcWeightedSumColumn(resize_state &st, unsigned char **src, int y,
                                   int interpolation_height,
                                   int image_width, int image_height,
                                   int image_pixel_width, int byte_per_pixel)
@@ -66,8 +70,8 @@ static void calcWeightedSumColumn(unsigned char **src, int y,
 
     for (int s=0 ; s<byte_per_pixel ; s++){
         if ((y_start-1)>=0 && (y_start-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
+            unsigned long *pa = st.pixel_accum + image_width*s;
+            unsigned long *pan = st.pixel_accum_num + image_width*s;
             unsigned char *p = *src+image_pixel_width*(y_start-1)+s;
             for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
                 *pa++ -= *p;
@@ -76,8 +80,8 @@ static void calcWeightedSumColumn(unsigned char **src, int y,
         }
         
         if ((y_end-1)>=0 && (y_end-1)<image_height){
-            unsigned long *pa = pixel_accum + image_width*s;
-            unsigned long *pan = pixel_accum_num + image_width*s;
+            unsigned long *pa = st.pixel_accum + image_width*s;
+            unsigned long *pan = st.pixel_accum_num + image_width*s;
             unsigned char *p = *src+image_pixel_width*(y_end-1)+s;
             for (int j=image_width ; j>0 ; j--, p+=byte_per_pixel){
                 *pa++ += *p;
@@ -87,30 +91,30 @@ static void calcWeightedSumColumn(unsigned char **src, int y,
     }
 }
 
-static void calcWeightedSum(unsigned char **dst, int x_start, int x_end,
+static void calcWeightedSum(resize_state &st, unsigned char **dst, int x_start, int x_end,
                             int image_width, int cell_start, int next_cell_start,
                             int byte_per_pixel)
 {
     for (int s=0 ; s<byte_per_pixel ; s++){
         // avoid interpolating data from other cells or outside the image
         if (x_start>=cell_start && x_start<next_cell_start){
-            tmp_acc[s] -= pixel_accum[image_width*s+x_start];
-            tmp_acc_num[s] -= pixel_accum_num[image_width*s+x_start];
+            st.tmp_acc[s] -= st.pixel_accum[image_width*s+x_start];
+            st.tmp_acc_num[s] -= st.pixel_accum_num[image_width*s+x_start];
         }
         if (x_end>=cell_start && x_end<next_cell_start){
-            tmp_acc[s] += pixel_accum[image_width*s+x_end];
-            tmp_acc_num[s] += pixel_accum_num[image_width*s+x_end];
+            st.tmp_acc[s] += st.pixel_accum[image_width*s+x_end];
+            st.tmp_acc_num[s] += st.pixel_accum_num[image_width*s+x_end];
         }
-        switch (tmp_acc_num[s]){
+        switch (st.tmp_acc_num[s]){
             //avoid a division op if possible
-            case 1: *(*dst)++ = (unsigned char)tmp_acc[s];
+            case 1: *(*dst)++ = (unsigned char)st.tmp_acc[s];
                     break;
-            case 2: *(*dst)++ = (unsigned char)(tmp_acc[s]>>1);
+            case 2: *(*dst)++ = (unsigned char)(st.tmp_acc[s]>>1);
                     break;
             default:
-            case 3: *(*dst)++ = (unsigned char)(tmp_acc[s]/tmp_acc_num[s]);
+            case 3: *(*dst)++ = (unsigned char)(st.tmp_acc[s]/st.tmp_acc_num[s]);
                     break;
-            case 4: *(*dst)++ = (unsigned char)(tmp_acc[s]>>2);
+            case 4: *(*dst)++ = (unsigned char)(st.tmp_acc[s]>>2);
                     break;
         }
     }
@@ -140,37 +144,33 @@ void resizeImage( unsigned char *dst_buffer, int dst_width, int dst_height, int
 
     int cell_width = src_width / num_cells;
 
-    if (pixel_accum_size < src_width*byte_per_pixel){
-        pixel_accum_size = src_width*byte_per_pixel;
-        if (pixel_accum) delete[] pixel_accum;
-        pixel_accum = new unsigned long[pixel_accum_size];
-        if (pixel_accum_num) delete[] pixel_accum_num;
-        pixel_accum_num = new unsigned long[pixel_accum_size];
-    }
+    resize_state st;
+    st.pixel_accum = new unsigned long[src_width*byte_per_pixel];
+    st.pixel_accum_num = new unsigned long[src_width*byte_per_pixel];
     /* smoothing */
     if (byte_per_pixel >= 3){
-        calcWeightedSumColumnInit(&src_buf, interpolation_height, src_width,
+        calcWeightedSumColumnInit(st, &src_buf, interpolation_height, src_width,
                                   src_height, src_total_width, byte_per_pixel );
         for ( i=0 ; i<src_height ; i++ ){
-            calcWeightedSumColumn(&src_buf, i, interpolation_height, src_width,
+            calcWeightedSumColumn(st, &src_buf, i, interpolation_height, src_width,
                                   src_height, src_total_width, byte_per_pixel );
             for ( c=0 ; c<src_width ; c+=cell_width ) {
                 // do a separate set of smoothings for each cell,
                 // to avoid interpolating data from other cells
                 for ( s=0 ; s<byte_per_pixel ; s++ ){
-                    tmp_acc[s]=0;
-                    tmp_acc_num[s]=0;
+                    st.tmp_acc[s]=0;
+                    st.tmp_acc_num[s]=0;
                     for (j=0 ; j<-interpolation_width/2+interpolation_width-1 ; j++){
                         if (j >= cell_width) break;
-                        tmp_acc[s] += pixel_accum[src_width*s+c+j];
-                        tmp_acc_num[s] += pixel_accum_num[src_width*s+c+j];
+                        st.tmp_acc[s] += st.pixel_accum[src_width*s+c+j];
+                        st.tmp_acc_num[s] += st.pixel_accum_num[src_width*s+c+j];
                     }
                 }
 
                 int x_start = c - interpolation_width/2 - 1;
                 int x_end   = x_start + interpolation_width;
                 for ( j=cell_width ; j>0 ; j--, x_start++, x_end++ )
-                    calcWeightedSum(&tmp_buf, x_start, x_end,
+                    calcWeightedSum(st, &tmp_buf, x_start, x_end,
                                     src_width, c, c+cell_width,
                                     byte_per_pixel );
             }
@@ -217,6 +217,8 @@ void resizeImage( unsigned char *dst_buffer, int dst_width, int dst_height, int
             *dst_buf++ = 0;
     }
     delete[] dst_to_src;
+    delete[] st.pixel_accum;
+    delete[] st.pixel_accum_num;
 
     /* pixels at the corners (of each cell) are preserved */
     int dst_cell_width = byte_per_pixel * dst_width / num_cells;
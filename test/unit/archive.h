@@ -0,0 +1,139 @@
+/* -*- C++ -*-
+ *
+ *  archive.h - Building NSA archives for the reader tests
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __TEST_ARCHIVE_H__
+#define __TEST_ARCHIVE_H__
+
+#include "test.h"
+#include "BaseReader.h"
+#include <bzlib.h>
+#include <vector>
+
+struct TestEntry {
+    std::string name;
+    int compression;       // BaseReader::*_COMPRESSION
+    std::string stored;    // the bytes as they are in the archive
+    Uint32 original_length;
+};
+
+static inline void test_put32(std::string& s, Uint32 n)
+{
+    s += (char) (n >> 24);
+    s += (char) (n >> 16);
+    s += (char) (n >> 8);
+    s += (char) n;
+}
+
+static inline std::string test_random_bytes(TestRandom& r, size_t len,
+                                            bool compressible)
+{
+    std::string s(len, 0);
+    for (size_t i = 0; i < len; ++i)
+        s[i] = compressible && r.below(4) ? "abcdefgh"[i / 61 % 8]
+                                          : (char) r.next();
+    return s;
+}
+
+static inline TestEntry test_stored(const std::string& name,
+                                    const std::string& data)
+{
+    TestEntry e;
+    e.name = name;
+    e.compression = BaseReader::NO_COMPRESSION;
+    e.stored = data;
+    e.original_length = data.size();
+    return e;
+}
+
+// NBZ: the decoded length, then a bzip2 stream.
+static inline TestEntry test_nbz(const std::string& name,
+                                 const std::string& data)
+{
+    unsigned int len = data.size() + data.size() / 50 + 1024;
+    std::vector<char> buf(len);
+    if (BZ2_bzBuffToBuffCompress(&buf[0], &len, (char*) data.data(),
+                                 data.size(), 9, 0, 0) != BZ_OK) {
+        fprintf(stderr, "bzip2 failed\n");
+        exit(2);
+    }
+    TestEntry e;
+    e.name = name;
+    e.compression = BaseReader::NBZ_COMPRESSION;
+    test_put32(e.stored, data.size());
+    e.stored.append(&buf[0], len);
+    e.original_length = 0; // as NScripter's tools write it
+    return e;
+}
+
+// Any bit string is valid LZSS, so noise gives literals and matches
+// in roughly equal measure.  Every nine bits yield at least one byte,
+// so there is enough noise for the decoder to reach original_length.
+static inline TestEntry test_lzss(const std::string& name, TestRandom& r,
+                                  Uint32 original_length)
+{
+    TestEntry e;
+    e.name = name;
+    e.compression = BaseReader::LZSS_COMPRESSION;
+    e.stored = test_random_bytes(r, original_length * 9 / 8 + 2, false);
+    e.original_length = original_length;
+    return e;
+}
+
+// SPB: width and height, then the bit-packed planes; noise decodes
+// to some image of that size.
+static inline TestEntry test_spb(const std::string& name, TestRandom& r,
+                                 int width, int height, size_t len)
+{
+    TestEntry e;
+    e.name = name;
+    e.compression = BaseReader::SPB_COMPRESSION;
+    e.stored += (char) (width >> 8);
+    e.stored += (char) width;
+    e.stored += (char) (height >> 8);
+    e.stored += (char) height;
+    e.stored += test_random_bytes(r, len, false);
+    e.original_length = 0;
+    return e;
+}
+
+// An unkeyed NSA archive: file count, offset of the data, then name,
+// compression, offset, length and decoded length for each entry.
+static inline void test_write_nsa(const std::string& path,
+                                  const std::vector<TestEntry>& entries)
+{
+    std::string dir, data;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const TestEntry& e = entries[i];
+        dir += e.name;
+        dir += '\0';
+        dir += (char) e.compression;
+        test_put32(dir, data.size());
+        test_put32(dir, e.stored.size());
+        test_put32(dir, e.original_length);
+        data += e.stored;
+    }
+    std::string out;
+    out += (char) (entries.size() >> 8);
+    out += (char) entries.size();
+    test_put32(out, 6 + dir.size());
+    test_write(path, out + dir + data);
+}
+
+#endif // __TEST_ARCHIVE_H__
@@ -0,0 +1,142 @@
+/* -*- C++ -*-
+ *
+ *  array_sum_test.cpp - Summing an array in a tight for loop
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Fill an array, then sum it with for/add/next, once through variables
+// below VARIABLE_RANGE and once through extended ones among a thousand
+// others in use.  The commands run the way ScriptParser runs them: the
+// same ScriptHandler calls in the same order.  The sums must be right,
+// and the time per iteration is printed.  Then check that resetting the
+// variables leaves no array reachable through the per-site cache.
+
+#include "test.h"
+#include "ScriptHandler.h"
+#include "DirPaths.h"
+
+enum { LENGTH = 1000, ROUNDS = 1000 };
+
+struct ForLoop {
+    Expression var;
+    int to, step;
+    const char* next_script;
+    ForLoop(const Expression& e) : var(e) {}
+};
+
+// Runs from label to the next "end": dim, mov, add, for and next only,
+// as in ScriptParser_command.cpp.
+static void run(ScriptHandler& h, const char* label)
+{
+    std::vector<ForLoop> loops;
+    h.setCurrent(h.lookupLabel(label).start_address);
+    h.readToken();
+    for (;;) {
+        pstring cmd = h.getStrBuf();
+        if (cmd == "end") break;
+        if (cmd == "dim") {
+            h.declareDim();
+        }
+        else if (cmd == "mov") {
+            Expression e = h.readExpr();
+            e.mutate(h.readIntValue());
+        }
+        else if (cmd == "add") {
+            Expression e = h.readExpr();
+            e.mutate(e.as_int() + h.readIntValue());
+        }
+        else if (cmd == "for") {
+            ForLoop l(h.readIntExpr());
+            CHECK(h.compareString("="));
+            h.setCurrent(h.getNext() + 1);
+            l.var.mutate(h.readIntValue());
+            CHECK(h.readBareword() == "to");
+            l.to = h.readIntValue();
+            l.step = 1;
+            l.next_script = h.getNext();
+            loops.push_back(l);
+        }
+        else if (cmd == "next") {
+            ForLoop& l = loops.back();
+            l.var.mutate(l.var.as_int() + l.step);
+            if (l.var.as_int() > l.to)
+                loops.pop_back();
+            else
+                h.setCurrent(l.next_script);
+        }
+        h.readToken();
+    }
+}
+
+
+int main(int, char**)
+{
+    const std::string& dir = test_mkdir("array_sum_test");
+    test_write(dir + "/0.utf",
+               "*define\n"
+               "*start\n"
+               "dim ?0[999]\n"
+               "for %0 = 0 to 999\n"
+               "mov ?0[%0],%0 * 3\n"
+               "next\n"
+               "end\n"
+               "*sum\n"
+               "mov %1,0\n"
+               "for %0 = 0 to 999\n"
+               "add %1,?0[%0]\n"
+               "next\n"
+               "end\n"
+               "*sum_extended\n"
+               "mov %5001,0\n"
+               "for %5000 = 0 to 999\n"
+               "add %5001,?0[%5000]\n"
+               "next\n"
+               "end\n");
+
+    DirPaths paths(dir.c_str());
+    ScriptHandler h;
+    CHECK(h.readScript(&paths, NULL) == 0);
+    run(h, "start");
+    // Games that use high-numbered globals use a lot of them.
+    for (int i = 0; i < 1000; ++i)
+        h.getVariableData(6000 + i).set_num(i);
+
+    const int expect = 3 * (LENGTH - 1) * LENGTH / 2;
+    static const char* labels[] = { "sum", "sum_extended" };
+    static const int sums[] = { 1, 5001 };
+    for (int k = 0; k < 2; ++k) {
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        for (int i = 0; i < ROUNDS; ++i) {
+            run(h, labels[k]);
+            if (h.getVariableData(sums[k]).get_num() != expect) break;
+        }
+        double ns = (double) (SDL_GetPerformanceCounter() - t0)
+            / SDL_GetPerformanceFrequency() * 1e9 / (ROUNDS * LENGTH);
+        CHECK(h.getVariableData(sums[k]).get_num() == expect);
+        printf("%s: %.1f ns per iteration\n", labels[k], ns);
+    }
+
+    // reset() drops the arrays; nothing cached may still point at them.
+    h.reset();
+    CHECK(h.findArray(0, NULL) == NULL);
+    run(h, "start");
+    run(h, "sum");
+    CHECK(h.getVariableData(1).get_num() == expect);
+
+    test_cleanup();
+    return test_result();
+}
@@ -0,0 +1,18 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVM_AUDIODECODER_H
+#define AVM_AUDIODECODER_H
+
+#include "avifile.h"
+
+namespace avm {
+class IAudioDecoder {
+public:
+    virtual ~IAudioDecoder();
+    virtual int Convert(const void* in_data, uint_t in_size, void* out_data,
+                        uint_t out_size, uint_t* size_read,
+                        uint_t* size_written) = 0;
+    virtual int GetOutputFormat(WAVEFORMATEX* destfmt) const;
+};
+}
+
+#endif
@@ -0,0 +1,123 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVIFILE_H
+#define AVIFILE_H
+
+#include "avm_fourcc.h"
+#include <stdint.h>
+
+typedef unsigned int uint_t;
+typedef int framepos_t;
+
+struct WAVEFORMATEX {
+    uint16_t wFormatTag;
+    uint16_t nChannels;
+    uint32_t nSamplesPerSec;
+    uint32_t nAvgBytesPerSec;
+    uint16_t nBlockAlign;
+    uint16_t wBitsPerSample;
+    uint16_t cbSize;
+};
+
+struct BITMAPINFOHEADER {
+    int32_t  biSize;
+    int32_t  biWidth;
+    int32_t  biHeight;
+    int16_t  biPlanes;
+    int16_t  biBitCount;
+    uint32_t biCompression;
+    int32_t  biSizeImage;
+    int32_t  biXPelsPerMeter;
+    int32_t  biYPelsPerMeter;
+    int32_t  biClrUsed;
+    int32_t  biClrImportant;
+};
+
+#define IMG_FMT_YUY2 fccYUY2
+#define IMG_FMT_YV12 fccYV12
+
+namespace avm {
+
+struct BitmapInfo : public BITMAPINFOHEADER {
+    BitmapInfo();
+    BitmapInfo(const BitmapInfo& bi);
+};
+
+class CImage {
+public:
+    CImage(const CImage* im);
+    CImage(const BitmapInfo* header, const uint8_t* data = 0, bool copy = true);
+    void AddRef() const;
+    void Release() const;
+    uint8_t* Data();
+    const BitmapInfo* GetFmt() const;
+    int Width() const;
+    int Height() const;
+    void ToYUV();
+    void ToRGB();
+
+private:
+    ~CImage();
+};
+
+class StreamInfo {
+public:
+    ~StreamInfo();
+    int GetVideoWidth() const;
+    int GetVideoHeight() const;
+    double GetFps() const;
+};
+
+class IVideoDecoder {
+public:
+    enum CAPS {
+        CAP_NONE = 0,
+        CAP_YUY2 = 1 << 1,
+        CAP_YV12 = 1 << 2,
+        CAP_I420 = 1 << 6
+    };
+    virtual ~IVideoDecoder();
+    virtual CAPS GetCapabilities() const;
+    virtual int SetDestFmt(int bits = 24, fourcc_t csp = 0);
+};
+
+class IAudioDecoder;
+
+class IReadStream {
+public:
+    enum StreamType { None, Audio, Video, Other };
+    static const framepos_t ERR = -1;
+
+    virtual ~IReadStream();
+    virtual bool Eof() const = 0;
+    virtual IAudioDecoder* GetAudioDecoder() const = 0;
+    virtual IVideoDecoder* GetVideoDecoder() const = 0;
+    virtual CImage* GetFrame(bool readframe = true) = 0;
+    virtual StreamInfo* GetStreamInfo() const = 0;
+    virtual double GetTime(framepos_t frame = ERR) const = 0;
+    virtual int ReadFrames(void* buffer, uint_t bufsize, uint_t samples,
+                           uint_t& samples_read, uint_t& bytes_read) = 0;
+    virtual int StartStreaming(const char* privname = 0) = 0;
+    virtual int StopStreaming() = 0;
+};
+
+class IReadFile {
+public:
+    virtual ~IReadFile();
+    virtual IReadStream* GetStream(uint_t stream_id,
+                                   IReadStream::StreamType type) = 0;
+    virtual bool IsValid() const = 0;
+};
+
+IReadFile* CreateReadFile(const char* name, unsigned int flags = 0);
+
+}
+
+// The names from before the avm namespace, which avifile still offers.
+typedef avm::CImage CImage;
+typedef avm::IVideoDecoder IVideoDecoder;
+typedef avm::IReadFile IAviReadFile;
+typedef avm::IReadStream IAviReadStream;
+typedef avm::IReadStream AviStream;
+#define CreateIAviReadFile(name) avm::CreateReadFile(name)
+
+#endif
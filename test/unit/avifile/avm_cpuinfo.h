@@ -0,0 +1,15 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVM_CPUINFO_H
+#define AVM_CPUINFO_H
+
+namespace avm {
+class CPU_Info {
+public:
+    double GetFrequency() const;
+    bool HaveMMX() const;
+    bool HaveSSE() const;
+};
+extern CPU_Info freq;
+}
+
+#endif
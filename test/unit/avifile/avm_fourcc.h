@@ -0,0 +1,18 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVM_FOURCC_H
+#define AVM_FOURCC_H
+
+#include <stdint.h>
+
+typedef uint32_t fourcc_t;
+
+#define mmioFOURCC(a, b, c, d) \
+    ((fourcc_t) (uint8_t) (a) | ((fourcc_t) (uint8_t) (b) << 8) \
+     | ((fourcc_t) (uint8_t) (c) << 16) | ((fourcc_t) (uint8_t) (d) << 24))
+
+enum {
+    fccYUY2 = mmioFOURCC('Y', 'U', 'Y', '2'),
+    fccYV12 = mmioFOURCC('Y', 'V', '1', '2')
+};
+
+#endif
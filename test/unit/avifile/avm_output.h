@@ -0,0 +1,15 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVM_OUTPUT_H
+#define AVM_OUTPUT_H
+
+namespace avm {
+class AvmOutput {
+public:
+    void resetDebugLevels(int level = 0);
+    void setDebugLevel(const char* name, int level);
+    void write(const char* name, const char* format, ...);
+};
+extern AvmOutput out;
+}
+
+#endif
@@ -0,0 +1,11 @@
+// See README: declarations only, for checking AVIWrapper.cpp compiles.
+#ifndef AVM_UTILS_H
+#define AVM_UTILS_H
+
+#include <stdint.h>
+
+// CPU clock ticks, and the seconds between two readings.
+int64_t longcount();
+double to_float(int64_t tend, int64_t tbegin);
+
+#endif
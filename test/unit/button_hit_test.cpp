@@ -0,0 +1,149 @@
+/* -*- C++ -*-
+ *
+ *  button_hit_test.cpp - Finding the button under the mouse
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Put up a few hundred overlapping sprite buttons, some of them partly
+// off screen, and move the mouse over them along random paths.  At each
+// point, the button found through ButtonGrid must be the one the full
+// scan mouseOverCheck used to do finds: the last defined of those whose
+// rect holds the point.  Then both are timed over the same paths and
+// the hit-tests per second printed.
+
+#include <map>
+#include "test.h"
+#include "ButtonGrid.h"
+
+enum { SCREEN_W = 800, SCREEN_H = 600, BUTTONS = 500, PATHS = 200,
+       STEPS = 2000, ROUNDS = 5 };
+
+typedef std::map<int, SDL_Rect> Buttons;
+
+static bool inside(const SDL_Rect& r, int x, int y)
+{
+    return x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h;
+}
+
+
+// As mouseOverCheck did: every button, last defined first.
+static int scan(const Buttons& buttons, int x, int y)
+{
+    for (Buttons::const_reverse_iterator it = buttons.rbegin();
+         it != buttons.rend(); ++it)
+        if (inside(it->second, x, y)) return it->first;
+    return 0;
+}
+
+
+// As mouseOverCheck does now, falling back to the scan off screen.
+static int lookup(const ButtonGrid& grid, const Buttons& buttons,
+                  int x, int y)
+{
+    const std::vector<int>* cell = grid.cell(x, y);
+    if (!cell) return scan(buttons, x, y);
+    for (std::vector<int>::const_iterator no = cell->begin();
+         no != cell->end(); ++no)
+        if (inside(buttons.find(*no)->second, x, y)) return *no;
+    return 0;
+}
+
+
+struct Point { int x, y; };
+
+// A cursor wandering in small steps, now and then jumping; it strays a
+// little past the screen's edges.
+static std::vector<Point> paths(TestRandom& r)
+{
+    std::vector<Point> points;
+    for (int p = 0; p < PATHS; ++p) {
+        Point pt = { (int) r.below(SCREEN_W), (int) r.below(SCREEN_H) };
+        for (int i = 0; i < STEPS; ++i) {
+            if (r.below(100) == 0) {
+                pt.x = r.below(SCREEN_W);
+                pt.y = r.below(SCREEN_H);
+            }
+            pt.x += (int) r.below(17) - 8;
+            pt.y += (int) r.below(17) - 8;
+            if (pt.x < -10) pt.x = -10;
+            if (pt.x > SCREEN_W + 10) pt.x = SCREEN_W + 10;
+            if (pt.y < -10) pt.y = -10;
+            if (pt.y > SCREEN_H + 10) pt.y = SCREEN_H + 10;
+            points.push_back(pt);
+        }
+    }
+    return points;
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    TestRandom r(41);
+    Buttons buttons;
+    for (int i = 0; i < BUTTONS; ++i) {
+        SDL_Rect rect;
+        rect.w = 20 + r.below(180);
+        rect.h = 20 + r.below(100);
+        rect.x = (int) r.below(SCREEN_W + rect.w) - rect.w / 2;
+        rect.y = (int) r.below(SCREEN_H + rect.h) - rect.h / 2;
+        // Numbers needn't be dense: spbtn takes any.
+        buttons[1 + i * 3] = rect;
+    }
+    // One with no area, as for a sprite without an image.
+    SDL_Rect empty = { 100, 100, 0, 0 };
+    buttons[10000] = empty;
+
+    ButtonGrid grid;
+    grid.reset(SCREEN_W, SCREEN_H);
+    for (Buttons::reverse_iterator it = buttons.rbegin();
+         it != buttons.rend(); ++it)
+        grid.add(it->first, it->second);
+    CHECK(grid.count == buttons.size());
+
+    std::vector<Point> points = paths(r);
+    int hits = 0, mismatches = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        int want = scan(buttons, points[i].x, points[i].y);
+        if (lookup(grid, buttons, points[i].x, points[i].y) != want)
+            ++mismatches;
+        if (want) ++hits;
+    }
+    CHECK(mismatches == 0);
+    CHECK(hits > 0 && hits < (int) points.size());
+
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    int sum = 0;
+    for (int k = 0; k < ROUNDS; ++k)
+        for (size_t i = 0; i < points.size(); ++i)
+            sum += scan(buttons, points[i].x, points[i].y);
+    Uint64 t1 = SDL_GetPerformanceCounter();
+    for (int k = 0; k < ROUNDS; ++k)
+        for (size_t i = 0; i < points.size(); ++i)
+            sum -= lookup(grid, buttons, points[i].x, points[i].y);
+    Uint64 t2 = SDL_GetPerformanceCounter();
+    CHECK(sum == 0);
+
+    double f = (double) SDL_GetPerformanceFrequency();
+    double n = (double) points.size() * ROUNDS;
+    printf("%d buttons, %d points (%d over a button): "
+           "%.2fM hit-tests/s by grid, %.2fM by full scan\n",
+           (int) buttons.size(), (int) points.size(), hits,
+           n / ((t2 - t1) / f) / 1e6, n / ((t1 - t0) / f) / 1e6);
+
+    return test_result();
+}
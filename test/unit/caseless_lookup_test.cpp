@@ -0,0 +1,86 @@
+/* -*- C++ -*-
+ *
+ *  caseless_lookup_test.cpp - Finding loose files whatever their case
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Scripts name files in whatever case they like, so on case-sensitive
+// filesystems DirectReader matches each part of the path against the
+// directory ignoring case.  In a directory of a few thousand files, look
+// files up by names in the wrong case, some of them missing, and print
+// the lookups per second.  Then check that files added, and added again
+// within the same second, are found straight away.
+
+#include <sys/stat.h>
+#include <time.h>
+#include "test.h"
+#include "DirectReader.h"
+#include "encoding.h"
+
+enum { FILES = 5000, LOOKUPS = 10000 };
+
+static pstring name(int i, bool upper)
+{
+    pstring s;
+    s.format(upper ? "Sub/FILE%04d.Dat" : "sub/file%04d.dat", i);
+    return s;
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+
+    const std::string& dir = test_mkdir("caseless_lookup_test");
+    mkdir((dir + "/sub").c_str(), 0755);
+    for (int i = 0; i < FILES; ++i)
+        test_write(dir + "/" + (const char*) name(i, false),
+                   std::string(1 + i % 7, 'x'));
+
+    // Misses in the second the directory last changed rescan it; time
+    // the lookups from the next second on, as a game would make them.
+    time_t written = time(NULL);
+    while (time(NULL) == written) SDL_Delay(10);
+
+    DirectReader reader(new DirPaths(dir.c_str()));
+    TestRandom r(38);
+    int found = 0;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < LOOKUPS; ++i) {
+        // One lookup in ten is for a file that isn't there.
+        int n = r.below(FILES + FILES / 10);
+        size_t len = reader.getFileLength(name(n, true));
+        CHECK(len == (n < FILES ? (size_t) (1 + n % 7) : 0));
+        if (len) ++found;
+    }
+    double s = (double) (SDL_GetPerformanceCounter() - t0)
+        / SDL_GetPerformanceFrequency();
+    printf("%d lookups, %d found, in %.3f s: %.0f lookups/s\n",
+           LOOKUPS, found, s, LOOKUPS / s);
+
+    // New files show up at once, even when the directory changes twice
+    // in the same second.
+    for (int i = FILES + 1; i < FILES + 4; ++i) {
+        CHECK(reader.getFileLength(name(i, true)) == 0);
+        test_write(dir + "/" + (const char*) name(i, false), "new");
+        CHECK(reader.getFileLength(name(i, true)) == 3);
+    }
+
+    test_cleanup();
+    return test_result();
+}
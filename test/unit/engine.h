@@ -0,0 +1,68 @@
+/* -*- C++ -*-
+ *
+ *  engine.h - Running the engine on a test script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "test.h"
+
+// Ponscripter needs a font to show text, and we don't ship one: use
+// $PONSCR_TEST_FONT, or else any of a few common system fonts.
+static inline std::string test_font()
+{
+    static const char* candidates[] = {
+        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+        "/usr/share/fonts/TTF/DejaVuSans.ttf",
+        "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+        "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+        "/Library/Fonts/Arial.ttf",
+        "C:/Windows/Fonts/arial.ttf",
+        NULL
+    };
+    const char* env = getenv("PONSCR_TEST_FONT");
+    if (env) return test_read(env);
+    for (int i = 0; candidates[i]; ++i) {
+        std::string font = test_read(candidates[i]);
+        if (!font.empty()) return font;
+    }
+    return std::string();
+}
+
+// Runs the engine built alongside the tests ($PONSCR, as "make check"
+// sets it) on script, in dir, with no window or sound, passing it any
+// extra options.  Files the script saves end up in dir too.
+static inline int test_run_script(const std::string& dir,
+                                  const std::string& font,
+                                  const std::string& script,
+                                  const std::string& options = "")
+{
+    test_write(dir + "/0.txt", script);
+    test_write(dir + "/default.ttf", font);
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    SDL_setenv("SDL_RENDER_DRIVER", "software", 1);
+    const char* ponscr = getenv("PONSCR");
+    std::string cmd = std::string(ponscr ? ponscr : "./ponscr")
+                    + " -r '" + dir + "' -s '" + dir + "' " + options
+                    + " > '" + dir + "/log.txt' 2>&1";
+    return system(cmd.c_str());
+}
+
+#endif // __ENGINE_H__
@@ -0,0 +1,73 @@
+/* -*- C++ -*-
+ *
+ *  font_share_test.cpp - Styles opened from the same font file
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Open one font file under two names, the second a symlink to the
+// first, as MapFont does when several styles name the same file.  The
+// two must share one copy of the file's contents, yet keep sizes of
+// their own; the copy must go when the last of them closes.  A different
+// file gets a copy of its own.
+
+#include <unistd.h>
+#include "engine.h"
+#include "font.h"
+
+int main(int, char**)
+{
+    std::string data = test_font();
+    if (data.empty()) {
+        printf("font_share_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+    const std::string& dir = test_mkdir("font_share_test");
+    std::string a = dir + "/a.ttf", b = dir + "/b.ttf", c = dir + "/c.ttf";
+    test_write(a, data);
+    test_write(c, data);
+    CHECK(symlink(a.c_str(), b.c_str()) == 0);
+
+    // Fontinfo.cpp's Fonts table calls FontFinished() at exit.
+    FontInitialise();
+    const size_t before = FontData::mapped_bytes + FontData::heap_bytes;
+    Font* fa = new Font(a.c_str());
+    Font* fb = new Font(b.c_str());
+    CHECK(FontData::mapped_bytes + FontData::heap_bytes
+          == before + data.size());
+
+    fa->set_size(12);
+    fb->set_size(48);
+    CHECK(fa->lineskip() < fb->lineskip());
+    CHECK(fa->advance('M') < fb->advance('M'));
+
+    Font* fc = new Font(c.c_str());
+    CHECK(FontData::mapped_bytes + FontData::heap_bytes
+          == before + 2 * data.size());
+    delete fc;
+
+    delete fa;
+    CHECK(FontData::mapped_bytes + FontData::heap_bytes
+          == before + data.size());
+    fb->set_size(24);
+    CHECK(fb->has_char('A'));
+    delete fb;
+    CHECK(FontData::mapped_bytes + FontData::heap_bytes == before);
+
+    test_cleanup();
+    return test_result();
+}
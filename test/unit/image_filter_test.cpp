@@ -0,0 +1,292 @@
+/* -*- C++ -*-
+ *
+ *  image_filter_test.cpp - Nega, monochrome and mosaic, and how fast
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// The row filters behind nega and monocro must give exactly what the
+// per-pixel loops they replaced gave -- the XOR with the RGB mask, and
+// MONOCRO_PIXEL through monocro_color_lut -- and the mosaic fill must
+// match the old block-by-block loop, over random sizes, pitches and
+// buffer alignments, with and without SSE2.  Then each is timed over a
+// 1280x720 and a 1920x1080 screen, the old way and the new.
+
+#include "test.h"
+#include "AnimationInfo.h"
+#include "graphics_common.h"
+#include <vector>
+
+#ifdef BPP16
+int main(int, char**)
+{
+    printf("image_filter_test: skipped, 32bpp only\n");
+    return 0;
+}
+#else
+
+typedef AnimationInfo::ONSBuf ONSBuf;
+
+enum { ROUNDS = 20 };
+
+static const Uint32 nega_mask = RMASK | GMASK | BMASK;
+static rgb_t monocro_color;
+static rgb_t monocro_color_lut[256];
+
+static void set_monocro(Uint8 r, Uint8 g, Uint8 b)
+{
+    monocro_color.r = r;
+    monocro_color.g = g;
+    monocro_color.b = b;
+    // As monocroCommand builds it.
+    for (int i = 0; i < 256; i++) {
+        monocro_color_lut[i].r = (monocro_color.r * i) >> 8;
+        monocro_color_lut[i].g = (monocro_color.g * i) >> 8;
+        monocro_color_lut[i].b = (monocro_color.b * i) >> 8;
+    }
+}
+
+
+// The loops from makeNegaSurface and makeMonochromeSurface.
+static void old_nega(ONSBuf* buf, int w, int h, int pitch)
+{
+    ONSBuf mask = nega_mask;
+    for (int i = h; i > 0; i--) {
+        for (int j = w; j > 0; j--)
+            *buf++ ^= mask;
+        buf += pitch - w;
+    }
+}
+
+static void old_monocro(ONSBuf* buffer, int w, int h, int pitch)
+{
+    for (int i = h; i > 0; i--) {
+        for (int j = w; j > 0; j--, buffer++)
+            MONOCRO_PIXEL();
+        buffer += pitch - w;
+    }
+}
+
+// And as they call the row filters now.
+static void new_nega(ONSBuf* buf, int w, int h, int pitch)
+{
+    for (int i = h; i > 0; i--) {
+        AnimationInfo::imageFilterNega(buf, nega_mask, w);
+        buf += pitch;
+    }
+}
+
+static void new_monocro(ONSBuf* buffer, int w, int h, int pitch)
+{
+    for (int i = h; i > 0; i--) {
+        AnimationInfo::imageFilterMonochrome(buffer, monocro_color, w);
+        buffer += pitch;
+    }
+}
+
+
+// generateMosaic as it was, block by block from the bottom left.
+static void old_mosaic(ONSBuf* dst, const ONSBuf* src, int w, int h,
+                       int pitch, int width)
+{
+    for (int i = h - 1; i >= 0; i -= width) {
+        for (int j = 0; j < w; j += width) {
+            ONSBuf  p = src[i * pitch + j];
+            ONSBuf* dst_buffer = dst + i * pitch + j;
+
+            int height2 = width;
+            if (i + 1 - width < 0) height2 = i + 1;
+
+            int width2 = width;
+            if (j + width > w) width2 = w - j;
+
+            for (int ii = 0; ii < height2; ii++) {
+                for (int jj = 0; jj < width2; jj++) {
+                    *dst_buffer++ = p;
+                }
+
+                dst_buffer -= pitch + width2;
+            }
+        }
+    }
+}
+
+static void new_mosaic(ONSBuf* dst, const ONSBuf* src, int w, int h,
+                       int pitch, int width)
+{
+    AnimationInfo::imageFilterMosaic(dst, src, w, h, pitch, width);
+}
+
+
+static unsigned int sse2_funcs()
+{
+#if defined(USE_X86_GFX)
+    if (SDL_HasSSE2()) return AnimationInfo::CPUF_X86_SSE2;
+#endif
+    return AnimationInfo::CPUF_NONE;
+}
+
+
+// A w x h image at the given pixel offset into its buffer, rows pitch
+// pixels apart; the pixels either side of it are there to be checked.
+struct Image {
+    std::vector<ONSBuf> buf;
+    int off, w, h, pitch;
+
+    Image(int w_, int h_, int pitch_, int off_, TestRandom& r)
+        : buf(off_ + pitch_ * h_ + 4), off(off_), w(w_), h(h_), pitch(pitch_)
+    {
+        for (size_t i = 0; i < buf.size(); ++i) buf[i] = r.next();
+    }
+
+    ONSBuf* pixels() { return &buf[off]; }
+};
+
+
+static void check_filters()
+{
+    unsigned int fast = sse2_funcs();
+    if (fast == AnimationInfo::CPUF_NONE)
+        printf("no SSE2 routines in this build: checking the scalar path "
+               "only\n");
+
+    // Every grey and plenty of other pixels through MONOCRO_PIXEL, in a
+    // few colours.
+    static const Uint8 colours[][3] = {
+        { 255, 255, 255 }, { 0, 0, 0 }, { 255, 200, 140 }, { 1, 128, 254 }
+    };
+    TestRandom r(44);
+    for (int c = 0; c < 4; ++c) {
+        set_monocro(colours[c][0], colours[c][1], colours[c][2]);
+        std::vector<ONSBuf> ref(1 << 16), got;
+        for (size_t i = 0; i < ref.size(); ++i)
+            ref[i] = i < 256 ? i * 0x010101 | i << 24 : r.next();
+        for (int f = 0; f < 2; ++f) {
+            std::vector<ONSBuf> want = ref;
+            got = ref;
+            old_monocro(&want[0], want.size(), 1, want.size());
+            AnimationInfo::setCpufuncs(f ? fast : AnimationInfo::CPUF_NONE);
+            new_monocro(&got[0], got.size(), 1, got.size());
+            CHECK(want == got);
+        }
+    }
+
+    // Random rectangles at every alignment, in random pitches.
+    for (int k = 0; k < 400; ++k) {
+        int w = 1 + r.below(k < 200 ? 40 : 700);
+        int h = 1 + r.below(k < 200 ? 8 : 60);
+        int pitch = w + r.below(20);
+        int off = r.below(4);
+        set_monocro(r.next(), r.next(), r.next());
+        Image img(w, h, pitch, off, r);
+        for (int f = 0; f < 2; ++f) {
+            AnimationInfo::setCpufuncs(f ? fast : AnimationInfo::CPUF_NONE);
+
+            Image want = img, got = img;
+            old_nega(want.pixels(), w, h, pitch);
+            new_nega(got.pixels(), w, h, pitch);
+            CHECK(want.buf == got.buf);
+
+            want = img;
+            got = img;
+            old_monocro(want.pixels(), w, h, pitch);
+            new_monocro(got.pixels(), w, h, pitch);
+            CHECK(want.buf == got.buf);
+        }
+
+        // Mosaic writes a whole screen from another one, at any level.
+        int width = 160 >> r.below(8);
+        Image src(w, h, pitch, off, r);
+        Image want = img, got = img;
+        old_mosaic(want.pixels(), src.pixels(), w, h, pitch, width);
+        new_mosaic(got.pixels(), src.pixels(), w, h, pitch, width);
+        CHECK(want.buf == got.buf);
+    }
+    AnimationInfo::setCpufuncs(fast);
+}
+
+
+static double seconds(Uint64 ticks)
+{
+    return (double) ticks / SDL_GetPerformanceFrequency();
+}
+
+
+typedef void (*Filter)(ONSBuf*, int, int, int);
+
+static double time_filter(Filter filter, Image& img)
+{
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ROUNDS; ++i)
+        filter(img.pixels(), img.w, img.h, img.pitch);
+    return seconds(SDL_GetPerformanceCounter() - t0) * 1000 / ROUNDS;
+}
+
+typedef void (*Mosaic)(ONSBuf*, const ONSBuf*, int, int, int, int);
+
+// A whole mosaic effect: one frame at each level.
+static double time_mosaic(Mosaic mosaic, Image& dst, Image& src)
+{
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ROUNDS; ++i)
+        for (int level = 0; level < 8; ++level)
+            mosaic(dst.pixels(), src.pixels(), dst.w, dst.h, dst.pitch,
+                   160 >> level);
+    return seconds(SDL_GetPerformanceCounter() - t0) * 1000 / ROUNDS;
+}
+
+
+static void benchmark(int w, int h)
+{
+    TestRandom r(w);
+    Image img(w, h, w, 0, r), src(w, h, w, 0, r);
+    set_monocro(255, 200, 140);
+    unsigned int fast = sse2_funcs();
+
+    printf("%dx%d, ms per screen:\n", w, h);
+    AnimationInfo::setCpufuncs(AnimationInfo::CPUF_NONE);
+    double nega_old = time_filter(old_nega, img);
+    double nega_scalar = time_filter(new_nega, img);
+    double mono_old = time_filter(old_monocro, img);
+    double mono_scalar = time_filter(new_monocro, img);
+    AnimationInfo::setCpufuncs(fast);
+    double nega_new = time_filter(new_nega, img);
+    double mono_new = time_filter(new_monocro, img);
+    printf("  %-10s %8.3f old, %8.3f scalar, %8.3f %s\n", "nega:",
+           nega_old, nega_scalar, nega_new,
+           fast == AnimationInfo::CPUF_NONE ? "scalar" : "SSE2");
+    printf("  %-10s %8.3f old, %8.3f scalar, %8.3f %s\n", "monocro:",
+           mono_old, mono_scalar, mono_new,
+           fast == AnimationInfo::CPUF_NONE ? "scalar" : "SSE2");
+    printf("  %-10s %8.3f old, %8.3f new (all 8 levels)\n", "mosaic:",
+           time_mosaic(old_mosaic, img, src),
+           time_mosaic(new_mosaic, img, src));
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+
+    check_filters();
+    benchmark(1280, 720);
+    benchmark(1920, 1080);
+
+    SDL_Quit();
+    return test_result();
+}
+
+#endif
@@ -0,0 +1,299 @@
+/* -*- C++ -*-
+ *
+ *  ligature_test.cpp - Decoding with ligatures, against the old tree
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Make random ligature edits -- adds, deletes and clears, with code
+// points the font has and ones it lacks -- through the engine and, in
+// step, through a copy of the std::map tree encoding.cpp used before
+// the ligatures were compiled into a flat trie.  After each edit decode
+// random UTF-8 text at every character with both; the code point and
+// length must agree, as must NextCharSize.  Then decode a few MB of
+// English text with the usual ligatures both ways and print the rates.
+
+#include "engine.h"
+#include "DirPaths.h"
+#include "Fontinfo.h"
+#include <map>
+#include <vector>
+
+enum { ROUNDS = 20000, BENCH_BYTES = 4 << 20, BENCH_PASSES = 5 };
+
+// The tree from encoding.cpp before the flat trie, as it was.
+struct ref_ligature {
+    wchar codepoint;
+    int seqlen;
+    ref_ligature() : codepoint(0), seqlen(0) {}
+};
+
+class ref_ligatures {
+    typedef std::map<char, ref_ligatures*> ligmap;
+    typedef ligmap::iterator ligmap_iter;
+    typedef std::pair<char, ref_ligatures*> lignode;
+    typedef std::pair<ligmap_iter, bool> ligmap_insertion;
+    ref_ligature val;
+    ligmap children;
+
+public:
+    void clear();
+    ref_ligature* find(const char* seq, const Fontinfo* face);
+    void add(const char* seq, wchar value, int depth = 0);
+    void del(const char* seq);
+
+    ~ref_ligatures() { clear(); }
+};
+
+void ref_ligatures::clear()
+{
+    for (ligmap_iter it=children.begin() ; it != children.end(); ) {
+        if (it->second) delete it->second;
+        it->second = 0;
+        children.erase(it++);
+    }
+}
+
+ref_ligature* ref_ligatures::find(const char* seq, const Fontinfo* face)
+{
+    ref_ligature* v = 0;
+    ligmap_iter e = children.find(*seq);
+    if (e != children.end())
+        v = e->second->find(seq + 1, face);
+    if (!v && val.codepoint &&
+        (!face || face->font()->has_char(val.codepoint)))
+        v = &val;
+    return v;
+}
+
+void ref_ligatures::add(const char* seq, wchar value, int depth)
+{
+    if (*seq) {
+        ligmap_insertion p = children.insert(lignode(*seq, 0));
+        if (p.second) {
+            if (p.first->second) delete p.first->second;
+            p.first->second = new ref_ligatures;
+        }
+        p.first->second->add(seq + 1, value, depth + 1);
+    }
+    else {
+        val.codepoint = value;
+        val.seqlen = depth;
+    }
+}
+
+void ref_ligatures::del(const char* seq)
+{
+    if (*seq) {
+        ligmap_iter e = children.find(*seq);
+        if (e != children.end()) {
+            e->second->del(seq + 1);
+            if (!e->second->val.codepoint && e->second->children.empty())
+                children.erase(e);
+        }
+    }
+    else {
+        val.codepoint = 0;
+    }
+}
+
+static ref_ligatures ref;
+
+// As Decode_impl did for text with no tags or '|' in it.
+static wchar ref_decode(const char* s, int& bytes, const Fontinfo* fi)
+{
+    const ref_ligature* lig = ref.find(s, fi);
+    if (lig) {
+        bytes = lig->seqlen;
+        return lig->codepoint;
+    }
+    return file_encoding->DecodeChar(s, bytes);
+}
+
+
+// Whole characters for random text and sequences: the ASCII that the
+// default ligatures use, and some two- and three-byte characters.
+static const char* alphabet[] = {
+    "f", "i", "l", "'", "`", "-", ".", "+", "*", "#", "(", "c", ")", "r",
+    "t", "m", "%", "_", "@", "/", "\\", "^", "!", "a", "b", " ",
+    "\xc3\xa9", "\xc3\xbc", "\xe2\x80\xa6", "\xe3\x81\x82"
+};
+enum { ALPHABET = sizeof alphabet / sizeof *alphabet };
+
+// Appends chars random characters to s, noting where each starts.
+static void random_text(TestRandom& r, int chars, std::string& s,
+                        std::vector<int>* starts = NULL)
+{
+    for (int i = 0; i < chars; ++i) {
+        if (starts) starts->push_back(s.size());
+        s += alphabet[r.below(ALPHABET)];
+    }
+}
+
+// Half from punctuation the font should have, half from CJK it may
+// not; now and then 0, which is no ligature at all.
+static wchar random_codepoint(TestRandom& r)
+{
+    switch (r.below(5)) {
+    case 0: return 0;
+    case 1: case 2: return 0x2000 + r.below(0x200);
+    default: return 0x4e00 + r.below(0x5000);
+    }
+}
+
+
+static void fuzz(const Fontinfo& fi)
+{
+    TestRandom r(46);
+    std::vector<std::string> added;
+    int checked = 0, ligatures = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        int op = r.below(10);
+        if (op == 0) {
+            ClearLigatures();
+            ref.clear();
+            added.clear();
+        }
+        else if (op < 5) {
+            std::string seq;
+            random_text(r, 1 + r.below(4), seq);
+            wchar cp = random_codepoint(r);
+            AddLigature(seq.c_str(), cp);
+            ref.add(seq.c_str(), cp);
+            added.push_back(seq);
+        }
+        else if (op < 7) {
+            // Mostly what was added, or a prefix of it.
+            std::string seq;
+            random_text(r, 1 + r.below(4), seq);
+            if (!added.empty() && r.below(4)) {
+                seq = added[r.below(added.size())];
+                seq.resize(1 + r.below(seq.size()));
+            }
+            DeleteLigature(seq.c_str());
+            ref.del(seq.c_str());
+        }
+
+        // Random characters with some of the sequences added among them.
+        std::vector<int> starts;
+        std::string text;
+        random_text(r, 1 + r.below(6), text, &starts);
+        for (int i = r.below(4); i > 0 && !added.empty(); --i) {
+            const std::string& seq = added[r.below(added.size())];
+            for (size_t j = 0; j < seq.size(); ++j)
+                if ((seq[j] & 0xc0) != 0x80) starts.push_back(text.size() + j);
+            text += seq;
+            random_text(r, r.below(3), text, &starts);
+        }
+        for (size_t i = 0; i < starts.size(); ++i) {
+            const char* p = text.c_str() + starts[i];
+            int bytes, want_bytes;
+            wchar got = file_encoding->DecodeWithLigatures(p, fi, bytes);
+            wchar want = ref_decode(p, want_bytes, &fi);
+            if (got != want || bytes != want_bytes) {
+                printf("round %d, \"%s\" at %d: got U+%04x/%d, "
+                       "expected U+%04x/%d\n", round, text.c_str(),
+                       starts[i], got, bytes, want, want_bytes);
+            }
+            CHECK(got == want);
+            CHECK(bytes == want_bytes);
+            CHECK(file_encoding->NextCharSize(p, &fi) == want_bytes);
+            if (want != file_encoding->DecodeChar(p)) ++ligatures;
+            ++checked;
+        }
+    }
+    printf("%d decodes checked, %d of them ligatures\n", checked,
+           ligatures);
+    CHECK(ligatures > checked / 50);
+}
+
+
+static double seconds(Uint64 ticks)
+{
+    return (double) ticks / SDL_GetPerformanceFrequency();
+}
+
+static void benchmark(const Fontinfo& fi)
+{
+    static const char* defaults[][2] = {
+        { "`", "\xe2\x80\x98" }, { "``", "\xe2\x80\x9c" },
+        { "'", "\xe2\x80\x99" }, { "''", "\xe2\x80\x9d" },
+        { "...", "\xe2\x80\xa6" }, { "--", "\xe2\x80\x93" },
+        { "---", "\xe2\x80\x94" }, { "(c)", "\xc2\xa9" },
+        { "ff", "\xef\xac\x80" }, { "fi", "\xef\xac\x81" },
+        { "fl", "\xef\xac\x82" }, { "ffi", "\xef\xac\x83" },
+        { "ffl", "\xef\xac\x84" }, { "##", "#" }, { "#@", "@" },
+    };
+    ClearLigatures();
+    ref.clear();
+    for (size_t i = 0; i < sizeof defaults / sizeof *defaults; ++i) {
+        wchar cp = file_encoding->DecodeChar(defaults[i][1]);
+        AddLigature(defaults[i][0], cp);
+        ref.add(defaults[i][0], cp);
+    }
+
+    static const char words[] =
+        "The fine office's \"final\" -- flow... of ``quotes'' and (c) "
+        "text, caf\xc3\xa9 \xe3\x81\x82 affluent shuffling; ";
+    std::string text;
+    while (text.size() < BENCH_BYTES) text += words;
+
+    long sum[2] = { 0, 0 };
+    double t[2];
+    for (int k = 0; k < 2; ++k) {
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        for (int pass = 0; pass < BENCH_PASSES; ++pass) {
+            for (const char* p = text.c_str(); *p; ) {
+                int bytes;
+                sum[k] += k ? ref_decode(p, bytes, &fi)
+                            : file_encoding->DecodeWithLigatures(p, fi, bytes);
+                p += bytes;
+            }
+        }
+        t[k] = seconds(SDL_GetPerformanceCounter() - t0);
+    }
+    CHECK(sum[0] == sum[1]);
+    double mb = (double) text.size() * BENCH_PASSES / 1e6;
+    printf("%.1f MB of text: %.0f MB/s with the trie, %.0f MB/s with "
+           "the old tree\n", text.size() / 1e6, mb / t[0], mb / t[1]);
+}
+
+
+int main(int, char**)
+{
+    std::string data = test_font();
+    if (data.empty()) {
+        printf("ligature_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+    const std::string& dir = test_mkdir("ligature_test");
+    test_write(dir + "/face0.ttf", data);
+
+    file_encoding = new UTF8Encoding;
+    DirPaths paths(dir.c_str());
+    InitialiseFontSystem(&paths);
+    Fontinfo fi;
+    CHECK(fi.font()->has_char(0x2019));
+
+    fuzz(fi);
+    benchmark(fi);
+
+    ClearLigatures();
+    ref.clear();
+    test_cleanup();
+    return test_result();
+}
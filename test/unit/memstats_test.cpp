@@ -0,0 +1,236 @@
+/* -*- C++ -*-
+ *
+ *  memstats_test.cpp - Memory counters while sprites come and go
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Run a script under --memstats-interval that idles, loads a screenful
+// of sprites, a background and a standing picture, idles, frees them
+// all and idles again.  The lines logged while idle must keep coming
+// though nothing wakes the event loop, the sprites must show up in
+// their counter, and every counter must be back where it started once
+// they are freed.
+//
+// Then load hidden sprites under a budget small enough that each one
+// loaded drops the images of the others, and draw them with drawsp,
+// drawsp2 and drawsp3: the screen must come out as it does with no
+// budget.
+
+#include "engine.h"
+#include <vector>
+
+enum { INTERVAL_MS = 50, IDLE_MS = 600 };
+
+static void put16(std::string& s, unsigned n)
+{
+    s += (char) n;
+    s += (char) (n >> 8);
+}
+
+static void put32(std::string& s, Uint32 n)
+{
+    put16(s, n & 0xffff);
+    put16(s, n >> 16);
+}
+
+// A 24-bit BMP of w x h pixels, shaded so that it isn't all one colour.
+static std::string bmp(int w, int h, int seed)
+{
+    int pitch = (w * 3 + 3) & ~3;
+    std::string s = "BM";
+    put32(s, 54 + pitch * h);
+    put32(s, 0);
+    put32(s, 54);
+    put32(s, 40);
+    put32(s, w);
+    put32(s, h);
+    put16(s, 1);
+    put16(s, 24);
+    put32(s, 0);
+    put32(s, pitch * h);
+    put32(s, 2835);
+    put32(s, 2835);
+    put32(s, 0);
+    put32(s, 0);
+    for (int y = 0; y < h; ++y) {
+        std::string row(pitch, 0);
+        for (int x = 0; x < w; ++x) {
+            row[x * 3] = (char) (x + seed);
+            row[x * 3 + 1] = (char) (y * seed);
+            row[x * 3 + 2] = (char) (x ^ y);
+        }
+        s += row;
+    }
+    return s;
+}
+
+
+// The categories of one "memory: ..." line, by name, in KB.
+struct Line {
+    std::vector<std::string> names;
+    std::vector<unsigned long> kb;
+
+    unsigned long get(const std::string& name) const
+    {
+        for (size_t i = 0; i < names.size(); ++i)
+            if (names[i] == name) return kb[i];
+        return 0;
+    }
+};
+
+static std::vector<Line> parse_log(const std::string& log)
+{
+    std::vector<Line> lines;
+    size_t p = 0;
+    while ((p = log.find("memory: ", p)) != std::string::npos) {
+        size_t end = log.find('\n', p);
+        std::string text = log.substr(p + 8, end - p - 8);
+        p = end;
+        Line line;
+        char name[32];
+        unsigned long kb;
+        int n;
+        const char* c = text.c_str();
+        if (sscanf(c, "%luK%n", &kb, &n) != 1) continue;
+        line.names.push_back("total");
+        line.kb.push_back(kb);
+        c += n;
+        while (sscanf(c, " %31s %luK%n", name, &kb, &n) == 2) {
+            line.names.push_back(name);
+            line.kb.push_back(kb);
+            c += n;
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+
+static void evicted_drawsp(const std::string& dir, const std::string& font)
+{
+    std::string script =
+        "*define\n"
+        "game\n"
+        "*start\n"
+        "bg black,1\n"
+        "lsph 1,\"sprite0.bmp\",0,0\n"
+        "lsph 2,\"sprite1.bmp\",0,0\n"
+        "lsph 3,\"sprite2.bmp\",0,0\n"
+        "lsp 4,\"sprite3.bmp\",400,300\n"
+        "print 1\n"
+        "drawclear\n"
+        "drawsp 1,0,255,10,10\n"
+        "drawsp2 2,0,255,200,100,100,100,0\n"
+        "drawsp3 3,0,200,300,50,1000,0,0,1000\n"
+        "draw\n"
+        "getscreenshot 640,480\n"
+        "savescreenshot \"drawsp.bmp\"\n"
+        "end\n";
+    CHECK(test_run_script(dir, font, script) == 0);
+    std::string want = test_read(dir + "/drawsp.bmp");
+    CHECK(test_run_script(dir, font, script, "--memory-budget 1") == 0);
+    std::string got = test_read(dir + "/drawsp.bmp");
+    CHECK(!want.empty());
+    CHECK(want.find_first_not_of('\0', 54) != std::string::npos);
+    CHECK(got == want);
+}
+
+
+int main(int, char**)
+{
+    std::string font = test_font();
+    if (font.empty()) {
+        printf("memstats_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+
+    const std::string& dir = test_mkdir("memstats_test");
+    for (int i = 0; i < 4; ++i) {
+        char name[32];
+        snprintf(name, sizeof name, "/sprite%d.bmp", i);
+        test_write(dir + name, bmp(80 + 40 * i, 60 + 30 * i, i + 1));
+    }
+    test_write(dir + "/bg.bmp", bmp(640, 480, 7));
+    test_write(dir + "/ch.bmp", bmp(200, 400, 9));
+
+    char idle[32];
+    snprintf(idle, sizeof idle, "wait %d\n", IDLE_MS);
+    std::string script =
+        "*define\n"
+        "game\n"
+        "*start\n";
+    script += idle;
+    for (int i = 0; i < 40; ++i) {
+        char line[64];
+        snprintf(line, sizeof line, "lsp %d,\"sprite%d.bmp\",%d,%d\n",
+                 i + 1, i % 4, i * 13, i * 9);
+        script += line;
+    }
+    script +=
+        "bg \"bg.bmp\",1\n"
+        "ld c,\"ch.bmp\",1\n"
+        "print 1\n";
+    script += idle;
+    script +=
+        "csp -1\n"
+        "cl a,1\n"
+        "bg black,1\n"
+        "print 1\n";
+    script += idle;
+    script += "end\n";
+
+    char interval[32];
+    snprintf(interval, sizeof interval, "--memstats-interval %d",
+             INTERVAL_MS);
+    CHECK(test_run_script(dir, font, script, interval) == 0);
+
+    std::vector<Line> lines = parse_log(test_read(dir + "/log.txt"));
+    printf("%d lines logged in %d ms of idling\n", (int) lines.size(),
+           3 * IDLE_MS);
+    // Logged on time while waiting, not just when the wait ends.
+    CHECK(lines.size() >= (size_t) (3 * IDLE_MS / INTERVAL_MS / 2));
+
+    if (lines.size() >= 2) {
+        const Line& first = lines.front();
+        const Line& last = lines.back();
+        unsigned long peak = 0;
+        for (size_t i = 0; i < lines.size(); ++i)
+            if (lines[i].get("sprites") > peak) peak = lines[i].get("sprites");
+        printf("sprites: %luK at first, %luK at most, %luK at last\n",
+               first.get("sprites"), peak, last.get("sprites"));
+        // 40 sprites of at least 80x60, a background and a picture.
+        CHECK(peak >= first.get("sprites") + (40 * 80 * 60 * 4 >> 10));
+        CHECK(first.names == last.names);
+        CHECK(first.names.size() > 1);
+        for (size_t i = 0; i < first.names.size(); ++i) {
+            if (first.kb[i] != last.kb[i])
+                fprintf(stderr, "%s: %luK before, %luK after\n",
+                        first.names[i].c_str(), first.kb[i], last.kb[i]);
+            CHECK(first.kb[i] == last.kb[i]);
+        }
+    }
+
+    evicted_drawsp(dir, font);
+
+    if (test_result()) {
+        fprintf(stderr, "log left in %s\n", dir.c_str());
+        return 1;
+    }
+    test_cleanup();
+    return 0;
+}
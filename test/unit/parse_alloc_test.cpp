@@ -0,0 +1,219 @@
+/* -*- C++ -*-
+ *
+ *  parse_alloc_test.cpp - Heap allocations made reading command arguments
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Read the arguments of a mix of common commands -- numbers, strings,
+// aliases, arrays, labels -- the way their ScriptParser commands read
+// them, over and over.  The values read must be right and must not
+// change from one pass to the next.  Where malloc can be hooked, count
+// the calls made per command once the expression cache is warm, and
+// fail if there are more than MAX_ALLOCS; print them and the time per
+// command either way.
+
+#include "test.h"
+#include "ScriptHandler.h"
+#include "DirPaths.h"
+#include <string.h>
+
+enum { REPEAT = 2000, PASSES = 20, MAX_ALLOCS = 5 };
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void __libc_free(void*);
+
+static unsigned long allocations;
+
+extern "C" void* malloc(size_t n)
+{
+    ++allocations;
+    return __libc_malloc(n);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+    ++allocations;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* p, size_t n)
+{
+    if (!p) ++allocations;
+    return __libc_realloc(p, n);
+}
+
+extern "C" void free(void* p)
+{
+    __libc_free(p);
+}
+
+static const bool counting = true;
+#else
+static unsigned long allocations;
+static const bool counting = false;
+#endif
+
+static const char* commands[] = {
+    "mov %1,5",
+    "mov %2,%1 + 3 * 2",
+    "add %1,%2",
+    "mov $1,\"hello world\"",
+    "mov $2,$1",
+    "lsp 10,\":a;image\\foo.png\",100,200",
+    "bg \"bg\\room.jpg\",2",
+    "gosub *sub_label",
+    "textcolor #ffffff",
+    "locate 10,20",
+    "monocro off",
+    "mov %3,?0[1][2] + 1",
+    "itoa $3,%1",
+    "mov $4,spr_name",
+    "inc %5",
+    "mov %4,num_alias",
+    NULL
+};
+
+// As the commands themselves read their arguments; returns a sum of
+// what was read.
+static long args(ScriptHandler& h, const char* cmd)
+{
+    long sum = 0;
+    if (!strcmp(cmd, "mov") || !strcmp(cmd, "add")) {
+        Expression e = h.readExpr();
+        if (e.is_textual())
+            sum += h.readStrValue().length();
+        else
+            sum += h.readIntValue();
+    }
+    else if (!strcmp(cmd, "lsp")) {
+        sum += h.readIntValue();
+        sum += h.readStrValue().length();
+        sum += h.readIntValue();
+        sum += h.readIntValue();
+    }
+    else if (!strcmp(cmd, "bg")) {
+        sum += h.readStrValue().length();
+        sum += h.readIntValue();
+    }
+    else if (!strcmp(cmd, "gosub")) {
+        sum += h.readStrExpr().as_string().length();
+    }
+    else if (!strcmp(cmd, "monocro")) {
+        sum += h.readStrExpr().is_bareword("off");
+    }
+    else if (!strcmp(cmd, "textcolor")) {
+        sum += h.readStrValue().length();
+    }
+    else if (!strcmp(cmd, "locate")) {
+        sum += h.readIntValue();
+        sum += h.readIntValue();
+    }
+    else if (!strcmp(cmd, "itoa")) {
+        h.readStrExpr();
+        sum += h.readIntValue();
+    }
+    else if (!strcmp(cmd, "inc")) {
+        sum += h.readIntExpr().var_no();
+    }
+    return sum;
+}
+
+
+// One pass from *start to the end, counting commands.
+static long run(ScriptHandler& h, int& count)
+{
+    long sum = 0;
+    h.setCurrent(h.lookupLabel("start").start_address);
+    for (;;) {
+        const char* cmd = h.readToken();
+        if (!strcmp(cmd, "\n")) continue;
+        if (!strcmp(cmd, "end")) break;
+        sum += args(h, cmd);
+        ++count;
+    }
+    return sum;
+}
+
+
+int main(int, char**)
+{
+    file_encoding = new UTF8Encoding;
+
+    std::string script = "*define\n*start\n";
+    for (int i = 0; i < REPEAT; ++i)
+        for (const char** c = commands; *c; ++c)
+            script = script + *c + "\n";
+    script += "end\n*sub_label\nreturn\n*dims\ndim ?0[3][4]\n*values\n";
+    for (const char** c = commands; *c; ++c)
+        script = script + *c + "\n";
+    const std::string& dir = test_mkdir("parse_alloc_test");
+    test_write(dir + "/0.utf", script);
+
+    DirPaths paths(dir.c_str());
+    ScriptHandler h;
+    CHECK(h.readScript(&paths, NULL) == 0);
+    h.addNumAlias("num_alias", 6);
+    h.addStrAlias("spr_name", "sprite_name");
+    h.getVariableData(1).set_num(7);
+    h.getVariableData(1).str = "abc";
+    h.setCurrent(h.lookupLabel("dims").start_address);
+    h.readToken();
+    h.declareDim();
+
+    // The commands are read as they should be.
+    static const long values[] = {
+        5, 7 + 6, 0, 11, 3, 10 + 16 + 100 + 200, 11 + 2, 9, 7, 10 + 20,
+        1, 1, 7, 11, 5, 6
+    };
+    h.setCurrent(h.lookupLabel("values").start_address);
+    for (int i = 0; commands[i]; ++i) {
+        const char* cmd = h.readToken();
+        while (!strcmp(cmd, "\n")) cmd = h.readToken();
+        long v = args(h, cmd);
+        if (v != values[i])
+            printf("%s: read %ld, expected %ld\n", commands[i], v,
+                   values[i]);
+        CHECK(v == values[i]);
+    }
+
+    int count = 0;
+    long first = run(h, count);
+    count = 0;
+    unsigned long a0 = allocations;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < PASSES; ++i)
+        CHECK(run(h, count) == first);
+    double ns = (double) (SDL_GetPerformanceCounter() - t0)
+        / SDL_GetPerformanceFrequency() * 1e9 / count;
+    double per = (double) (allocations - a0) / count;
+
+    if (counting) {
+        printf("%d commands: %.2f allocations and %.0f ns per command\n",
+               count, per, ns);
+        CHECK(per <= MAX_ALLOCS);
+    }
+    else {
+        printf("%d commands: %.0f ns per command (allocations not "
+               "counted on this platform)\n", count, ns);
+    }
+
+    test_cleanup();
+    return test_result();
+}
@@ -0,0 +1,272 @@
+/* -*- C++ -*-
+ *
+ *  psa_roundtrip_test.cpp - Packing a tree with psapack and reading it back
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Build a directory tree of files that compress well, files that
+// don't, and empty ones; pack it with psapack, compressed and then
+// with -0; and read every file back through PsaReader, whole with
+// getFile() and streamed with openFile(), in pieces and after seeks.
+// psapack -t must pass the archive and psapack -x must give back the
+// tree.  Last, a damaged entry must be refused rather than returned.
+
+#include "test.h"
+#include "PsaReader.h"
+#include "encoding.h"
+#include <sys/stat.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+struct File {
+    std::string name; // relative, with '/'
+    std::string data;
+};
+static std::vector<File> files;
+
+static std::string psapack()
+{
+    const char* p = getenv("PSAPACK");
+    return p ? p : "./psapack";
+}
+
+
+static int run(const std::string& args)
+{
+    std::string cmd = psapack() + " " + args + " > /dev/null";
+    return system(cmd.c_str());
+}
+
+
+static void make_tree(const std::string& root)
+{
+    static const char* dirs[] = { "", "Image/", "image/bg/", "sound/Voice/" };
+    TestRandom r(43);
+    mkdir(root.c_str(), 0777);
+    for (int d = 1; d < 4; ++d) {
+        std::string path = root + "/";
+        for (const char* p = dirs[d]; *p; ++p) {
+            if (*p == '/') mkdir(path.c_str(), 0777);
+            path += *p;
+        }
+    }
+
+    for (int i = 0; i < 60; ++i) {
+        File f;
+        char name[64];
+        snprintf(name, sizeof name, "%s%s%02d.%s", dirs[i % 4],
+                 i % 3 ? "file" : "File", i, i % 2 ? "dat" : "PNG");
+        f.name = name;
+        switch (i % 5) {
+        case 0: // compresses well
+            for (size_t n = 1 + r.below(300000); f.data.size() < n;)
+                f.data += "Ponscripter reads its own archives. ";
+            break;
+        case 1: // partly
+        case 2:
+            f.data = std::string(1 + r.below(100000), 0);
+            for (size_t k = 0; k < f.data.size(); ++k)
+                f.data[k] = r.below(4) ? "abcdefgh"[k / 61 % 8]
+                                       : (char) r.next();
+            break;
+        case 3: // not at all
+            f.data = std::string(1 + r.below(100000), 0);
+            for (size_t k = 0; k < f.data.size(); ++k)
+                f.data[k] = (char) r.next();
+            break;
+        case 4: // tiny or empty
+            f.data = std::string(r.below(3) ? r.below(16) : 0, 'x');
+            break;
+        }
+        test_write(root + "/" + f.name, f.data);
+        files.push_back(f);
+    }
+}
+
+
+static std::string read_stream(SDL_RWops* rw, size_t len)
+{
+    std::string s(len, 0);
+    size_t got = 0;
+    while (got < len) {
+        size_t n = SDL_RWread(rw, &s[got], 1, len - got);
+        if (!n) break;
+        got += n;
+    }
+    s.resize(got);
+    return s;
+}
+
+
+static std::string upper(std::string s)
+{
+    for (size_t i = 0; i < s.size(); ++i)
+        if (s[i] >= 'a' && s[i] <= 'z') s[i] -= 'a' - 'A';
+    return s;
+}
+
+
+// Returns how many entries were compressed.
+static int check_reads(const std::string& game)
+{
+    PsaReader psa(new DirPaths(game.c_str()));
+    BaseReader& reader = psa;
+    CHECK(reader.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+    CHECK(reader.getNumFiles() == (int) files.size());
+
+    TestRandom r(7);
+    for (size_t i = 0; i < files.size(); ++i) {
+        const File& f = files[i];
+        // Names with either separator and in any case find the entry.
+        pstring name = f.name.c_str();
+        pstring other = upper(f.name).c_str();
+        replace_ascii(other, '/', '\\');
+        int location = -1;
+
+        CHECK(reader.getFileLength(name) == f.data.size());
+        CHECK(reader.getFileLength(other) == f.data.size());
+        pstring whole = reader.getFile(other, &location);
+        CHECK((size_t) whole.length() == f.data.size());
+        CHECK(std::string((const char*) whole, whole.length()) == f.data);
+        if (f.data.size())
+            CHECK(location == BaseReader::ARCHIVE_TYPE_PSA);
+
+        SDL_RWops* rw = reader.openFile(name);
+        CHECK(rw != NULL);
+        if (!rw) continue;
+        CHECK(SDL_RWsize(rw) == (Sint64) f.data.size());
+
+        // In pieces of random sizes...
+        std::string streamed;
+        for (;;) {
+            std::string piece = read_stream(rw, 1 + r.below(5000));
+            if (piece.empty()) break;
+            streamed += piece;
+        }
+        CHECK(streamed == f.data);
+
+        // ...and from random places.
+        for (int k = 0; k < 8 && f.data.size(); ++k) {
+            size_t pos = r.below(f.data.size());
+            size_t len = r.below(4096);
+            CHECK(SDL_RWseek(rw, pos, RW_SEEK_SET) == (Sint64) pos);
+            CHECK(read_stream(rw, len) == f.data.substr(pos, len));
+        }
+        CHECK(SDL_RWseek(rw, -1, RW_SEEK_END) ==
+              (Sint64) f.data.size() - 1 || f.data.empty());
+        SDL_RWclose(rw);
+    }
+
+    // Every entry is listed once.
+    std::vector<std::string> listed;
+    int compressed = 0;
+    for (int i = 0; i < reader.getNumFiles(); ++i) {
+        BaseReader::FileInfo fi = reader.getFileByIndex(i);
+        listed.push_back(upper(std::string((const char*) fi.name,
+                                           fi.name.length())));
+        if (fi.length < fi.original_length) ++compressed;
+    }
+    std::sort(listed.begin(), listed.end());
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string n = upper(files[i].name);
+        for (size_t k = 0; k < n.size(); ++k)
+            if (n[k] == '/') n[k] = '\\';
+        CHECK(std::binary_search(listed.begin(), listed.end(), n));
+    }
+    return compressed;
+}
+
+
+static void check_unpacked(const std::string& root)
+{
+    for (size_t i = 0; i < files.size(); ++i)
+        CHECK(test_read(root + "/" + files[i].name) == files[i].data);
+}
+
+
+// Flips a byte in the middle of the largest entry; reading it must
+// then fail whether it was compressed or not.
+static void check_damage(const std::string& game, const std::string& arc)
+{
+    size_t big = 0;
+    for (size_t i = 1; i < files.size(); ++i)
+        if (files[i].data.size() > files[big].data.size()) big = i;
+
+    PsaReader before(new DirPaths(game.c_str()));
+    CHECK(before.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+    pstring name = files[big].name.c_str();
+    size_t offset = 0;
+    for (int i = 0; i < before.getNumFiles(); ++i) {
+        BaseReader::FileInfo fi = before.getFileByIndex(i);
+        pstring n = fi.name;
+        replace_ascii(n, '\\', '/');
+        if (n.caselessEqual(name)) offset = fi.offset + fi.length / 2;
+    }
+    CHECK(offset > 0);
+    before.close();
+
+    std::string data = test_read(arc);
+    data[offset] ^= 0x55;
+    test_write(arc, data);
+
+    PsaReader after(new DirPaths(game.c_str()));
+    CHECK(after.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+    CHECK(((BaseReader&) after).getFile(name).length() == 0);
+    CHECK(run("-t '" + arc + "' 2> /dev/null") != 0);
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+
+    const std::string& dir = test_mkdir("psa_roundtrip_test");
+    std::string tree = dir + "/tree", game = dir + "/game";
+    std::string arc = game + "/arc.psa";
+    make_tree(tree);
+    mkdir(game.c_str(), 0777);
+
+    static const struct {
+        const char* label;
+        const char* flag;
+    } modes[] = { { "compressed", "" }, { "stored", "-0 " } };
+    for (int m = 0; m < 2; ++m) {
+        std::string out = dir + "/out" + (char) ('0' + m);
+        remove(arc.c_str());
+        CHECK(run(std::string(modes[m].flag) + "'" + arc + "' '" + tree + "'")
+              == 0);
+        CHECK(run("-t '" + arc + "'") == 0);
+        int compressed = check_reads(game);
+        printf("%s: %d of %d entries compressed\n", modes[m].label,
+               compressed, (int) files.size());
+        CHECK(m == 0 ? compressed >= 30 : compressed == 0);
+        CHECK(run("-x '" + arc + "' '" + out + "'") == 0);
+        check_unpacked(out);
+        check_damage(game, arc);
+    }
+
+    if (test_result()) {
+        fprintf(stderr, "files left in %s\n", dir.c_str());
+        SDL_Quit();
+        return 1;
+    }
+    test_cleanup();
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,327 @@
+/* -*- C++ -*-
+ *
+ *  reader_decode_test.cpp - LZSS, SPB and NBZ decoding against the
+ *                           bit-serial decoders
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// The decoders below are DirectReader's as they were before they read
+// whole entries into memory: one bit at a time, with a ring buffer for
+// LZSS and bzip2 fed in READ_LENGTH pieces.  Only the source changed,
+// from positioned reads of the archive to the stored bytes, which ends
+// the input where the entry ends.  Every entry of an archive of random
+// and truncated ones must come out of NsaReader exactly as they decode
+// it.  Then large entries are decoded both ways and the throughput of
+// each is printed; the reference reads from memory, so it is if
+// anything faster than the old code was.
+
+#include "archive.h"
+#include "NsaReader.h"
+#include "encoding.h"
+
+enum { READ_LENGTH = 4096, EI = 8, EJ = 4, P = 1,
+       N = 1 << EI, F = (1 << EJ) + P, ROUNDS = 5 };
+
+struct RefBitReader {
+    const unsigned char* p;
+    size_t len, count;
+    int mask, bits;
+    RefBitReader(const std::string& s, size_t start)
+        : p((const unsigned char*) s.data()), len(s.size()), count(start),
+          mask(0), bits(0) {}
+};
+
+static int getbit(RefBitReader& br, int n)
+{
+    int i, x = 0;
+
+    for (i = 0; i < n; i++) {
+        if (br.mask == 0) {
+            if (br.len == br.count) return EOF;
+
+            br.bits = br.p[br.count++];
+            br.mask = 128;
+        }
+
+        x <<= 1;
+        if (br.bits & br.mask) x++;
+
+        br.mask >>= 1;
+    }
+
+    return x;
+}
+
+
+static std::string refLZSS(const TestEntry& e)
+{
+    std::string buf;
+    int i, j, k, r, c;
+    unsigned char decomp_buffer[N];
+
+    RefBitReader br(e.stored, 0);
+    memset(decomp_buffer, 0, N);
+    r = N - F;
+
+    while (buf.size() < e.original_length) {
+        if (getbit(br, 1)) {
+            if ((c = getbit(br, 8)) == EOF) break;
+
+            buf += (char) c;
+            decomp_buffer[r++] = c;  r &= (N - 1);
+        }
+        else {
+            if ((i = getbit(br, EI)) == EOF) break;
+
+            if ((j = getbit(br, EJ)) == EOF) break;
+
+            for (k = 0; k <= j + 1 && buf.size() < e.original_length; k++) {
+                c = decomp_buffer[(i + k) & (N - 1)];
+                buf += (char) c;
+                decomp_buffer[r++] = c;  r &= (N - 1);
+            }
+        }
+    }
+
+    return buf;
+}
+
+
+static std::string refSPB(const TestEntry& e)
+{
+    const unsigned char* header = (const unsigned char*) e.stored.data();
+    size_t width  = header[0] << 8 | header[1];
+    size_t height = header[2] << 8 | header[3];
+    RefBitReader br(e.stored, 4);
+
+    size_t width_pad = (4 - width * 3 % 4) % 4;
+    size_t total_size = (width * 3 + width_pad) * height + 54;
+    std::string out(total_size, 0);
+    unsigned char* buf = (unsigned char*) &out[0];
+
+    buf[0]  = 'B'; buf[1] = 'M';
+    buf[2]  = total_size & 0xff;
+    buf[3]  = (total_size >> 8) & 0xff;
+    buf[4]  = (total_size >> 16) & 0xff;
+    buf[5]  = (total_size >> 24) & 0xff;
+    buf[10] = 54;
+    buf[14] = 40;
+    buf[18] = width & 0xff;
+    buf[19] = (width >> 8) & 0xff;
+    buf[22] = height & 0xff;
+    buf[23] = (height >> 8) & 0xff;
+    buf[26] = 1;
+    buf[28] = 24;
+    buf[34] = total_size - 54;
+    buf += 54;
+
+    std::vector<unsigned char> decomp_buffer(width * height + 4);
+    unsigned int count;
+    size_t i, j, k;
+    int c, n, m;
+    for (i = 0; i < 3; i++) {
+        count = 0;
+        decomp_buffer[count++] = c = getbit(br, 8);
+        while (count < (unsigned) (width * height)) {
+            n = getbit(br, 3);
+            if (n == 0) {
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                decomp_buffer[count++] = c;
+                continue;
+            }
+            else if (n == 7) {
+                m = getbit(br, 1) + 1;
+            }
+            else {
+                m = n + 2;
+            }
+
+            for (j = 0; j < 4; j++) {
+                if (m == 8) {
+                    c = getbit(br, 8);
+                }
+                else {
+                    k = getbit(br, m);
+                    if (k & 1) c += (k >> 1) + 1;
+                    else c -= (k >> 1);
+                }
+
+                decomp_buffer[count++] = c;
+            }
+        }
+
+        unsigned char* pbuf = buf + (width * 3 + width_pad) * (height - 1) + i;
+        unsigned char* psbuf = &decomp_buffer[0];
+
+        for (j = 0; j < height; j++) {
+            if (j & 1) {
+                for (k = 0; k < width; k++, pbuf -= 3) *pbuf = *psbuf++;
+
+                pbuf -= width * 3 + width_pad - 3;
+            }
+            else {
+                for (k = 0; k < width; k++, pbuf += 3) *pbuf = *psbuf++;
+
+                pbuf -= width * 3 + width_pad + 3;
+            }
+        }
+    }
+
+    return out;
+}
+
+
+static std::string refNBZ(const TestEntry& e)
+{
+    const unsigned char* in = (const unsigned char*) e.stored.data();
+    unsigned int original_length =
+        in[0] << 24 | in[1] << 16 | in[2] << 8 | in[3];
+    std::string out(original_length, 0);
+    if (!original_length) return out;
+    size_t offset = 4, length = e.stored.size() - 4;
+
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return std::string();
+
+    strm.next_out  = &out[0];
+    strm.avail_out = original_length;
+    int err = BZ_OK;
+    while (err == BZ_OK && strm.avail_out > 0) {
+        if (strm.avail_in == 0) {
+            size_t c = length < READ_LENGTH ? length : READ_LENGTH;
+            if (c == 0) break;
+            strm.next_in  = (char*) in + offset;
+            strm.avail_in = c;
+            offset += c;
+            length -= c;
+        }
+        err = BZ2_bzDecompress(&strm);
+    }
+    BZ2_bzDecompressEnd(&strm);
+
+    out.resize(original_length - strm.avail_out);
+    return out;
+}
+
+
+static std::string reference(const TestEntry& e)
+{
+    switch (e.compression) {
+    case BaseReader::LZSS_COMPRESSION: return refLZSS(e);
+    case BaseReader::SPB_COMPRESSION:  return refSPB(e);
+    case BaseReader::NBZ_COMPRESSION:  return refNBZ(e);
+    }
+    return e.stored;
+}
+
+
+// Cuts the stored bytes short, keeping the four byte header of SPB and
+// NBZ entries: without it the old decoders read the next entry's.
+static TestEntry truncated(TestEntry e, TestRandom& r)
+{
+    size_t keep = e.compression == BaseReader::LZSS_COMPRESSION ? 0 : 4;
+    e.name += ".cut";
+    e.stored.resize(keep + r.below(e.stored.size() - keep));
+    return e;
+}
+
+
+static void compare(const std::vector<TestEntry>& entries,
+                    const std::string& dir)
+{
+    test_write_nsa(dir + "/arc.nsa", entries);
+    NsaReader reader(new DirPaths(dir.c_str()));
+    CHECK(reader.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::string want = reference(entries[i]);
+        pstring got = reader.BaseReader::getFile(entries[i].name.c_str());
+        if ((size_t) got.length() != want.size() ||
+            memcmp((const char*) got, want.data(), want.size()) != 0) {
+            fprintf(stderr, "%s: %d bytes, expected %d\n",
+                    entries[i].name.c_str(), (int) got.length(),
+                    (int) want.size());
+            CHECK(!"entry decodes as the bit-serial decoder did");
+        }
+    }
+}
+
+
+static void benchmark(const TestEntry& e, const char* what,
+                      const std::string& dir)
+{
+    std::vector<TestEntry> one(1, e);
+    test_write_nsa(dir + "/arc.nsa", one);
+    NsaReader reader(new DirPaths(dir.c_str()));
+    CHECK(reader.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+
+    size_t length = 0;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ROUNDS; ++i)
+        length = reader.BaseReader::getFile(e.name.c_str()).length();
+    Uint64 t1 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ROUNDS; ++i)
+        CHECK(reference(e).size() == length);
+    Uint64 t2 = SDL_GetPerformanceCounter();
+
+    double mb = (double) length * ROUNDS / (1 << 20);
+    double f = (double) SDL_GetPerformanceFrequency();
+    printf("%s: %.1f MB/s, bit-serial %.1f MB/s\n", what,
+           mb / ((t1 - t0) / f), mb / ((t2 - t1) / f));
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+
+    const std::string& dir = test_mkdir("reader_decode_test");
+    TestRandom r(2718);
+    std::vector<TestEntry> entries;
+    for (int i = 0; i < 300; ++i) {
+        char name[32];
+        snprintf(name, sizeof name, "file%03d.dat", i);
+        size_t len = 1 + r.below(i % 10 == 0 ? 100000 : 3000);
+        TestEntry e;
+        switch (i % 3) {
+        case 0:
+            e = test_lzss(name, r, len);
+            break;
+        case 1:
+            e = test_spb(name, r, 1 + r.below(200), 1 + r.below(150),
+                         1 + r.below(len));
+            break;
+        case 2:
+            e = test_nbz(name, test_random_bytes(r, len, true));
+            break;
+        }
+        entries.push_back(e);
+        entries.push_back(truncated(e, r));
+    }
+    compare(entries, dir);
+
+    benchmark(test_lzss("big.lzss", r, 4 << 20), "LZSS", dir);
+    benchmark(test_spb("big.spb", r, 1024, 768, 1 << 20), "SPB", dir);
+    benchmark(test_nbz("big.nbz", test_random_bytes(r, 4 << 20, true)),
+              "NBZ", dir);
+
+    test_cleanup();
+    return test_result();
+}
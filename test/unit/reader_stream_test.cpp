@@ -0,0 +1,185 @@
+/* -*- C++ -*-
+ *
+ *  reader_stream_test.cpp - Streamed reads against whole-file reads
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// openFile() streams stored entries from disk and decodes NBZ and LZSS
+// entries as they are read; SPB is still decoded whole.  For entries of
+// every kind, read the stream in pieces from one byte to many buffers
+// long, seek about it every way SDL allows, and compare each byte with
+// what getFile() returns for the whole entry.
+
+#include "archive.h"
+#include "NsaReader.h"
+#include "encoding.h"
+
+enum { SEEKS = 200 };
+
+static std::string read_stream(SDL_RWops* rw, size_t len)
+{
+    std::string s(len, 0);
+    size_t got = 0;
+    while (got < len) {
+        size_t n = SDL_RWread(rw, &s[got], 1, len - got);
+        if (!n) break;
+        got += n;
+    }
+    s.resize(got);
+    return s;
+}
+
+
+// Reads the whole stream in pieces of at most max_piece bytes.
+static std::string read_pieces(SDL_RWops* rw, TestRandom& r, size_t max_piece)
+{
+    std::string s;
+    for (;;) {
+        std::string piece = read_stream(rw, 1 + r.below(max_piece));
+        if (piece.empty()) break;
+        s += piece;
+    }
+    return s;
+}
+
+
+static void check_entry(BaseReader& reader, const pstring& name, TestRandom& r)
+{
+    pstring whole = reader.getFile(name);
+    std::string expected((const char*) whole, whole.length());
+    size_t len = expected.size();
+    CHECK(len > 0);
+    CHECK(reader.getFileLength(name) == len);
+
+    // Whole, a byte at a time, a little at a time, and a lot at a time.
+    static const size_t pieces[] = { 1, 7, 300, 5000, 100000 };
+    for (int p = 0; p < 5; ++p) {
+        SDL_RWops* rw = reader.openFile(name);
+        CHECK(rw != NULL);
+        if (!rw) return;
+        CHECK(SDL_RWsize(rw) == (Sint64) len);
+        if (pieces[p] == 1 && len > 20000) {
+            // One byte at a time is slow; do that for a prefix only.
+            std::string s;
+            char c;
+            while (s.size() < 20000 && SDL_RWread(rw, &c, 1, 1) == 1) s += c;
+            CHECK(s == expected.substr(0, s.size()));
+            s += read_stream(rw, len);
+            CHECK(s == expected);
+        }
+        else {
+            CHECK(read_pieces(rw, r, pieces[p]) == expected);
+        }
+        // At the end, reads give nothing.
+        char c;
+        CHECK(SDL_RWread(rw, &c, 1, 1) == 0);
+        CHECK(SDL_RWtell(rw) == (Sint64) len);
+        SDL_RWclose(rw);
+    }
+
+    // Partial reads after seeks forwards, backwards, from the current
+    // position and from the end, including ones running off the end.
+    SDL_RWops* rw = reader.openFile(name);
+    CHECK(rw != NULL);
+    if (!rw) return;
+    Sint64 pos = 0;
+    for (int i = 0; i < SEEKS; ++i) {
+        Sint64 target = r.below(len + 1);
+        Sint64 got;
+        switch (r.below(3)) {
+        case 0:
+            got = SDL_RWseek(rw, target, RW_SEEK_SET);
+            break;
+        case 1:
+            got = SDL_RWseek(rw, target - pos, RW_SEEK_CUR);
+            break;
+        default:
+            got = SDL_RWseek(rw, target - (Sint64) len, RW_SEEK_END);
+            break;
+        }
+        CHECK(got == target);
+        size_t n = r.below(i % 10 ? 3000 : 70000);
+        std::string s = read_stream(rw, n);
+        CHECK(s == expected.substr(target, n));
+        pos = target + s.size();
+        CHECK(SDL_RWtell(rw) == pos);
+    }
+    // Seeks outside the entry stop at its ends, as with SDL's memory
+    // streams.
+    CHECK(SDL_RWseek(rw, -1, RW_SEEK_SET) == 0);
+    CHECK(read_stream(rw, 10) == expected.substr(0, 10));
+    CHECK(SDL_RWseek(rw, 1, RW_SEEK_END) == (Sint64) len);
+    CHECK(read_stream(rw, 10).empty());
+    SDL_RWclose(rw);
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+
+    const std::string& dir = test_mkdir("reader_stream_test");
+    TestRandom r(50);
+    std::vector<TestEntry> entries;
+    std::vector<std::string> plain; // contents, where we know them
+    static const size_t sizes[] = { 1, 13, 4095, 4096, 4097, 70000, 400000 };
+    for (int k = 0; k < 7; ++k) {
+        size_t len = sizes[k];
+        char name[32];
+        snprintf(name, sizeof name, "stored%d.dat", k);
+        plain.push_back(test_random_bytes(r, len, false));
+        entries.push_back(test_stored(name, plain.back()));
+        snprintf(name, sizeof name, "nbz%d.dat", k);
+        plain.push_back(test_random_bytes(r, len, k & 1));
+        entries.push_back(test_nbz(name, plain.back()));
+        snprintf(name, sizeof name, "lzss%d.dat", k);
+        plain.push_back("");
+        entries.push_back(test_lzss(name, r, len));
+        snprintf(name, sizeof name, "spb%d.bmp", k);
+        plain.push_back("");
+        entries.push_back(test_spb(name, r, 1 + r.below(k * 60 + 1),
+                                   1 + r.below(k * 40 + 1), len / 4 + 1));
+    }
+    test_write_nsa(dir + "/arc.nsa", entries);
+
+    NsaReader nsa(new DirPaths(dir.c_str()));
+    BaseReader& reader = nsa;
+    CHECK(reader.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pstring name = entries[i].name.c_str();
+        check_entry(reader, name, r);
+        if (plain[i].empty()) continue;
+        pstring whole = reader.getFile(name);
+        CHECK(std::string((const char*) whole, whole.length()) == plain[i]);
+    }
+
+    // The stream outlives the reader.
+    SDL_RWops* rw = reader.openFile("nbz6.dat");
+    CHECK(rw != NULL);
+    pstring whole = reader.getFile("nbz6.dat");
+    reader.close();
+    if (rw) {
+        std::string s = read_pieces(rw, r, 10000);
+        CHECK(s == std::string((const char*) whole, whole.length()));
+        SDL_RWclose(rw);
+    }
+
+    test_cleanup();
+    SDL_Quit();
+    return test_result();
+}
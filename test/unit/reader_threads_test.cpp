@@ -0,0 +1,179 @@
+/* -*- C++ -*-
+ *
+ *  reader_threads_test.cpp - Reading one archive from many threads
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Eight threads read every entry of an NSA archive through one
+// SynchronizedReader, as the prefetcher and the main thread do, and
+// compare what they get with a single-threaded read.  The reader is
+// fresh, so the lazily worked out NBZ and SPB lengths are first
+// computed while the threads race for them.  Meanwhile a ninth thread
+// keeps taking the exclusive lock, which must not be starved.
+
+#include "archive.h"
+#include "SynchronizedReader.h"
+#include "NsaReader.h"
+#include "encoding.h"
+
+enum { NUM_THREADS = 8, ROUNDS = 4, WRITES = 50, TIME_LIMIT_MS = 60000 };
+
+struct Expected {
+    pstring name;
+    size_t length;
+    Uint32 checksum;
+};
+static std::vector<Expected> expected;
+
+static SynchronizedReader* shared_reader;
+static SDL_atomic_t writer_done;
+static Uint32 start_ticks;
+
+static void readAll(BaseReader* reader, std::vector<Expected>& out)
+{
+    int n = reader->getNumFiles();
+    for (int i = 0; i < n; ++i) {
+        Expected e;
+        e.name = reader->getFileByIndex(i).name;
+        pstring data = reader->getFile(e.name);
+        e.length = (size_t) data.length();
+        e.checksum = test_checksum((const unsigned char*) (const char*) data,
+                                   data.length());
+        out.push_back(e);
+    }
+}
+
+
+static int readerThread(void* data)
+{
+    int id = (int) (size_t) data;
+    TestRandom r(id + 1);
+    int rounds = 0;
+    // Keep reading until the writer is through, so that it has to get
+    // in between reads rather than after them.
+    while (rounds < ROUNDS || !SDL_AtomicGet(&writer_done)) {
+        if (SDL_GetTicks() - start_ticks > TIME_LIMIT_MS) break;
+        size_t first = r.below(expected.size());
+        for (size_t k = 0; k < expected.size(); ++k) {
+            size_t i = (first + k) % expected.size();
+            const Expected& e = expected[i];
+            CHECK(shared_reader->getFileByIndex(i).name == e.name);
+            CHECK(shared_reader->getFileLength(e.name) == e.length);
+            pstring got = shared_reader->getFile(e.name);
+            CHECK((size_t) got.length() == e.length);
+            CHECK(test_checksum((const unsigned char*) (const char*) got,
+                                got.length()) == e.checksum);
+        }
+        ++rounds;
+    }
+    return rounds;
+}
+
+
+static int writerThread(void*)
+{
+    for (int i = 0; i < WRITES; ++i) {
+        pstring ext;
+        ext.format("T%02d", i);
+        shared_reader->registerCompressionType(ext, BaseReader::NO_COMPRESSION);
+        SDL_Delay(1);
+    }
+    SDL_AtomicSet(&writer_done, 1);
+    return 0;
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+
+    const std::string& dir = test_mkdir("reader_threads_test");
+    TestRandom r(12345);
+    std::vector<TestEntry> entries;
+    std::vector<std::string> plain; // contents, where we know them
+    for (int i = 0; i < 40; ++i) {
+        char name[32];
+        snprintf(name, sizeof name, "dir\\file%02d.dat", i);
+        size_t len = 1 + r.below(i % 5 == 0 ? 200000 : 20000);
+        plain.push_back("");
+        switch (i % 4) {
+        case 0:
+            plain[i] = test_random_bytes(r, len, false);
+            entries.push_back(test_stored(name, plain[i]));
+            break;
+        case 1:
+            plain[i] = test_random_bytes(r, len, true);
+            entries.push_back(test_nbz(name, plain[i]));
+            break;
+        case 2:
+            entries.push_back(test_lzss(name, r, len));
+            break;
+        case 3:
+            entries.push_back(test_spb(name, r, 1 + r.below(300),
+                                       1 + r.below(200), len / 4 + 1));
+            break;
+        }
+    }
+    test_write_nsa(dir + "/arc.nsa", entries);
+
+    {
+        NsaReader single(new DirPaths(dir.c_str()));
+        CHECK(single.open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+        readAll(&single, expected);
+    }
+    CHECK(expected.size() == entries.size());
+    for (size_t i = 0; i < expected.size() && i < plain.size(); ++i) {
+        CHECK(expected[i].length > 0);
+        if (plain[i].empty()) continue;
+        CHECK(expected[i].length == plain[i].size());
+        CHECK(expected[i].checksum ==
+              test_checksum((const unsigned char*) plain[i].data(),
+                            plain[i].size()));
+    }
+
+    shared_reader =
+        new SynchronizedReader(new NsaReader(new DirPaths(dir.c_str())));
+    CHECK(shared_reader->open("", BaseReader::ARCHIVE_TYPE_NSA) == 0);
+
+    start_ticks = SDL_GetTicks();
+    SDL_Thread* threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i)
+        threads[i] = SDL_CreateThread(readerThread, "reader",
+                                      (void*) (size_t) i);
+    SDL_Thread* writer = SDL_CreateThread(writerThread, "writer", NULL);
+
+    SDL_WaitThread(writer, NULL);
+    Uint32 writer_ticks = SDL_GetTicks() - start_ticks;
+    int rounds = 0;
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        int n;
+        SDL_WaitThread(threads[i], &n);
+        rounds += n;
+    }
+    Uint32 ticks = SDL_GetTicks() - start_ticks;
+    printf("%d threads read %d entries %d times in %u ms; "
+           "%d exclusive calls done after %u ms\n", NUM_THREADS,
+           (int) expected.size(), rounds, ticks, WRITES, writer_ticks);
+    CHECK(rounds >= (int) NUM_THREADS * ROUNDS);
+    CHECK(writer_ticks < TIME_LIMIT_MS);
+
+    delete shared_reader;
+    test_cleanup();
+    SDL_Quit();
+    return test_result();
+}
@@ -0,0 +1,214 @@
+/* -*- C++ -*-
+ *
+ *  screenshot_test.cpp - Screenshots written on a worker thread
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Take 100 screenshots of a changing screen at assorted sizes through
+// ScreenshotWriter, as getscreenshot and savescreenshot do, and the
+// same 100 the way those commands used to: convert, scale and save on
+// the calling thread.  The files must be byte for byte the same, and
+// the main thread's share of each must be smaller.  Then check the
+// ordering rules: a newer capture replaces one not yet saved, a
+// discarded screenshot saves as a blank, and waitFor() only returns
+// once the file is there.
+
+#include "test.h"
+#include "AnimationInfo.h"
+#include "ScreenshotWriter.h"
+#include "encoding.h"
+#include <vector>
+
+enum { SHOTS = 100, SCREEN_W = 800, SCREEN_H = 600 };
+
+static SDL_Surface* screen_surface;
+static SDL_Surface* image_surface;  // the engine's reference format
+
+static SDL_Surface* new_surface(int w, int h)
+{
+    return SDL_CreateRGBSurface(0, w, h, 32, 0x00ff0000, 0x0000ff00,
+                                0x000000ff, 0xff000000);
+}
+
+
+// Something different for each frame, with edges for the filter.
+static void paint(SDL_Surface* s, TestRandom& r)
+{
+    SDL_FillRect(s, NULL, r.next() | 0xff000000);
+    for (int i = 0; i < 20; ++i) {
+        SDL_Rect rect = { (int) r.below(s->w), (int) r.below(s->h),
+                          (int) r.below(200) + 1, (int) r.below(200) + 1 };
+        SDL_FillRect(s, &rect, r.next());
+    }
+}
+
+
+// getscreenshot and savescreenshot as they were.
+static SDL_Surface* old_screenshot;
+
+static void old_capture(int w, int h)
+{
+    if (old_screenshot &&
+        (old_screenshot->w != w || old_screenshot->h != h)) {
+        SDL_FreeSurface(old_screenshot);
+        old_screenshot = NULL;
+    }
+    if (old_screenshot == NULL)
+        old_screenshot = SDL_CreateRGBSurface(0, w, h, 32, 0, 0, 0, 0);
+
+    SDL_Surface* surface =
+        SDL_ConvertSurface(screen_surface, image_surface->format,
+                           SDL_SWSURFACE);
+    AnimationInfo::resizeSurface(surface, old_screenshot);
+    SDL_FreeSurface(surface);
+}
+
+static void old_save(const std::string& filename)
+{
+    SDL_SaveBMP(old_screenshot, filename.c_str());
+}
+
+
+static double seconds(Uint64 ticks)
+{
+    return (double) ticks / SDL_GetPerformanceFrequency();
+}
+
+
+static void check_shots(const std::string& dir)
+{
+    static const int sizes[][2] = {
+        { 800, 600 }, { 400, 300 }, { 160, 120 }, { 333, 211 },
+        { 1, 1 }, { 1024, 768 }, { 800, 600 }, { 57, 801 }
+    };
+    std::vector<std::string> names;
+    double worker_main = 0, old_main = 0;
+    TestRandom r(47);
+
+    {
+        ScreenshotWriter writer;
+        for (int i = 0; i < SHOTS; ++i) {
+            paint(screen_surface, r);
+            int w = sizes[i % 8][0], h = sizes[i % 8][1];
+            char name[64];
+            snprintf(name, sizeof name, "/shot%03d", i);
+            names.push_back(dir + name);
+
+            Uint64 t0 = SDL_GetPerformanceCounter();
+            writer.capture(screen_surface, image_surface->format->format,
+                           w, h);
+            writer.save((names.back() + "-new.bmp").c_str());
+            worker_main += seconds(SDL_GetPerformanceCounter() - t0);
+
+            t0 = SDL_GetPerformanceCounter();
+            old_capture(w, h);
+            old_save(names.back() + "-old.bmp");
+            old_main += seconds(SDL_GetPerformanceCounter() - t0);
+        }
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        writer.flush();
+        printf("main thread per screenshot: %.3f ms queued "
+               "(then %.1f ms waiting for the rest), %.3f ms as before\n",
+               worker_main * 1000 / SHOTS,
+               seconds(SDL_GetPerformanceCounter() - t0) * 1000,
+               old_main * 1000 / SHOTS);
+        CHECK(worker_main < old_main);
+    }
+
+    int differ = 0;
+    for (int i = 0; i < SHOTS; ++i) {
+        std::string now = test_read(names[i] + "-new.bmp");
+        std::string then = test_read(names[i] + "-old.bmp");
+        CHECK(!then.empty());
+        if (now != then) {
+            if (!differ++)
+                fprintf(stderr, "%s differs from the synchronous path\n",
+                        names[i].c_str());
+        }
+    }
+    CHECK(differ == 0);
+}
+
+
+static void check_order(const std::string& dir)
+{
+    ScreenshotWriter writer;
+    TestRandom r(48);
+
+    // Two captures in a row: the save gets the second.
+    paint(screen_surface, r);
+    writer.capture(screen_surface, image_surface->format->format, 200, 150);
+    paint(screen_surface, r);
+    writer.capture(screen_surface, image_surface->format->format, 200, 150);
+    writer.save((dir + "/second.bmp").c_str());
+    old_capture(200, 150);
+    old_save(dir + "/second-old.bmp");
+
+    // Discarded: a blank 1x1.
+    writer.discard();
+    writer.save((dir + "/blank.bmp").c_str());
+
+    // waitFor() matches the end of the path, in any case.
+    writer.waitFor("SECOND.BMP");
+    CHECK(test_read(dir + "/second.bmp") == test_read(dir + "/second-old.bmp"));
+    writer.waitFor("blank.bmp");
+    SDL_Surface* blank = SDL_LoadBMP((dir + "/blank.bmp").c_str());
+    CHECK(blank && blank->w == 1 && blank->h == 1);
+    if (blank) SDL_FreeSurface(blank);
+
+    // Saves still queued are written before the writer goes away.
+    writer.capture(screen_surface, image_surface->format->format, 640, 480);
+    for (int i = 0; i < 10; ++i) {
+        char name[64];
+        snprintf(name, sizeof name, "/last%d.bmp", i);
+        writer.save((dir + name).c_str());
+    }
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    file_encoding = new UTF8Encoding;
+    screen_surface = new_surface(SCREEN_W, SCREEN_H);
+    image_surface = new_surface(1, 1);
+
+    const std::string& dir = test_mkdir("screenshot_test");
+    check_shots(dir);
+    check_order(dir);
+    std::string last = test_read(dir + "/last0.bmp");
+    SDL_Surface* s = SDL_LoadBMP((dir + "/last0.bmp").c_str());
+    CHECK(s && s->w == 640 && s->h == 480);
+    if (s) SDL_FreeSurface(s);
+    for (int i = 1; i < 10; ++i) {
+        char name[64];
+        snprintf(name, sizeof name, "/last%d.bmp", i);
+        CHECK(test_read(dir + name) == last);
+    }
+
+    if (old_screenshot) SDL_FreeSurface(old_screenshot);
+    SDL_FreeSurface(image_surface);
+    SDL_FreeSurface(screen_surface);
+    if (test_result()) {
+        fprintf(stderr, "screenshots left in %s\n", dir.c_str());
+        SDL_Quit();
+        return 1;
+    }
+    test_cleanup();
+    SDL_Quit();
+    return 0;
+}
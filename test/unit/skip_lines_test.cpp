@@ -0,0 +1,92 @@
+/* -*- C++ -*-
+ *
+ *  skip_lines_test.cpp - Lines of script skipped per second
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Run the engine with --skip over a few thousand lines of text with
+// click waits, short waits and effects between them, and again over
+// none; the difference gives the lines skipped per second.  The script
+// saves a screenshot at its end, which shows that skipping got there.
+// autoclick is there in case it doesn't, so the test finishes anyway,
+// only slowly.
+
+#include "engine.h"
+
+enum { PAGES = 200, LINES_PER_PAGE = 8 };
+
+static const char* setup =
+    "*define\n"
+    "effect 10,10,200\n"
+    "game\n"
+    "*start\n"
+    "erasetextwindow 0\n"
+    "setwindow 8,16,30,23,20,20,0,2,20,1,1,#999999,0,0,639,479\n"
+    "bg #336699,1\n"
+    "autoclick 20\n";
+
+// With for and next, eight lines: text with click waits, a wait and
+// an effect.
+static const char* page =
+    "`A line that waits for a click.@\n"
+    "`Another one, then a short wait.@\n"
+    "wait 5\n"
+    "`A third line.@\n"
+    "bg #663399,10\n"
+    "`A fourth, after a fade.\\\n";
+
+
+static Uint32 timed(const std::string& dir, const std::string& font,
+                    const std::string& script)
+{
+    Uint32 t0 = SDL_GetTicks();
+    CHECK(test_run_script(dir, font, script, "--skip") == 0);
+    return SDL_GetTicks() - t0;
+}
+
+
+int main(int, char**)
+{
+    std::string font = test_font();
+    if (font.empty()) {
+        printf("skip_lines_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+    SDL_Init(SDL_INIT_TIMER);
+
+    const std::string& dir = test_mkdir("skip_lines_test");
+    char loop[32];
+    snprintf(loop, sizeof loop, "for %%0 = 1 to %d\n", PAGES);
+    std::string script = std::string(setup) + loop + page + "next\n"
+        "getscreenshot 64,48\n"
+        "savescreenshot \"end.bmp\"\n"
+        "end\n";
+    Uint32 base = timed(dir, font, std::string(setup) + "end\n");
+    Uint32 total = timed(dir, font, script);
+    CHECK(!test_read(dir + "/end.bmp").empty());
+    if (total > base)
+        printf("%d lines in %u ms: %.0f lines/s\n", PAGES * LINES_PER_PAGE,
+               total - base, PAGES * LINES_PER_PAGE * 1000.0 / (total - base));
+
+    if (test_result()) {
+        fprintf(stderr, "log left in %s\n", dir.c_str());
+        return 1;
+    }
+    test_cleanup();
+    return 0;
+}
@@ -0,0 +1,134 @@
+/* -*- C++ -*-
+ *
+ *  sprite_anim_test.cpp - Animated sprites, and the time spent on them
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Sprites that animate once and stop must end up looking like sprites
+// set to their last cell, and a slot loaded again without animation
+// must stop animating.  Then the engine waits two seconds with 0, 10
+// and 1000 sprites animating, and the CPU time each run takes, startup
+// included, is printed.
+
+#include <sys/resource.h>
+#include "engine.h"
+
+enum { CELL = 8, WAIT = 2000 };
+
+static const char* setup =
+    "*define\n"
+    "game\n"
+    "*start\n"
+    "bg #336699,1\n";
+
+// Two cells side by side: red, then blue.
+static std::string cells_bmp()
+{
+    const int w = CELL * 2, h = CELL, pitch = (w * 3 + 3) & ~3;
+    std::string bmp(54 + pitch * h, 0);
+    unsigned char* p = (unsigned char*) &bmp[0];
+    Uint32 size = bmp.size();
+    p[0] = 'B'; p[1] = 'M';
+    for (int i = 0; i < 4; ++i) p[2 + i] = size >> (8 * i);
+    p[10] = 54; p[14] = 40; p[18] = w; p[22] = h; p[26] = 1; p[28] = 24;
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            unsigned char* px = p + 54 + y * pitch + x * 3;
+            px[x < CELL ? 2 : 0] = 0xff; // BGR
+        }
+    return bmp;
+}
+
+
+static std::string sprites(int n, const char* tag, bool last_cell)
+{
+    char buf[160];
+    snprintf(buf, sizeof buf, "for %%0 = 0 to %d\n"
+             "lsp %%0,\"%scells.bmp\",(%%0 mod 40) * 16,(%%0 / 40) * 16\n"
+             "%s"
+             "next\n", n - 1, tag, last_cell ? "cell %0,1\n" : "");
+    return buf;
+}
+
+
+static std::string shot(const std::string& name)
+{
+    return "getscreenshot 640,480\nsavescreenshot \"" + name + "\"\n";
+}
+
+
+static double cpu_ms()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0
+        + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+
+int main(int, char**)
+{
+    std::string font = test_font();
+    if (font.empty()) {
+        printf("sprite_anim_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+
+    const std::string& dir = test_mkdir("sprite_anim_test");
+    test_write(dir + "/cells.bmp", cells_bmp());
+
+    std::string script = setup;
+    script += sprites(10, ":c/2,20,1;", false);
+    script += "lsp 500,\":c/2,20,0;cells.bmp\",0,400\n"
+              "lsp 500,\":c/2,20,3;cells.bmp\",0,400\n"
+              "cell 500,1\n"
+              "print 1\n"
+              "wait 300\n";
+    script += shot("anim.bmp");
+    script += "csp -1\n";
+    script += sprites(10, ":c/2,20,3;", true);
+    script += "lsp 500,\":c/2,20,3;cells.bmp\",0,400\n"
+              "cell 500,1\n"
+              "print 1\n";
+    script += shot("still.bmp");
+    script += "end\n";
+    CHECK(test_run_script(dir, font, script) == 0);
+    std::string anim = test_read(dir + "/anim.bmp");
+    CHECK(!anim.empty());
+    CHECK(anim == test_read(dir + "/still.bmp"));
+
+    static const int counts[] = { 0, 10, 1000 };
+    for (int i = 0; i < 3; ++i) {
+        char wait[32];
+        snprintf(wait, sizeof wait, "print 1\nwait %d\nend\n", WAIT);
+        script = setup;
+        if (counts[i]) script += sprites(counts[i], ":c/2,16,0;", false);
+        script += wait;
+        double t0 = cpu_ms();
+        CHECK(test_run_script(dir, font, script) == 0);
+        printf("%4d animated sprites: %.0f ms of CPU over a %d ms wait\n",
+               counts[i], cpu_ms() - t0, WAIT);
+    }
+
+    if (test_result()) {
+        fprintf(stderr, "screenshots and log left in %s\n", dir.c_str());
+        return 1;
+    }
+    test_cleanup();
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* -*- C++ -*-
+ *
+ *  test.h - Checks shared by the unit tests
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// Each test is a program: CHECK() reports a failure and carries on,
+// and main() ends with "return test_result();".
+static SDL_atomic_t test_failures;
+
+#define CHECK(cond) \
+    ((cond) ? (void) 0 : test_fail(__FILE__, __LINE__, #cond))
+
+static inline void test_fail(const char* file, int line, const char* what)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    SDL_AtomicAdd(&test_failures, 1);
+}
+
+static inline int test_result()
+{
+    int n = SDL_AtomicGet(&test_failures);
+    if (n) fprintf(stderr, "%d check(s) failed\n", n);
+    return n ? 1 : 0;
+}
+
+// A fresh directory for the test's files, removed by test_cleanup().
+static std::string test_dir;
+
+static inline const std::string& test_mkdir(const char* name)
+{
+    const char* tmp = getenv("TMPDIR");
+    char buf[512];
+    snprintf(buf, sizeof buf, "%s/%s.XXXXXX", tmp ? tmp : "/tmp", name);
+    if (!mkdtemp(buf)) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    test_dir = buf;
+    return test_dir;
+}
+
+static inline void test_cleanup()
+{
+    if (test_dir.empty()) return;
+    std::string cmd = "rm -rf '" + test_dir + "'";
+    if (system(cmd.c_str()) != 0)
+        fprintf(stderr, "couldn't remove %s\n", test_dir.c_str());
+}
+
+static inline void test_write(const std::string& path, const std::string& data)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp || fwrite(data.data(), 1, data.size(), fp) != data.size()) {
+        perror(path.c_str());
+        exit(2);
+    }
+    fclose(fp);
+}
+
+// The whole file, or an empty string if it can't be read.
+static inline std::string test_read(const std::string& path)
+{
+    std::string data;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return data;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, fp)) > 0) data.append(buf, n);
+    fclose(fp);
+    return data;
+}
+
+// FNV-1a, to compare file contents cheaply.
+static inline Uint32 test_checksum(const unsigned char* p, size_t len)
+{
+    Uint32 h = 2166136261u;
+    while (len--) h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+// Deterministic random numbers, so failures can be reproduced.
+struct TestRandom {
+    Uint32 state;
+    TestRandom(Uint32 seed) : state(seed ? seed : 1) {}
+    Uint32 next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    Uint32 below(Uint32 n) { return n ? next() % n : 0; }
+};
+
+#endif // __TEST_H__
@@ -0,0 +1,100 @@
+/* -*- C++ -*-
+ *
+ *  text_below_test.cpp - Typing text over a scene that has just changed
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// Glyphs are drawn over a saved copy of the scene beneath the text
+// window rather than by recompositing everything under them.  Type a
+// line after each way the scene can change under an open window, take
+// a screenshot, then "repaint" (a full recomposite) and take another:
+// the two must be identical.
+
+#include "engine.h"
+
+// Each case is some script that changes the scene and types a line.
+struct Case {
+    const char* name;
+    const char* script;
+};
+static const Case cases[] = {
+    // The window stays up while an effect changes the scene...
+    { "fade",   "bg #0000ff,10\n`Typed over blue after a fade.\n" },
+    { "cut",    "bg #00ff00,1\n`Typed over green after a cut.\n" },
+    { "quake",  "quake 2,100\n`Typed after a quake.\n" },
+    // ...or comes back with the scene changed while it was away.
+    { "window", "erasetextwindow 1\nbg #ffff00,10\n"
+                "`Typed in a new window over yellow.\n" },
+    { NULL, NULL }
+};
+
+
+static std::string shot(const std::string& name)
+{
+    return "getscreenshot 640,480\nsavescreenshot \"" + name + "\"\n";
+}
+
+
+int main(int, char**)
+{
+    std::string font = test_font();
+    if (font.empty()) {
+        printf("text_below_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+
+    std::string script =
+        "*define\n"
+        "effect 10,10,200\n"
+        "game\n"
+        "*start\n"
+        "!s0\n"
+        "erasetextwindow 0\n"
+        "setwindow 8,16,30,23,20,20,0,2,20,1,1,#999999,0,0,639,479\n"
+        "bg #ff0000,1\n"
+        "`Some text on red.\n";
+    for (int i = 0; cases[i].name; ++i) {
+        std::string name = cases[i].name;
+        script += cases[i].script;
+        script += shot(name + "-typed.bmp");
+        script += "repaint\n";
+        script += shot(name + "-repainted.bmp");
+    }
+    script += "end\n";
+
+    const std::string& dir = test_mkdir("text_below_test");
+    CHECK(test_run_script(dir, font, script) == 0);
+
+    for (int i = 0; cases[i].name; ++i) {
+        std::string name = dir + "/" + cases[i].name;
+        std::string typed = test_read(name + "-typed.bmp");
+        std::string repainted = test_read(name + "-repainted.bmp");
+        if (typed.empty() || typed != repainted)
+            fprintf(stderr, "%s: typed text differs from a full "
+                    "recomposite\n", cases[i].name);
+        CHECK(!typed.empty());
+        CHECK(typed == repainted);
+    }
+
+    if (test_result()) {
+        fprintf(stderr, "screenshots and log left in %s\n", dir.c_str());
+        return 1;
+    }
+    test_cleanup();
+    return 0;
+}
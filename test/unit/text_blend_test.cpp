@@ -0,0 +1,348 @@
+/* -*- C++ -*-
+ *
+ *  text_blend_test.cpp - Blending glyphs from the atlas, and how fast
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// The vectorised row kernel must give exactly what BLEND_PIXEL8_ALPHA
+// gives, for every coverage over every alpha; a page blended as one
+// batch must match the same page blended a glyph at a time; and glyphs
+// still held must survive the atlas being emptied under them.  Then
+// time a page of Latin text and a page of CJK text, from a cold cache
+// and a warm one, per glyph and batched, with and without SSE2.
+
+#include "engine.h"
+#include "AnimationInfo.h"
+#include "MemStats.h"
+#include <vector>
+
+#ifdef BPP16
+int main(int, char**)
+{
+    printf("text_blend_test: skipped, 32bpp only\n");
+    return 0;
+}
+#else
+
+enum { PAGE_W = 640, PAGE_H = 480, FONT_SIZE = 26, ROUNDS = 20 };
+
+static unsigned int sse2_funcs()
+{
+#if defined(USE_X86_GFX)
+    if (SDL_HasSSE2()) return AnimationInfo::CPUF_X86_SSE2;
+#endif
+    return AnimationInfo::CPUF_NONE;
+}
+
+
+static void check_kernel()
+{
+    unsigned int fast = sse2_funcs();
+    if (fast == AnimationInfo::CPUF_NONE)
+        printf("no SSE2 routines in this build: checking the scalar path "
+               "against itself\n");
+
+    // Every coverage over every destination alpha, in a few colours.
+    static const Uint32 colours[] = { 0xffffff, 0x000000, 0x12c0fe };
+    std::vector<Uint8> cov(256);
+    std::vector<Uint32> ref(256), got(256);
+    TestRandom r(40);
+    for (int c = 0; c < 3; ++c) {
+        for (int a = 0; a < 256; ++a) {
+            for (int m = 0; m < 256; ++m) {
+                cov[m] = m;
+                ref[m] = (Uint32) a << 24 | (r.next() & 0xffffff);
+            }
+            got = ref;
+            AnimationInfo::setCpufuncs(AnimationInfo::CPUF_NONE);
+            AnimationInfo::imageFilterBlendText(&ref[0], &cov[0],
+                                                colours[c], 256);
+            AnimationInfo::setCpufuncs(fast);
+            AnimationInfo::imageFilterBlendText(&got[0], &cov[0],
+                                                colours[c], 256);
+            CHECK(ref == got);
+        }
+    }
+
+    // Odd lengths and offsets, so the tail and unaligned rows are hit.
+    for (int len = 0; len < 40; ++len) {
+        for (int off = 0; off < 4; ++off) {
+            std::vector<Uint8> src(len + off);
+            std::vector<Uint32> d1(len + off), d2;
+            for (int i = 0; i < len + off; ++i) {
+                Uint32 x = r.next();
+                src[i] = x & 1 ? 0 : x >> 24;
+                d1[i] = r.next();
+            }
+            d2 = d1;
+            Uint32 colour = r.next() & 0xffffff;
+            AnimationInfo::setCpufuncs(AnimationInfo::CPUF_NONE);
+            if (len)
+                AnimationInfo::imageFilterBlendText(&d1[off], &src[off],
+                                                    colour, len);
+            AnimationInfo::setCpufuncs(fast);
+            if (len)
+                AnimationInfo::imageFilterBlendText(&d2[off], &src[off],
+                                                    colour, len);
+            CHECK(d1 == d2);
+        }
+    }
+}
+
+
+// A page of text laid out as drawGlyph would, with a shadow under
+// every other line.
+struct Page {
+    std::vector<Uint16> text;
+    std::vector<AnimationInfo::GlyphBlend> glyphs;
+    bool missing;
+};
+
+static void layout(Font& font, Page& page)
+{
+    font.set_size(FONT_SIZE);
+    page.glyphs.clear();
+    page.missing = false;
+    float x = 8;
+    int y = 8;
+    for (size_t i = 0; i < page.text.size(); ++i) {
+        Uint16 ch = page.text[i];
+        if (!font.has_char(ch)) page.missing = true;
+        float adv = font.advance(ch);
+        if (x + adv > PAGE_W - 8) {
+            x = 8;
+            y += font.lineskip();
+            if (y + font.lineskip() > PAGE_H) break;
+        }
+        float minx;
+        font.get_metrics(ch, &minx, NULL, NULL, NULL);
+        AnimationInfo::GlyphBlend b;
+        b.glyph = font.render_glyph(ch, x + minx - floor(x + minx));
+        if (b.glyph.pixels) {
+            b.x = int(floor(x + b.glyph.left));
+            b.y = y + font.ascent() - int(ceil(b.glyph.top));
+            b.color.r = 0xff;
+            b.color.g = 0xee;
+            b.color.b = 0xdd;
+            if ((y / font.lineskip()) & 1) {
+                AnimationInfo::GlyphBlend s = b;
+                s.x += 1;
+                s.y += 1;
+                s.color.r = s.color.g = s.color.b = 0;
+                page.glyphs.push_back(s);
+            }
+            page.glyphs.push_back(b);
+        }
+        x += adv;
+    }
+}
+
+
+static void blend_each(AnimationInfo& anim, const Page& page)
+{
+    for (size_t i = 0; i < page.glyphs.size(); ++i) {
+        AnimationInfo::GlyphBlend b = page.glyphs[i];
+        anim.blendText(b.glyph, b.x, b.y, b.color, NULL);
+    }
+}
+
+
+static void alloc_page(AnimationInfo& anim)
+{
+    anim.num_of_cells = 1;
+    anim.allocImage(PAGE_W, PAGE_H);
+    anim.fill(0, 0, 0, 0);
+}
+
+
+static std::string pixels(AnimationInfo& anim)
+{
+    SDL_Surface* s = anim.image_surface;
+    return std::string((const char*) s->pixels, s->pitch * s->h);
+}
+
+
+static void check_batch(Font& font, Page& page)
+{
+    layout(font, page);
+    CHECK(!page.glyphs.empty());
+
+    AnimationInfo each, batch;
+    alloc_page(each);
+    alloc_page(batch);
+    blend_each(each, page);
+    batch.blendGlyphs(page.glyphs, NULL);
+    CHECK(pixels(each) == pixels(batch));
+
+    // Clipped to a window, as text sprites are
+    SDL_Rect clip = { 100, 50, 300, 200 };
+    each.fill(0, 0, 0, 0);
+    batch.fill(0, 0, 0, 0);
+    for (size_t i = 0; i < page.glyphs.size(); ++i) {
+        AnimationInfo::GlyphBlend b = page.glyphs[i];
+        each.blendText(b.glyph, b.x, b.y, b.color, &clip);
+    }
+    batch.blendGlyphs(page.glyphs, &clip);
+    CHECK(pixels(each) == pixels(batch));
+}
+
+
+// Render far more glyphs than the atlas holds while keeping one: its
+// pixels must be untouched, and all pages must go once nothing holds
+// them.
+static void check_atlas(const std::string& data)
+{
+    size_t before = MemStats::get(MemStats::GLYPHS);
+    {
+        Uint8* copy = new Uint8[data.size()];
+        memcpy(copy, data.data(), data.size());
+        Font font(copy, data.size());
+        font.set_size(40);
+        Glyph kept = font.render_glyph('g', 0);
+        CHECK(kept.pixels && kept.w > 0 && kept.h > 0);
+        std::string saved;
+        for (int y = 0; y < kept.h; ++y)
+            saved.append((const char*) kept.pixels + y * kept.pitch, kept.w);
+
+        size_t peak = 0;
+        for (int size = 40; size < 100; size += 3) {
+            font.set_size(size);
+            for (Uint16 ch = 0x21; ch < 0x250; ++ch) {
+                Glyph g = font.render_glyph(ch, 0);
+                if (MemStats::get(MemStats::GLYPHS) > peak)
+                    peak = MemStats::get(MemStats::GLYPHS);
+            }
+        }
+        printf("atlas peaked at %luK\n", (unsigned long) (peak >> 10));
+        CHECK(peak <= before + 9 * 512 * 512);
+
+        std::string now;
+        for (int y = 0; y < kept.h; ++y)
+            now.append((const char*) kept.pixels + y * kept.pitch, kept.w);
+        CHECK(now == saved);
+    }
+    CHECK(MemStats::get(MemStats::GLYPHS) == before);
+}
+
+
+static double seconds(Uint64 ticks)
+{
+    return (double) ticks / SDL_GetPerformanceFrequency();
+}
+
+
+static void benchmark(const std::string& data, Page& page, const char* name)
+{
+    Uint8* copy = new Uint8[data.size()];
+    memcpy(copy, data.data(), data.size());
+    Font font(copy, data.size());
+
+    AnimationInfo anim;
+    alloc_page(anim);
+
+    // Cold: every glyph rendered into the atlas for the first time.
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    layout(font, page);
+    anim.blendGlyphs(page.glyphs, NULL);
+    double cold = seconds(SDL_GetPerformanceCounter() - t0);
+    size_t n = page.glyphs.size();
+    printf("%s page: %lu glyphs%s, %luK of atlas\n", name, (unsigned long) n,
+           page.missing ? " (font lacks some; .notdef boxes drawn)" : "",
+           (unsigned long) (MemStats::get(MemStats::GLYPHS) >> 10));
+    printf("  %-26s %10.0f glyphs/s\n", "cold cache:", n / cold);
+
+    // Warm: laid out from the cache and blended again.
+    static const struct {
+        const char* label;
+        bool batch, fast;
+    } modes[] = {
+        { "warm, per glyph, scalar:", false, false },
+        { "warm, per glyph, SSE2:", false, true },
+        { "warm, batched, scalar:", true, false },
+        { "warm, batched, SSE2:", true, true },
+    };
+    for (int m = 0; m < 4; ++m) {
+        if (modes[m].fast && sse2_funcs() == AnimationInfo::CPUF_NONE)
+            continue;
+        AnimationInfo::setCpufuncs(modes[m].fast ? sse2_funcs()
+                                                 : AnimationInfo::CPUF_NONE);
+        t0 = SDL_GetPerformanceCounter();
+        for (int i = 0; i < ROUNDS; ++i) {
+            anim.fill(0, 0, 0, 0);
+            layout(font, page);
+            if (modes[m].batch)
+                anim.blendGlyphs(page.glyphs, NULL);
+            else
+                blend_each(anim, page);
+        }
+        double t = seconds(SDL_GetPerformanceCounter() - t0);
+        printf("  %-26s %10.0f glyphs/s\n", modes[m].label,
+               n * ROUNDS / t);
+    }
+    AnimationInfo::setCpufuncs(sse2_funcs());
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+    FontInitialise(); // FontFinished() is left to Fontinfo at exit
+
+    check_kernel();
+
+    std::string data = test_font();
+    if (data.empty()) {
+        printf("text_blend_test: no font, only the kernel was checked "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        SDL_Quit();
+        return test_result();
+    }
+
+    static const char latin[] =
+        "The quick brown fox jumps over the lazy dog. Pack my box with "
+        "five dozen liquor jugs! \"Sphinx of black quartz, judge my vow,\" "
+        "said Wolf; AVAST, To: Ye 0123456789. ";
+    Page latin_page, cjk_page;
+    while (latin_page.text.size() < 1200)
+        for (const char* p = latin; *p; ++p)
+            latin_page.text.push_back((Uint8) *p);
+    // Kana and the commonest ideographs, few of which repeat on a page.
+    for (int i = 0; i < 600; ++i) {
+        if (i % 4 == 0)
+            cjk_page.text.push_back(0x3042 + i % 80);
+        else
+            cjk_page.text.push_back(0x4e00 + (i * 37) % 5000);
+    }
+
+    {
+        Uint8* copy = new Uint8[data.size()];
+        memcpy(copy, data.data(), data.size());
+        Font font(copy, data.size());
+        AnimationInfo::setCpufuncs(sse2_funcs());
+        check_batch(font, latin_page);
+        check_batch(font, cjk_page);
+    }
+    check_atlas(data);
+
+    benchmark(data, latin_page, "Latin");
+    benchmark(data, cjk_page, "CJK");
+
+    SDL_Quit();
+    return test_result();
+}
+
+#endif
@@ -0,0 +1,117 @@
+/* -*- C++ -*-
+ *
+ *  text_pages_test.cpp - Pages of text shown without waits, per second
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// With !s0, text that isn't interrupted by a command or a wait is laid
+// out in one pass rather than a character at a time.  A page typed that
+// way must look the same as one typed a character at a time; then the
+// engine is run over a few hundred pages, and again over none, and the
+// difference gives the number of pages shown per second.  autoclick
+// answers the click waits, which are what flush text to the screen;
+// a run with the waits but no text shows how much of the time is
+// spent on the text itself.
+
+#include "engine.h"
+
+enum { PAGES = 300 };
+
+static const char* page =
+    "`The quick brown fox jumps over the lazy dog, and the dog, "
+    "not being quick, watches it go and goes back to sleep.\n"
+    "`Pack my box with five dozen liquor jugs; then, having packed "
+    "it, carry it down the stairs and out to the cart.\n"
+    "`How vexingly quick daft zebras jump!  Sphinx of black quartz, "
+    "judge my vow.  Jackdaws love my big sphinx of quartz.\n"
+    "`The five boxing wizards jump quickly, and a wizard's job is to "
+    "vex chumps quickly in fog.";
+
+static const char* setup =
+    "*define\n"
+    "game\n"
+    "*start\n"
+    "erasetextwindow 0\n"
+    "setwindow 8,16,30,23,20,20,0,2,20,1,1,#999999,0,0,639,479\n"
+    "bg #336699,1\n"
+    "autoclick 1\n";
+
+
+static std::string shot(const std::string& name)
+{
+    return "getscreenshot 640,480\nsavescreenshot \"" + name + "\"\n";
+}
+
+
+static Uint32 timed(const std::string& dir, const std::string& font,
+                    const std::string& script)
+{
+    Uint32 t0 = SDL_GetTicks();
+    CHECK(test_run_script(dir, font, script) == 0);
+    return SDL_GetTicks() - t0;
+}
+
+
+int main(int, char**)
+{
+    std::string font = test_font();
+    if (font.empty()) {
+        printf("text_pages_test: skipped, no font "
+               "(set PONSCR_TEST_FONT to a TrueType file)\n");
+        return 0;
+    }
+    SDL_Init(SDL_INIT_TIMER);
+
+    const std::string& dir = test_mkdir("text_pages_test");
+    std::string script = setup;
+    script += "!s0\n";
+    script += page;
+    script += "@\n" + shot("run.bmp");
+    script += "textclear\n!s1\n";
+    script += page;
+    script += "@\n" + shot("each.bmp");
+    script += "end\n";
+    CHECK(test_run_script(dir, font, script) == 0);
+    std::string run = test_read(dir + "/run.bmp");
+    CHECK(!run.empty());
+    if (run != test_read(dir + "/each.bmp"))
+        fprintf(stderr, "a page typed in one pass differs from one "
+                "typed a character at a time\n");
+    CHECK(run == test_read(dir + "/each.bmp"));
+
+    char loop[32];
+    snprintf(loop, sizeof loop, "for %%0 = 1 to %d\n", PAGES);
+    script = setup + std::string("!s0\n") + loop;
+    std::string waits = script + "`\\\nnext\nend\n";
+    script += page;
+    script += "\\\nnext\nend\n";
+    Uint32 base = timed(dir, font, std::string(setup) + "end\n");
+    Uint32 paging = timed(dir, font, waits);
+    Uint32 total = timed(dir, font, script);
+    if (total > paging && paging > base)
+        printf("%d pages in %u ms: %.0f pages/s, %.2f ms per page "
+               "besides the waits\n", PAGES, total - base,
+               PAGES * 1000.0 / (total - base),
+               (double) (total - paging) / PAGES);
+
+    if (test_result()) {
+        fprintf(stderr, "screenshots and log left in %s\n", dir.c_str());
+        return 1;
+    }
+    test_cleanup();
+    return 0;
+}
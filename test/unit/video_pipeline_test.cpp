@@ -0,0 +1,221 @@
+/* -*- C++ -*-
+ *
+ *  video_pipeline_test.cpp - Decoding ahead and presenting on time
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+// A synthetic source numbers its frames and counts those not yet
+// released.  Played at normal speed, every frame must come out once,
+// in order and not before it is due; when the clock jumps, the frames
+// it overtook must be dropped and counted; and stopping with frames in
+// the ring, or with the decoder busy or blocked, must release them all.
+
+#include "test.h"
+#include "VideoPipeline.h"
+#include <vector>
+
+enum { FPS = 100, CAPACITY = 4 };
+
+class TestSource : public VideoFrameSource {
+public:
+    TestSource(int frames, int delay_ms = 0)
+        : frames(frames), delay_ms(delay_ms), next(0)
+    {
+        SDL_AtomicSet(&live, 0);
+        SDL_AtomicSet(&decoded, 0);
+    }
+
+    void* decodeFrame(double& time)
+    {
+        if (next == frames) return NULL;
+        if (delay_ms) SDL_Delay(delay_ms);
+        time = (double) next / FPS;
+        SDL_AtomicAdd(&live, 1);
+        SDL_AtomicAdd(&decoded, 1);
+        return new int(next++);
+    }
+
+    void releaseFrame(void* frame)
+    {
+        delete (int*) frame;
+        SDL_AtomicAdd(&live, -1);
+    }
+
+    // Waits until n frames have been decoded, or a second has passed.
+    bool waitDecoded(int n)
+    {
+        for (int i = 0; i < 1000 && SDL_AtomicGet(&decoded) < n; ++i)
+            SDL_Delay(1);
+        return SDL_AtomicGet(&decoded) >= n;
+    }
+
+    int frames, delay_ms;
+    int next;  // decode thread only
+    SDL_atomic_t live, decoded;
+};
+
+
+static double seconds_since(Uint64 start)
+{
+    return (double) (SDL_GetPerformanceCounter() - start)
+        / SDL_GetPerformanceFrequency();
+}
+
+
+// Plays at real time, checking each frame is the next one and due.
+static void check_order()
+{
+    TestSource source(50, 1);
+    {
+        VideoPipeline pipeline(&source, CAPACITY);
+        pipeline.start();
+        Uint64 start = SDL_GetPerformanceCounter();
+        int expect = 0;
+        while (!pipeline.finished() && seconds_since(start) < 10) {
+            double clock = seconds_since(start), wait;
+            void* frame = pipeline.frameAt(clock, wait);
+            if (!frame) {
+                CHECK(wait >= 0 && wait <= 1.0 / FPS + 1e-9);
+                SDL_Delay(1);
+                continue;
+            }
+            int n = *(int*) frame;
+            CHECK(n >= expect);
+            CHECK((double) n / FPS <= clock);
+            expect = n + 1;
+            pipeline.release(frame);
+        }
+        CHECK(pipeline.finished());
+        CHECK(expect == 50);
+        printf("in order: %d frames, %lu dropped\n", expect,
+               pipeline.droppedFrames());
+    }
+    CHECK(SDL_AtomicGet(&source.live) == 0);
+}
+
+
+// Asking for a clock far ahead of what was shown gives the newest due
+// frame and drops exactly the ones it passed.
+static void check_late()
+{
+    TestSource source(20);
+    {
+        VideoPipeline pipeline(&source, CAPACITY);
+        double wait;
+        pipeline.start();
+        CHECK(source.waitDecoded(CAPACITY));
+        SDL_Delay(10); // the decoder is now blocked on a full ring
+
+        // Before the first frame is due
+        CHECK(pipeline.frameAt(-0.5, wait) == NULL);
+        CHECK(wait > 0.49 && wait < 0.51);
+
+        // Frame 2 is due; 0 and 1 are late.
+        void* frame = pipeline.frameAt(2.5 / FPS, wait);
+        CHECK(frame && *(int*) frame == 2);
+        CHECK(pipeline.droppedFrames() == 2);
+        pipeline.release(frame);
+
+        // The same clock again: nothing more is due.
+        CHECK(pipeline.frameAt(2.5 / FPS, wait) == NULL);
+        CHECK(wait > 0);
+
+        // Far beyond the end: everything left is late but the last.
+        int last = -1, shown = 1;
+        while (!pipeline.finished()) {
+            frame = pipeline.frameAt(1000, wait);
+            if (frame) {
+                CHECK(*(int*) frame > last);
+                last = *(int*) frame;
+                ++shown;
+                pipeline.release(frame);
+            }
+            else
+                SDL_Delay(1);
+        }
+        CHECK(last == 19);
+        printf("late: %lu of 20 frames dropped\n", pipeline.droppedFrames());
+        CHECK(shown + (int) pipeline.droppedFrames() == 20);
+        CHECK(SDL_AtomicGet(&source.decoded) == 20);
+        CHECK(SDL_AtomicGet(&source.live) == 0);
+    }
+    CHECK(SDL_AtomicGet(&source.live) == 0);
+}
+
+
+// Stopping mid-stream releases every frame still queued, whether the
+// decoder is blocked on a full ring or busy decoding; and the pipeline
+// can be destroyed without being stopped.
+static void check_shutdown()
+{
+    {
+        TestSource source(1000);
+        {
+            VideoPipeline pipeline(&source, CAPACITY);
+            pipeline.start();
+            CHECK(source.waitDecoded(CAPACITY));
+            SDL_Delay(10);
+            CHECK(SDL_AtomicGet(&source.live) == CAPACITY);
+            pipeline.stop();
+            CHECK(SDL_AtomicGet(&source.live) == 0);
+            CHECK(!pipeline.finished());
+        }
+        CHECK(SDL_AtomicGet(&source.live) == 0);
+    }
+    {
+        // A frame the presenter holds is its own to release.
+        TestSource source(1000, 20);
+        void* held;
+        {
+            VideoPipeline pipeline(&source, CAPACITY);
+            double wait;
+            pipeline.start();
+            CHECK(source.waitDecoded(2));
+            held = pipeline.frameAt(0, wait);
+            CHECK(held != NULL);
+            // Decoding is under way; stop must wait for it and then
+            // release whatever it produced.
+        }
+        CHECK(SDL_AtomicGet(&source.live) == 1);
+        source.releaseFrame(held);
+        CHECK(SDL_AtomicGet(&source.live) == 0);
+    }
+    {
+        // Many starts and stops in a row.
+        TestSource source(1000000);
+        VideoPipeline pipeline(&source, CAPACITY);
+        for (int i = 0; i < 100; ++i) {
+            pipeline.start();
+            if (i & 1) SDL_Delay(1);
+            pipeline.stop();
+            CHECK(SDL_AtomicGet(&source.live) == 0);
+        }
+    }
+}
+
+
+int main(int, char**)
+{
+    SDL_Init(0);
+
+    check_order();
+    check_late();
+    check_shutdown();
+
+    SDL_Quit();
+    return test_result();
+}